@@ -0,0 +1,458 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pm0.h"
+
+/**
+ *  Ahead of time compiler for PM/0 code: turns a .pm0 into a C program that does
+ *  exactly what vm --fast would with it, then has the C compiler make an executable.
+ *
+ *      aot <code.pm0> <program>        writes <program>.c and compiles it to <program>
+ *      aot -c <code.pm0> <program.c>   only writes the C
+ *
+ *  The C compiler is $CC, gcc if that isn't set.
+ *
+ *  The generated program keeps the PM/0 stack, bp and sp, so the stack memory goes
+ *  through the same values as on the VM and reading a variable nobody set gives the
+ *  same leftovers. Loops and ifs are rebuilt from the JMP/JPC pattern the compiler
+ *  barks for them. Any jump that doesn't fit one becomes a goto. RET goes through
+ *  a switch on the return addresses of the CALs. A RET anywhere else hands what's
+ *  left over to an interpreter in the generated program.
+ */
+
+#define MAX_STACK_HEIGHT 2000   // Same as vm.c
+#define STACK_SLACK 1024        // Room past the top for pushes, which no PM/0 instruction checks
+
+const pm0Instr *code;
+int count;
+FILE *out;
+char *consumed;     // Jumps a loop or an if took care of, they need no goto
+char *labelled;     // Instructions something still jumps to
+int hasRet;
+
+// An instruction that can go somewhere other than the next one
+int control(const pm0Instr *c)
+{
+    return c->op == 5 || c->op == 7 || c->op == 8 || (c->op == 2 && c->m == 0) || (c->op == 9 && c->m == 2);
+}
+
+int inRange(int m)
+{
+    return m >= 0 && m < count;
+}
+
+void indent(int depth)
+{
+    fprintf(out, "%*s", depth * 4, "");
+}
+
+// Where to go for a jump to m, running off the end of the code halts
+void jumpTo(int m)
+{
+    if (inRange(m))
+        fprintf(out, "goto L%d;\n", m);
+    else
+        fprintf(out, "return 0;\n");
+}
+
+// stack[...] for a variable l levels down
+void variable(int l, int m)
+{
+    if (l == 0)
+        fprintf(out, "stack[bp + %d]", m);
+    else
+        fprintf(out, "stack[base(bp, %d) + %d]", l, m);
+}
+
+void instruction(int pc, int depth)
+{
+    static const char *ops[14] = {NULL, NULL, "+", "-", "*", "/", NULL, "%", "==", "!=", "<", "<=", ">", ">="};
+    const pm0Instr *c = &code[pc];
+    int l = c->l, m = c->m;
+
+    switch (c->op)
+    {
+        case 1:
+            indent(depth);
+            fprintf(out, "stack[++sp] = %d;\n", m);
+            break;
+        case 2:
+            if (m == 0)
+            {
+                indent(depth);
+                fprintf(out, "sp = bp - 1;\n");
+                indent(depth);
+                fprintf(out, "ret = stack[sp + 4];\n");
+                indent(depth);
+                fprintf(out, "bp = stack[sp + 3];\n");
+                indent(depth);
+                fprintf(out, "goto ret;\n");
+            }
+            else if (m == 1)
+            {
+                indent(depth);
+                fprintf(out, "stack[sp] = WRAP(0, -, stack[sp]);\n");
+            }
+            else if (m == 6)
+            {
+                indent(depth);
+                fprintf(out, "stack[sp] = stack[sp] & 1;\n");
+            }
+            else if (m > 1 && m < 14)
+            {
+                indent(depth);
+                fprintf(out, "sp--;\n");
+                indent(depth);
+                if (m <= 4)
+                    fprintf(out, "stack[sp] = WRAP(stack[sp], %s, stack[sp + 1]);\n", ops[m]);
+                else
+                    fprintf(out, "stack[sp] = stack[sp] %s stack[sp + 1];\n", ops[m]);
+            }
+            break;
+        case 3:
+            indent(depth);
+            fprintf(out, "stack[++sp] = ");
+            variable(l, m);
+            fprintf(out, ";\n");
+            break;
+        case 4:
+            indent(depth);
+            variable(l, m);
+            fprintf(out, " = stack[sp--];\n");
+            break;
+        case 5:
+            indent(depth);
+            fprintf(out, "if (sp + 4 > HEIGHT)\n");
+            indent(depth + 1);
+            fprintf(out, "return overflow(%d);\n", pc);
+            indent(depth);
+            fprintf(out, "stack[sp + 1] = 0;\n");
+            indent(depth);
+            if (l == 0)
+                fprintf(out, "stack[sp + 2] = bp;\n");
+            else
+                fprintf(out, "stack[sp + 2] = base(bp, %d);\n", l);
+            indent(depth);
+            fprintf(out, "stack[sp + 3] = bp;\n");
+            indent(depth);
+            fprintf(out, "stack[sp + 4] = %d;\n", pc + 1);
+            indent(depth);
+            fprintf(out, "bp = sp + 1;\n");
+            indent(depth);
+            jumpTo(m);
+            break;
+        case 6:
+            indent(depth);
+            fprintf(out, "if (sp + %d > HEIGHT)\n", m);
+            indent(depth + 1);
+            fprintf(out, "return overflow(%d);\n", pc);
+            indent(depth);
+            fprintf(out, "sp += %d;\n", m);
+            break;
+        case 7:
+            indent(depth);
+            jumpTo(m);
+            break;
+        case 8:
+            indent(depth);
+            fprintf(out, "if (stack[sp--] == 0)\n");
+            indent(depth + 1);
+            jumpTo(m);
+            break;
+        case 9:
+            indent(depth);
+            if (m == 0)
+                fprintf(out, "printf(\"%%d\\n\", stack[sp--]);\n");
+            else if (m == 1)
+                fprintf(out, "scanf(\"%%d\", &stack[++sp]);\n");
+            else if (m == 2)
+                fprintf(out, "return 0;\n");
+            else
+                fprintf(out, ";\n");
+            break;
+    }
+}
+
+void label(int pc)
+{
+    if (out != NULL && labelled[pc])
+        fprintf(out, "L%d: ;\n", pc);
+}
+
+void line(int depth, const char *text)
+{
+    if (out != NULL)
+    {
+        indent(depth);
+        fprintf(out, "%s\n", text);
+    }
+}
+
+/*
+    Turns code[from] up to code[to - 1] into C. Without out it only works out which
+    jumps the loops and ifs take care of. The structure comes out the same both
+    times, since it only depends on the code.
+
+    A loop is what the compiler barks for while:
+        i: condition; j: JPC k + 1; body; k: JMP i
+    An if is a JPC forward that stays inside the range. It gets an else when the
+    instruction before where it jumps to is a JMP forward that also stays inside.
+    Every instruction's label, if it needs one, goes right where its code is, so
+    a goto into the middle of a loop or an if still lands in the right place.
+*/
+void translate(int from, int to, int depth)
+{
+    int i = from, j, k, t, e;
+
+    while (i < to)
+    {
+        for (j = i; j < to && !control(&code[j]); j++)
+            ;
+        if (j < to && code[j].op == 8 && (k = code[j].m - 1) > j && k < to
+            && code[k].op == 7 && code[k].m == i)
+        {
+            consumed[j] = consumed[k] = 1;
+            line(depth, "for (;;)");
+            line(depth, "{");
+            for (; i < j; i++)
+            {
+                label(i);
+                if (out != NULL)
+                    instruction(i, depth + 1);
+            }
+            label(j);
+            line(depth + 1, "if (stack[sp--] == 0)");
+            line(depth + 2, "break;");
+            translate(j + 1, k, depth + 1);
+            label(k);
+            line(depth, "}");
+            i = k + 1;
+        }
+        else if (code[i].op == 8 && (t = code[i].m) > i && t <= to)
+        {
+            e = -1;
+            if (t - 1 > i && code[t - 1].op == 7 && code[t - 1].m >= t && code[t - 1].m <= to)
+                e = code[t - 1].m;
+            consumed[i] = 1;
+            label(i);
+            line(depth, "if (stack[sp--] != 0)");
+            line(depth, "{");
+            if (e < 0)
+                translate(i + 1, t, depth + 1);
+            else
+            {
+                consumed[t - 1] = 1;
+                translate(i + 1, t - 1, depth + 1);
+                label(t - 1);
+                line(depth, "}");
+                line(depth, "else");
+                line(depth, "{");
+                translate(t, e, depth + 1);
+                t = e;
+            }
+            line(depth, "}");
+            i = t;
+        }
+        else
+        {
+            label(i);
+            if (out != NULL)
+                instruction(i, depth);
+            i++;
+        }
+    }
+}
+
+// The interpreter a RET goes to when it doesn't land after a CAL, same as fastloop.h
+const char *interpreter =
+    "/* Carries on from pc on an interpreter, for a RET that goes where no CAL returns to */\n"
+    "static int interpret(int pc, int bp, int sp)\n"
+    "{\n"
+    "    int op, l, m;\n"
+    "\n"
+    "    while (pc >= 0 && pc < COUNT)\n"
+    "    {\n"
+    "        op = code[pc][0];\n"
+    "        l = code[pc][1];\n"
+    "        m = code[pc][2];\n"
+    "        if ((op == 5 || op == 7 || op == 8) && (m < 0 || m > COUNT))\n"
+    "            m = COUNT;\n"
+    "        pc++;\n"
+    "        switch (op)\n"
+    "        {\n"
+    "            case 1: stack[++sp] = m; break;\n"
+    "            case 2:\n"
+    "                switch (m)\n"
+    "                {\n"
+    "                    case 0:\n"
+    "                        sp = bp - 1;\n"
+    "                        pc = stack[sp + 4];\n"
+    "                        bp = stack[sp + 3];\n"
+    "                        break;\n"
+    "                    case 1: stack[sp] = WRAP(0, -, stack[sp]); break;\n"
+    "                    case 2: sp--; stack[sp] = WRAP(stack[sp], +, stack[sp + 1]); break;\n"
+    "                    case 3: sp--; stack[sp] = WRAP(stack[sp], -, stack[sp + 1]); break;\n"
+    "                    case 4: sp--; stack[sp] = WRAP(stack[sp], *, stack[sp + 1]); break;\n"
+    "                    case 5: sp--; stack[sp] = stack[sp] / stack[sp + 1]; break;\n"
+    "                    case 6: stack[sp] = stack[sp] & 1; break;\n"
+    "                    case 7: sp--; stack[sp] = stack[sp] % stack[sp + 1]; break;\n"
+    "                    case 8: sp--; stack[sp] = stack[sp] == stack[sp + 1]; break;\n"
+    "                    case 9: sp--; stack[sp] = stack[sp] != stack[sp + 1]; break;\n"
+    "                    case 10: sp--; stack[sp] = stack[sp] < stack[sp + 1]; break;\n"
+    "                    case 11: sp--; stack[sp] = stack[sp] <= stack[sp + 1]; break;\n"
+    "                    case 12: sp--; stack[sp] = stack[sp] > stack[sp + 1]; break;\n"
+    "                    case 13: sp--; stack[sp] = stack[sp] >= stack[sp + 1]; break;\n"
+    "                }\n"
+    "                break;\n"
+    "            case 3: stack[++sp] = stack[base(bp, l) + m]; break;\n"
+    "            case 4: stack[base(bp, l) + m] = stack[sp--]; break;\n"
+    "            case 5:\n"
+    "                if (sp + 4 > HEIGHT)\n"
+    "                    return overflow(pc - 1);\n"
+    "                stack[sp + 1] = 0;\n"
+    "                stack[sp + 2] = base(bp, l);\n"
+    "                stack[sp + 3] = bp;\n"
+    "                stack[sp + 4] = pc;\n"
+    "                bp = sp + 1;\n"
+    "                pc = m;\n"
+    "                break;\n"
+    "            case 6:\n"
+    "                if (sp + m > HEIGHT)\n"
+    "                    return overflow(pc - 1);\n"
+    "                sp += m;\n"
+    "                break;\n"
+    "            case 7: pc = m; break;\n"
+    "            case 8: if (stack[sp--] == 0) pc = m; break;\n"
+    "            case 9:\n"
+    "                if (m == 0)\n"
+    "                    printf(\"%d\\n\", stack[sp--]);\n"
+    "                else if (m == 1)\n"
+    "                    scanf(\"%d\", &stack[++sp]);\n"
+    "                else if (m == 2)\n"
+    "                    return 0;\n"
+    "                break;\n"
+    "        }\n"
+    "    }\n"
+    "    return 0;\n"
+    "}\n"
+    "\n";
+
+void writeProgram(FILE *f, const char *name)
+{
+    int i, usesBase = 0;
+
+    for (i = 0; i < count; i++)
+    {
+        if ((code[i].op == 3 || code[i].op == 4 || code[i].op == 5) && code[i].l > 0)
+            usesBase = 1;
+        if (code[i].op == 2 && code[i].m == 0)
+            hasRet = 1;
+    }
+    out = NULL;
+    translate(0, count, 1);     // Only finds the loops and ifs
+    out = f;
+    for (i = 0; i < count; i++)
+    {
+        if ((code[i].op == 5 || ((code[i].op == 7 || code[i].op == 8) && !consumed[i])) && inRange(code[i].m))
+            labelled[code[i].m] = 1;
+        if (hasRet && code[i].op == 5 && i + 1 < count)
+            labelled[i + 1] = 1;
+    }
+
+    fprintf(out, "/* Generated by aot from %s */\n", name);
+    fprintf(out, "#include <stdio.h>\n\n");
+    fprintf(out, "#define HEIGHT %d\n", MAX_STACK_HEIGHT);
+    fprintf(out, "#define COUNT %d\n", count);
+    fprintf(out, "#define WRAP(a, op, b) ((int)((unsigned)(a) op (unsigned)(b)))    /* Wraps around like the VM does */\n\n");
+    fprintf(out, "static int stack[HEIGHT + 1 + %d];    /* LIT, LOD and INP don't check for overflow */\n\n", STACK_SLACK);
+    fprintf(out, "static int overflow(int pc)\n{\n    printf(\"Stack overflow at %%d\\n\", pc);\n    return 1;\n}\n\n");
+    if (usesBase || hasRet)
+        fprintf(out, "static int base(int b, int l)\n{\n    while (l-- > 0)\n        b = stack[b + 1];\n    return b;\n}\n\n");
+    if (hasRet)
+    {
+        fprintf(out, "static const int code[COUNT][3] =\n{\n");
+        for (i = 0; i < count; i++)
+            fprintf(out, "    {%d, %d, %d},\n", code[i].op, code[i].l, code[i].m);
+        fprintf(out, "};\n\n%s", interpreter);
+    }
+
+    fprintf(out, "int main(void)\n{\n");
+    fprintf(out, "    int bp = 1, sp = 0%s;\n\n", hasRet ? ", ret" : "");
+    translate(0, count, 1);
+    if (count == 0 || code[count - 1].op != 9 || code[count - 1].m != 2)     // Not after a HLT
+        fprintf(out, "    return 0;\n");
+    if (hasRet)
+    {
+        fprintf(out, "ret:\n    switch (ret)\n    {\n");
+        for (i = 0; i + 1 < count; i++)
+            if (code[i].op == 5)
+                fprintf(out, "        case %d: goto L%d;\n", i + 1, i + 1);
+        fprintf(out, "    }\n    return interpret(ret, bp, sp);\n");
+    }
+    fprintf(out, "}\n");
+}
+
+int main(int argc, char **argv)
+{
+    pm0Program prog;
+    FILE *f;
+    const char *in, *program, *cc;
+    char *source, *command;
+    int onlyC = argc > 1 && strcmp(argv[1], "-c") == 0, result;
+
+    if (argc != 3 + onlyC)
+    {
+        printf("Usage: aot [-c] <code.pm0> <program>\n");
+        return -1;
+    }
+    in = argv[1 + onlyC];
+    program = argv[2 + onlyC];
+    if (loadProgram(in, &prog) != 0)
+        return -1;
+    if (prog.maxFrame > MAX_STACK_HEIGHT)
+    {
+        printf("Program needs a frame of %d, the stack only holds %d\n", prog.maxFrame, MAX_STACK_HEIGHT);
+        return -1;
+    }
+    code = prog.code;
+    count = prog.count;
+    consumed = calloc(count + 1, 1);
+    labelled = calloc(count + 1, 1);
+    source = malloc(strlen(program) + 3);
+    if (consumed == NULL || labelled == NULL || source == NULL)
+    {
+        printf("Out of memory for the program code\n");
+        return -1;
+    }
+    sprintf(source, onlyC ? "%s" : "%s.c", program);
+
+    if ((f = fopen(source, "w")) == NULL)
+    {
+        printf("Error opening %s\n", source);
+        return -1;
+    }
+    writeProgram(f, in);
+    fclose(f);
+    freeProgram(&prog);
+    if (onlyC)
+        return 0;
+
+    // Wrapping arithmetic is spelled out in the C already, -O2 is all it needs
+    if ((cc = getenv("CC")) == NULL || *cc == '\0')
+        cc = "gcc";
+    command = malloc(strlen(cc) + strlen(program) + strlen(source) + 32);
+    if (command == NULL)
+    {
+        printf("Out of memory for the program code\n");
+        return -1;
+    }
+    sprintf(command, "%s -O2 -o \"%s\" \"%s\"", cc, program, source);
+    result = system(command);
+    if (result != 0)
+        printf("%s failed\n", command);
+    free(command);
+    free(source);
+    free(consumed);
+    free(labelled);
+    return result != 0;
+}
@@ -0,0 +1,73 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "arena.h"
+#include "nomem.h"
+
+#define ALIGN 8
+
+static arenaBlock *newBlock(size_t size)
+{
+    arenaBlock *block = malloc(sizeof(arenaBlock) + size);
+
+    if (block == NULL)
+        outOfMemory("Out of memory for the syntax tree\n");
+    block->next = NULL;
+    block->size = size;
+    block->used = 0;
+    return block;
+}
+
+void initArena(arena *a)
+{
+    a->first = a->current = NULL;
+}
+
+void *arenaAlloc(arena *a, size_t size)
+{
+    arenaBlock *block = a->current, *fresh;
+    void *p;
+
+    size = (size + ALIGN - 1) & ~(size_t)(ALIGN - 1);
+    while (block != NULL && block->used + size > block->size)
+    {
+        if (block->next == NULL)
+            break;
+        block = block->next;    // A block kept from before the last reset
+        block->used = 0;
+    }
+    if (block == NULL || block->used + size > block->size)
+    {
+        fresh = newBlock(size > ARENA_BLOCK ? size : ARENA_BLOCK);
+        if (block == NULL)
+            a->first = fresh;
+        else
+        {
+            fresh->next = block->next;
+            block->next = fresh;
+        }
+        block = fresh;
+    }
+    a->current = block;
+    p = (char *)(block + 1) + block->used;
+    block->used += size;
+    return p;
+}
+
+void resetArena(arena *a)
+{
+    a->current = a->first;
+    if (a->first != NULL)
+        a->first->used = 0;
+}
+
+void freeArena(arena *a)
+{
+    arenaBlock *block, *next;
+
+    for (block = a->first; block != NULL; block = next)
+    {
+        next = block->next;
+        free(block);
+    }
+    a->first = a->current = NULL;
+}
@@ -0,0 +1,30 @@
+#ifndef ARENA_H_INCLUDED
+#define ARENA_H_INCLUDED
+
+#include <stddef.h>
+
+#define ARENA_BLOCK 65536   // Bytes per block, bigger requests get a block of their own
+
+typedef struct arenaBlock
+{
+    struct arenaBlock *next;
+    size_t size;
+    size_t used;
+} arenaBlock;
+
+/**
+ *  Hands out memory by bumping a pointer through big blocks, and gives it all
+ *  back at once. Used for the syntax trees, which all die together.
+ */
+typedef struct arena
+{
+    arenaBlock *first;
+    arenaBlock *current;    // Block being handed out from, the ones after it are empty
+} arena;
+
+void initArena(arena *a);
+void *arenaAlloc(arena *a, size_t size);   // Never returns NULL, see nomem.h
+void resetArena(arena *a);                 // Everything handed out is gone, the blocks are kept for reuse
+void freeArena(arena *a);
+
+#endif // ARENA_H_INCLUDED
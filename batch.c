@@ -0,0 +1,433 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "compiler.h"
+#include "cache.h"
+#include "source.h"
+#include "pm0.h"
+#include "peephole.h"
+
+/**
+ *  Compiles a lot of programs in one process, on a pool of threads.
+ *
+ *      batch [-j <threads>] [--write] [--quiet] [--binary] [-O...] [--ir...]
+ *            [--cache <dir> [--cache-max <size>]] <file.pl0 | @list>...
+ *
+ *  @list is a file with one path per line. Every file gets a line saying how it went,
+ *  in the order they were given (--quiet leaves out the ones that compiled), then the
+ *  totals and how fast it went. With --write each program is written next to its
+ *  source as a .pm0, the same as Parser would write it. Otherwise it is compiled and
+ *  thrown away. --binary, -O, --ir and --cache mean what they do for Parser, and all
+ *  the threads share the one cache.
+ *
+ *  The files are split evenly between the threads up front. A thread works through
+ *  its own share from the back, and when that runs out it takes files from the front
+ *  of another thread's share, so a few big files don't leave the rest idle. -j is
+ *  the number of CPUs unless it's given.
+ */
+
+#define FILE_OK 0
+#define FILE_ERROR 1        // It didn't compile
+#define FILE_FAILED 2       // Couldn't read the source or write the code
+
+typedef struct fileResult
+{
+    int status;         // FILE_ constant
+    int instructions;   // Code it compiled to
+    int tokens;
+    size_t bytes;       // Size of the source
+    char *message;      // Why it didn't compile, on one line. NULL if it did
+} fileResult;
+
+// The files a thread has left, paths[head] up to paths[tail - 1]
+typedef struct workQueue
+{
+    pthread_mutex_t lock;
+    int head;           // Where other threads take from
+    int tail;           // The owner takes tail - 1
+} workQueue;
+
+typedef struct worker
+{
+    pthread_t thread;
+    workQueue queue;
+    int id;
+    int done;           // Files this thread compiled
+    int stolen;         // How many of them came from another thread's share
+} worker;
+
+char **paths;
+int fileCount, pathCap;
+fileResult *results;
+worker *workers;
+int threadCount;
+int optimize = 0, buildIR = 0, binaryOut = 0, writeOut = 0, quiet = 0;
+compileCache cache;
+int useCache = 0;
+
+void addPath(const char *path)
+{
+    if (fileCount == pathCap)
+    {
+        pathCap = pathCap ? pathCap * 2 : 256;
+        paths = realloc(paths, pathCap * sizeof(char *));
+    }
+    if (paths == NULL || (paths[fileCount] = strdup(path)) == NULL)
+    {
+        printf("Out of memory for the file list\n");
+        exit(1);
+    }
+    fileCount++;
+}
+
+// Every line of list is a path
+int addList(const char *list)
+{
+    FILE *f = fopen(list, "r");
+    char line[4096];
+    size_t n;
+
+    if (f == NULL)
+    {
+        printf("Error, cannot read the list %s\n", list);
+        return 1;
+    }
+    while (fgets(line, sizeof(line), f) != NULL)
+    {
+        n = strcspn(line, "\r\n");
+        line[n] = '\0';
+        if (n > 0)
+            addPath(line);
+    }
+    fclose(f);
+    return 0;
+}
+
+// The message with its lines joined up, for a status line
+char *oneLine(const char *message)
+{
+    char *s = strdup(message), *p;
+    size_t n;
+
+    if (s == NULL)
+        return NULL;
+    n = strlen(s);
+    while (n > 0 && s[n - 1] == '\n')
+        s[--n] = '\0';
+    for (p = s; *p != '\0'; p++)
+        if (*p == '\n')
+            *p = ' ';
+    return s;
+}
+
+void failFile(fileResult *r, const char *what, const char *path)
+{
+    char buf[4200];
+
+    snprintf(buf, sizeof(buf), "%s %s", what, path);
+    r->status = FILE_FAILED;
+    r->message = strdup(buf);
+}
+
+void compileFile(int f)
+{
+    fileResult *r = &results[f];
+    FILE *in, *out = NULL;
+    sourceBuf source;
+    compiler comp;
+    cacheKey key;
+    cacheEntry entry;
+    char *outPath = NULL, *partPath = NULL, *dot;
+    size_t len;
+    int hit = 0;
+
+    in = fopen(paths[f], "r");
+    if (in == NULL)
+    {
+        failFile(r, "Cannot read", paths[f]);
+        return;
+    }
+    if (loadSource(in, &source) != 0 && readStream(in, &source) != 0)
+    {
+        fclose(in);
+        failFile(r, "Out of memory for", paths[f]);
+        return;
+    }
+    fclose(in);
+    r->bytes = source.size;
+    if (useCache)
+    {
+        cacheKeyFor(&cache, &key, source.data, source.size, optimize, buildIR, binaryOut);
+        hit = cacheLookup(&cache, &key, &entry);
+    }
+
+    if (writeOut)                       // foo.pl0 goes to foo.pm0, written as foo.pm0.part first like Parser does
+    {
+        len = strlen(paths[f]);
+        outPath = malloc(len + 5);
+        partPath = malloc(len + 10);
+        if (outPath == NULL || partPath == NULL)
+        {
+            printf("Out of memory for the file list\n");
+            exit(1);
+        }
+        strcpy(outPath, paths[f]);
+        dot = strrchr(outPath, '.');
+        if (dot != NULL && strchr(dot, '/') == NULL)
+            *dot = '\0';
+        strcat(outPath, ".pm0");
+        sprintf(partPath, "%s.part", outPath);
+        out = fopen(partPath, binaryOut ? "wb+" : "w+");
+        if (out == NULL)
+        {
+            failFile(r, "Cannot write", outPath);
+            free(outPath);
+            free(partPath);
+            freeSource(&source);
+            if (hit)
+                freeEntry(&entry);
+            return;
+        }
+    }
+    else if (useCache && !hit)
+        out = tmpfile();                // Somewhere to write the code for the cache to keep
+
+    if (hit)
+    {
+        if (entry.diag.kind != DIAG_NONE)
+        {
+            r->status = FILE_ERROR;
+            r->message = oneLine(entry.diag.message);
+        }
+        else if (out != NULL)
+            fwrite(entry.code, 1, entry.codeSize, out);
+        r->instructions = entry.instructions;
+        r->tokens = entry.tokens;
+        freeEntry(&entry);
+    }
+    else
+    {
+        if (out != NULL && binaryOut)
+            writePm0Header(out, 0, 0);
+        initCompiler(&comp, optimize, buildIR, out, binaryOut);
+        if (compileSource(&comp, source.data, source.size) != 0)
+        {
+            r->status = FILE_ERROR;
+            r->message = oneLine(comp.diag.message);
+        }
+        else if (out != NULL && binaryOut)
+        {
+            fseek(out, 0, SEEK_SET);
+            writePm0Header(out, comp.code.count, comp.maxFrame);
+        }
+        r->instructions = comp.code.count;
+        r->tokens = comp.tokenCount;
+        if (useCache && (r->status != FILE_OK || out != NULL))
+            cacheStore(&cache, &key, &comp, r->status == FILE_OK ? out : NULL);
+        freeCompiler(&comp);
+    }
+    if (out != NULL && !writeOut)
+        fclose(out);
+    else if (out != NULL)
+    {
+        fclose(out);
+        if (r->status != FILE_OK)
+            remove(partPath);
+        else
+        {
+            remove(outPath);
+            if (rename(partPath, outPath) != 0)
+                failFile(r, "Cannot write", outPath);
+        }
+        free(outPath);
+        free(partPath);
+    }
+    freeSource(&source);
+}
+
+// Next file for w, from its own share or someone else's. -1 once there are none left anywhere
+int takeFile(worker *w)
+{
+    workQueue *q = &w->queue;
+    int f = -1, k;
+
+    pthread_mutex_lock(&q->lock);
+    if (q->head < q->tail)
+        f = --q->tail;
+    pthread_mutex_unlock(&q->lock);
+    for (k = 1; f < 0 && k < threadCount; k++)
+    {
+        q = &workers[(w->id + k) % threadCount].queue;
+        pthread_mutex_lock(&q->lock);
+        if (q->head < q->tail)
+            f = q->head++;
+        pthread_mutex_unlock(&q->lock);
+        if (f >= 0)
+            w->stolen++;
+    }
+    return f;
+}
+
+void *work(void *arg)
+{
+    worker *w = arg;
+    int f;
+
+    while ((f = takeFile(w)) >= 0)
+    {
+        compileFile(f);
+        w->done++;
+    }
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    struct timespec start, end;
+    int i, jobs = 0, ok = 0, errors = 0, failed = 0, tokens = 0, stolen = 0;
+    size_t bytes = 0;
+    double seconds;
+    const char *word;
+    char *cacheDir = getenv("PL0_CACHE");
+    long long cacheMax = CACHE_MAX;
+    cacheStats total;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+            jobs = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--write") == 0)
+            writeOut = 1;
+        else if (strcmp(argv[i], "--quiet") == 0)
+            quiet = 1;
+        else if (strcmp(argv[i], "--binary") == 0)
+            binaryOut = 1;
+        else if (strncmp(argv[i], "-O", 2) == 0)
+        {
+            optimize = peepFlags(argv[i] + 2);
+            if (optimize < 0)
+            {
+                printf("Error: -O takes a list of fold, branch, jumps and dead, like -O=fold,jumps\n");
+                return 1;
+            }
+        }
+        else if (strncmp(argv[i], "--ir", 4) == 0)
+        {
+            buildIR = irFlags(argv[i] + 4);
+            if (buildIR < 0)
+            {
+                printf("Error: --ir takes a list of const, cse, dse and unreachable, like --ir=const,cse\n");
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc)
+            cacheDir = argv[++i];
+        else if (strcmp(argv[i], "--cache-max") == 0 && i + 1 < argc)
+        {
+            cacheMax = parseSize(argv[++i]);
+            if (cacheMax < 0)
+            {
+                printf("Error: --cache-max takes a size in bytes, like 64M\n");
+                return 1;
+            }
+        }
+        else if (argv[i][0] == '-' && argv[i][1] != '\0')
+        {
+            printf("Error: Unknown option %s\n", argv[i]);
+            return 1;
+        }
+        else if (argv[i][0] == '@')
+        {
+            if (addList(argv[i] + 1) != 0)
+                return 1;
+        }
+        else
+            addPath(argv[i]);
+    }
+    if (fileCount == 0)
+    {
+        printf("Usage: batch [-j <threads>] [--write] [--quiet] [--binary] [-O...] [--ir...] "
+               "[--cache <dir> [--cache-max <size>]] <file.pl0 | @list>...\n");
+        return 1;
+    }
+    if (cacheDir != NULL && cacheDir[0] != '\0')
+    {
+        useCache = openCache(&cache, cacheDir, cacheMax) == 0;
+        if (!useCache)
+            printf("Warning, cannot use %s as a cache\n", cacheDir);
+    }
+    if (jobs <= 0)
+        jobs = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    threadCount = jobs < 1 ? 1 : jobs > fileCount ? fileCount : jobs;
+
+    results = calloc(fileCount, sizeof(fileResult));
+    workers = calloc(threadCount, sizeof(worker));
+    if (results == NULL || workers == NULL)
+    {
+        printf("Out of memory for the file list\n");
+        return 1;
+    }
+    for (i = 0; i < threadCount; i++)
+    {
+        workers[i].id = i;
+        workers[i].queue.head = (int)((long long)fileCount * i / threadCount);
+        workers[i].queue.tail = (int)((long long)fileCount * (i + 1) / threadCount);
+        pthread_mutex_init(&workers[i].queue.lock, NULL);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 1; i < threadCount; i++)
+        if (pthread_create(&workers[i].thread, NULL, work, &workers[i]) != 0)
+        {
+            printf("Error, cannot start thread %d\n", i);
+            return 1;
+        }
+    work(&workers[0]);                  // This thread is one of the workers too
+    for (i = 1; i < threadCount; i++)
+        pthread_join(workers[i].thread, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    for (i = 0; i < fileCount; i++)
+    {
+        fileResult *r = &results[i];
+
+        bytes += r->bytes;
+        tokens += r->tokens;
+        if (r->status == FILE_OK)
+            ok++;
+        else if (r->status == FILE_ERROR)
+            errors++;
+        else
+            failed++;
+        if (quiet && r->status == FILE_OK)
+            continue;
+        word = r->status == FILE_OK ? "ok" : r->status == FILE_ERROR ? "error" : "failed";
+        if (r->status == FILE_OK)
+            printf("%-6s %s, %d instructions\n", word, paths[i], r->instructions);
+        else
+            printf("%-6s %s: %s\n", word, paths[i], r->message != NULL ? r->message : "Out of memory");
+        free(r->message);
+    }
+    for (i = 0; i < threadCount; i++)
+        stolen += workers[i].stolen;
+
+    printf("%d files, %d compiled, %d with errors, %d could not be read or written\n", fileCount, ok, errors, failed);
+    printf("%.1f ms on %d threads (%d files moved between them): %.0f files/s, %.2f MB/s, %.0f tokens/s\n",
+           seconds * 1000, threadCount, stolen, fileCount / seconds, bytes / seconds / 1e6, tokens / seconds);
+    if (useCache)
+    {
+        closeCache(&cache, &total);
+        printCacheStats(&cache, &total);
+    }
+
+    for (i = 0; i < fileCount; i++)
+        free(paths[i]);
+    free(paths);
+    free(results);
+    free(workers);
+    return ok == fileCount ? 0 : 1;
+}
@@ -0,0 +1,138 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef _WIN32
+#include <io.h>
+#define ftruncate _chsize
+#else
+#include <unistd.h>
+#endif
+#include "bench.h"
+#include "fastvm.h"
+#include "regvm.h"
+#include "jit.h"
+
+#define ENGINES 4
+
+static const char *engineNames[ENGINES] = {"stack", "fused", "register", "jit"};
+
+static int runEngine(int engine, const pm0Instr *code, int count, int *stack, int height)
+{
+    int e;
+
+    switch (engine)
+    {
+        case 0: return runFast(code, count, stack, height, 0);
+        case 1: return runFast(code, count, stack, height, FAST_ALL);
+        case 2: return runRegister(code, count, stack, height);
+        default:
+            if ((e = runJit(code, count, stack, height)) >= 0)
+                return e;
+            return runFast(code, count, stack, height, FAST_ALL);
+    }
+}
+
+// Everything in f, NUL terminated. *size gets the length
+static char *slurp(FILE *f, long *size)
+{
+    char *data;
+
+    fseek(f, 0, SEEK_END);
+    *size = ftell(f);
+    data = malloc(*size + 1);
+    if (data == NULL)
+    {
+        printf("Out of memory for the benchmark\n");
+        exit(1);
+    }
+    fseek(f, 0, SEEK_SET);
+    *size = (long)fread(data, 1, *size, f);
+    data[*size] = '\0';
+    return data;
+}
+
+int benchEngines(const pm0Instr *code, int count, vmStack *space)
+{
+    int *stack = space->stack, height = space->height;
+    FILE *in = tmpfile(), *out[ENGINES];
+    char buf[4096], *written[ENGINES];
+    long size[ENGINES];
+    double best[ENGINES], t;
+    struct timespec start, end;
+    size_t n;
+    int e, run, savedOut, regSize, differ = 0;
+
+    if (in == NULL)
+    {
+        printf("Error, no room for a temporary file\n");
+        return 1;
+    }
+    while ((n = fread(buf, 1, sizeof(buf), stdin)) > 0)     // Every run reads the same input
+        fwrite(buf, 1, n, in);
+    fflush(in);
+    dup2(fileno(in), 0);
+
+    fflush(stdout);
+    savedOut = dup(1);
+    for (e = 0; e < ENGINES; e++)
+    {
+        out[e] = tmpfile();
+        if (out[e] == NULL)
+        {
+            printf("Error, no room for a temporary file\n");
+            return 1;
+        }
+        best[e] = -1;
+        for (run = 0; run < BENCH_RUNS; run++)
+        {
+            memset(stack, 0, stackUsed(space));
+            fseek(stdin, 0, SEEK_SET);
+            clearerr(stdin);
+            dropInput(sioStdin());
+            ftruncate(fileno(out[e]), 0);
+            lseek(fileno(out[e]), 0, SEEK_SET);
+            dup2(fileno(out[e]), 1);
+
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            runEngine(e, code, count, stack, height);
+            fflush(stdout);
+            clock_gettime(CLOCK_MONOTONIC, &end);
+
+            dup2(savedOut, 1);
+            t = (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6;
+            if (best[e] < 0 || t < best[e])
+                best[e] = t;
+        }
+        written[e] = slurp(out[e], &size[e]);
+        fclose(out[e]);
+    }
+    close(savedOut);
+    fclose(in);
+
+    printf("engine      best of %d   output\n", BENCH_RUNS);
+    for (e = 0; e < ENGINES; e++)
+    {
+        printf("%-10s %9.3f ms   ", engineNames[e], best[e]);
+        if (e == 0)
+            printf("%ld bytes\n", size[0]);
+        else if (size[e] == size[0] && memcmp(written[e], written[0], size[0]) == 0)
+            printf("same\n");
+        else
+        {
+            printf("DIFFERENT\n");
+            differ = 1;
+        }
+    }
+    regSize = registerSize(code, count, height);
+    if (regSize < 0)
+        printf("register code: not translated, ran on the stack machine\n");
+    else
+        printf("register code: %d instructions for %d PM/0 instructions\n", regSize, count);
+#if !defined(__x86_64__) || !defined(__linux__)
+    printf("jit: not on this machine, ran on the stack machine\n");
+#endif
+    for (e = 0; e < ENGINES; e++)
+        free(written[e]);
+    return differ;
+}
@@ -0,0 +1,19 @@
+#ifndef BENCH_H_INCLUDED
+#define BENCH_H_INCLUDED
+
+#include "pm0.h"
+#include "vmstack.h"
+
+#define BENCH_RUNS 5    // Runs of every engine, the fastest one counts
+
+/**
+ *  Runs the program on each of the fast engines in turn (plain stack machine,
+ *  with superinstructions, register machine, JIT), timing them and comparing
+ *  what they wrote. Every run gets the same input, everything on stdin is read
+ *  up front, and a fresh stack: what the run before used of space is cleared, the
+ *  rest was never touched. Prints a table instead of the program's output.
+ *  Returns 0 if every engine wrote the same thing.
+ */
+int benchEngines(const pm0Instr *code, int count, vmStack *space);
+
+#endif // BENCH_H_INCLUDED
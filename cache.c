@@ -0,0 +1,408 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cache.h"
+
+#ifndef _WIN32
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <utime.h>
+#include <time.h>
+
+#define STALE_TEMP 3600     // Seconds before a temporary file is taken to be left by a compile that died
+
+typedef struct entryHeader
+{
+    char magic[4];          // CACHE_MAGIC, not null terminated
+    int version;            // CACHE_VERSION
+    unsigned long long key[2];
+    int diagSize;           // sizeof(diagnostic) of whoever wrote it
+    int instructions;
+    int maxFrame;
+    int tokens;
+    long long codeSize;     // Bytes of code after the diagnostic
+} entryHeader;
+
+// An entry found while evicting
+typedef struct entryFile
+{
+    char *path;
+    long long size;
+    struct timespec used;
+} entryFile;
+
+static int tempCount;       // Makes the names of temporary files unique within the process
+
+#define P1 0x9E3779B185EBCA87ULL
+#define P2 0xC2B2AE3D27D4EB4FULL
+#define P3 0x165667B19E3779F9ULL
+#define P4 0x85EBCA77C2B2AE63ULL
+#define ROTL(x, r) (((x) << (r)) | ((x) >> (64 - (r))))
+
+// Murmur3's finalizer, every bit of k ends up in every bit of the result
+static unsigned long long mix(unsigned long long k)
+{
+    k ^= k >> 33;
+    k *= 0xFF51AFD7ED558CCDULL;
+    k ^= k >> 33;
+    k *= 0xC4CEB9FE1A85EC53ULL;
+    k ^= k >> 33;
+    return k;
+}
+
+/*
+    Folds size bytes into the two halves of h, eight at a time. Not meant to stand
+    up to someone making collisions on purpose, only to tell programs apart.
+*/
+static void hashBytes(unsigned long long h[2], const void *data, size_t size)
+{
+    const unsigned char *p = data, *end = p + size;
+    unsigned long long a = h[0], b = h[1], w;
+
+    for (; end - p >= 8; p += 8)
+    {
+        memcpy(&w, p, 8);
+        a = ROTL(a ^ w * P1, 31) * P2;
+        b = ROTL(b ^ w * P3, 27) * P4 + a;
+    }
+    w = 0;
+    memcpy(&w, p, end - p);
+    a = ROTL(a ^ w * P1, 31) * P2;
+    b = ROTL(b ^ (w ^ size) * P3, 27) * P4 + a;
+    h[0] = mix(a ^ size);
+    h[1] = mix(b + h[0]);
+}
+
+// dir/xx/<32 hex digits>, path needs room for strlen(dir) + 40
+static void entryPath(const compileCache *cache, const cacheKey *key, char *path)
+{
+    sprintf(path, "%s/%02x/%016llx%016llx", cache->dir, (unsigned)(key->hash[0] >> 56), key->hash[0], key->hash[1]);
+}
+
+int openCache(compileCache *cache, const char *dir, long long maxBytes)
+{
+    struct stat st;
+    long long exe[3];
+
+    memset(cache, 0, sizeof(*cache));
+    if (mkdir(dir, 0777) != 0 && (stat(dir, &st) != 0 || !S_ISDIR(st.st_mode)))
+        return 1;
+    cache->dir = strdup(dir);
+    if (cache->dir == NULL)
+        return 1;
+    cache->maxBytes = maxBytes;
+    cache->salt[0] = P1;
+    cache->salt[1] = P2;
+    hashBytes(cache->salt, COMPILER_VERSION, strlen(COMPILER_VERSION));
+    if (stat("/proc/self/exe", &st) == 0)   // A rebuilt compiler is a different compiler
+    {
+        exe[0] = st.st_size;
+        exe[1] = st.st_mtim.tv_sec;
+        exe[2] = st.st_mtim.tv_nsec;
+        hashBytes(cache->salt, exe, sizeof(exe));
+    }
+    return 0;
+}
+
+void cacheKeyFor(const compileCache *cache, cacheKey *key, const char *text, size_t size, int optimize, int buildIR, int binary)
+{
+    int options[3] = {optimize, buildIR, binary};
+
+    key->hash[0] = cache->salt[0];
+    key->hash[1] = cache->salt[1];
+    hashBytes(key->hash, text, size);
+    hashBytes(key->hash, options, sizeof(options));
+}
+
+int cacheLookup(compileCache *cache, const cacheKey *key, cacheEntry *entry)
+{
+    char *path = malloc(strlen(cache->dir) + 40);
+    entryHeader head;
+    FILE *f = NULL;
+
+    memset(entry, 0, sizeof(*entry));
+    if (path == NULL)
+        goto miss;
+    entryPath(cache, key, path);
+    f = fopen(path, "rb");
+    if (f == NULL || fread(&head, sizeof(head), 1, f) != 1)
+        goto miss;
+    if (memcmp(head.magic, CACHE_MAGIC, 4) != 0 || head.version != CACHE_VERSION || head.diagSize != sizeof(diagnostic)
+        || head.key[0] != key->hash[0] || head.key[1] != key->hash[1] || head.codeSize < 0)
+        goto miss;
+    entry->code = malloc(head.codeSize + 1);
+    if (entry->code == NULL || fread(&entry->diag, sizeof(diagnostic), 1, f) != 1
+        || fread(entry->code, 1, head.codeSize, f) != (size_t)head.codeSize)
+        goto miss;
+    entry->instructions = head.instructions;
+    entry->maxFrame = head.maxFrame;
+    entry->tokens = head.tokens;
+    entry->codeSize = head.codeSize;
+    fclose(f);
+    utime(path, NULL);                  // Now is when it was last used
+    free(path);
+    __atomic_add_fetch(&cache->hits, 1, __ATOMIC_RELAXED);
+    return 1;
+
+miss:
+    if (f != NULL)
+        fclose(f);
+    free(path);
+    freeEntry(entry);
+    __atomic_add_fetch(&cache->misses, 1, __ATOMIC_RELAXED);
+    return 0;
+}
+
+void freeEntry(cacheEntry *entry)
+{
+    free(entry->code);
+    entry->code = NULL;
+    entry->codeSize = 0;
+}
+
+void cacheStore(compileCache *cache, const cacheKey *key, const compiler *c, FILE *code)
+{
+    size_t len = strlen(cache->dir) + 40;
+    char *path = malloc(len), *temp = malloc(len + 32), buf[65536];
+    entryHeader head;
+    long long size = 0;
+    size_t n;
+    FILE *out;
+
+    if (c->diag.kind == DIAG_INTERNAL || path == NULL || temp == NULL)
+    {
+        free(path);
+        free(temp);
+        return;
+    }
+    if (code != NULL)
+    {
+        fflush(code);
+        fseek(code, 0, SEEK_END);
+        size = ftell(code);
+        fseek(code, 0, SEEK_SET);
+    }
+    memcpy(head.magic, CACHE_MAGIC, 4);
+    head.version = CACHE_VERSION;
+    head.key[0] = key->hash[0];
+    head.key[1] = key->hash[1];
+    head.diagSize = sizeof(diagnostic);
+    head.instructions = c->code.count;
+    head.maxFrame = c->maxFrame;
+    head.tokens = c->tokenCount;
+    head.codeSize = size;
+
+    sprintf(path, "%s/%02x", cache->dir, (unsigned)(key->hash[0] >> 56));
+    mkdir(path, 0777);                  // Fails if it's already there, which is fine
+    entryPath(cache, key, path);
+    sprintf(temp, "%s.tmp.%ld.%d", path, (long)getpid(), __atomic_fetch_add(&tempCount, 1, __ATOMIC_RELAXED));
+    out = fopen(temp, "wb");
+    if (out == NULL)
+    {
+        free(path);
+        free(temp);
+        return;
+    }
+    fwrite(&head, sizeof(head), 1, out);
+    fwrite(&c->diag, sizeof(diagnostic), 1, out);
+    while (code != NULL && (n = fread(buf, 1, sizeof(buf), code)) > 0)
+        fwrite(buf, 1, n, out);
+    if (ferror(out) | (fclose(out) != 0) || rename(temp, path) != 0)
+        remove(temp);                   // No room on the disk, most likely. It just won't be cached
+    else
+    {
+        __atomic_add_fetch(&cache->stores, 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&cache->storedBytes, (long long)(sizeof(head) + sizeof(diagnostic)) + size, __ATOMIC_RELAXED);
+    }
+    free(path);
+    free(temp);
+}
+
+static int oldestFirst(const void *a, const void *b)
+{
+    const entryFile *x = a, *y = b;
+
+    if (x->used.tv_sec != y->used.tv_sec)
+        return x->used.tv_sec < y->used.tv_sec ? -1 : 1;
+    return (x->used.tv_nsec > y->used.tv_nsec) - (x->used.tv_nsec < y->used.tv_nsec);
+}
+
+/*
+    Goes through every entry, and deletes the least recently used ones until what's
+    left fits in three quarters of maxBytes. Temporary files left by compiles that
+    died are cleared out on the way. stats->bytes ends up exact.
+*/
+static void evict(compileCache *cache, cacheStats *stats)
+{
+    entryFile *files = NULL, *bigger;
+    int count = 0, cap = 0, i;
+    long long total = 0;
+    DIR *top, *sub;
+    struct dirent *d, *e;
+    struct stat st;
+    char *path;
+    size_t len = strlen(cache->dir);
+    time_t now = time(NULL);
+
+    top = opendir(cache->dir);
+    if (top == NULL)
+        return;
+    while ((d = readdir(top)) != NULL)
+    {
+        if (strlen(d->d_name) != 2 || d->d_name[0] == '.')
+            continue;
+        path = malloc(len + 300);
+        if (path == NULL)
+            break;
+        sprintf(path, "%s/%s", cache->dir, d->d_name);
+        sub = opendir(path);
+        free(path);
+        while (sub != NULL && (e = readdir(sub)) != NULL)
+        {
+            if (e->d_name[0] == '.')
+                continue;
+            path = malloc(len + strlen(e->d_name) + 8);
+            if (path == NULL)
+                break;
+            sprintf(path, "%s/%s/%s", cache->dir, d->d_name, e->d_name);
+            if (stat(path, &st) != 0 || !S_ISREG(st.st_mode))
+            {
+                free(path);
+                continue;
+            }
+            if (strchr(e->d_name, '.') != NULL)     // Temporary, someone may still be writing it
+            {
+                if (now - st.st_mtime > STALE_TEMP)
+                    remove(path);
+                free(path);
+                continue;
+            }
+            if (count == cap)
+            {
+                cap = cap ? cap * 2 : 256;
+                bigger = realloc(files, cap * sizeof(entryFile));
+                if (bigger == NULL)
+                {
+                    free(path);
+                    break;
+                }
+                files = bigger;
+            }
+            files[count].path = path;
+            files[count].size = st.st_size;
+            files[count].used = st.st_mtim;
+            total += st.st_size;
+            count++;
+        }
+        if (sub != NULL)
+            closedir(sub);
+    }
+    closedir(top);
+
+    qsort(files, count, sizeof(entryFile), oldestFirst);
+    for (i = 0; i < count; i++)
+    {
+        if (total > cache->maxBytes / 4 * 3 && remove(files[i].path) == 0)
+        {
+            total -= files[i].size;
+            stats->evictions++;
+        }
+        free(files[i].path);
+    }
+    free(files);
+    stats->bytes = total;
+}
+
+void closeCache(compileCache *cache, cacheStats *total)
+{
+    char *path, text[256];
+    cacheStats s;
+    ssize_t n;
+    int fd;
+
+    memset(&s, 0, sizeof(s));
+    path = malloc(strlen(cache->dir) + 8);
+    fd = -1;
+    if (path != NULL)
+    {
+        sprintf(path, "%s/stats", cache->dir);
+        fd = open(path, O_RDWR | O_CREAT, 0666);
+        free(path);
+    }
+    if (fd >= 0 && flock(fd, LOCK_EX) == 0)
+    {
+        n = read(fd, text, sizeof(text) - 1);
+        text[n > 0 ? n : 0] = '\0';
+        sscanf(text, "%lld hits %lld misses %lld stores %lld evictions %lld bytes",
+               &s.hits, &s.misses, &s.stores, &s.evictions, &s.bytes);
+        s.hits += cache->hits;
+        s.misses += cache->misses;
+        s.stores += cache->stores;
+        s.bytes += cache->storedBytes;
+        if (s.bytes > cache->maxBytes)
+            evict(cache, &s);
+        n = snprintf(text, sizeof(text), "%lld hits %lld misses %lld stores %lld evictions %lld bytes\n",
+                     s.hits, s.misses, s.stores, s.evictions, s.bytes);
+        if (ftruncate(fd, 0) != 0 || pwrite(fd, text, n, 0) != n)
+            memset(&s, 0, sizeof(s));
+        flock(fd, LOCK_UN);
+    }
+    if (fd >= 0)
+        close(fd);
+    if (total != NULL)
+        *total = s;
+    free(cache->dir);
+    cache->dir = NULL;
+}
+
+#else
+
+int openCache(compileCache *cache, const char *dir, long long maxBytes)
+{
+    memset(cache, 0, sizeof(*cache));
+    return 1;                           // Not written for Windows yet
+}
+
+void cacheKeyFor(const compileCache *cache, cacheKey *key, const char *text, size_t size, int optimize, int buildIR, int binary) {}
+int cacheLookup(compileCache *cache, const cacheKey *key, cacheEntry *entry) { return 0; }
+void freeEntry(cacheEntry *entry) {}
+void cacheStore(compileCache *cache, const cacheKey *key, const compiler *c, FILE *code) {}
+
+void closeCache(compileCache *cache, cacheStats *total)
+{
+    if (total != NULL)
+        memset(total, 0, sizeof(*total));
+}
+
+#endif
+
+void printCacheStats(const compileCache *cache, const cacheStats *total)
+{
+    long long lookups = total->hits + total->misses;
+
+    printf("Cache: %d hits, %d misses, %d stored this time. %lld hits and %lld misses in all (%.1f%% hit), "
+           "%lld evicted, %.1f of %.1f MB in use\n",
+           cache->hits, cache->misses, cache->stores, total->hits, total->misses,
+           lookups > 0 ? 100.0 * total->hits / lookups : 0.0, total->evictions,
+           total->bytes / 1048576.0, cache->maxBytes / 1048576.0);
+}
+
+long long parseSize(const char *text)
+{
+    char *end;
+    long long n = strtoll(text, &end, 10);
+
+    if (end == text || n < 0)
+        return -1;
+    switch (*end)
+    {
+        case 'k': case 'K': n <<= 10; end++; break;
+        case 'm': case 'M': n <<= 20; end++; break;
+        case 'g': case 'G': n <<= 30; end++; break;
+    }
+    return *end == '\0' ? n : -1;
+}
@@ -0,0 +1,84 @@
+#ifndef CACHE_H_INCLUDED
+#define CACHE_H_INCLUDED
+
+#include <stdio.h>
+#include "compiler.h"
+
+#define CACHE_MAGIC "PL0C"      // First four bytes of an entry
+#define CACHE_VERSION 1
+#define CACHE_MAX (64LL << 20)  // Default size cap of a cache directory, in bytes
+
+/**
+ *  A directory of compiled programs, keyed by what went into compiling them, so a
+ *  program that was compiled before doesn't have to be lexed or parsed again.
+ *
+ *  The key is a 128 bit hash of the source bytes, the compiler (COMPILER_VERSION and
+ *  the size and time of the running executable) and the options that change what is
+ *  written (-O, --ir, --binary). An entry holds the whole .pm0 file as it was written,
+ *  or the diagnostic if the program didn't compile. Out of memory is never cached.
+ *
+ *  Entries live in dir/xx/<key in hex>, xx being its first two digits. They are
+ *  written to a file of their own and renamed into place, so any number of compiles,
+ *  processes or threads, can share a directory and never see half an entry. A hit
+ *  touches the entry's time, which makes eviction least recently used.
+ *
+ *  dir/stats holds the counters of everyone who used the directory and roughly how
+ *  much is in it. Each compileCache counts on its own and adds that in when it is
+ *  closed, under a lock on the file. Whoever finds the directory over maxBytes then
+ *  deletes the oldest entries until it's down to three quarters of it.
+ *
+ *  lookups and stores can be called from any number of threads on one compileCache.
+ */
+typedef struct compileCache
+{
+    char *dir;
+    long long maxBytes;
+    unsigned long long salt[2];     // The compiler's part of every key
+    int hits;                       // This compileCache's, since it was opened
+    int misses;
+    int stores;
+    long long storedBytes;
+} compileCache;
+
+typedef struct cacheKey
+{
+    unsigned long long hash[2];
+} cacheKey;
+
+typedef struct cacheEntry
+{
+    diagnostic diag;        // diag.kind is DIAG_NONE if it compiled
+    int instructions;
+    int maxFrame;
+    int tokens;
+    size_t codeSize;        // Bytes of code, the .pm0 file. 0 if it didn't compile
+    char *code;
+} cacheEntry;
+
+// Counters of a whole directory, see printCacheStats
+typedef struct cacheStats
+{
+    long long hits;
+    long long misses;
+    long long stores;
+    long long evictions;
+    long long bytes;
+} cacheStats;
+
+int openCache(compileCache *cache, const char *dir, long long maxBytes);   // Makes dir if it has to. Returns 1 if it can't be used
+void cacheKeyFor(const compileCache *cache, cacheKey *key, const char *text, size_t size, int optimize, int buildIR, int binary);
+int cacheLookup(compileCache *cache, const cacheKey *key, cacheEntry *entry);  // 1 and the entry if it's there, free it with freeEntry
+void freeEntry(cacheEntry *entry);
+
+/**
+ *  Keeps what compiling the program under key came to. code is the stream the .pm0
+ *  was written to, it has to be open for reading too and is read from the start, so
+ *  it's written exactly as the compiler left it. NULL if it didn't compile.
+ */
+void cacheStore(compileCache *cache, const cacheKey *key, const compiler *c, FILE *code);
+
+void closeCache(compileCache *cache, cacheStats *total);   // total gets the directory's counters, with ours added. May be NULL
+void printCacheStats(const compileCache *cache, const cacheStats *total);
+long long parseSize(const char *text);  // "64M" and the like. -1 if it isn't a size
+
+#endif // CACHE_H_INCLUDED
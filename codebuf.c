@@ -0,0 +1,219 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include "codebuf.h"
+#include "pm0.h"
+#include "nomem.h"
+
+static codeChunk *newChunk(codeBuffer *code)
+{
+    codeChunk *chunk = code->spare;
+
+    if (chunk != NULL)
+        code->spare = NULL;
+    else if ((chunk = malloc(sizeof(codeChunk))) == NULL)
+        outOfMemory("Out of memory for the program code\n");
+    chunk->next = NULL;
+    return chunk;
+}
+
+/*
+    Writes n commands starting at address addr. In binary, any of them still
+    held gets its place in the file noted in heldAt, so patchCode can go back
+    to it. Text never has one, writeFinished keeps them in memory.
+*/
+static void writeCommands(codeBuffer *code, const command *cmd, int addr, int n)
+{
+    pm0Instr packed[CHUNK_SIZE];         // On the stack, every thread's compiler writes its own
+    int h = 0, i;
+    long start;
+
+    if (!code->binary)
+    {
+        for (i = 0; i < n; i++)
+            fprintf(code->out, "%d %d %d\n", cmd[i].op, cmd[i].lex, cmd[i].mod);
+        return;
+    }
+    while (h < code->heldCount && code->held[h] < addr)
+        h++;
+    start = h < code->heldCount && code->held[h] < addr + n ? ftell(code->out) : -1;
+    for (i = 0; i < n; i++)
+    {
+        packed[i].op = (unsigned char)cmd[i].op;
+        packed[i].l = (unsigned char)cmd[i].lex;
+        packed[i].reserved = 0;
+        packed[i].m = cmd[i].mod;
+    }
+    for (; h < code->heldCount && code->held[h] < addr + n; h++)
+        code->heldAt[h] = start + (long)(code->held[h] - addr) * sizeof(pm0Instr) + offsetof(pm0Instr, m);
+    writePm0Code(code->out, packed, n);
+}
+
+/*
+    Overwrites the modifier of a held jump that was already written, at where
+    writeCommands put it, and goes back to the end to carry on.
+*/
+static void rewriteHeld(codeBuffer *code, long at, int m)
+{
+    long end = ftell(code->out);
+
+    fseek(code->out, at, SEEK_SET);
+    fwrite(&m, sizeof(m), 1, code->out);
+    fseek(code->out, end, SEEK_SET);
+}
+
+/*
+    Writes out every full chunk but the one being filled. If held jumps can't
+    be patched in out, only those that end before the oldest held address.
+*/
+static void writeFinished(codeBuffer *code)
+{
+    int limit = code->heldCount && !code->seekable ? code->held[0] : code->count;
+    codeChunk *done;
+
+    while (code->first != code->last && code->base + CHUNK_SIZE <= limit)
+    {
+        done = code->first;
+        writeCommands(code, done->code, code->base, CHUNK_SIZE);
+        code->first = done->next;
+        code->base += CHUNK_SIZE;
+        if (code->spare == NULL)
+            code->spare = done;
+        else
+            free(done);
+    }
+}
+
+void initCode(codeBuffer *code, FILE *out, int binary)
+{
+    memset(code, 0, sizeof(*code));
+    code->out = out;
+    code->binary = binary;
+    code->seekable = binary && out != NULL && ftell(out) >= 0;  // Text lines have no fixed width to patch
+}
+
+void freeCode(codeBuffer *code)
+{
+    codeChunk *chunk, *next;
+
+    for (chunk = code->first; chunk != NULL; chunk = next)
+    {
+        next = chunk->next;
+        free(chunk);
+    }
+    free(code->spare);
+    free(code->held);
+    free(code->heldAt);
+    memset(code, 0, sizeof(*code));
+}
+
+int emitCode(codeBuffer *code, int op, int l, int m)
+{
+    int at = code->count - code->base;  // Offset from the start of the first chunk
+    codeChunk *chunk;
+
+    if (code->last == NULL)             // The first one, not made until it's needed so initCode can't fail
+    {
+        code->first = code->last = newChunk(code);
+        if (code->peakChunks == 0)
+            code->peakChunks = 1;
+    }
+    else if (at > 0 && at % CHUNK_SIZE == 0) // Last chunk is full
+    {
+        chunk = newChunk(code);
+        code->last->next = chunk;
+        code->last = chunk;
+        if (code->out != NULL)
+            writeFinished(code);
+        if ((code->count - code->base) / CHUNK_SIZE + 1 > code->peakChunks)
+            code->peakChunks = (code->count - code->base) / CHUNK_SIZE + 1;
+    }
+    chunk = code->last;
+    at = (code->count - code->base) % CHUNK_SIZE;
+    chunk->code[at].op = op;
+    chunk->code[at].lex = l;
+    chunk->code[at].mod = m;
+    if (code->lines != NULL)
+        markLine(code->lines, code->count, code->line, code->column);
+    return code->count++;
+}
+
+void holdCode(codeBuffer *code, int addr)
+{
+    int cap = code->heldCap ? code->heldCap * 2 : 16;
+    void *bigger;
+
+    if (code->heldCount == code->heldCap)
+    {
+        if ((bigger = realloc(code->held, cap * sizeof(int))) == NULL)
+            outOfMemory("Out of memory for the program code\n");
+        code->held = bigger;
+        if ((bigger = realloc(code->heldAt, cap * sizeof(long))) == NULL)
+            outOfMemory("Out of memory for the program code\n");
+        code->heldAt = bigger;
+        code->heldCap = cap;
+    }
+    code->heldAt[code->heldCount] = -1;
+    code->held[code->heldCount++] = addr;     // Barked in order, so this stays sorted
+}
+
+void patchCode(codeBuffer *code, int addr, int m)
+{
+    int i;
+    command *cmd = codeAt(code, addr);
+
+    code->patches++;
+    if (cmd != NULL)
+        cmd->mod = m;
+    for (i = code->heldCount - 1; i >= 0; i--)  // Usually the newest one, control structures nest
+    {
+        if (code->held[i] == addr)
+        {
+            if (code->heldAt[i] >= 0)
+                rewriteHeld(code, code->heldAt[i], m);
+            memmove(code->held + i, code->held + i + 1, (code->heldCount - i - 1) * sizeof(int));
+            memmove(code->heldAt + i, code->heldAt + i + 1, (code->heldCount - i - 1) * sizeof(long));
+            code->heldCount--;
+            break;
+        }
+    }
+}
+
+command *codeAt(codeBuffer *code, int addr)
+{
+    codeChunk *chunk = code->first;
+    int at = addr - code->base;
+
+    if (at < 0 || addr >= code->count)
+        return NULL;
+    while (at >= CHUNK_SIZE)
+    {
+        chunk = chunk->next;
+        at -= CHUNK_SIZE;
+    }
+    return &chunk->code[at];
+}
+
+void flushCode(codeBuffer *code)
+{
+    codeChunk *next;
+    int n;
+
+    if (code->out == NULL || code->first == NULL)
+        return;
+    for (;;)
+    {
+        n = code->count - code->base;
+        if (n > CHUNK_SIZE)
+            n = CHUNK_SIZE;
+        writeCommands(code, code->first->code, code->base, n);
+        code->base += n;
+        if (code->first == code->last)  // Keep the last one around in case more is barked
+            break;
+        next = code->first->next;
+        free(code->first);
+        code->first = next;
+    }
+    code->heldCount = 0;
+}
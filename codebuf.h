@@ -0,0 +1,64 @@
+#ifndef CODEBUF_H_INCLUDED
+#define CODEBUF_H_INCLUDED
+
+#include "linemap.h"
+
+#define CHUNK_SIZE 4096     // Commands per chunk
+
+typedef struct command
+{
+    int op;
+    int lex;
+    int mod;
+} command;
+
+typedef struct codeChunk
+{
+    command code[CHUNK_SIZE];
+    struct codeChunk *next;
+} codeChunk;
+
+/**
+ *  The program as it is barked, kept in a list of fixed size chunks so there's no upper limit.
+ *
+ *  If out is set, a chunk is written out and freed as soon as it is full. Jumps whose
+ *  target isn't known yet are held (holdCode) until they are patched (patchCode). In
+ *  binary, a held jump that gets written out first keeps where its modifier went in the
+ *  file, and the patch goes back and overwrites it there. For text, or if out can't seek
+ *  (a pipe), nothing from the oldest held address on is written instead, and the code
+ *  inside the control structures that are still open (all of it, once there are
+ *  procedures) has to stay in memory.
+ *
+ *  If lines is set, every command barked is marked in it as coming from line and
+ *  column, which whoever is barking keeps up to date.
+ */
+typedef struct codeBuffer
+{
+    codeChunk *first;   // Oldest chunk still in memory, holds address base
+    codeChunk *last;    // Chunk being filled
+    codeChunk *spare;   // A written out chunk kept for reuse
+    int base;           // Address of first->code[0]
+    int count;          // Commands barked so far, also the next address
+    int *held;          // Addresses waiting to be patched, oldest first
+    long *heldAt;       // Where in out each one's modifier went, -1 while still in memory
+    int heldCount;
+    int heldCap;
+    int patches;        // Times patchCode was called
+    int peakChunks;     // Most chunks there were in memory at once
+    FILE *out;          // Where finished code goes, NULL to keep it all in memory
+    int binary;         // Write pm0Instr records instead of text, see pm0.h
+    int seekable;       // Binary out can go back to patch a held jump that's already written
+    lineMap *lines;     // NULL unless the caller sets it after initCode
+    int line;           // Where in the source the commands being barked come from
+    int column;
+} codeBuffer;
+
+void initCode(codeBuffer *code, FILE *out, int binary);
+void freeCode(codeBuffer *code);
+int emitCode(codeBuffer *code, int op, int l, int m);  // Adds a command, returns its address
+void holdCode(codeBuffer *code, int addr);             // addr will be patched later
+void patchCode(codeBuffer *code, int addr, int m);     // Sets the modifier of addr and lets go of it
+command *codeAt(codeBuffer *code, int addr);           // A command still in memory, NULL if it was already written
+void flushCode(codeBuffer *code);                      // Writes out everything left, held or not
+
+#endif // CODEBUF_H_INCLUDED
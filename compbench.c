@@ -0,0 +1,428 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+#include "compiler.h"
+#include "source.h"
+#include "tokens.h"
+#include "peephole.h"
+
+/**
+ *  Times each phase of the compiler over a set of programs, pl0gen makes good ones.
+ *
+ *      compbench [--runs <n>] [--json <file>] [--label <text>]
+ *                [--compare <baseline.json> [--threshold <percent>]] <file.pl0 | @list>...
+ *
+ *  read        Opening and mapping the files and touching every byte
+ *  lex         tokenize, the tokens and the name table
+ *  compile     All of compileSource, writing the code as text to /dev/null
+ *  parse       compile less lex, so the parser and barking the code
+ *  optimize    compile with -O
+ *  ir          compile with --ir
+ *
+ *  Each phase runs over every file --runs times (5 unless it's given) and the fastest
+ *  run is the one reported, as tokens/s, lines/s, instructions barked/s and MB/s of
+ *  source. Peak RSS is the most the process had in memory during the phase, and growth
+ *  is how much of that the phase added to what was there before it. On Linux the peak
+ *  is reset before each phase, elsewhere it can only be the peak of the whole run.
+ *
+ *  --json writes the results one object to a line, the first one says what was run.
+ *  --compare reads a file written by --json and exits with 1 if any phase is more than
+ *  --threshold percent (10 unless it's given) slower, or grew more than that much more
+ *  memory, than it was in the baseline. Being TIME_SLACK ms slower or GROWTH_SLACK KB
+ *  bigger is never enough, however many percent that is.
+ */
+
+#define PHASE_READ 0
+#define PHASE_LEX 1
+#define PHASE_COMPILE 2
+#define PHASE_PARSE 3       // Not run, worked out from compile and lex
+#define PHASE_OPTIMIZE 4
+#define PHASE_IR 5
+#define PHASES 6
+
+#define GROWTH_SLACK 1024   // KB of growth that is never a regression, the allocator moves that much around
+#define TIME_SLACK 0.5      // ms slower that is never a regression either, a phase that short is all noise
+
+static const char *phaseNames[PHASES] = {"read", "lex", "compile", "parse", "optimize", "ir"};
+
+typedef struct phaseResult
+{
+    double ms;              // Fastest run over all the files
+    long long tokens;
+    long long instructions;
+    long peakKB;
+    long growthKB;
+} phaseResult;
+
+char **paths;
+int fileCount, pathCap;
+sourceBuf *sources;
+long long totalBytes, totalLines;
+FILE *devNull;
+
+void addPath(const char *path)
+{
+    if (fileCount == pathCap)
+    {
+        pathCap = pathCap ? pathCap * 2 : 256;
+        paths = realloc(paths, pathCap * sizeof(char *));
+    }
+    if (paths == NULL || (paths[fileCount] = strdup(path)) == NULL)
+    {
+        printf("Out of memory for the file list\n");
+        exit(1);
+    }
+    fileCount++;
+}
+
+int addList(const char *list)
+{
+    char line[4096];
+    size_t len;
+    FILE *f = fopen(list, "r");
+
+    if (f == NULL)
+    {
+        printf("Error, cannot open list %s\n", list);
+        return 1;
+    }
+    while (fgets(line, sizeof(line), f) != NULL)
+    {
+        len = strcspn(line, "\r\n");
+        line[len] = '\0';
+        if (len > 0)
+            addPath(line);
+    }
+    fclose(f);
+    return 0;
+}
+
+// Reads a "Vm...:" line of /proc/self/status in KB, -1 if there isn't one
+static long statusKB(const char *field)
+{
+    char line[256];
+    long kb = -1;
+    size_t len = strlen(field);
+    FILE *f = fopen("/proc/self/status", "r");
+
+    if (f == NULL)
+        return -1;
+    while (fgets(line, sizeof(line), f) != NULL)
+        if (strncmp(line, field, len) == 0)
+        {
+            kb = atol(line + len);
+            break;
+        }
+    fclose(f);
+    return kb;
+}
+
+// Starts measuring the peak again from what is in memory now, returns that
+static long resetPeak(void)
+{
+    FILE *f = fopen("/proc/self/clear_refs", "w");
+
+    if (f != NULL)
+    {
+        fputs("5", f);      // Resets VmHWM to VmRSS
+        fclose(f);
+    }
+    return statusKB("VmRSS:");
+}
+
+static long peakKB(void)
+{
+    struct rusage usage;
+    long kb = statusKB("VmHWM:");
+
+    if (kb < 0 && getrusage(RUSAGE_SELF, &usage) == 0)
+        kb = usage.ru_maxrss;
+    return kb;
+}
+
+static double now(void)
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e3 + t.tv_nsec / 1e6;
+}
+
+// One run of a phase over every file, adds up what it made in r
+static void runPhase(int phase, phaseResult *r)
+{
+    compiler c;
+    tokenStream tokens;
+    internTable names;
+    sourceBuf src;
+    FILE *f;
+    unsigned sum = 0;
+    size_t j;
+    int i;
+
+    r->tokens = r->instructions = 0;
+    for (i = 0; i < fileCount; i++)
+    {
+        if (phase == PHASE_READ)
+        {
+            if ((f = fopen(paths[i], "rb")) == NULL)
+                continue;
+            if (loadSource(f, &src) == 0)
+            {
+                for (j = 0; j < src.size; j += 64)
+                    sum += (unsigned char)src.data[j];
+                freeSource(&src);
+            }
+            fclose(f);
+        }
+        else if (phase == PHASE_LEX)
+        {
+            initIntern(&names);
+            tokenize(sources[i].data, sources[i].size, &tokens, &names);
+            r->tokens += tokens.count;
+            freeTokens(&tokens);
+            freeIntern(&names);
+        }
+        else
+        {
+            initCompiler(&c, phase == PHASE_OPTIMIZE ? PEEP_ALL : 0, phase == PHASE_IR ? IR_ALL : 0, devNull, 0);
+            compileSource(&c, sources[i].data, sources[i].size);
+            r->tokens += c.tokenCount;
+            r->instructions += c.code.count;
+            freeCompiler(&c);
+        }
+    }
+    if (sum == 1)           // Never, it only keeps the reads from being thrown away
+        printf(" ");
+}
+
+static void measure(int phase, int runs, phaseResult *r)
+{
+    double start, ms;
+    long before, peak;
+    int run;
+
+    r->ms = -1;
+    r->peakKB = r->growthKB = 0;
+    for (run = 0; run < runs; run++)
+    {
+        before = resetPeak();
+        start = now();
+        runPhase(phase, r);
+        ms = now() - start;
+        if (r->ms < 0 || ms < r->ms)
+            r->ms = ms;
+        peak = peakKB();
+        if (peak > r->peakKB)
+            r->peakKB = peak;
+        if (before >= 0 && peak - before > r->growthKB)
+            r->growthKB = peak - before;
+    }
+}
+
+static double perSecond(long long n, double ms)
+{
+    return ms > 0 ? n / (ms / 1e3) : 0;
+}
+
+// The number after "key": in a line of --json output, -1 if it isn't there
+static double jsonNumber(const char *line, const char *key)
+{
+    char pattern[64];
+    const char *p;
+
+    snprintf(pattern, sizeof(pattern), "\"%s\":", key);
+    p = strstr(line, pattern);
+    return p != NULL ? atof(p + strlen(pattern)) : -1;
+}
+
+// Prints how each phase compares with the baseline, returns how many are over the threshold
+static int compare(const char *baseline, const phaseResult *results, double threshold)
+{
+    char line[1024], *p;
+    double ms, change;
+    long growth;
+    int i, slower = 0;
+    FILE *f = fopen(baseline, "r");
+
+    if (f == NULL)
+    {
+        printf("Error, cannot open baseline %s\n", baseline);
+        return -1;
+    }
+    printf("\nagainst %s, %.0f%% allowed\n", baseline, threshold);
+    while (fgets(line, sizeof(line), f) != NULL)
+    {
+        if (strstr(line, "\"compbench\":") != NULL && ((long long)jsonNumber(line, "bytes") != totalBytes || (int)jsonNumber(line, "files") != fileCount))
+            printf("Warning, the baseline was run on other programs, %.0f files and %.0f bytes\n", jsonNumber(line, "files"), jsonNumber(line, "bytes"));
+        if ((p = strstr(line, "\"phase\":\"")) == NULL)
+            continue;
+        p += strlen("\"phase\":\"");
+        for (i = 0; i < PHASES; i++)
+            if (strncmp(p, phaseNames[i], strlen(phaseNames[i])) == 0 && p[strlen(phaseNames[i])] == '"')
+                break;
+        if (i == PHASES)
+            continue;
+        ms = jsonNumber(line, "ms");
+        growth = (long)jsonNumber(line, "rss_growth_kb");
+        change = ms > 0 ? (results[i].ms / ms - 1) * 100 : 0;
+        printf("%-9s %9.3f ms -> %9.3f ms  %+6.1f%%", phaseNames[i], ms, results[i].ms, change);
+        if (change > threshold && results[i].ms > ms + TIME_SLACK)
+        {
+            printf("  SLOWER");
+            slower++;
+        }
+        if (growth >= 0 && results[i].growthKB > growth + GROWTH_SLACK && results[i].growthKB > growth * (1 + threshold / 100))
+        {
+            printf("  MEMORY %ld KB -> %ld KB", growth, results[i].growthKB);
+            slower++;
+        }
+        printf("\n");
+    }
+    fclose(f);
+    return slower;
+}
+
+static int writeJson(const char *name, const char *label, int runs, const phaseResult *results)
+{
+    char when[32];
+    time_t t = time(NULL);
+    const phaseResult *r;
+    int i;
+    FILE *f = fopen(name, "w");
+
+    if (f == NULL)
+    {
+        printf("Error, cannot open %s\n", name);
+        return 1;
+    }
+    strftime(when, sizeof(when), "%Y-%m-%dT%H:%M:%SZ", gmtime(&t));
+    fprintf(f, "{\"compbench\":1,\"compiler\":\"%s\",\"label\":\"", COMPILER_VERSION);
+    for (i = 0; label[i] != '\0'; i++)
+        if (label[i] == '"' || label[i] == '\\')
+            fprintf(f, "\\%c", label[i]);
+        else if ((unsigned char)label[i] >= ' ')
+            fputc(label[i], f);
+    fprintf(f, "\",\"time\":\"%s\",\"runs\":%d,\"files\":%d,\"bytes\":%lld,\"lines\":%lld}\n",
+            when, runs, fileCount, totalBytes, totalLines);
+    for (i = 0; i < PHASES; i++)
+    {
+        r = &results[i];
+        fprintf(f, "{\"phase\":\"%s\",\"ms\":%.3f,\"tokens\":%lld,\"instructions\":%lld,"
+                "\"mb_per_s\":%.2f,\"lines_per_s\":%.0f,\"tokens_per_s\":%.0f,\"instructions_per_s\":%.0f,"
+                "\"peak_rss_kb\":%ld,\"rss_growth_kb\":%ld}\n",
+                phaseNames[i], r->ms, r->tokens, r->instructions,
+                perSecond(totalBytes, r->ms) / 1e6, perSecond(totalLines, r->ms),
+                perSecond(r->tokens, r->ms), perSecond(r->instructions, r->ms), r->peakKB, r->growthKB);
+    }
+    if (fclose(f) != 0)
+    {
+        printf("Error, cannot write %s\n", name);
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    phaseResult results[PHASES];
+    const char *jsonName = NULL, *baseline = NULL, *label = "";
+    double threshold = 10;
+    int i, runs = 5, slower = 0;
+    size_t j;
+    FILE *f;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc)
+            runs = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc)
+            jsonName = argv[++i];
+        else if (strcmp(argv[i], "--label") == 0 && i + 1 < argc)
+            label = argv[++i];
+        else if (strcmp(argv[i], "--compare") == 0 && i + 1 < argc)
+            baseline = argv[++i];
+        else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc)
+            threshold = atof(argv[++i]);
+        else if (argv[i][0] == '-' && argv[i][1] != '\0')
+        {
+            printf("Error: Unknown option %s\n", argv[i]);
+            return 1;
+        }
+        else if (argv[i][0] == '@')
+        {
+            if (addList(argv[i] + 1) != 0)
+                return 1;
+        }
+        else
+            addPath(argv[i]);
+    }
+    if (fileCount == 0 || runs < 1)
+    {
+        printf("Usage: compbench [--runs <n>] [--json <file>] [--label <text>] "
+               "[--compare <baseline.json> [--threshold <percent>]] <file.pl0 | @list>...\n");
+        return 1;
+    }
+
+    sources = calloc(fileCount, sizeof(sourceBuf));
+    devNull = fopen("/dev/null", "w");
+    if (sources == NULL || devNull == NULL)
+    {
+        printf("Error, cannot set up the benchmark\n");
+        return 1;
+    }
+    for (i = 0; i < fileCount; i++)     // Everything but read works on sources already in memory
+    {
+        if ((f = fopen(paths[i], "rb")) == NULL || (loadSource(f, &sources[i]) != 0 && readStream(f, &sources[i]) != 0))
+        {
+            printf("Error, cannot read %s\n", paths[i]);
+            return 1;
+        }
+        fclose(f);
+        totalBytes += sources[i].size;
+        for (j = 0; j < sources[i].size; j++)
+            totalLines += sources[i].data[j] == '\n';
+        if (sources[i].size > 0 && sources[i].data[sources[i].size - 1] != '\n')
+            totalLines++;
+    }
+
+    for (i = 0; i < PHASES; i++)
+        if (i != PHASE_PARSE)
+            measure(i, runs, &results[i]);
+    results[PHASE_PARSE] = results[PHASE_COMPILE];
+    results[PHASE_PARSE].ms = results[PHASE_COMPILE].ms - results[PHASE_LEX].ms;
+    results[PHASE_PARSE].tokens = results[PHASE_LEX].tokens;
+
+    printf("%d files, %lld bytes, %lld lines, best of %d runs\n", fileCount, totalBytes, totalLines, runs);
+    printf("phase            ms      MB/s     lines/s    tokens/s     instr/s   peak RSS     growth\n");
+    for (i = 0; i < PHASES; i++)
+        printf("%-9s %9.3f %9.2f %11.0f %11.0f %11.0f %8ld KB %7ld KB\n", phaseNames[i], results[i].ms,
+               perSecond(totalBytes, results[i].ms) / 1e6, perSecond(totalLines, results[i].ms),
+               perSecond(results[i].tokens, results[i].ms), perSecond(results[i].instructions, results[i].ms),
+               results[i].peakKB, results[i].growthKB);
+
+    if (jsonName != NULL && writeJson(jsonName, label, runs, results) != 0)
+        return 1;
+    if (baseline != NULL)
+    {
+        slower = compare(baseline, results, threshold);
+        if (slower < 0)
+            return 1;
+        if (slower > 0)
+            printf("%d regressions\n", slower);
+        else
+            printf("No regressions\n");
+    }
+
+    for (i = 0; i < fileCount; i++)
+    {
+        freeSource(&sources[i]);
+        free(paths[i]);
+    }
+    free(sources);
+    free(paths);
+    fclose(devNull);
+    return slower > 0;
+}
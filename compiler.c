@@ -0,0 +1,763 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include "compiler.h"
+#include "peephole.h"
+#include "nomem.h"
+
+enum Token_Name
+{
+    nulsym = 1,
+    identsym = 2,
+    numbersym = 3,
+    plussym = 4,
+    minussym = 5,
+    multsym = 6,
+    slashsym = 7,
+    oddsym = 8,
+    eqlsym = 9,
+    neqsym = 10,
+    lessym = 11,
+    leqsym = 12,
+    gtrsym = 13,
+    geqsym = 14,
+    lparentsym = 15,
+    rparentsym = 16,
+    commasym = 17,
+    semicolonsym = 18,
+    periodsym = 19,
+    becomessym = 20,
+    beginsym = 21,
+    endsym = 22,
+    ifsym = 23,
+    thensym = 24,
+    whilesym = 25,
+    dosym = 26,
+    callsym = 27,
+    constsym = 28,
+    varsym = 29,
+    procsym = 30,
+    writesym = 31,
+    readsym = 32,
+    elsesym = 33
+};
+static const char symbolName[34][13] = {"", "nulsym", "identsym", "numbersym", "plussym", "minussym", "multsym", "slashsym", "oddsym", "eqlsym", "neqsym", "lessym", "leqsym", "gtrsym", "geqsym", "lparentsym",
+                                 "rparentsym", "commasym", "semicolonsym", "periodsym", "becomessym", "beginsym", "endsym", "ifsym", "thensym", "whilesym", "dosym", "callsym", "constsym", "varsym",
+                                 "procsym", "writesym", "readsym", "elsesym"};
+
+/**
+ *  Non-Terminal Symbols
+ *  Used in Tiny PL0 Grammar
+ */
+static void program(compiler *c);
+static void block(compiler *c);
+static void constDec(compiler *c);
+static void varDec(compiler *c);
+static void procDec(compiler *c);
+static void statement(compiler *c);
+static astNode *condition(compiler *c);
+static astNode *expression(compiler *c);
+static astNode *term(compiler *c);
+static astNode *factor(compiler *c);
+
+/**
+ *  These provide functionality to our compiler
+ *
+ */
+static void consume(compiler *c, int last);             //Consumes the old token, and gets a new one. Will complain if it gets heartburn (unexpected token)
+static int ahead(compiler *c, int n);                   //Index in the stream of the token n places after the current one
+static int peek(compiler *c, int n);                    //Type of the token n places after the current one, without consuming anything
+static void bark(compiler *c, int op, int l, int m);    //Barks out command
+static int barkHole(compiler *c, int op, int l);        //Barks out a command whose modifier isn't known yet, returns its address for rebark
+static void rebark(compiler *c, int addr, int m);       //Updates command with new modifier
+static void optimizeBark(compiler *c);                  //Runs the peephole pass over the whole program and barks out the result
+static void sourceAt(compiler *c, int index);           //What's barked from now on comes from token index, for the line map
+static int stat(compiler *c, int bucket);               //Time from now on goes to bucket, returns where it went before. For --stats
+static void countMemory(compiler *c);                   //Fills in the stats on what's about to be freed
+static int ident(compiler *c, int kind);                //Adds ident to symbol table, returns where it went
+static int findName(compiler *c, int name);             //findSymbol, counted for --stats
+static astNode *identNode(compiler *c, int name);       //Finds the identifier in symbol table and makes the tree that loads its value
+static symbol *varIdent(compiler *c, int name);         //Finds the identifier in symbol table and makes sure it can be stored into
+static symbol *procIdent(compiler *c, int name);        //Finds the identifier in symbol table and makes sure it can be called
+static void storeIdent(compiler *c, int name);          //Finds memory address in symbol table and stores top of stack there
+static void barkExpr(compiler *c, astNode *e);          //Barks out the commands for an expression tree, and throws the tree away
+static void fail(compiler *c, int kind, int expected, const char *format, ...) __attribute__((noreturn, format(printf, 4, 5)));  //Fills in diag and gives up on the compilation
+static void outOfMemoryHere(void *c, const char *message) __attribute__((noreturn));   //What running out of memory anywhere in the compilation does, see nomem.h
+
+
+void initCompiler(compiler *c, int optimize, int buildIR, FILE *out, int binary)
+{
+    memset(c, 0, sizeof(*c));
+    c->optimize = optimize;
+    c->buildIR = buildIR;
+    c->out = out;
+    c->binary = binary;
+    initCode(&c->code, optimize ? NULL : out, binary);  //Finished code is written out while we parse, unless it is optimized first
+}
+
+void freeCompiler(compiler *c)
+{
+    freeCode(&c->code);
+}
+
+int compileSource(compiler *c, const char *text, size_t size)
+{
+    memset(&c->diag, 0, sizeof(c->diag));
+    c->frameSize = 4;
+    c->tokenNum = 0;
+    c->tokenCount = 0;
+    c->irOpen = 0;
+    c->code.lines = c->lines;
+    if (c->stats != NULL)
+    {
+        initStats(c->stats);
+        c->stats->sourceBytes = (long long)size;
+    }
+    catchOutOfMemory(outOfMemoryHere, c);
+    if (setjmp(c->fail) == 0)
+    {
+        initIntern(&c->names);
+        initSymbols(&c->symTab);
+        initArena(&c->nodes);
+        perfStart(c->perf, PERF_LEX);
+        stat(c, STAT_LEX);
+        tokenize(text, size, &c->tokens, &c->names);  //A lexer error is kept in the stream, consume() reports it when the parser gets there
+        c->tokenCount = c->tokens.count;
+        perfStart(c->perf, PERF_PARSE);
+        stat(c, STAT_PARSE);
+        c->tok.idNum = 1;
+        consume(c, nulsym);
+        program(c);
+        if (c->optimize)
+        {
+            perfStart(c->perf, PERF_OPTIMIZE);
+            stat(c, STAT_OPTIMIZE);
+            optimizeBark(c);
+        }
+        perfStart(c->perf, PERF_WRITE);
+        stat(c, STAT_WRITE);
+        flushCode(&c->code);    //Most of it is already out, this is whatever was left
+    }
+    catchOutOfMemory(NULL, NULL);
+    perfStop(c->perf);          //Whichever phase it got to, an error included
+    stat(c, -1);
+    countMemory(c);
+    if (c->irOpen)              //Only if an error left a block half built
+        freeIR(&c->ir);
+    freeSymbols(&c->symTab);
+    freeArena(&c->nodes);
+    freeTokens(&c->tokens);
+    freeIntern(&c->names);
+    return c->diag.kind != DIAG_NONE;
+}
+
+static void program(compiler *c)
+{
+    block(c);
+    sourceAt(c, c->tokenNum - 1);       //The halt belongs to the period
+    consume(c, periodsym);
+    bark(c, 9, 0, 2);
+}
+
+static void block(compiler *c)
+{
+    int jump, start, save;
+
+    constDec(c);
+    varDec(c);
+    if (c->tok.idNum == procsym)
+    {
+        sourceAt(c, c->tokenNum - 1);
+        jump = barkHole(c, 7, 0);       //Jump over the procedures to our own code
+        procDec(c);
+        rebark(c, jump, c->commandPos);
+    }
+    start = c->tokenNum - 1;            //Setting up the frame belongs to the statement it's for
+    if (c->buildIR)
+    {
+        int frame;
+
+        initIR(&c->ir, &c->nodes, c->frameSize);
+        c->irOpen = 1;
+        statement(c);
+        save = stat(c, STAT_OPTIMIZE);
+        optimizeIR(&c->ir, c->buildIR);
+        sourceAt(c, start);
+        stat(c, STAT_EMIT);
+        frame = lowerIR(&c->ir, &c->code); //Barks the INC too, with room for the temporaries
+        stat(c, save);
+        c->commandPos = c->code.count;
+        if (frame > c->maxFrame)
+            c->maxFrame = frame;
+        if (c->stats != NULL)
+        {
+            c->stats->irInstructions += c->ir.count;
+            if ((long long)c->ir.capacity * sizeof(irInstr) > c->stats->bytes[MEM_IR])
+                c->stats->bytes[MEM_IR] = (long long)c->ir.capacity * sizeof(irInstr);
+        }
+        freeIR(&c->ir);
+        c->irOpen = 0;
+        resetArena(&c->nodes);
+    } else
+    {
+        sourceAt(c, start);
+        bark(c, 6, 0, c->frameSize);    //Set up our stack frame with room for all of our variables
+        statement(c);
+    }
+}
+
+static void constDec(compiler *c)
+{
+    if (c->tok.idNum == constsym)
+    {
+        consume(c, constsym);
+        ident(c, 1);
+        /* consume(c, eqlsym); // Ident will handle this
+        number(); */
+        while (c->tok.idNum == commasym)
+        {
+            consume(c, commasym);
+            ident(c, 1);
+        }
+        consume(c, semicolonsym);
+    }
+}
+
+static void varDec(compiler *c)
+{
+    if (c->tok.idNum == varsym)
+    {
+        consume(c, varsym);
+        ident(c, 2);
+        while (c->tok.idNum == commasym)
+        {
+            consume(c, commasym);
+            ident(c, 2);
+        }
+        consume(c, semicolonsym);
+    }
+    if (c->frameSize > c->maxFrame)
+        c->maxFrame = c->frameSize;
+}
+
+static void procDec(compiler *c)
+{
+    int loc, outerFrame, save;
+
+    while (c->tok.idNum == procsym)
+    {
+        consume(c, procsym);
+        loc = ident(c, 3);
+        consume(c, semicolonsym);
+        c->symTab.symbols[loc].addr = c->commandPos; //The procedure starts with the first thing its block barks
+        outerFrame = c->frameSize;
+        c->frameSize = 4;                   //Its variables go in its own frame, after the return value and the links
+        save = stat(c, STAT_SYMBOLS);
+        pushScope(&c->symTab);
+        stat(c, save);
+        block(c);
+        save = stat(c, STAT_SYMBOLS);
+        popScope(&c->symTab);
+        stat(c, save);
+        c->frameSize = outerFrame;
+        sourceAt(c, c->tokenNum - 1);       //The semicolon that ends it
+        bark(c, 2, 0, 0);                   //Return to whoever called it
+        consume(c, semicolonsym);
+    }
+}
+
+static void statement(compiler *c)
+{
+    int id, label, label2;
+    int save, save2, start = c->tokenNum - 1;
+    astNode *e;
+    symbol *sym;
+
+    sourceAt(c, start);
+    switch (c->tok.idNum)
+    {
+        case identsym : id = c->tok.name;       //<ident> := <expression> ** Store the name of the ident token for later
+                        consume(c, identsym);
+                        consume(c, becomessym);
+                        e = expression(c);
+                        if (c->buildIR)
+                        {
+                            sym = varIdent(c, id);
+                            irAdd(&c->ir, IR_STORE, c->symTab.depth - 1 - sym->level, sym->addr, 0, e);
+                            break;
+                        }
+                        barkExpr(c, e);
+                        storeIdent(c, id);      //Store the value at the top of the stack into the memory address for the identifier we started with.
+                        break;
+        case beginsym : consume(c, beginsym);   //begin <statement> {; <statement>} end
+                        statement(c);
+                        while (c->tok.idNum == semicolonsym)
+                        {
+                            consume(c, semicolonsym);
+                            statement(c);
+                        }
+                        consume(c, endsym);
+                        break;
+        case ifsym    : consume(c, ifsym);      //if <condition> then <statement>
+                        e = condition(c);
+                        if (c->buildIR)
+                        {
+                            label = irLabelNew(&c->ir);
+                            irAdd(&c->ir, IR_BRANCH, 0, 0, label, e);
+                            consume(c, thensym);
+                            statement(c);
+                            irAdd(&c->ir, IR_LABEL, 0, 0, label, NULL);
+                            break;
+                        }
+                        barkExpr(c, e);
+                        save = barkHole(c, 8, 0); //Bark out a jump if condition resolved to 0, saving its position so we can rebark it later
+                        consume(c, thensym);
+                        statement(c);
+                        rebark(c, save, c->commandPos); //Update the mod of our jump command to go to the next instruction after the body of the then.
+                        break;
+        case whilesym : consume(c, whilesym);   //while <condition> do <statement>
+                        save2 = c->commandPos;
+                        e = condition(c);
+                        if (c->buildIR)
+                        {
+                            label = irLabelNew(&c->ir);
+                            label2 = irLabelNew(&c->ir);
+                            irAdd(&c->ir, IR_LABEL, 0, 0, label, NULL);
+                            irAdd(&c->ir, IR_BRANCH, 0, 0, label2, e);
+                            consume(c, dosym);
+                            statement(c);
+                            sourceAt(c, start);     //Going round again is the while's
+                            irAdd(&c->ir, IR_JUMP, 0, 0, label, NULL);
+                            irAdd(&c->ir, IR_LABEL, 0, 0, label2, NULL);
+                            break;
+                        }
+                        barkExpr(c, e);
+                        save = barkHole(c, 8, 0); //Bark out a jump if condition resolved to 0, saving its position so we can rebark it later
+                        consume(c, dosym);
+                        statement(c);
+                        sourceAt(c, start);
+                        bark(c, 7, 0, save2);
+                        rebark(c, save, c->commandPos); //Update the mod of our jump command to go to the next instruction after the body of the loop.
+                        break;
+        case readsym  : consume(c, readsym);    //read <ident>
+                        if (c->buildIR)
+                        {
+                            sym = varIdent(c, c->tok.name);
+                            irAdd(&c->ir, IR_READ, c->symTab.depth - 1 - sym->level, sym->addr, 0, NULL);
+                            consume(c, identsym);
+                            break;
+                        }
+                        bark(c, 9, 0, 1);       //Bark out a read from user input command
+                        storeIdent(c, c->tok.name); //Store the value read in to the ident token we were given.
+                        consume(c, identsym);
+                        break;
+        case writesym : consume(c, writesym);   //write <ident>
+                        e = identNode(c, c->tok.name); //Retrieve the value of the ident token we were given
+                        if (c->buildIR)
+                            irAdd(&c->ir, IR_WRITE, 0, 0, 0, e);
+                        else
+                        {
+                            barkExpr(c, e);
+                            bark(c, 9, 0, 0);   //Bark the command to write out the value on the top of the stack to the screen
+                        }
+                        consume(c, identsym);
+                        break;
+        case callsym  : consume(c, callsym);    //call <ident>
+                        sym = procIdent(c, c->tok.name);
+                        if (c->buildIR)
+                            irAdd(&c->ir, IR_CALL, c->symTab.depth - 1 - sym->level, sym->addr, 0, NULL);
+                        else
+                            bark(c, 5, c->symTab.depth - 1 - sym->level, sym->addr);
+                        consume(c, identsym);
+                        break;
+        default       : break;
+    }
+}
+
+static astNode *condition(compiler *c)
+{
+    if (c->tok.idNum == oddsym)
+    {
+        consume(c, oddsym);
+        return expression(c);
+    } else
+    {
+        astNode *left = expression(c);
+        int op = c->tok.idNum;
+        switch(c->tok.idNum)
+        {
+            case eqlsym : consume(c, eqlsym);
+                          break;
+            case neqsym : consume(c, neqsym);
+                          break;
+            case lessym : consume(c, lessym);
+                          break;
+            case leqsym : consume(c, leqsym);
+                          break;
+            case gtrsym : consume(c, gtrsym);
+                          break;
+            case geqsym : consume(c, geqsym);
+                          break;
+            default     : consume(c, neqsym); // If it's not one of these we need an error of some kind.
+        }
+        return oprNode(&c->nodes, op - eqlsym + 8, left, expression(c)); //eqlsym to geqsym are in the same order as OPR 8 to 13
+    }
+}
+
+static astNode *expression(compiler *c)
+{
+    int isNeg=0;
+    astNode *e;
+    if (c->tok.idNum == plussym)
+    {
+        consume(c, plussym);
+    }
+    else if (c->tok.idNum == minussym)
+    {
+        consume(c, minussym);
+        isNeg = 1;
+    }
+    e = term(c);
+    if (isNeg)
+        e = oprNode(&c->nodes, 1, e, NULL);
+    while (c->tok.idNum == plussym || c->tok.idNum == minussym)
+    {
+        isNeg=0;
+        if (c->tok.idNum == plussym)
+            consume(c, plussym);
+        else
+        {
+            consume(c, minussym);
+            isNeg=1;
+        }
+        if (isNeg)
+            e = oprNode(&c->nodes, 3, e, term(c));
+        else
+            e = oprNode(&c->nodes, 2, e, term(c));
+    }
+    return e;
+}
+
+static astNode *term(compiler *c)
+{
+    int isMult;
+    astNode *e = factor(c);
+    while (c->tok.idNum == multsym || c->tok.idNum == slashsym)
+    {
+        isMult=0;
+        if (c->tok.idNum == multsym)
+        {
+            consume(c, multsym);
+            isMult=1;
+        }
+        else
+            consume(c, slashsym);
+        if (isMult)
+            e = oprNode(&c->nodes, 4, e, factor(c));
+        else
+            e = oprNode(&c->nodes, 5, e, factor(c));
+    }
+    return e;
+}
+
+static astNode *factor(compiler *c)
+{
+    astNode *e;
+    if (c->tok.idNum == identsym)
+    {
+        e = identNode(c, c->tok.name);
+        consume(c, identsym);
+    }else if (c->tok.idNum == numbersym)
+    {
+        e = numNode(&c->nodes, c->tok.value);
+        consume(c, numbersym);
+    } else
+    {
+        consume(c, lparentsym);
+        e = expression(c);
+        consume(c, rparentsym);
+    }
+    return e;
+}
+
+static void consume(compiler *c, int last)
+{
+    int next = ahead(c, 1);
+
+    if (c->tok.idNum == last)
+    {
+        if (peek(c, 1) == 0)    //This is where the lexer gave up
+            fail(c, DIAG_LEXER, 0, "%sLexer failed to parse token #%d\n", c->tokens.error, c->tokenNum+1);
+        c->tok.idNum = c->tokens.kind[next];
+        c->tok.value = c->tokens.value[next];
+        c->tok.name = c->tokens.name[next];
+        c->tok.ident = tokenText(&c->tokens, &c->names, next);
+    } else if (last < nulsym || last > elsesym)
+        fail(c, DIAG_INTERNAL, last, "Wrong token at token #%d\nWHAT? This shouldn't happen! Token expected was %s\n", c->tokenNum, symbolName[last]);
+    else if (last >= lessym && last <= periodsym)  //Nothing worth showing about these
+        fail(c, DIAG_SYNTAX, last, "Wrong token at token #%d\nExpected %s, but found %s instead.\n",
+             c->tokenNum, symbolName[last], symbolName[c->tok.idNum]);
+    else
+        fail(c, DIAG_SYNTAX, last, "Wrong token at token #%d\nExpected %s, but found %s: %s instead.\n",
+             c->tokenNum, symbolName[last], symbolName[c->tok.idNum], c->tok.ident);
+    c->tokenNum++;
+}
+
+static int ahead(compiler *c, int n)
+{
+    int at = c->tokenNum + n - 1;   //tokenNum already points one past the current token
+
+    return at < c->tokens.count ? at : c->tokens.count - 1;    //Past the end we keep seeing the end of file
+}
+
+static int peek(compiler *c, int n)
+{
+    return c->tokens.kind[ahead(c, n)];
+}
+
+static void bark(compiler *c, int op, int l, int m)
+{
+    int save = stat(c, STAT_EMIT);
+
+    emitCode(&c->code, op, l, m);
+    c->commandPos = c->code.count;
+    stat(c, save);
+}
+
+static int barkHole(compiler *c, int op, int l)
+{
+    int save = stat(c, STAT_EMIT);
+    int addr = emitCode(&c->code, op, l, 0);
+
+    holdCode(&c->code, addr);   //Binary output patches it in the file if it's written out before it is rebarked
+    c->commandPos = c->code.count;
+    stat(c, save);
+    return addr;
+}
+
+static void rebark(compiler *c, int addr, int m)
+{
+    int save = stat(c, STAT_EMIT);
+
+    patchCode(&c->code, addr, m);
+    stat(c, save);
+}
+
+static void optimizeBark(compiler *c)
+{
+    command *prog = malloc((c->code.count + 1) * sizeof(command));
+    int *from = c->lines != NULL ? malloc((c->code.count + 1) * sizeof(int)) : NULL;
+    int i, at, n = c->code.count;
+    lineMap before;
+
+    int peakChunks = c->code.peakChunks, patches = c->code.patches;
+
+    if (prog == NULL || (c->lines != NULL && from == NULL))
+    {
+        free(prog);
+        free(from);
+        fail(c, DIAG_INTERNAL, 0, "Out of memory for the optimizer\n");
+    }
+    for (i = 0; i < n; i++)
+        prog[i] = *codeAt(&c->code, i);
+    n = peephole(prog, n, c->optimize, from);
+    if (c->stats != NULL)
+    {
+        c->stats->barked = c->code.count;
+        c->stats->bytes[MEM_CODE] = (long long)(c->code.count + 1) * (sizeof(command) + (from != NULL ? sizeof(int) : 0));
+    }
+
+    freeCode(&c->code);         //Start over with the optimized program, this time straight to the file
+    initCode(&c->code, c->out, c->binary);
+    c->code.peakChunks = peakChunks;    //The stats are for the whole compile
+    c->code.patches = patches;
+    if (c->lines != NULL)       //Marked again as it's barked, each command where it was before
+    {
+        before = *c->lines;
+        c->lines->count = c->lines->capacity = 0;
+        c->lines->ranges = NULL;
+        before.source = NULL;
+        c->code.lines = c->lines;
+    }
+    for (i = 0; i < n; i++)
+    {
+        if (from != NULL && (at = lineAt(&before, from[i])) >= 0)
+        {
+            c->code.line = before.ranges[at].line;
+            c->code.column = before.ranges[at].column;
+        }
+        emitCode(&c->code, prog[i].op, prog[i].lex, prog[i].mod);
+    }
+    if (c->lines != NULL)
+        freeLineMap(&before);
+    c->commandPos = c->code.count;
+    free(prog);
+    free(from);
+}
+
+static int stat(compiler *c, int bucket)
+{
+    return c->stats != NULL ? switchStat(c->stats, bucket) : -1;
+}
+
+static void countMemory(compiler *c)
+{
+    compileStats *s = c->stats;
+    arenaBlock *block;
+
+    if (s == NULL)
+        return;
+    s->tokens = c->tokens.count;
+    s->instructions = c->code.count;
+    if (!c->optimize)
+        s->barked = c->code.count;
+    s->backpatches = c->code.patches;
+    s->bytes[MEM_TOKENS] = (long long)c->tokens.capacity * (2 + 3 * sizeof(int)) + (long long)c->tokens.lines * sizeof(int);
+    s->bytes[MEM_NAMES] = (long long)c->names.capacity * (sizeof(int) + sizeof(unsigned)) + (long long)(c->names.slotMask + 1) * sizeof(int) + c->names.textCap;
+    s->bytes[MEM_SYMBOLS] = (long long)c->symTab.capacity * sizeof(symbol) + (long long)(c->symTab.bindingCap + c->symTab.scopeCap) * sizeof(int);
+    for (block = c->nodes.first; block != NULL; block = block->next)
+        s->bytes[MEM_NODES] += sizeof(arenaBlock) + block->size;
+    s->bytes[MEM_CODE] += (long long)c->code.peakChunks * sizeof(codeChunk) + (long long)c->code.heldCap * (sizeof(int) + sizeof(long));
+}
+
+static void sourceAt(compiler *c, int index)
+{
+    if (c->lines == NULL || index < 0 || index >= c->tokens.count)
+        return;
+    tokenPlace(&c->tokens, index, &c->code.line, &c->code.column);
+    c->ir.line = c->code.line;
+    c->ir.column = c->code.column;
+}
+
+static int ident(compiler *c, int kind)
+{
+    int loc, save;
+    symbol *sym;
+
+    if (c->tok.idNum != identsym)                       //Nothing to declare, let consume complain about it
+        consume(c, identsym);
+    save = stat(c, STAT_SYMBOLS);
+    loc = addSymbol(&c->symTab, c->tok.name, kind);
+    stat(c, save);
+    if (c->stats != NULL)
+        c->stats->symbols++;
+    if (loc == -1)                                      //If there's already an identifier in this scope with that name
+        fail(c, DIAG_SEMANTIC, 0, "Error, duplicate identifier\n");    //Can't have two identifiers in the list at the same level with the same name
+    sym = &c->symTab.symbols[loc];
+    if (kind == 1)                                      //If our ident is a constant
+    {
+        consume(c, identsym);                           //Next symbol
+        consume(c, eqlsym);                             //Next symbol
+        sym->val = c->tok.value;                        //Save the value of the constant into the table
+        consume(c, numbersym);                          //Next symbol
+    }else if (kind == 2)                                //If our ident is a variable
+    {
+        sym->addr = c->frameSize;                       //Save the memory position of the variable into the table
+        c->frameSize++;                                 //Increase the frame size
+        consume(c, identsym);                           //Next symbol
+    }else                                               //It's a procedure, procDec fills in where it starts
+    {
+        consume(c, identsym);                           //Next symbol
+    }
+    return loc;
+}
+
+static int findName(compiler *c, int name)
+{
+    int save, loc;
+
+    if (c->stats == NULL)
+        return findSymbol(&c->symTab, name);
+    save = stat(c, STAT_SYMBOLS);
+    loc = findSymbol(&c->symTab, name);
+    stat(c, save);
+    c->stats->lookups++;
+    return loc;
+}
+
+static astNode *identNode(compiler *c, int name)
+{
+    int loc = findName(c, name);            //Look the identifier up in the table
+    symbol *sym;
+
+    if (loc == -1)
+        fail(c, DIAG_SEMANTIC, 0, "Identifier not declared in symbol table\n");
+    sym = &c->symTab.symbols[loc];
+    if (sym->kind == 1)                                 //If it's a constant
+    {
+        return numNode(&c->nodes, sym->val);            //Put the value on the stack
+    }else if (sym->kind == 3)                           //A procedure has no value
+    {
+        fail(c, DIAG_SEMANTIC, 0, "Expression must not contain a procedure identifier\n");
+    }else                                               //Otherwise it's a variable
+    {
+        return varNode(&c->nodes, c->symTab.depth - 1 - sym->level, sym->addr); //Load it's value from memory, and put it on the top of the stack
+    }
+}
+
+static symbol *varIdent(compiler *c, int name)
+{
+    int loc = findName(c, name);
+    symbol *sym;
+
+    if (loc == -1)
+        fail(c, DIAG_SEMANTIC, 0, "Identifier not declared in symbol table\n");
+    sym = &c->symTab.symbols[loc];
+    if (sym->kind == 1)                                 //If it's a constant
+        fail(c, DIAG_SEMANTIC, 0, "Cannot change the value of a constant\n");   //Can't change a constant
+    if (sym->kind == 3)                                 //Or a procedure
+        fail(c, DIAG_SEMANTIC, 0, "Cannot assign to a procedure\n");
+    return sym;                                         //Otherwise it's a variable and we can store it
+}
+
+static symbol *procIdent(compiler *c, int name)
+{
+    int loc = findName(c, name);
+    symbol *sym;
+
+    if (loc == -1)
+        fail(c, DIAG_SEMANTIC, 0, "Identifier not declared in symbol table\n");
+    sym = &c->symTab.symbols[loc];
+    if (sym->kind != 3)                                 //Only procedures can be called
+        fail(c, DIAG_SEMANTIC, 0, "Call of a constant or variable is meaningless\n");
+    return sym;
+}
+
+static void storeIdent(compiler *c, int name)
+{
+    symbol *sym = varIdent(c, name);
+
+    bark(c, 4, c->symTab.depth - 1 - sym->level, sym->addr);
+}
+
+static void barkExpr(compiler *c, astNode *e)
+{
+    int save = stat(c, STAT_EMIT);
+
+    emitExpr(&c->code, e);
+    c->commandPos = c->code.count;
+    resetArena(&c->nodes);
+    stat(c, save);
+}
+
+static void fail(compiler *c, int kind, int expected, const char *format, ...)
+{
+    va_list args;
+    int at = c->tokenNum > 0 ? c->tokenNum - 1 : 0;   //The current token, the one consume() already moved past
+
+    c->diag.kind = kind;
+    c->diag.token = c->tokenNum;
+    c->diag.offset = at < c->tokens.count ? c->tokens.offset[at] : -1;
+    c->diag.expected = kind == DIAG_SYNTAX ? expected : 0;
+    c->diag.found = kind == DIAG_SYNTAX ? c->tok.idNum : 0;
+    va_start(args, format);
+    vsnprintf(c->diag.message, DIAG_SIZE, format, args);
+    va_end(args);
+    longjmp(c->fail, 1);
+}
+
+static void outOfMemoryHere(void *c, const char *message)
+{
+    fail(c, DIAG_INTERNAL, 0, "%s", message);
+}
@@ -0,0 +1,103 @@
+#ifndef COMPILER_H_INCLUDED
+#define COMPILER_H_INCLUDED
+
+#include <stdio.h>
+#include <setjmp.h>
+#include "tokens.h"
+#include "symtab.h"
+#include "codebuf.h"
+#include "arena.h"
+#include "ir.h"
+#include "perf.h"
+#include "stats.h"
+
+#define COMPILER_VERSION "1" // Change it when the same program would compile to different code, see cache.h
+#define DIAG_SIZE 256       // Room for the longest message, the lexer's included
+
+// What a diagnostic is about
+#define DIAG_NONE 0
+#define DIAG_LEXER 1        // Something in the source that isn't a token
+#define DIAG_SYNTAX 2       // A token the grammar doesn't allow there
+#define DIAG_SEMANTIC 3     // Undeclared or duplicate identifiers, storing into a constant and the like
+#define DIAG_INTERNAL 4     // Out of memory, or a bug in the compiler
+
+typedef struct diagnostic
+{
+    int kind;                   // DIAG_ constant, DIAG_NONE if nothing went wrong
+    int token;                  // Number of the token it was found at
+    int offset;                 // Where that token starts in the source, -1 if there isn't one
+    int expected;               // For DIAG_SYNTAX the token type the parser wanted, 0 otherwise
+    int found;                  // and the one it got
+    char message[DIAG_SIZE];    // What the command line compiler prints for it, one or more whole lines
+} diagnostic;
+
+typedef struct token
+{
+    int idNum;
+    const char *ident;  // Spelling of the token, points into the name table so it never needs copying
+    int name;           // Interned id of an identifier, -1 for anything else
+    int value;
+} token;
+
+/**
+ *  One compilation. Everything the parser used to keep in globals is in here, so
+ *  any number of them can run at once, one per thread. Nothing in it ever exits
+ *  or prints: the first error stops the compilation and is handed back in diag,
+ *  running out of memory included (DIAG_INTERNAL, see nomem.h).
+ *
+ *  The program ends up in code. If out is set, finished code is written there as
+ *  it is barked (see codebuf.h) and whatever is left is flushed at the end, so only
+ *  the count stays meaningful. The binary header is the caller's business, maxFrame
+ *  is what goes in it.
+ *
+ *  perf is NULL unless the caller sets it after initCompiler, then every phase of the
+ *  compilation is counted in it (see perf.h). Likewise lines, then every command is
+ *  marked in it with the line and column of the statement it was barked for (see
+ *  linemap.h). It isn't cleared first. And stats, which compileSource starts over and
+ *  fills in with where the time and memory went (see stats.h).
+ */
+typedef struct compiler
+{
+    int optimize;       // PEEP_ flags, the peephole pass runs over the whole program (see peephole.h)
+    int buildIR;        // IR_ flags, each block's statement goes through the IR (see ir.h)
+    FILE *out;
+    int binary;         // out gets pm0Instr records instead of text, see pm0.h
+    perfSet *perf;
+    lineMap *lines;
+    compileStats *stats;
+
+    codeBuffer code;
+    int maxFrame;       // Biggest stack frame the program sets up
+    int tokenCount;     // Tokens in the source, end of file included
+    diagnostic diag;
+
+    /**
+     *  Only used while compileSource runs
+     *  symTab keeps track of what ident is where, scoped by lexical level
+     *  nodes holds the expression trees, they are thrown away once barked
+     *  ir is the statement of the block being compiled, when buildIR is on. irOpen is set while it holds anything
+     *  frameSize determines where new variables will be stored in the stack as well as the size of the stack
+     *  commandPos is the current position for the end of the program code
+     *  tokenNum is the token number of the current token, also the index of the next one in tokens
+     *  tok is the current token being parsed
+     *  names holds the spelling of every identifier and number, tokens refer to them by id
+     *  fail is where an error jumps back to
+     */
+    symbolTable symTab;
+    arena nodes;
+    irBlock ir;
+    int irOpen;
+    int frameSize;
+    int commandPos;
+    int tokenNum;
+    token tok;
+    tokenStream tokens;
+    internTable names;
+    jmp_buf fail;
+} compiler;
+
+void initCompiler(compiler *c, int optimize, int buildIR, FILE *out, int binary);
+int compileSource(compiler *c, const char *text, size_t size);  // Returns 0 if it compiled, 1 with the reason in c->diag if not
+void freeCompiler(compiler *c);
+
+#endif // COMPILER_H_INCLUDED
@@ -0,0 +1,559 @@
+/**
+ *  Body of the fast engine, included by fastvm.c once for every flavour of it.
+ *
+ *  The includer defines ENGINE (the function name) and ENGINE_ARGS (its parameters,
+ *  which start with the fastProgram p and the vmInstance vm to run it on), and
+ *  RECORDING if every instruction should also be written to a traceRecorder rec
+ *  (see trace.h). Without RECORDING all the REC() parts compile to nothing, so the
+ *  plain engine pays nothing for them.
+ *
+ *  PROFILING counts how often every instruction ran in a vmProfile prof (see
+ *  profile.h), the same way steps is counted: where each straight run starts and
+ *  ends, at the control transfers only, plus how often each JPC jumped. It is the
+ *  plain engine otherwise, superinstructions and display included, and takes keep
+ *  the same way.
+ *
+ *  The plain engine also takes keep. The handler addresses only exist inside the
+ *  function, so loadFast calls it with keep set to have p's code decoded into
+ *  *keep instead of run, and every run after that uses p->decoded. A recording
+ *  decodes the code itself every time.
+ *
+ *  The plain engine also fuses the sequences the compiler barks most (loads feeding
+ *  an operator, an operator feeding a store or a JPC) into superinstructions when
+ *  flags has FAST_FUSE. Only the handler of the first instruction changes, the ones
+ *  after it are still there for anything that jumps into the middle. A recording
+ *  can't use them, the trace needs an event for every instruction.
+ *
+ *  With FAST_DISPLAY it keeps display[k], the bp of the frame at lexical level k
+ *  the static links lead to, so a LOD or STO l > 0 is one lookup instead of l. CAL
+ *  and RET keep it up to date, and anything that could make it disagree with the
+ *  static links on the stack (a store over a frame's links, a RET that doesn't go
+ *  back where the CAL came from) switches it off for the rest of the run. It lives
+ *  in vm->display, which a CAL doubles (growDisplay) when there's no room for one
+ *  more call, so it's only as big as the deepest run on the instance needed.
+ *
+ *  Nothing compares sp with height, the guard above the stack catches a push past
+ *  it (see vmstack.h). Everything that can push says which instruction it is in
+ *  stackPc first (AT), for the message. Only an INC of more than the guard covers
+ *  (inc_far) still checks.
+ */
+#ifdef RECORDING
+#define REC(...) __VA_ARGS__
+#define NEXT do { if (tp > rec->limit) { rec->at = tp; flushTrace(rec); tp = rec->at; } ir = ip++; goto *ir->run; } while (0)
+#else
+#define REC(...)
+#define NEXT do { ir = ip++; goto *ir->run; } while (0)
+#endif
+#ifdef PROFILING
+#define PROF(...) __VA_ARGS__
+#else
+#define PROF(...)
+#endif
+#define USE_DISPLAY(d) (frames = (d)->frames, display = (d)->level, displayAt = display + (d)->size, room = (d)->size)
+#define AT(k) (stackPc = (int)(ir - prog) + (k))
+#define SPAN(end) PROF(runs[seg - prog]++; runs[(end) - prog]--;)     // seg up to end - 1 ran once more
+#define EVENT(flags) (*tp++ = (unsigned char)(ir->op | (flags)))
+#define NUM(v) TRACE_NUM(tp, v)
+#define INT(v) TRACE_NUM(tp, TRACE_ZIGZAG(v))
+
+int ENGINE(ENGINE_ARGS)
+{
+    static const void *ops[10] = {&&nop, &&lit, &&opr, &&lod, &&sto, &&cal, &&inc, &&jmp, &&jpc, &&sio};
+    static const void *oprs[14] = {&&ret, &&neg, &&add, &&sub, &&mul, &&dvd, &&odd, &&mod,
+                                   &&eql, &&neq, &&lss, &&leq, &&gtr, &&geq};
+    static const void *sios[3] = {&&out, &&inp, &&hlt};
+    const pm0Instr *code = p->code;
+    fastInstr *prog, *ip, *ir;
+    int count = p->count;
+    int *stack, height, pc, bp, sp;
+    sioReader *in;
+    sioWriter *out;
+    fastInstr *seg;                     // First instruction of the straight run we're in
+    long long steps = 0;                // Instructions in the runs before it
+    int i, op, m, b, l;
+    REC(unsigned char *tp = rec->at;)
+    PROF(long long *runs = prof != NULL ? prof->runs : NULL, *taken = prof != NULL ? prof->taken : NULL;)
+#ifndef RECORDING
+    // Superinstructions by the OPR they end in (or go through), NULL where there isn't one
+    static const void *llOps[14] = {NULL, NULL, &&ll_add, &&ll_sub, &&ll_mul, &&ll_dvd, NULL, &&ll_mod,
+                                    &&ll_eql, &&ll_neq, &&ll_lss, &&ll_leq, &&ll_gtr, &&ll_geq};
+    static const void *lcOps[14] = {NULL, NULL, &&lc_add, &&lc_sub, &&lc_mul, &&lc_dvd, NULL, &&lc_mod,
+                                    &&lc_eql, &&lc_neq, &&lc_lss, &&lc_leq, &&lc_gtr, &&lc_geq};
+    static const void *llStos[14] = {NULL, NULL, &&lls_add, &&lls_sub, &&lls_mul, &&lls_dvd, NULL, &&lls_mod,
+                                     &&lls_eql, &&lls_neq, &&lls_lss, &&lls_leq, &&lls_gtr, &&lls_geq};
+    static const void *lcStos[14] = {NULL, NULL, &&lcs_add, &&lcs_sub, &&lcs_mul, &&lcs_dvd, NULL, &&lcs_mod,
+                                     &&lcs_eql, &&lcs_neq, &&lcs_lss, &&lcs_leq, &&lcs_gtr, &&lcs_geq};
+    static const void *stos[14] = {NULL, NULL, &&add_sto, &&sub_sto, &&mul_sto, &&dvd_sto, NULL, &&mod_sto,
+                                   &&eql_sto, &&neq_sto, &&lss_sto, &&leq_sto, &&gtr_sto, &&geq_sto};
+    static const void *jpcs[14] = {NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+                                   &&eql_jpc, &&neq_jpc, &&lss_jpc, &&leq_jpc, &&gtr_jpc, &&geq_jpc};
+    static const void *llJpcs[14] = {NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+                                     &&ll_eql_jpc, &&ll_neq_jpc, &&ll_lss_jpc, &&ll_leq_jpc, &&ll_gtr_jpc, &&ll_geq_jpc};
+    static const void *lcJpcs[14] = {NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+                                     &&lc_eql_jpc, &&lc_neq_jpc, &&lc_lss_jpc, &&lc_leq_jpc, &&lc_gtr_jpc, &&lc_geq_jpc};
+    const pm0Instr *c;
+    const void *fused;
+    int x, y, loads;
+    displayFrame *frames = NULL, *f;
+    int *display = NULL, *displayAt = NULL;    // displayAt[k] is the frames[] index of display[k], -1 for main's
+    int disp = 0, lev = 0, calls = 0, room = 0;
+    int flags = p->flags;
+#endif
+
+#ifndef RECORDING
+    if (keep == NULL)
+        prog = p->decoded;
+    else
+#endif
+    {
+        prog = malloc((count + 1) * sizeof(fastInstr));
+        if (prog == NULL)
+        {
+            printf("Out of memory for the program code\n");
+            return 1;
+        }
+        for (i = 0; i < count; i++)
+        {
+            op = code[i].op;
+            m = code[i].m;
+            prog[i].op = op < 16 ? op : 0;
+            prog[i].l = code[i].l;
+            prog[i].m = m;
+            if (op == 2)
+                prog[i].run = m >= 0 && m < 14 ? oprs[m] : &&nop;
+            else if (op == 9)
+                prog[i].run = m >= 0 && m < 3 ? sios[m] : &&nop;
+            else
+                prog[i].run = op < 10 ? ops[op] : &&nop;
+            if ((op == 5 || op == 7 || op == 8) && (m < 0 || m > count))
+                prog[i].m = count;
+            if (op == 6 && (m < 0 || m > STACK_REACH))
+                prog[i].run = &&inc_far;
+#ifndef RECORDING
+            if ((op == 3 || op == 4) && code[i].l > 0)
+                prog[i].run = op == 3 ? &&lod_up : &&sto_up;
+#endif
+        }
+        prog[count].run = &&hlt;    // Running off the end halts, like the tracing VM
+        prog[count].op = prog[count].l = 0;
+        prog[count].m = 0;
+
+#ifndef RECORDING
+#define LOCAL(k, o) (c[k].op == (o) && c[k].l == 0)
+#define OPR(k) (c[k].op == 2 && c[k].m >= 0 && c[k].m < 14)
+        for (i = 0; (flags & FAST_FUSE) && i < count; i++)
+        {
+            c = code + i;
+            fused = NULL;
+            if (i + 2 < count && LOCAL(0, 3) && (LOCAL(1, 3) || c[1].op == 1) && OPR(2))
+            {
+                loads = c[1].op == 3;       // LOD x; LOD y or LOD x; LIT c
+                if (i + 3 < count && c[3].op == 8)
+                    fused = (loads ? llJpcs : lcJpcs)[c[2].m];
+                else if (i + 3 < count && LOCAL(3, 4))
+                    fused = (loads ? llStos : lcStos)[c[2].m];
+                if (fused == NULL)
+                    fused = (loads ? llOps : lcOps)[c[2].m];
+            }
+            else if (i + 1 < count && OPR(0) && c[1].op == 8)
+                fused = jpcs[c[0].m];
+            else if (i + 1 < count && OPR(0) && LOCAL(1, 4))
+                fused = stos[c[0].m];
+            else if (i + 1 < count && c[0].op == 1 && LOCAL(1, 4))
+                fused = &&lit_sto;
+            else if (i + 1 < count && LOCAL(0, 3) && LOCAL(1, 4))
+                fused = &&lod_sto;
+            if (fused != NULL)
+                prog[i].run = fused;
+        }
+#undef LOCAL
+#undef OPR
+        *keep = prog;
+        return 0;
+#endif
+    }
+
+    stack = vm->stack;
+    height = vm->height;
+    pc = vm->pc;
+    bp = vm->bp;
+    sp = vm->sp;
+    in = vm->in;
+    out = vm->out;
+
+#ifndef RECORDING
+    // Only from the start, the frames a resume begins in aren't known. loadFast checked the code
+    if ((flags & FAST_DISPLAY) && pc == 0 && bp == 1 && sp == 0)
+    {
+        disp = vm->display != NULL || growDisplay(vm) == 0;
+        if (disp)
+        {
+            USE_DISPLAY(vm->display);
+            display[0] = 1;
+            displayAt[0] = -1;
+        }
+    }
+#endif
+
+    ip = seg = prog + (pc >= 0 && pc <= count ? pc : count);
+    ir = ip++;
+    goto *ir->run;
+
+nop:
+opr:
+sio:
+    REC(EVENT(0);)
+    NEXT;
+lit:
+    AT(0);
+    stack[++sp] = ir->m;
+    REC(EVENT(TRACE_SP | TRACE_WRITE); INT(1); NUM(sp); INT(ir->m);)
+    NEXT;
+lod:
+    AT(0);
+    for (b = bp, l = ir->l; l > 0; l--)
+        b = stack[b + 1];
+    stack[++sp] = stack[b + ir->m];
+    REC(EVENT(TRACE_SP | TRACE_WRITE); INT(1); NUM(sp); INT(stack[sp]);)
+    NEXT;
+sto:
+    for (b = bp, l = ir->l; l > 0; l--)
+        b = stack[b + 1];
+    stack[b + ir->m] = stack[sp--];
+    REC(EVENT(TRACE_SP | TRACE_WRITE); INT(-1); NUM(b + ir->m); INT(stack[b + ir->m]);)
+    NEXT;
+cal:
+    AT(0);
+    if (STACK_REACH < 4 && sp + 4 > height)
+        goto overflow;
+#ifndef RECORDING
+    if (disp && calls + 1 >= room)      // The callee's level and frame go at calls + 1 at most
+    {
+        disp = growDisplay(vm) == 0;
+        if (disp)
+            USE_DISPLAY(vm->display);
+    }
+    if (disp)
+    {
+        if (ir->l > lev)
+            disp = 0;
+        else
+        {
+            b = display[lev - ir->l];
+            f = frames + calls++;
+            f->bp = sp + 1;
+            f->pc = (int)(ip - prog);
+            f->level = lev;
+            lev = lev - ir->l + 1;
+            f->saved = display[lev];
+            f->savedAt = displayAt[lev];
+            display[lev] = sp + 1;
+            displayAt[lev] = calls - 1;
+            goto called;
+        }
+    }
+#endif
+    for (b = bp, l = ir->l; l > 0; l--)
+        b = stack[b + 1];
+#ifndef RECORDING
+called:
+#endif
+    stack[sp + 1] = 0;                  // return value
+    stack[sp + 2] = b;                  // static link
+    stack[sp + 3] = bp;                 // dynamic link
+    stack[sp + 4] = (int)(ip - prog);   // return address
+    bp = sp + 1;
+    SPAN(ir + 1)
+    steps += ir - seg + 1;
+    ip = seg = prog + ir->m;
+    REC(EVENT(TRACE_JUMP | TRACE_BP | TRACE_WRITE); NUM(ir->m); NUM(bp);
+        for (i = 1; i <= 4; i++) { NUM(sp + i); INT(stack[sp + i]); })
+    NEXT;
+inc:
+    AT(0);
+    sp += ir->m;
+    (void)*(volatile int *)&stack[sp];  // Faults now if it's past the top, not after another INC
+    REC(EVENT(TRACE_SP); INT(ir->m);)
+    NEXT;
+inc_far:
+    if (sp + ir->m > height)
+        goto overflow;
+    sp += ir->m;
+    REC(EVENT(TRACE_SP); INT(ir->m);)
+    NEXT;
+jmp:
+    SPAN(ir + 1)
+    steps += ir - seg + 1;
+    ip = seg = prog + ir->m;
+    REC(EVENT(TRACE_JUMP); NUM(ir->m);)
+    NEXT;
+jpc:
+    SPAN(ir + 1)
+    steps += ir - seg + 1;
+    if (stack[sp--] == 0)
+    {
+        ip = prog + ir->m;
+        PROF(taken[ir - prog]++;)
+        REC(EVENT(TRACE_JUMP | TRACE_SP); NUM(ir->m); INT(-1);)
+    }
+    REC(else { EVENT(TRACE_SP); INT(-1); })
+    seg = ip;
+    NEXT;
+ret:
+    REC(b = sp;)
+    sp = bp - 1;
+    m = stack[sp + 4];
+    bp = stack[sp + 3];
+    SPAN(ir + 1)
+    steps += ir - seg + 1;
+    ip = seg = prog + (m >= 0 && m <= count ? m : count);
+    REC(EVENT(TRACE_JUMP | TRACE_SP | TRACE_BP); NUM(ip - prog); INT(sp - b); NUM(bp);)
+#ifndef RECORDING
+    if (disp)
+    {
+        if (calls == 0)
+            disp = 0;
+        else
+        {
+            f = frames + --calls;
+            display[lev] = f->saved;
+            displayAt[lev] = f->savedAt;
+            if (f->bp != sp + 1 || f->pc != m || bp != display[f->level])
+                disp = 0;               // Not back to the CAL, the links were changed
+            lev = f->level;
+        }
+    }
+#endif
+    NEXT;
+neg:
+    stack[sp] = -stack[sp];
+    REC(EVENT(TRACE_WRITE); NUM(sp); INT(stack[sp]);)
+    NEXT;
+odd:
+    stack[sp] = stack[sp] & 1;
+    REC(EVENT(TRACE_WRITE); NUM(sp); INT(stack[sp]);)
+    NEXT;
+
+// The binary operators all pop one and overwrite the new top
+#define BINARY(expr) \
+    sp--; \
+    stack[sp] = expr; \
+    REC(EVENT(TRACE_SP | TRACE_WRITE); INT(-1); NUM(sp); INT(stack[sp]);) \
+    NEXT;
+add:
+    BINARY(stack[sp] + stack[sp + 1])
+sub:
+    BINARY(stack[sp] - stack[sp + 1])
+mul:
+    BINARY(stack[sp] * stack[sp + 1])
+dvd:
+    BINARY(stack[sp] / stack[sp + 1])
+mod:
+    BINARY(stack[sp] % stack[sp + 1])
+eql:
+    BINARY(stack[sp] == stack[sp + 1])
+neq:
+    BINARY(stack[sp] != stack[sp + 1])
+lss:
+    BINARY(stack[sp] < stack[sp + 1])
+leq:
+    BINARY(stack[sp] <= stack[sp + 1])
+gtr:
+    BINARY(stack[sp] > stack[sp + 1])
+geq:
+    BINARY(stack[sp] >= stack[sp + 1])
+#undef BINARY
+
+#ifndef RECORDING
+/*
+    The superinstructions leave everything exactly as the instructions they stand
+    for would, the values they pushed and popped above sp included: an INC later on
+    can make those part of a frame again. x and y are the operands of the OPR. x is
+    pushed before y is loaded, as the second LOD can be of the very slot x went to,
+    and pushed at all so a push past the top is caught at the same instruction.
+*/
+#define FUSED(name, expr) \
+ll_##name:      /* LOD 0 a; LOD 0 b; OPR */ \
+    AT(0); \
+    x = stack[sp + 1] = stack[bp + ir->m]; \
+    AT(1); \
+    y = stack[sp + 2] = stack[bp + ir[1].m]; \
+    stack[++sp] = expr; \
+    ip += 2; \
+    NEXT; \
+lc_##name:      /* LOD 0 a; LIT c; OPR */ \
+    AT(0); \
+    x = stack[sp + 1] = stack[bp + ir->m]; \
+    AT(1); \
+    y = stack[sp + 2] = ir[1].m; \
+    stack[++sp] = expr; \
+    ip += 2; \
+    NEXT; \
+lls_##name:     /* LOD 0 a; LOD 0 b; OPR; STO 0 d */ \
+    AT(0); \
+    x = stack[sp + 1] = stack[bp + ir->m]; \
+    AT(1); \
+    y = stack[sp + 2] = stack[bp + ir[1].m]; \
+    stack[sp + 1] = expr; \
+    stack[bp + ir[3].m] = stack[sp + 1]; \
+    ip += 3; \
+    NEXT; \
+lcs_##name:     /* LOD 0 a; LIT c; OPR; STO 0 d */ \
+    AT(0); \
+    x = stack[sp + 1] = stack[bp + ir->m]; \
+    AT(1); \
+    y = stack[sp + 2] = ir[1].m; \
+    stack[sp + 1] = expr; \
+    stack[bp + ir[3].m] = stack[sp + 1]; \
+    ip += 3; \
+    NEXT; \
+name##_sto:     /* OPR; STO 0 d */ \
+    x = stack[sp - 1]; \
+    y = stack[sp]; \
+    sp -= 2; \
+    stack[sp + 1] = expr; \
+    stack[bp + ir[1].m] = stack[sp + 1]; \
+    ip++; \
+    NEXT;
+FUSED(add, x + y)
+FUSED(sub, x - y)
+FUSED(mul, x * y)
+FUSED(dvd, x / y)
+FUSED(mod, x % y)
+FUSED(eql, x == y)
+FUSED(neq, x != y)
+FUSED(lss, x < y)
+FUSED(leq, x <= y)
+FUSED(gtr, x > y)
+FUSED(geq, x >= y)
+#undef FUSED
+
+// Compare and branch, the JPC pops the result right away
+#define FUSED(name, expr) \
+name##_jpc:     /* OPR; JPC t */ \
+    x = stack[sp - 1]; \
+    y = stack[sp]; \
+    sp -= 2; \
+    stack[sp + 1] = expr; \
+    SPAN(ir + 2) \
+    PROF(taken[ir - prog + 1] += stack[sp + 1] == 0;) \
+    steps += ir - seg + 2; \
+    ip = seg = stack[sp + 1] == 0 ? prog + ir[1].m : ip + 1; \
+    NEXT; \
+ll_##name##_jpc:    /* LOD 0 a; LOD 0 b; OPR; JPC t */ \
+    AT(0); \
+    x = stack[sp + 1] = stack[bp + ir->m]; \
+    AT(1); \
+    y = stack[sp + 2] = stack[bp + ir[1].m]; \
+    stack[sp + 1] = expr; \
+    SPAN(ir + 4) \
+    PROF(taken[ir - prog + 3] += stack[sp + 1] == 0;) \
+    steps += ir - seg + 4; \
+    ip = seg = stack[sp + 1] == 0 ? prog + ir[3].m : ip + 3; \
+    NEXT; \
+lc_##name##_jpc:    /* LOD 0 a; LIT c; OPR; JPC t */ \
+    AT(0); \
+    x = stack[sp + 1] = stack[bp + ir->m]; \
+    AT(1); \
+    y = stack[sp + 2] = ir[1].m; \
+    stack[sp + 1] = expr; \
+    SPAN(ir + 4) \
+    PROF(taken[ir - prog + 3] += stack[sp + 1] == 0;) \
+    steps += ir - seg + 4; \
+    ip = seg = stack[sp + 1] == 0 ? prog + ir[3].m : ip + 3; \
+    NEXT;
+FUSED(eql, x == y)
+FUSED(neq, x != y)
+FUSED(lss, x < y)
+FUSED(leq, x <= y)
+FUSED(gtr, x > y)
+FUSED(geq, x >= y)
+#undef FUSED
+
+lit_sto:        // LIT c; STO 0 d
+    AT(0);
+    stack[sp + 1] = ir->m;
+    stack[bp + ir[1].m] = ir->m;
+    ip++;
+    NEXT;
+lod_sto:        // LOD 0 a; STO 0 d
+    AT(0);
+    stack[sp + 1] = stack[bp + ir->m];
+    stack[bp + ir[1].m] = stack[sp + 1];
+    ip++;
+    NEXT;
+
+// LOD and STO with l > 0, through the display while there is one
+lod_up:
+    if (!disp || ir->l > lev)
+        goto lod;
+    AT(0);
+    stack[++sp] = stack[display[lev - ir->l] + ir->m];
+    NEXT;
+sto_up:
+    if (!disp)
+        goto sto;
+    if (ir->l > lev)
+    {
+        disp = 0;
+        goto sto;
+    }
+    b = display[lev - ir->l] + ir->m;
+    if (ir->m < 2 || b > frames[displayAt[lev - ir->l] + 1].bp)
+    {
+        disp = 0;                       // Over some frame's links, or into the frames above
+        goto sto;
+    }
+    stack[b] = stack[sp--];
+    NEXT;
+#endif
+
+out:
+    writeNumber(out, stack[sp--]);
+    REC(EVENT(TRACE_SP); INT(-1);)
+    NEXT;
+inp:
+    AT(0);
+    readNumber(in, &stack[++sp]);
+    REC(EVENT(TRACE_SP | TRACE_WRITE); INT(1); NUM(sp); INT(stack[sp]);)
+    NEXT;
+hlt:
+    SPAN(ir + (ir - prog < count))
+    steps += ir - seg + (ir - prog < count);    // Running off the end isn't an instruction
+    REC(if (ir - prog < count) EVENT(0);
+        rec->at = tp;)
+    i = 0;
+    goto stop;
+
+overflow:
+    flushWriter(out);
+    fprintf(out->file, "Stack overflow at %d\n", (int)(ir - prog));
+    SPAN(ir + 1)
+    steps += ir - seg + 1;
+    REC(rec->at = tp;)
+    i = 1;
+stop:
+    flushWriter(out);
+    vm->pc = (int)(ir - prog);
+    vm->bp = bp;
+    vm->sp = sp;
+    vm->steps += steps;
+#ifdef RECORDING
+    free(prog);
+#endif
+    return i;
+}
+
+#undef REC
+#undef PROF
+#undef SPAN
+#undef AT
+#undef USE_DISPLAY
+#undef NEXT
+#undef EVENT
+#undef NUM
+#undef INT
+#undef ENGINE
+#undef ENGINE_ARGS
+#undef RECORDING
+#undef PROFILING
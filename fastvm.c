@@ -0,0 +1,304 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "fastvm.h"
+#include "vmstack.h"
+
+#define DISPLAY_START 64    // Calls a display has room for to begin with
+
+typedef struct fastInstr
+{
+    const void *run;    // Handler for this instruction
+    unsigned char op;   // Only needed for recording
+    unsigned char l;
+    int m;              // Jump targets are checked when decoding, anything outside the code halts
+} fastInstr;
+
+// A call the display knows about, what its RET has to put back
+typedef struct displayFrame
+{
+    int bp;             // Of the frame the CAL made
+    int pc;             // Where it should return to
+    int level;          // Lexical level of the caller
+    int saved;          // display[] and displayAt[] the callee's level had before
+    int savedAt;
+} displayFrame;
+
+// What a vmInstance keeps the display in between runs
+struct vmDisplay
+{
+    displayFrame *frames;   // One for every call the display knows about
+    int *level;             // display[], then displayAt[], size of each
+    int size;
+};
+
+/*
+    Makes vm's display twice as big, or gives it one of DISPLAY_START if it has
+    none. Returns 1 if there's no memory for it, the old one is still there then.
+*/
+static int growDisplay(vmInstance *vm)
+{
+    vmDisplay *d = vm->display;
+    displayFrame *frames;
+    int *level, size;
+
+    if (d == NULL && (d = vm->display = calloc(1, sizeof(vmDisplay))) == NULL)
+        return 1;
+    size = d->size ? d->size * 2 : DISPLAY_START;
+    frames = realloc(d->frames, size * sizeof(displayFrame));
+    if (frames == NULL)
+        return 1;
+    d->frames = frames;
+    level = malloc(2 * size * sizeof(int));
+    if (level == NULL)
+        return 1;
+    if (d->level != NULL)
+    {
+        memcpy(level, d->level, d->size * sizeof(int));
+        memcpy(level + size, d->level + d->size, d->size * sizeof(int));
+        free(d->level);
+    }
+    d->level = level;
+    d->size = size;
+    return 0;
+}
+
+/*
+    The display caches the static links, so it's only right as long as nothing but
+    CAL writes one. Going by the depth of every instruction: nothing may push or
+    compute into the static link slot of its own frame, store there or below the
+    frame, or CAL while the new frame would overlap its own links. Stores into an
+    outer frame, and RETs, are checked while it runs (see fastloop.h).
+*/
+static int displaySafe(const pm0Instr *code, int count, int height)
+{
+    int *depth = malloc((count + 1) * sizeof(int));
+    int i, d, op, m, safe;
+
+    if (depth == NULL)
+    {
+        printf("Out of memory for the program code\n");
+        exit(1);
+    }
+    safe = stackDepths(code, count, height, depth);
+    for (i = 0; safe && i < count; i++)
+    {
+        d = depth[i];
+        op = code[i].op;
+        m = code[i].m;
+        if (d == DEPTH_UNSEEN)
+            continue;
+        if ((op == 1 || op == 3 || (op == 9 && m == 1)) && d + 1 == 1)
+            safe = 0;           // Pushes into slot d + 1
+        else if (op == 2 && (m == 1 || m == 6) && d == 1)
+            safe = 0;           // NEG and ODD write slot d
+        else if (op == 2 && m >= 2 && m <= 13 && m != 6 && d - 1 == 1)
+            safe = 0;           // The others slot d - 1
+        else if (op == 4 && code[i].l <= 0 && (m < 0 || m == 1))
+            safe = 0;
+        else if (op == 5 && d < 2)
+            safe = 0;           // The new frame starts at d + 1
+    }
+    free(depth);
+    return safe;
+}
+
+static int fastEngine(const fastProgram *p, vmInstance *vm, fastInstr **keep);
+
+#define ENGINE fastEngine
+#define ENGINE_ARGS const fastProgram *p, vmInstance *vm, fastInstr **keep
+#include "fastloop.h"
+
+static int recordEngine(const fastProgram *p, vmInstance *vm, traceRecorder *rec);
+
+#define RECORDING
+#define ENGINE recordEngine
+#define ENGINE_ARGS const fastProgram *p, vmInstance *vm, traceRecorder *rec
+#include "fastloop.h"
+
+static int profileEngine(const fastProgram *p, vmInstance *vm, fastInstr **keep, vmProfile *prof);
+
+#define PROFILING
+#define ENGINE profileEngine
+#define ENGINE_ARGS const fastProgram *p, vmInstance *vm, fastInstr **keep, vmProfile *prof
+#include "fastloop.h"
+
+int loadFast(fastProgram *p, const pm0Instr *code, int count, int height, int flags)
+{
+    fastInstr *decoded;
+
+    p->code = code;
+    p->count = count;
+    p->height = height;
+    p->flags = flags;
+    p->decoded = NULL;
+    if ((flags & FAST_DISPLAY) && !displaySafe(code, count, height))
+        p->flags &= ~FAST_DISPLAY;
+    if (fastEngine(p, NULL, &decoded) != 0)
+        return 1;
+    p->decoded = decoded;
+    return 0;
+}
+
+int runInstance(const fastProgram *p, vmInstance *vm)
+{
+    return fastEngine(p, vm, NULL);
+}
+
+void freeInstance(vmInstance *vm)
+{
+    if (vm->display != NULL)
+    {
+        free(vm->display->frames);
+        free(vm->display->level);
+        free(vm->display);
+        vm->display = NULL;
+    }
+}
+
+void freeFast(fastProgram *p)
+{
+    free(p->decoded);
+    p->decoded = NULL;
+}
+
+int runFast(const pm0Instr *code, int count, int *stack, int height, int flags)
+{
+    stack[1] = stack[2] = stack[3] = 0;
+    return resumeFast(code, count, stack, height, flags, 0, 1, 0);
+}
+
+int resumeFast(const pm0Instr *code, int count, int *stack, int height, int flags, int pc, int bp, int sp)
+{
+    vmInstance vm = {stack, height, pc, bp, sp, sioStdin(), sioStdout(), 0, NULL};
+    fastProgram p;
+    int r;
+
+    if (pc != 0 || bp != 1 || sp != 0)
+        flags &= ~FAST_DISPLAY;
+    if (loadFast(&p, code, count, height, flags) != 0)
+        return 1;
+    r = runInstance(&p, &vm);
+    freeInstance(&vm);
+    freeFast(&p);
+    return r;
+}
+
+int runRecorded(const pm0Instr *code, int count, int *stack, int height, traceRecorder *rec)
+{
+    vmInstance vm = {stack, height, 0, 1, 0, sioStdin(), sioStdout(), 0, NULL};
+    fastProgram p = {code, count, height, 0, NULL};
+
+    stack[1] = stack[2] = stack[3] = 0;
+    return recordEngine(&p, &vm, rec);
+}
+
+int runProfiled(const pm0Instr *code, int count, int *stack, int height, int flags, vmProfile *prof)
+{
+    vmInstance vm = {stack, height, 0, 1, 0, sioStdin(), sioStdout(), 0, NULL};
+    fastProgram p = {code, count, height, flags, NULL};
+    fastInstr *decoded;
+    int r;
+
+    if ((flags & FAST_DISPLAY) && !displaySafe(code, count, height))
+        p.flags &= ~FAST_DISPLAY;
+    if (profileEngine(&p, NULL, &decoded, NULL) != 0)    // Its own handlers, the plain engine's can't be jumped to from here
+        return 1;
+    p.decoded = decoded;
+    stack[1] = stack[2] = stack[3] = 0;
+    r = profileEngine(&p, &vm, NULL, prof);
+    prof->steps += vm.steps;
+    freeInstance(&vm);
+    free(decoded);
+    return r;
+}
+
+int stackDepths(const pm0Instr *code, int count, int height, int *depth)
+{
+    int *work = malloc((count + 1) * sizeof(int));
+    int top = 0, i, d, op, m, next[2], n, k;
+
+    if (work == NULL)
+    {
+        printf("Out of memory for the program code\n");
+        exit(1);
+    }
+    for (i = 0; i <= count; i++)
+        depth[i] = DEPTH_UNSEEN;
+    depth[0] = -1;
+    work[top++] = 0;
+    while (top > 0)
+    {
+        i = work[--top];
+        if (i >= count)
+            continue;
+        d = depth[i];
+        op = code[i].op;
+        m = code[i].m;
+        n = 0;
+        switch (op)
+        {
+            case 1: case 3:
+                d++;
+                break;
+            case 4:
+                d--;
+                break;
+            case 2:
+                if (m == 0)                 // RET, where to is only known when it runs
+                    continue;
+                if (m >= 2 && m <= 13 && m != 6)
+                    d--;
+                break;
+            case 5:
+                if (m >= 0 && m < count && depth[m] != -1)
+                {
+                    if (depth[m] != DEPTH_UNSEEN)
+                        goto bad;
+                    depth[m] = -1;
+                    work[top++] = m;
+                }
+                break;
+            case 6:
+                d += m;
+                break;
+            case 7: case 8:
+                if (op == 8)
+                    d--;
+                if (m >= 0 && m < count)
+                    next[n++] = m;
+                if (op == 7)
+                    goto follow;
+                break;
+            case 9:
+                if (m == 0)
+                    d--;
+                else if (m == 1)
+                    d++;
+                else if (m == 2)
+                    continue;
+                break;
+        }
+        next[n++] = i + 1;
+    follow:
+        if (d < -1 || d > height)
+            goto bad;
+        for (k = 0; k < n; k++)
+        {
+            if (next[k] >= count)
+                continue;
+            if (depth[next[k]] == DEPTH_UNSEEN)
+            {
+                depth[next[k]] = d;
+                work[top++] = next[k];
+            }
+            else if (depth[next[k]] != d)
+                goto bad;
+        }
+    }
+    free(work);
+    return 1;
+bad:
+    free(work);
+    return 0;
+}
@@ -0,0 +1,108 @@
+#ifndef FASTVM_H_INCLUDED
+#define FASTVM_H_INCLUDED
+
+#include <stdio.h>
+#include <limits.h>
+#include "pm0.h"
+#include "trace.h"
+#include "profile.h"
+#include "sio.h"
+
+#define FAST_FUSE 1         // Superinstructions
+#define FAST_DISPLAY 2      // Non local variables through a display
+#define FAST_ALL 3
+
+#define DEPTH_UNSEEN INT_MIN    // stackDepths for an instruction nothing gets to
+
+/**
+ *  One machine running a program: its stack, registers and I/O. Everything the
+ *  fast engine changes while it runs is in here or on the stack, so any number of
+ *  them can run at once, each on its own thread.
+ *
+ *  stack has room for height+1 ints. pc, bp and sp are where the run starts (0, 1
+ *  and 0 for a fresh one) and are left where it stopped. SIO reads from in and
+ *  writes to out (see sio.h), which is flushed when the run stops. steps counts every instruction it ran, the HLT or the one that
+ *  had to be stopped included, and is added to rather than reset.
+ *
+ *  display is where the fast engine keeps the display (FAST_DISPLAY). It starts out
+ *  NULL, grows with the calls a run makes and is kept for the next run on the same
+ *  instance, so freeInstance lets go of it once the instance isn't needed any more.
+ */
+typedef struct vmDisplay vmDisplay;
+
+typedef struct vmInstance
+{
+    int *stack;
+    int height;
+    int pc, bp, sp;
+    sioReader *in;
+    sioWriter *out;
+    long long steps;
+    vmDisplay *display;
+} vmInstance;
+
+/**
+ *  A program decoded for the fast engine once, so it can be run any number of
+ *  times without doing it again. Nothing changes it after loadFast, so one can be
+ *  shared by every thread running the program. flags are the FAST_ extras it was
+ *  decoded with, less FAST_DISPLAY if the program can't use the display.
+ */
+typedef struct fastProgram
+{
+    const pm0Instr *code;   // Still needed, the code isn't copied
+    int count;
+    int height;             // The stack height the display was checked against
+    int flags;
+    void *decoded;
+} fastProgram;
+
+// Decodes code for stacks of height. Returns 1 if there's no memory for it
+int loadFast(fastProgram *p, const pm0Instr *code, int count, int height, int flags);
+
+// Runs p on vm, which needs a stack at least as high as p was loaded for. Returns what runFast does
+int runInstance(const fastProgram *p, vmInstance *vm);
+void freeInstance(vmInstance *vm);     // Frees what runs kept in vm, not its stack or streams
+void freeFast(fastProgram *p);
+
+/**
+ *  Runs a program without tracing anything, as fast as we can.
+ *
+ *  The code is decoded once up front into the address of the handler for each
+ *  instruction (OPR and SIO already split by their modifier), and every handler
+ *  jumps straight to the next one (computed goto, a gcc extension). pc, bp and sp
+ *  live in locals for the whole run. The only output is what the program writes.
+ *
+ *  stack has room for height+1 ints and is used the same way as the tracing VM's,
+ *  starting with bp = 1 and sp = 0. Returns 0 if the program halted normally, 1 if
+ *  it had to be stopped (out of stack, out of memory).
+ *
+ *  flags picks the FAST_ extras. With FAST_FUSE common runs of instructions are
+ *  decoded into a single handler (superinstructions, see fastloop.h). With
+ *  FAST_DISPLAY a LOD or STO l levels down finds the frame in a display, an array
+ *  with the frame of every lexical level that CAL and RET keep up to date, instead
+ *  of following l static links. Nothing the program can see changes either way.
+ *
+ *  runFast, resumeFast and runRecorded decode the code every time, and SIO goes to
+ *  sioStdin and sioStdout.
+ */
+int runFast(const pm0Instr *code, int count, int *stack, int height, int flags);
+
+// Carries on with a run another engine started, from pc with that bp and sp. The display needs a fresh start
+int resumeFast(const pm0Instr *code, int count, int *stack, int height, int flags, int pc, int bp, int sp);
+
+// The same engine, also writing every instruction to rec as it goes. See trace.h
+int runRecorded(const pm0Instr *code, int count, int *stack, int height, traceRecorder *rec);
+
+// runFast counting every instruction it runs into prof, which initProfile made for count. See profile.h
+int runProfiled(const pm0Instr *code, int count, int *stack, int height, int flags, vmProfile *prof);
+
+/**
+ *  Depth of every instruction: sp - bp before it runs. 0 and anything CAL goes to
+ *  start at -1 (bp is one past sp right after a call), a CAL and its RET together
+ *  leave it where it was. Returns 0 if some instruction can be reached at two
+ *  different depths, or the stack would go below the frame or over height.
+ *  depth needs room for count + 1.
+ */
+int stackDepths(const pm0Instr *code, int count, int height, int *depth);
+
+#endif // FASTVM_H_INCLUDED
@@ -0,0 +1,120 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "intern.h"
+#include "nomem.h"
+
+#define INITIAL_SLOTS 256   // Must be a power of two
+
+static void *growArray(void *array, int count, size_t size)
+{
+    void *bigger = realloc(array, count * size);
+    if (bigger == NULL)
+        outOfMemory("Out of memory for the name table\n");
+    return bigger;
+}
+
+static unsigned hashName(const char *name, int len)    // FNV-1a, names are at most 12 characters
+{
+    unsigned h = 2166136261u;
+    int i;
+    for (i = 0; i < len; i++)
+    {
+        h ^= (unsigned char)name[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+void initIntern(internTable *table)
+{
+    table->count = 0;
+    table->capacity = 0;
+    table->offsets = NULL;
+    table->hashes = NULL;
+    table->slotMask = INITIAL_SLOTS - 1;
+    table->slots = calloc(INITIAL_SLOTS, sizeof(int));
+    table->text = NULL;
+    table->textLen = 0;
+    table->textCap = 0;
+    if (table->slots == NULL)
+        outOfMemory("Out of memory for the name table\n");
+}
+
+void freeIntern(internTable *table)
+{
+    free(table->offsets);
+    free(table->hashes);
+    free(table->slots);
+    free(table->text);
+    memset(table, 0, sizeof(*table));
+}
+
+/*
+    Doubles the slot array once it's half full and puts every id back in. The
+    hashes were kept so the names themselves aren't looked at again.
+*/
+static void growSlots(internTable *table)
+{
+    int newMask = table->slotMask * 2 + 1;
+    int *slots = calloc(newMask + 1, sizeof(int));
+    int id, s;
+
+    if (slots == NULL)
+        outOfMemory("Out of memory for the name table\n");
+    for (id = 0; id < table->count; id++)
+    {
+        s = table->hashes[id] & newMask;
+        while (slots[s] != 0)
+            s = (s + 1) & newMask;
+        slots[s] = id + 1;
+    }
+    free(table->slots);
+    table->slots = slots;
+    table->slotMask = newMask;
+}
+
+int internName(internTable *table, const char *name, int len)
+{
+    unsigned h = hashName(name, len);
+    int s = h & table->slotMask;
+    int id;
+
+    while (table->slots[s] != 0)    // Linear probing until we find it or an empty slot
+    {
+        id = table->slots[s] - 1;
+        if (table->hashes[id] == h && strncmp(table->text + table->offsets[id], name, len) == 0
+            && table->text[table->offsets[id] + len] == '\0')
+            return id;
+        s = (s + 1) & table->slotMask;
+    }
+
+    // It's new, store the spelling and give it the next id
+    if (table->count == table->capacity)
+    {
+        table->capacity = table->capacity ? table->capacity * 2 : 64;
+        table->offsets = growArray(table->offsets, table->capacity, sizeof(int));
+        table->hashes = growArray(table->hashes, table->capacity, sizeof(unsigned));
+    }
+    while (table->textLen + len + 1 > table->textCap)
+    {
+        table->textCap = table->textCap ? table->textCap * 2 : 1024;
+        table->text = growArray(table->text, table->textCap, 1);
+    }
+    id = table->count++;
+    table->offsets[id] = table->textLen;
+    table->hashes[id] = h;
+    memcpy(table->text + table->textLen, name, len);
+    table->text[table->textLen + len] = '\0';
+    table->textLen += len + 1;
+    table->slots[s] = id + 1;
+
+    if (table->count * 2 > table->slotMask)
+        growSlots(table);
+    return id;
+}
+
+const char *internText(const internTable *table, int id)
+{
+    return table->text + table->offsets[id];
+}
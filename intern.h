@@ -0,0 +1,26 @@
+#ifndef INTERN_H_INCLUDED
+#define INTERN_H_INCLUDED
+
+/**
+ *  Every distinct identifier (and number) spelling is stored once and given a small
+ *  integer id, counting up from 0. After that the compiler compares ids instead of strings.
+ */
+typedef struct internTable
+{
+    int count;          // Names stored so far, also the next id handed out
+    int capacity;       // Room in offsets/hashes before they have to grow
+    int *offsets;       // Where each name starts in text
+    unsigned *hashes;   // Hash of each name, so growing the slots doesn't rehash the text
+    int *slots;         // Open addressing table of id+1, 0 is an empty slot
+    int slotMask;       // Number of slots - 1, always a power of two minus one
+    char *text;         // All the names, each one null terminated
+    int textLen;
+    int textCap;
+} internTable;
+
+void initIntern(internTable *table);
+void freeIntern(internTable *table);
+int internName(internTable *table, const char *name, int len);   // Returns the id for name, adding it if it's new
+const char *internText(const internTable *table, int id);        // The null terminated spelling for an id
+
+#endif // INTERN_H_INCLUDED
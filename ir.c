@@ -0,0 +1,830 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ir.h"
+#include "peephole.h"
+#include "nomem.h"
+
+static void *grow(void *p, int count, size_t size)
+{
+    p = realloc(p, count * size);
+    if (p == NULL)
+        outOfMemory("Out of memory for the optimizer\n");
+    return p;
+}
+
+static astNode *newNode(arena *nodes, int kind)
+{
+    astNode *e = arenaAlloc(nodes, sizeof(astNode));
+
+    memset(e, 0, sizeof(*e));
+    e->kind = kind;
+    return e;
+}
+
+astNode *numNode(arena *nodes, int value)
+{
+    astNode *e = newNode(nodes, AST_NUM);
+    e->value = value;
+    return e;
+}
+
+astNode *varNode(arena *nodes, int lex, int addr)
+{
+    astNode *e = newNode(nodes, AST_VAR);
+    e->lex = lex;
+    e->addr = addr;
+    return e;
+}
+
+astNode *oprNode(arena *nodes, int op, astNode *left, astNode *right)
+{
+    astNode *e = newNode(nodes, AST_OPR);
+    e->op = op;
+    e->left = left;
+    e->right = right;
+    return e;
+}
+
+void emitExpr(codeBuffer *code, const astNode *e)
+{
+    switch (e->kind)
+    {
+        case AST_NUM: emitCode(code, 1, 0, e->value);
+                      break;
+        case AST_VAR: emitCode(code, 3, e->lex, e->addr);
+                      break;
+        case AST_OPR: emitExpr(code, e->left);
+                      if (e->right != NULL)
+                          emitExpr(code, e->right);
+                      emitCode(code, 2, 0, e->op);
+                      break;
+    }
+    if (e->save > 0)    // Keep a copy for the CSE pass, STO pops it so load it right back
+    {
+        emitCode(code, 4, 0, e->save);
+        emitCode(code, 3, 0, e->save);
+    }
+}
+
+void initIR(irBlock *ir, arena *nodes, int frameSize)
+{
+    memset(ir, 0, sizeof(*ir));
+    ir->nodes = nodes;
+    ir->frameSize = frameSize;
+}
+
+void freeIR(irBlock *ir)
+{
+    free(ir->code);
+    memset(ir, 0, sizeof(*ir));
+}
+
+int irLabelNew(irBlock *ir)
+{
+    return ir->labels++;
+}
+
+void irAdd(irBlock *ir, int kind, int lex, int addr, int label, astNode *expr)
+{
+    irInstr *in;
+
+    if (ir->count == ir->capacity)
+    {
+        ir->capacity = ir->capacity ? ir->capacity * 2 : 256;
+        ir->code = grow(ir->code, ir->capacity, sizeof(irInstr));
+    }
+    in = &ir->code[ir->count++];
+    in->kind = kind;
+    in->lex = lex;
+    in->addr = addr;
+    in->label = label;
+    in->expr = expr;
+    in->line = ir->line;
+    in->column = ir->column;
+}
+
+// A division or mod that might be by zero has to stay, the VM would stop on it
+static int mayTrap(const astNode *e)
+{
+    if (e->kind != AST_OPR)
+        return 0;
+    if ((e->op == 5 || e->op == 7) &&
+        (e->right->kind != AST_NUM || e->right->value == 0 || e->right->value == -1))
+        return 1;
+    return mayTrap(e->left) || (e->right != NULL && mayTrap(e->right));
+}
+
+static int hasSave(const astNode *e)
+{
+    if (e->save > 0)
+        return 1;
+    return e->kind == AST_OPR && (hasSave(e->left) || (e->right != NULL && hasSave(e->right)));
+}
+
+/*
+    Constant propagation and folding
+
+    Walks forward remembering which local variables hold a known constant.
+    Anything can jump to a label, so everything is forgotten there. A call
+    can change any of them too.
+*/
+static astNode *fold(irBlock *ir, astNode *e, const char *known, const int *value)
+{
+    int result, a, b;
+
+    if (e->kind == AST_VAR && e->lex == 0 && e->addr < ir->frameSize && known[e->addr])
+        return numNode(ir->nodes, value[e->addr]);
+    if (e->kind != AST_OPR)
+        return e;
+    e->left = fold(ir, e->left, known, value);
+    if (e->right != NULL)
+        e->right = fold(ir, e->right, known, value);
+    if (e->left->kind == AST_NUM && (e->right == NULL || e->right->kind == AST_NUM) &&
+        foldOpr(e->op, e->left->value, e->right ? e->right->value : 0, &result))
+        return numNode(ir->nodes, result);
+    if (e->right == NULL)
+        return e;
+    a = e->left->kind == AST_NUM ? e->left->value : -1;
+    b = e->right->kind == AST_NUM ? e->right->value : -1;
+    if ((e->op == 2 && b == 0) || (e->op == 3 && b == 0) || (e->op == 4 && b == 1) || (e->op == 5 && b == 1))
+        return e->left;     // x + 0, x - 0, x * 1, x / 1
+    if ((e->op == 2 && a == 0) || (e->op == 4 && a == 1))
+        return e->right;    // 0 + x, 1 * x
+    return e;
+}
+
+static int propagate(irBlock *ir)
+{
+    char *known = calloc(ir->frameSize + 1, 1);
+    int *value = malloc((ir->frameSize + 1) * sizeof(int));
+    int i, changed = 0;
+    irInstr *in;
+
+    if (known == NULL || value == NULL)
+    {
+        free(known);
+        free(value);
+        outOfMemory("Out of memory for the optimizer\n");
+    }
+    for (i = 0; i < ir->count; i++)
+    {
+        in = &ir->code[i];
+        if (in->expr != NULL)
+            in->expr = fold(ir, in->expr, known, value);
+        switch (in->kind)
+        {
+            case IR_STORE:
+            case IR_READ:   if (in->lex != 0 || in->addr >= ir->frameSize)
+                                break;
+                            known[in->addr] = in->kind == IR_STORE && in->expr->kind == AST_NUM;
+                            if (known[in->addr])
+                                value[in->addr] = in->expr->value;
+                            break;
+            case IR_BRANCH: if (in->expr->kind != AST_NUM)
+                                break;
+                            if (in->expr->value == 0)   // Always taken
+                                in->kind = IR_JUMP;
+                            else                        // Never taken
+                                in->kind = IR_NOP;
+                            in->expr = NULL;
+                            changed = 1;
+                            break;
+            case IR_LABEL:
+            case IR_CALL:   memset(known, 0, ir->frameSize + 1);
+                            break;
+        }
+    }
+    free(known);
+    free(value);
+    return changed;
+}
+
+/*
+    Unreachable code
+
+    Nothing after a JUMP runs until a label something jumps to. Labels nothing
+    jumps to are dropped, which lets the constants flow through them next time.
+*/
+static int nextLive(irBlock *ir, int i)
+{
+    while (i < ir->count && ir->code[i].kind == IR_NOP)
+        i++;
+    return i;
+}
+
+static int dropUnreachable(irBlock *ir)
+{
+    int *refs = calloc(ir->labels + 1, sizeof(int));
+    int i, j, changed = 0, skipping = 0;
+    irInstr *in;
+
+    if (refs == NULL)
+        outOfMemory("Out of memory for the optimizer\n");
+    for (i = 0; i < ir->count; i++)
+        if (ir->code[i].kind == IR_JUMP || ir->code[i].kind == IR_BRANCH)
+            refs[ir->code[i].label]++;
+    for (i = 0; i < ir->count; i++)
+    {
+        in = &ir->code[i];
+        if (in->kind == IR_LABEL && refs[in->label] > 0)
+            skipping = 0;
+        if (in->kind == IR_NOP)
+            continue;
+        if (skipping || (in->kind == IR_LABEL && refs[in->label] == 0))
+        {
+            if (in->kind == IR_JUMP || in->kind == IR_BRANCH)
+                refs[in->label]--;
+            in->kind = IR_NOP;
+            changed = 1;
+            continue;
+        }
+        if (in->kind == IR_JUMP || (in->kind == IR_BRANCH && !mayTrap(in->expr)))
+        {
+            j = nextLive(ir, i + 1);
+            if (j < ir->count && ir->code[j].kind == IR_LABEL && ir->code[j].label == in->label)
+            {
+                refs[in->label]--;      // Goes where it would have gone anyway
+                in->kind = IR_NOP;
+                changed = 1;
+                continue;
+            }
+        }
+        if (in->kind == IR_JUMP)
+            skipping = 1;
+    }
+    free(refs);
+    return changed;
+}
+
+/*
+    Common subexpressions
+
+    Inside a stretch of code with no label in it, every subtree gets a value
+    number: two subtrees with the same number always have the same value,
+    because each assignment gives its variable a new version. A call ends the
+    stretch and gives every variable a new version. An operator whose
+    value is still sitting in a variable (x := a / b; ... a / b) just loads the
+    variable. What's left that is computed more than once, and worth it, is kept
+    in a temporary the first time and loaded from there afterwards.
+*/
+typedef struct vnEntry
+{
+    int key[4];
+    int vn;
+    unsigned stamp;
+} vnEntry;
+
+typedef struct cseState
+{
+    irBlock *ir;
+    vnEntry *table;
+    int tableMask;
+    int tableCount;
+    unsigned stamp;         // Entries from an older stretch don't count
+    int *version;           // Per local variable
+    int outerEpoch;         // Version of every non local variable at once
+    int vnCount;
+    int vnCap;
+    int *holderAddr;        // Local variable holding the value of a vn, -1 for none
+    int *holderVersion;
+    int *uses;              // Occurrences still computed
+    int *firstOcc;          // Occurrences of each vn, chained through occNext
+    int *lastOcc;
+    int *size;
+    astNode **occ;
+    int *occNext;
+    int occCount;
+    int occCap;
+    int temps;              // Temporaries this stretch, they are dead again at the next label
+} cseState;
+
+static unsigned hashKey(const int *key)
+{
+    unsigned h = 2166136261u;
+    int i;
+
+    for (i = 0; i < 4; i++)
+        h = (h ^ (unsigned)key[i]) * 16777619u;
+    return h;
+}
+
+static void growTable(cseState *cs)
+{
+    vnEntry *old = cs->table;
+    int oldSize = cs->tableMask + 1, i, at;
+
+    cs->tableMask = cs->tableMask ? cs->tableMask * 2 + 1 : 1023;
+    cs->table = calloc(cs->tableMask + 1, sizeof(vnEntry));
+    if (cs->table == NULL)
+        outOfMemory("Out of memory for the optimizer\n");
+    for (i = 0; old != NULL && i < oldSize; i++)
+    {
+        if (old[i].stamp != cs->stamp)
+            continue;
+        at = hashKey(old[i].key) & cs->tableMask;
+        while (cs->table[at].stamp == cs->stamp)
+            at = (at + 1) & cs->tableMask;
+        cs->table[at] = old[i];
+    }
+    free(old);
+}
+
+static int valueNumber(cseState *cs, int k0, int k1, int k2, int k3)
+{
+    int key[4] = {k0, k1, k2, k3}, at, vn;
+
+    if ((cs->tableCount + 1) * 2 > cs->tableMask + 1)
+        growTable(cs);
+    at = hashKey(key) & cs->tableMask;
+    while (cs->table[at].stamp == cs->stamp)
+    {
+        if (memcmp(cs->table[at].key, key, sizeof(key)) == 0)
+            return cs->table[at].vn;
+        at = (at + 1) & cs->tableMask;
+    }
+    if (cs->vnCount == cs->vnCap)
+    {
+        cs->vnCap = cs->vnCap ? cs->vnCap * 2 : 1024;
+        cs->holderAddr = grow(cs->holderAddr, cs->vnCap, sizeof(int));
+        cs->holderVersion = grow(cs->holderVersion, cs->vnCap, sizeof(int));
+        cs->uses = grow(cs->uses, cs->vnCap, sizeof(int));
+        cs->firstOcc = grow(cs->firstOcc, cs->vnCap, sizeof(int));
+        cs->lastOcc = grow(cs->lastOcc, cs->vnCap, sizeof(int));
+        cs->size = grow(cs->size, cs->vnCap, sizeof(int));
+    }
+    vn = cs->vnCount++;
+    cs->holderAddr[vn] = -1;
+    cs->uses[vn] = 0;
+    cs->firstOcc[vn] = cs->lastOcc[vn] = -1;
+    memcpy(cs->table[at].key, key, sizeof(key));
+    cs->table[at].vn = vn;
+    cs->table[at].stamp = cs->stamp;
+    cs->tableCount++;
+    return vn;
+}
+
+static void number(cseState *cs, astNode *e)
+{
+    int l, r, t;
+
+    switch (e->kind)
+    {
+        case AST_NUM: e->vn = valueNumber(cs, AST_NUM, e->value, 0, 0);
+                      e->size = 1;
+                      break;
+        case AST_VAR: if (e->lex == 0)
+                          e->vn = valueNumber(cs, AST_VAR, e->addr, cs->version[e->addr], 0);
+                      else
+                          e->vn = valueNumber(cs, -AST_VAR, e->lex, e->addr, cs->outerEpoch);
+                      e->size = 1;
+                      break;
+        case AST_OPR: number(cs, e->left);
+                      l = e->left->vn;
+                      r = -1;
+                      e->size = e->left->size + 1;
+                      if (e->right != NULL)
+                      {
+                          number(cs, e->right);
+                          r = e->right->vn;
+                          e->size += e->right->size;
+                      }
+                      if ((e->op == 2 || e->op == 4 || e->op == 8 || e->op == 9) && r < l)
+                      {
+                          t = l;    // a + b is b + a
+                          l = r;
+                          r = t;
+                      }
+                      e->vn = valueNumber(cs, AST_OPR, e->op, l, r);
+                      cs->size[e->vn] = e->size;
+                      break;
+    }
+}
+
+// Swaps in a variable that already holds the value, biggest subtrees first
+static void reuse(cseState *cs, astNode *e)
+{
+    int holder;
+
+    if (e->kind != AST_OPR)
+        return;
+    holder = cs->holderAddr[e->vn];
+    if (holder >= 0 && cs->holderVersion[e->vn] == cs->version[holder])
+    {
+        e->kind = AST_VAR;
+        e->lex = 0;
+        e->addr = holder;
+        e->left = e->right = NULL;
+        return;
+    }
+    reuse(cs, e->left);
+    if (e->right != NULL)
+        reuse(cs, e->right);
+}
+
+static void collect(cseState *cs, astNode *e)
+{
+    int at;
+
+    if (e->kind != AST_OPR)
+        return;
+    collect(cs, e->left);
+    if (e->right != NULL)
+        collect(cs, e->right);
+    if (cs->occCount == cs->occCap)
+    {
+        cs->occCap = cs->occCap ? cs->occCap * 2 : 1024;
+        cs->occ = grow(cs->occ, cs->occCap, sizeof(astNode *));
+        cs->occNext = grow(cs->occNext, cs->occCap, sizeof(int));
+    }
+    at = cs->occCount++;
+    cs->occ[at] = e;
+    cs->occNext[at] = -1;
+    if (cs->lastOcc[e->vn] >= 0)
+        cs->occNext[cs->lastOcc[e->vn]] = at;
+    else
+        cs->firstOcc[e->vn] = at;
+    cs->lastOcc[e->vn] = at;
+    cs->uses[e->vn]++;
+}
+
+static void killTree(astNode *e)
+{
+    if (e->kind != AST_OPR)
+        return;
+    e->left->save = -1;
+    killTree(e->left);
+    if (e->right != NULL)
+    {
+        e->right->save = -1;
+        killTree(e->right);
+    }
+}
+
+// Sorts (size, value number) pairs, biggest first
+static int bySize(const void *a, const void *b)
+{
+    const int *x = a, *y = b;
+
+    if (x[0] != y[0])
+        return y[0] - x[0];
+    return x[1] - y[1];
+}
+
+// End of a stretch, decide which repeated operators get a temporary
+static void keepTemps(cseState *cs)
+{
+    int *pick = malloc((cs->vnCount + 1) * 2 * sizeof(int));
+    int picks = 0, i, v, o, live, t;
+    astNode *first;
+
+    if (pick == NULL)
+        outOfMemory("Out of memory for the optimizer\n");
+    for (v = 0; v < cs->vnCount; v++)
+        if (cs->uses[v] > 1)
+        {
+            pick[2 * picks] = cs->size[v];
+            pick[2 * picks + 1] = v;
+            picks++;
+        }
+    qsort(pick, picks, 2 * sizeof(int), bySize);
+    for (i = 0; i < picks; i++)
+    {
+        v = pick[2 * i + 1];
+        live = 0;
+        for (o = cs->firstOcc[v]; o >= 0; o = cs->occNext[o])
+            if (cs->occ[o]->save != -1)
+                live++;
+        if ((live - 1) * (cs->size[v] - 1) <= 2)    // Saving it costs a STO and a LOD, each reuse saves size-1
+            continue;
+        t = cs->ir->frameSize + cs->temps++;
+        if (cs->temps > cs->ir->temps)
+            cs->ir->temps = cs->temps;
+        first = NULL;
+        for (o = cs->firstOcc[v]; o >= 0; o = cs->occNext[o])
+        {
+            if (cs->occ[o]->save == -1)
+                continue;
+            if (first == NULL)
+            {
+                first = cs->occ[o];
+                first->save = t;
+                continue;
+            }
+            killTree(cs->occ[o]);
+            cs->occ[o]->kind = AST_VAR;
+            cs->occ[o]->lex = 0;
+            cs->occ[o]->addr = t;
+            cs->occ[o]->left = cs->occ[o]->right = NULL;
+        }
+    }
+    free(pick);
+    cs->stamp++;
+    cs->tableCount = 0;
+    cs->vnCount = 0;
+    cs->occCount = 0;
+    cs->temps = 0;
+}
+
+static void commonSubexpressions(irBlock *ir)
+{
+    cseState cs;
+    irInstr *in;
+    int i, j;
+
+    memset(&cs, 0, sizeof(cs));
+    cs.ir = ir;
+    cs.stamp = 1;
+    cs.version = calloc(ir->frameSize + 1, sizeof(int));
+    if (cs.version == NULL)
+        outOfMemory("Out of memory for the optimizer\n");
+    growTable(&cs);
+    for (i = 0; i < ir->count; i++)
+    {
+        in = &ir->code[i];
+        if (in->kind == IR_LABEL || in->kind == IR_CALL)
+            keepTemps(&cs);
+        if (in->kind == IR_CALL)
+        {
+            for (j = 0; j < ir->frameSize; j++)
+                cs.version[j]++;
+            cs.outerEpoch++;
+        }
+        if (in->expr != NULL)
+        {
+            number(&cs, in->expr);
+            reuse(&cs, in->expr);
+            collect(&cs, in->expr);
+        }
+        if (in->kind == IR_STORE || in->kind == IR_READ)
+        {
+            if (in->lex != 0)
+                cs.outerEpoch++;
+            else if (in->addr < ir->frameSize)
+            {
+                cs.version[in->addr]++;
+                if (in->kind == IR_STORE && in->expr->kind == AST_OPR)
+                {
+                    cs.holderAddr[in->expr->vn] = in->addr;
+                    cs.holderVersion[in->expr->vn] = cs.version[in->addr];
+                }
+            }
+        }
+    }
+    keepTemps(&cs);
+
+    free(cs.table);
+    free(cs.version);
+    free(cs.holderAddr);
+    free(cs.holderVersion);
+    free(cs.uses);
+    free(cs.firstOcc);
+    free(cs.lastOcc);
+    free(cs.size);
+    free(cs.occ);
+    free(cs.occNext);
+}
+
+/*
+    Dead stores
+
+    Liveness of the local variables over the basic blocks, then every store to a
+    local nothing reads afterwards is dropped (unless computing the value could
+    stop the VM, or it fills a CSE temporary). A call might read any variable,
+    the temporaries are the only ones it can't see.
+*/
+#define DSE_MAX_BITS (64 * 1024 * 1024)    // Skip the pass if the live sets would take more than 8MB
+
+typedef unsigned long long liveWord;
+
+static void useVars(const astNode *e, liveWord *live, int vars)
+{
+    if (e->kind == AST_VAR && e->lex == 0 && e->addr < vars)
+        live[e->addr / 64] |= (liveWord)1 << (e->addr % 64);
+    else if (e->kind == AST_OPR)
+    {
+        useVars(e->left, live, vars);
+        if (e->right != NULL)
+            useVars(e->right, live, vars);
+    }
+}
+
+// Walks a block backwards from its live out set. With drop set, removes the dead stores on the way
+static int walkBack(irBlock *ir, int start, int end, liveWord *live, int vars, int drop)
+{
+    int i, w, dropped = 0;
+    irInstr *in;
+
+    for (i = end - 1; i >= start; i--)
+    {
+        in = &ir->code[i];
+        if ((in->kind == IR_STORE || in->kind == IR_READ) && in->lex == 0 && in->addr < vars)
+        {
+            if (drop && in->kind == IR_STORE && !(live[in->addr / 64] & ((liveWord)1 << (in->addr % 64))) &&
+                !mayTrap(in->expr) && !hasSave(in->expr))
+            {
+                in->kind = IR_NOP;
+                in->expr = NULL;
+                dropped = 1;
+                continue;
+            }
+            live[in->addr / 64] &= ~((liveWord)1 << (in->addr % 64));
+        }
+        if (in->expr != NULL)
+            useVars(in->expr, live, vars);
+        if (in->kind == IR_CALL)
+            for (w = 0; w < ir->frameSize; w++)
+                live[w / 64] |= (liveWord)1 << (w % 64);
+    }
+    return dropped;
+}
+
+static int dropDeadStores(irBlock *ir)
+{
+    int vars = ir->frameSize + ir->temps, words = (vars + 63) / 64;
+    int *start, *labelBlock, blocks = 0, i, b, w, s, changed, dropped = 0;
+    liveWord *liveIn, *liveOut, *live;
+    irInstr *last;
+
+    start = malloc((ir->count + 2) * sizeof(int));
+    labelBlock = malloc((ir->labels + 1) * sizeof(int));
+    if (start == NULL || labelBlock == NULL)
+    {
+        free(start);
+        free(labelBlock);
+        outOfMemory("Out of memory for the optimizer\n");
+    }
+    for (i = 0; i < ir->count; i++)
+    {
+        if (i == 0 || ir->code[i].kind == IR_LABEL ||
+            ir->code[i - 1].kind == IR_JUMP || ir->code[i - 1].kind == IR_BRANCH)
+            start[blocks++] = i;
+        if (ir->code[i].kind == IR_LABEL)
+            labelBlock[ir->code[i].label] = blocks - 1;
+    }
+    start[blocks] = ir->count;
+    if ((double)blocks * words * 64 * 2 > DSE_MAX_BITS)
+    {
+        free(start);
+        free(labelBlock);
+        return 0;
+    }
+
+    liveIn = calloc((size_t)blocks * words + 1, sizeof(liveWord));
+    liveOut = calloc((size_t)blocks * words + 1, sizeof(liveWord));
+    live = calloc(words + 1, sizeof(liveWord));
+    if (liveIn == NULL || liveOut == NULL || live == NULL)
+    {
+        free(start);
+        free(labelBlock);
+        free(liveIn);
+        free(liveOut);
+        free(live);
+        outOfMemory("Out of memory for the optimizer\n");
+    }
+    do
+    {
+        changed = 0;
+        for (b = blocks - 1; b >= 0; b--)
+        {
+            liveWord *out = liveOut + (size_t)b * words;
+
+            last = &ir->code[start[b + 1] - 1];
+            memset(out, 0, words * sizeof(liveWord));
+            if (last->kind != IR_JUMP && b + 1 < blocks)    // Falls through
+                for (w = 0; w < words; w++)
+                    out[w] |= liveIn[(size_t)(b + 1) * words + w];
+            if (last->kind == IR_JUMP || last->kind == IR_BRANCH)
+            {
+                s = labelBlock[last->label];
+                for (w = 0; w < words; w++)
+                    out[w] |= liveIn[(size_t)s * words + w];
+            }
+            memcpy(live, out, words * sizeof(liveWord));
+            walkBack(ir, start[b], start[b + 1], live, vars, 0);
+            if (memcmp(live, liveIn + (size_t)b * words, words * sizeof(liveWord)) != 0)
+            {
+                memcpy(liveIn + (size_t)b * words, live, words * sizeof(liveWord));
+                changed = 1;
+            }
+        }
+    } while (changed);
+
+    for (b = 0; b < blocks; b++)
+    {
+        memcpy(live, liveOut + (size_t)b * words, words * sizeof(liveWord));
+        if (walkBack(ir, start[b], start[b + 1], live, vars, 1))
+            dropped = 1;
+    }
+    free(start);
+    free(labelBlock);
+    free(liveIn);
+    free(liveOut);
+    free(live);
+    return dropped;
+}
+
+void optimizeIR(irBlock *ir, int flags)
+{
+    int changed, rounds;
+
+    do
+    {
+        changed = 0;
+        if ((flags & IR_CONST) && propagate(ir))
+            changed = 1;
+        if ((flags & IR_UNREACHABLE) && dropUnreachable(ir))
+            changed = 1;
+    } while (changed);
+    if (flags & IR_CSE)
+        commonSubexpressions(ir);
+    for (rounds = 0; (flags & IR_DSE) && rounds < 16 && dropDeadStores(ir); rounds++)
+        ;   // Each round can free up the stores that only fed the ones it dropped
+}
+
+int lowerIR(irBlock *ir, codeBuffer *code)
+{
+    int frame = ir->frameSize + ir->temps, i, at, *labelAddr, *waiting, *nextWaiting;
+    irInstr *in;
+
+    labelAddr = malloc((ir->labels + 1) * sizeof(int));
+    waiting = malloc((ir->labels + 1) * sizeof(int));       // First jump waiting for each label
+    nextWaiting = malloc((ir->count + 1) * sizeof(int));    // Chained by the IR index of the jump
+    if (labelAddr == NULL || waiting == NULL || nextWaiting == NULL)
+    {
+        free(labelAddr);
+        free(waiting);
+        free(nextWaiting);
+        outOfMemory("Out of memory for the optimizer\n");
+    }
+    for (i = 0; i < ir->labels; i++)
+        labelAddr[i] = waiting[i] = -1;
+
+    emitCode(code, 6, 0, frame);
+    for (i = 0; i < ir->count; i++)
+    {
+        in = &ir->code[i];
+        code->line = in->line;
+        code->column = in->column;
+        switch (in->kind)
+        {
+            case IR_STORE:  emitExpr(code, in->expr);
+                            emitCode(code, 4, in->lex, in->addr);
+                            break;
+            case IR_READ:   emitCode(code, 9, 0, 1);
+                            emitCode(code, 4, in->lex, in->addr);
+                            break;
+            case IR_WRITE:  emitExpr(code, in->expr);
+                            emitCode(code, 9, 0, 0);
+                            break;
+            case IR_BRANCH: emitExpr(code, in->expr);
+                            // fall through
+            case IR_JUMP:   if (labelAddr[in->label] >= 0)
+                            {
+                                emitCode(code, in->kind == IR_JUMP ? 7 : 8, 0, labelAddr[in->label]);
+                                break;
+                            }
+                            at = emitCode(code, in->kind == IR_JUMP ? 7 : 8, 0, 0);
+                            holdCode(code, at);
+                            in->addr = at;      // Nothing needs the IR any more, keep the address here
+                            nextWaiting[i] = waiting[in->label];
+                            waiting[in->label] = i;
+                            break;
+            case IR_CALL:   emitCode(code, 5, in->lex, in->addr);
+                            break;
+            case IR_LABEL:  labelAddr[in->label] = code->count;
+                            for (at = waiting[in->label]; at >= 0; at = nextWaiting[at])
+                                patchCode(code, ir->code[at].addr, code->count);
+                            break;
+        }
+    }
+    free(labelAddr);
+    free(waiting);
+    free(nextWaiting);
+    return frame;
+}
+
+int irFlags(const char *spec)
+{
+    static const char *names[] = {"const", "cse", "dse", "unreachable"};
+    int flags = 0, i, len;
+
+    if (*spec == '\0')
+        return IR_ALL;
+    if (*spec++ != '=')
+        return -1;
+    while (*spec != '\0')
+    {
+        len = (int)strcspn(spec, ",");
+        for (i = 0; i < 4; i++)
+            if ((int)strlen(names[i]) == len && strncmp(spec, names[i], len) == 0)
+                break;
+        if (i == 4)
+            return -1;
+        flags |= 1 << i;
+        spec += len;
+        if (*spec == ',')
+            spec++;
+    }
+    return flags;
+}
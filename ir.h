@@ -0,0 +1,86 @@
+#ifndef IR_H_INCLUDED
+#define IR_H_INCLUDED
+
+#include "arena.h"
+#include "codebuf.h"
+
+/**
+ *  Expression trees, built by expression(), term(), factor() and condition().
+ *  Without --ir they are barked and thrown away as soon as the statement has them.
+ */
+#define AST_NUM 1
+#define AST_VAR 2
+#define AST_OPR 3
+
+typedef struct astNode
+{
+    int kind;
+    int op;                         // OPR modifier of an AST_OPR
+    int value;                      // AST_NUM
+    int lex;                        // AST_VAR, level and address the way LOD wants them
+    int addr;
+    struct astNode *left;
+    struct astNode *right;          // NULL for NEG and ODD
+    int size;                       // Commands it takes to compute, set by the CSE pass
+    int vn;                         // Value number, same number means same value. Set by the CSE pass
+    int save;                       // Temporary the value is also stored in, 0 for none. -1 if the node is never computed
+} astNode;
+
+astNode *numNode(arena *nodes, int value);
+astNode *varNode(arena *nodes, int lex, int addr);
+astNode *oprNode(arena *nodes, int op, astNode *left, astNode *right);
+void emitExpr(codeBuffer *code, const astNode *e);     // Barks the commands that leave the value on the stack
+
+/**
+ *  Linear IR for the statement of a block, built by statement() under --ir.
+ *  Jumps go to numbered labels instead of addresses, so the passes can add and
+ *  remove instructions freely. lowerIR turns it into commands.
+ */
+#define IR_NOP 0        // Removed by a pass
+#define IR_STORE 1      // lex addr := expr
+#define IR_READ 2       // read into lex addr
+#define IR_WRITE 3      // write expr
+#define IR_JUMP 4       // goto label
+#define IR_BRANCH 5     // goto label if expr is 0
+#define IR_LABEL 6
+#define IR_CALL 7       // call the procedure at lex addr, which can read and change any variable it can see
+
+#define IR_CONST 1          // Constant propagation and folding
+#define IR_CSE 2            // Common subexpressions, reusing a variable that already has the value or a temporary
+#define IR_DSE 4            // Stores nobody reads
+#define IR_UNREACHABLE 8    // Code after a jump nobody jumps into, jumps to the next instruction, unused labels
+#define IR_ALL 15
+
+typedef struct irInstr
+{
+    int kind;
+    int lex;
+    int addr;
+    int label;
+    astNode *expr;
+    int line;           // Where in the source it came from, see codebuf.h
+    int column;
+} irInstr;
+
+typedef struct irBlock
+{
+    irInstr *code;
+    int count;
+    int capacity;
+    int labels;         // Labels handed out so far
+    int frameSize;      // Variables of the block, temporaries go after them
+    int temps;          // Temporaries the CSE pass added
+    arena *nodes;
+    int line;           // Where the instructions being added come from
+    int column;
+} irBlock;
+
+void initIR(irBlock *ir, arena *nodes, int frameSize);
+void freeIR(irBlock *ir);
+int irLabelNew(irBlock *ir);
+void irAdd(irBlock *ir, int kind, int lex, int addr, int label, astNode *expr);
+void optimizeIR(irBlock *ir, int flags);
+int lowerIR(irBlock *ir, codeBuffer *code);    // Barks INC and the statement, returns the frame size it set up
+int irFlags(const char *spec);                 // Flags for what follows --ir: "" is everything, "=const,cse" picks some. -1 if it makes no sense
+
+#endif // IR_H_INCLUDED
@@ -0,0 +1,510 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "jit.h"
+#include "sio.h"
+#include "vmstack.h"
+
+#if defined(__x86_64__) && defined(__linux__)
+
+#include <sys/mman.h>
+
+/*
+    Registers while the code runs:
+        rbx     stack
+        r12     stack + bp
+        r13     stack + sp
+        r14     stack + height, for the overflow checks
+        r15     native address of every PM/0 instruction, for RET
+        rbp     &stackPc, set before a read that jitIn does the push of
+        eax     top of the stack, when cached says so
+    rdi, rcx and rdx are scratch. rbx and r12 to r15 survive the calls into C.
+*/
+#define RAX 0
+#define RCX 1
+#define RDX 2
+#define RBX 3
+#define RBP 5
+#define RDI 7
+#define R12 12
+#define R13 13
+
+#define HALT_TARGET -1      // Jump fixup going to the halt code instead of an instruction
+
+typedef struct jitFixup
+{
+    int at;         // Where the rel32 is
+    int target;     // PM/0 instruction, HALT_TARGET, or overflow stub when over is set
+    int over;
+} jitFixup;
+
+typedef struct jitBuf
+{
+    unsigned char *code;
+    int size;
+    int capacity;
+    jitFixup *fix;
+    int fixes;
+    int fixCapacity;
+} jitBuf;
+
+typedef int (*jitEntry)(int *stack, long height, void **table, volatile int *at);
+
+// The code running on this thread, for locate
+static __thread const unsigned char *running;
+static __thread const int *runningAt;      // Where each instruction's code starts, and [count] where they end
+static __thread int runningCount;
+
+/*
+    The PM/0 instruction the native code at where belongs to, -1 if it isn't in
+    the code running on this thread. The stack's fault handler asks (stackLocate),
+    so a push past the top costs nothing until it happens.
+*/
+static int locate(const void *where)
+{
+    long off = (const unsigned char *)where - running;
+    int lo = 0, hi = runningCount - 1, mid;
+
+    if (running == NULL || off < 0 || off >= runningAt[runningCount])
+        return -1;
+    while (lo < hi)         // The last one starting at or before off, some are empty
+    {
+        mid = (lo + hi + 1) / 2;
+        if (runningAt[mid] <= off)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    return lo;
+}
+
+static void jitOut(int value)
+{
+    writeNumber(sioStdout(), value);
+}
+
+static void jitIn(int *slot)
+{
+    readNumber(sioStdin(), slot);
+}
+
+static void jitOverflow(int pc)
+{
+    flushWriter(sioStdout());
+    printf("Stack overflow at %d\n", pc);
+}
+
+static void room(jitBuf *j, int n)
+{
+    if (j->size + n <= j->capacity)
+        return;
+    while (j->size + n > j->capacity)
+        j->capacity = j->capacity ? j->capacity * 2 : 4096;
+    j->code = realloc(j->code, j->capacity);
+    if (j->code == NULL)
+    {
+        printf("Out of memory for the program code\n");
+        exit(1);
+    }
+}
+
+static void byte(jitBuf *j, int b)
+{
+    room(j, 1);
+    j->code[j->size++] = (unsigned char)b;
+}
+
+static void bytes(jitBuf *j, const char *b, int n)
+{
+    room(j, n);
+    memcpy(j->code + j->size, b, n);
+    j->size += n;
+}
+
+static void int32(jitBuf *j, int v)
+{
+    room(j, 4);
+    memcpy(j->code + j->size, &v, 4);
+    j->size += 4;
+}
+
+static void int64(jitBuf *j, long long v)
+{
+    room(j, 8);
+    memcpy(j->code + j->size, &v, 8);
+    j->size += 8;
+}
+
+/*
+    op reg, [base + disp]. w makes it 64 bit. Always uses a displacement, which
+    keeps clear of the rbp/r13 and rsp/r12 special cases of the encoding.
+*/
+static void mem(jitBuf *j, int op, int reg, int base, int disp, int w)
+{
+    int rex = (w ? 8 : 0) | (reg >= 8 ? 4 : 0) | (base >= 8 ? 1 : 0);
+    int mod = disp >= -128 && disp <= 127 ? 1 : 2;
+
+    if (rex)
+        byte(j, 0x40 | rex);
+    if (op > 0xff)
+        byte(j, op >> 8);
+    byte(j, op & 0xff);
+    byte(j, mod << 6 | (reg & 7) << 3 | (base & 7));
+    if ((base & 7) == 4)
+        byte(j, 0x24);      // SIB with no index
+    if (mod == 1)
+        byte(j, disp);
+    else
+        int32(j, disp);
+}
+
+static void fixup(jitBuf *j, int target, int over)
+{
+    if (j->fixes == j->fixCapacity)
+    {
+        j->fixCapacity = j->fixCapacity ? j->fixCapacity * 2 : 256;
+        j->fix = realloc(j->fix, j->fixCapacity * sizeof(jitFixup));
+        if (j->fix == NULL)
+        {
+            printf("Out of memory for the program code\n");
+            exit(1);
+        }
+    }
+    j->fix[j->fixes].at = j->size;
+    j->fix[j->fixes].target = target;
+    j->fix[j->fixes].over = over;
+    j->fixes++;
+    int32(j, 0);
+}
+
+static void jumpTo(jitBuf *j, int target, int count)
+{
+    byte(j, 0xe9);
+    fixup(j, target >= 0 && target < count ? target : HALT_TARGET, 0);
+}
+
+static void callC(jitBuf *j, void *f)
+{
+    bytes(j, "\x48\xb8", 2);        // mov rax, f
+    int64(j, (long long)f);
+    bytes(j, "\xff\xd0", 2);        // call rax
+}
+
+// rdx = stack + base(l), the frame l levels down the static links
+static void frameDown(jitBuf *j, int l)
+{
+    bytes(j, "\x4c\x89\xe2", 3);            // mov rdx, r12
+    for (; l > 0; l--)
+    {
+        bytes(j, "\x48\x63\x52\x04", 4);    // movsxd rdx, [rdx + 4]
+        bytes(j, "\x48\x8d\x14\x93", 4);    // lea rdx, [rbx + rdx * 4]
+    }
+}
+
+// ja to a stub that reports a stack overflow at pc, when rcx went past r14
+static void checkOverflow(jitBuf *j, int pc)
+{
+    bytes(j, "\x49\x3b\xce", 3);            // cmp rcx, r14
+    bytes(j, "\x0f\x87", 2);                // ja
+    fixup(j, pc, 1);
+}
+
+// stackPc = pc, for a push past the top that happens in C where locate can't see it
+static void here(jitBuf *j, int pc)
+{
+    mem(j, 0xc7, 0, RBP, 0, 0);             // mov dword [rbp], pc
+    int32(j, pc);
+}
+
+static void loadTop(jitBuf *j, int *cached)
+{
+    if (!*cached)
+        mem(j, 0x8b, RAX, R13, 0, 0);       // mov eax, [r13]
+    *cached = 1;
+}
+
+static void pushEax(jitBuf *j)
+{
+    bytes(j, "\x49\x83\xc5\x04", 4);        // add r13, 4
+    mem(j, 0x89, RAX, R13, 0, 0);           // mov [r13], eax
+}
+
+// The native code for one instruction. cached says whether eax holds the top coming in and going out
+static void compileAt(jitBuf *j, const pm0Instr *in, int pc, int count, int *cached)
+{
+    static const unsigned char setcc[14] = {0, 0, 0, 0, 0, 0, 0, 0, 0x94, 0x95, 0x9c, 0x9e, 0x9f, 0x9d};
+    int l = in->l, m = in->m;
+
+    switch (in->op)
+    {
+        case 1:     // LIT
+            byte(j, 0xb8);                  // mov eax, m
+            int32(j, m);
+            pushEax(j);
+            *cached = 1;
+            break;
+        case 3:     // LOD
+            if (l == 0)
+                mem(j, 0x8b, RAX, R12, m * 4, 0);       // mov eax, [r12 + m * 4]
+            else
+            {
+                frameDown(j, l);
+                mem(j, 0x8b, RAX, RDX, m * 4, 0);       // mov eax, [rdx + m * 4]
+            }
+            pushEax(j);
+            *cached = 1;
+            break;
+        case 4:     // STO
+            loadTop(j, cached);
+            if (l == 0)
+                mem(j, 0x89, RAX, R12, m * 4, 0);       // mov [r12 + m * 4], eax
+            else
+            {
+                frameDown(j, l);
+                mem(j, 0x89, RAX, RDX, m * 4, 0);       // mov [rdx + m * 4], eax
+            }
+            bytes(j, "\x49\x83\xed\x04", 4);            // sub r13, 4
+            *cached = 0;
+            break;
+        case 5:     // CAL
+            if (STACK_REACH < 4)
+            {
+                mem(j, 0x8d, RCX, R13, 16, 1);          // lea rcx, [r13 + 16]
+                checkOverflow(j, pc);
+            }
+            frameDown(j, l);
+            bytes(j, "\x48\x89\xd1\x48\x29\xd9\x48\xc1\xe9\x02", 10);  // rcx = (rdx - rbx) / 4, the static link
+            mem(j, 0xc7, 0, R13, 4, 0);                 // return value
+            int32(j, 0);
+            mem(j, 0x89, RCX, R13, 8, 0);               // static link
+            bytes(j, "\x4c\x89\xe1\x48\x29\xd9\x48\xc1\xe9\x02", 10);  // rcx = bp
+            mem(j, 0x89, RCX, R13, 12, 0);              // dynamic link
+            mem(j, 0xc7, 0, R13, 16, 0);                // return address, the PM/0 one
+            int32(j, pc + 1);
+            bytes(j, "\x4d\x8d\x65\x04", 4);            // lea r12, [r13 + 4]
+            jumpTo(j, m, count);
+            *cached = 0;
+            break;
+        case 6:     // INC
+            mem(j, 0x8d, RCX, R13, m * 4, 1);           // lea rcx, [r13 + m * 4]
+            if (m < 0 || m > STACK_REACH)
+                checkOverflow(j, pc);                   // Further than the guard goes
+            bytes(j, "\x49\x89\xcd", 3);                // mov r13, rcx
+            if (m >= 0 && m <= STACK_REACH)
+                mem(j, 0x8b, RCX, R13, 0, 0);           // mov ecx, [r13], faults now if it's past the top
+            *cached = 0;
+            break;
+        case 7:     // JMP
+            jumpTo(j, m, count);
+            *cached = 0;
+            break;
+        case 8:     // JPC
+            loadTop(j, cached);
+            bytes(j, "\x49\x83\xed\x04", 4);            // sub r13, 4
+            bytes(j, "\x85\xc0\x0f\x84", 4);            // test eax, eax; jz
+            fixup(j, m >= 0 && m < count ? m : HALT_TARGET, 0);
+            *cached = 0;
+            break;
+        case 2:     // OPR
+            if (m == 0)                                 // RET
+            {
+                bytes(j, "\x4d\x89\xe5\x49\x83\xed\x04", 7);    // r13 = r12 - 4, sp = bp - 1
+                bytes(j, "\x49\x63\x4d\x0c", 4);                // movsxd rcx, [r13 + 12]
+                bytes(j, "\x4c\x8d\x24\x8b", 4);                // lea r12, [rbx + rcx * 4]
+                mem(j, 0x8b, RAX, R13, 16, 0);                  // mov eax, [r13 + 16]
+                byte(j, 0x3d);                                  // cmp eax, count
+                int32(j, count);
+                bytes(j, "\x0f\x83", 2);                        // jae halt, negative ones too
+                fixup(j, HALT_TARGET, 0);
+                bytes(j, "\x41\xff\x24\xc7", 4);                // jmp [r15 + rax * 8]
+                *cached = 0;
+                break;
+            }
+            if (m == 1 || m == 6)
+            {
+                loadTop(j, cached);
+                if (m == 1)
+                    bytes(j, "\xf7\xd8", 2);            // neg eax
+                else
+                    bytes(j, "\x83\xe0\x01", 3);        // and eax, 1
+                mem(j, 0x89, RAX, R13, 0, 0);
+                break;
+            }
+            if (m < 2 || m > 13)
+                break;                                  // Does nothing, like on the interpreters
+            loadTop(j, cached);
+            bytes(j, "\x89\xc1", 2);                    // mov ecx, eax
+            mem(j, 0x8b, RAX, R13, -4, 0);              // mov eax, [r13 - 4]
+            bytes(j, "\x49\x83\xed\x04", 4);            // sub r13, 4
+            switch (m)
+            {
+                case 2: bytes(j, "\x01\xc8", 2); break;                 // add eax, ecx
+                case 3: bytes(j, "\x29\xc8", 2); break;                 // sub eax, ecx
+                case 4: bytes(j, "\x0f\xaf\xc1", 3); break;             // imul eax, ecx
+                case 5: bytes(j, "\x99\xf7\xf9", 3); break;             // cdq; idiv ecx
+                case 7: bytes(j, "\x99\xf7\xf9\x89\xd0", 5); break;     // cdq; idiv ecx; mov eax, edx
+                default:
+                    bytes(j, "\x39\xc8\x0f", 3);                        // cmp eax, ecx; setcc al
+                    byte(j, setcc[m]);
+                    bytes(j, "\xc0\x0f\xb6\xc0", 4);                    // movzx eax, al
+                    break;
+            }
+            mem(j, 0x89, RAX, R13, 0, 0);
+            break;
+        case 9:     // SIO
+            if (m == 0)
+            {
+                loadTop(j, cached);
+                bytes(j, "\x89\xc7", 2);                // mov edi, eax
+                bytes(j, "\x49\x83\xed\x04", 4);        // sub r13, 4
+                callC(j, (void *)jitOut);
+                *cached = 0;
+            }
+            else if (m == 1)
+            {
+                here(j, pc);
+                bytes(j, "\x49\x83\xc5\x04", 4);        // add r13, 4
+                bytes(j, "\x4c\x89\xef", 3);            // mov rdi, r13
+                callC(j, (void *)jitIn);
+                *cached = 0;
+            }
+            else if (m == 2)
+            {
+                byte(j, 0xe9);
+                fixup(j, HALT_TARGET, 0);
+            }
+            break;
+    }
+}
+
+int runJit(const pm0Instr *code, int count, int *stack, int height)
+{
+    jitBuf j;
+    char *target = calloc(count + 1, 1);
+    int *at = malloc((count + 1) * sizeof(int)), *reload = malloc((count + 1) * sizeof(int));
+    int *over = malloc((count + 1) * sizeof(int)), *native = malloc((count + 1) * sizeof(int));
+    void **table = malloc((count + 1) * sizeof(void *));
+    int i, cached, halt, epilogue, overflow, result, m;
+    unsigned char *exec;
+
+    if (target == NULL || at == NULL || reload == NULL || over == NULL || native == NULL || table == NULL)
+    {
+        printf("Out of memory for the program code\n");
+        exit(1);
+    }
+    memset(&j, 0, sizeof(j));
+    for (i = 0; i < count; i++)
+    {
+        m = code[i].m;
+        if ((code[i].op == 5 || code[i].op == 7 || code[i].op == 8) && m >= 0 && m < count)
+            target[m] = 1;
+    }
+
+    bytes(&j, "\x53\x55\x41\x54\x41\x55\x41\x56\x41\x57", 10);     // push rbx, rbp, r12 to r15
+    bytes(&j, "\x48\x83\xec\x08", 4);                               // sub rsp, 8, calls want it 16 aligned
+    bytes(&j, "\x48\x89\xfb", 3);                                   // mov rbx, rdi
+    bytes(&j, "\x4c\x8d\x63\x04", 4);                               // lea r12, [rbx + 4], bp = 1
+    bytes(&j, "\x49\x89\xdd", 3);                                   // mov r13, rbx, sp = 0
+    bytes(&j, "\x4c\x8d\x34\xb3", 4);                               // lea r14, [rbx + rsi * 4]
+    bytes(&j, "\x49\x89\xd7", 3);                                   // mov r15, rdx
+    bytes(&j, "\x48\x89\xcd", 3);                                   // mov rbp, rcx
+
+    cached = 0;
+    for (i = 0; i < count; i++)
+    {
+        if (target[i])
+            cached = 0;     // Jumps arrive with the top only in memory
+        at[i] = j.size;
+        reload[i] = cached;
+        over[i] = -1;
+        compileAt(&j, &code[i], i, count, &cached);
+    }
+    halt = j.size;          // Also where running off the end goes
+    at[count] = halt;
+    memcpy(native, at, (count + 1) * sizeof(int));     // at changes below for the ones reached with eax
+    reload[count] = 0;
+    bytes(&j, "\x31\xc0", 2);                                       // xor eax, eax
+    epilogue = j.size;
+    bytes(&j, "\x48\x83\xc4\x08", 4);                               // add rsp, 8
+    bytes(&j, "\x41\x5f\x41\x5e\x41\x5d\x41\x5c\x5d\x5b\xc3", 11); // pop r15 to r12, rbp, rbx; ret
+    overflow = j.size;
+    callC(&j, (void *)jitOverflow);
+    byte(&j, 0xb8);                                                 // mov eax, 1
+    int32(&j, 1);
+    byte(&j, 0xe9);                                                 // jmp epilogue
+    int32(&j, epilogue - (j.size + 4));
+
+    // Overflow stubs, one per instruction that checks, and a way in for a RET to an instruction expecting eax
+    for (i = 0; i < j.fixes; i++)
+        if (j.fix[i].over && over[j.fix[i].target] < 0)
+        {
+            over[j.fix[i].target] = j.size;
+            byte(&j, 0xbf);                                         // mov edi, pc
+            int32(&j, j.fix[i].target);
+            byte(&j, 0xe9);
+            int32(&j, overflow - (j.size + 4));
+        }
+    for (i = 0; i < count; i++)
+        if (reload[i])
+        {
+            m = j.size;
+            mem(&j, 0x8b, RAX, R13, 0, 0);                          // mov eax, [r13]
+            byte(&j, 0xe9);
+            int32(&j, at[i] - (j.size + 4));
+            at[i] = m;
+        }
+    for (i = 0; i < j.fixes; i++)
+    {
+        if (j.fix[i].over)
+            m = over[j.fix[i].target];
+        else if (j.fix[i].target == HALT_TARGET)
+            m = halt;
+        else
+            m = at[j.fix[i].target];    // Only jump targets, which never expect eax
+        m -= j.fix[i].at + 4;
+        memcpy(j.code + j.fix[i].at, &m, 4);
+    }
+
+    exec = mmap(NULL, j.size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (exec == MAP_FAILED)
+        result = -1;
+    else
+    {
+        memcpy(exec, j.code, j.size);
+        if (mprotect(exec, j.size, PROT_READ | PROT_EXEC) != 0)
+            result = -1;
+        else
+        {
+            for (i = 0; i <= count; i++)
+                table[i] = exec + at[i];
+            stack[1] = stack[2] = stack[3] = 0;
+            running = exec;
+            runningAt = native;
+            runningCount = count;
+            stackLocate = locate;
+            result = ((jitEntry)(void *)exec)(stack, height, table, &stackPc);
+            stackLocate = NULL;
+            running = NULL;
+            flushWriter(sioStdout());
+        }
+        munmap(exec, j.size);
+    }
+    free(j.code);
+    free(j.fix);
+    free(target);
+    free(at);
+    free(reload);
+    free(over);
+    free(native);
+    free(table);
+    return result;
+}
+
+#else
+
+int runJit(const pm0Instr *code, int count, int *stack, int height)
+{
+    return -1;      // No code generator for this machine
+}
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef JIT_H_INCLUDED
+#define JIT_H_INCLUDED
+
+#include "pm0.h"
+
+/**
+ *  Compiles the program to x86-64 machine code and runs that (Linux only).
+ *
+ *  Every PM/0 instruction turns into a few native instructions in an mmap'd
+ *  buffer: bp and sp are kept as pointers in registers, and the top of the stack
+ *  stays in eax between instructions of the same block. Pushes still go to
+ *  memory as well, so the stack looks exactly as it does on the interpreters.
+ *  CAL and RET use the same activation records, RET finds where to go through a
+ *  table with the native address of every PM/0 instruction. Only OUT, INP and
+ *  the stack overflow message call back into C.
+ *
+ *  Arguments and the return value are the same as runFast's, except it returns
+ *  -1 without running anything when there's no JIT here (another CPU, or no
+ *  executable memory), so the caller can use an interpreter instead.
+ */
+int runJit(const pm0Instr *code, int count, int *stack, int height);
+
+#endif // JIT_H_INCLUDED
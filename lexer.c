@@ -8,8 +8,13 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "lexer.h"
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #define TOK_WIDTH 13    // The max width of an identifier
+#define MAX_CLASSES 64  // More than enough character classes for the DFA
 
 
 // Each token of the program will be placed in a tokNode
@@ -136,6 +141,70 @@ const char edges [79] [256]={/*NUL, SOH, STX, ETX, EOT, ENQ, ACK, BEL, BS, HT, L
               /* state 0, 1, 2, 3, 4, 5,  6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40, 41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, 52, 53, 54, 55, 56, 57, 58, 59, 60, 61, 62, 63, 64, 65, 66, 67, 68, 69, 70, 71, 72, 73, 74, 75, 76, 77, 78*/
 const int symbols[79]={0, 1, 2, 2, 2, 2, 21, 2, 2, 2, 27,  2,  2,  2, 28,  2, 26,  2,  2,  2, 33,  2, 22,  2, 23,  2,  2,  8,  2,  2,  2,  2,  2,  2,  2,  2, 30,  2,  2,  2, 32,  2,  2,  2, 24,  2,  2, 29,  2,  2,  2,  2, 25,  2,  2,  2, 31,  2, 18,  3,  4, 19,  7,  0,  0,  1,  5,  6,  9, 11, 10, 12, 13, 14, 15, 16, 17,  0, 20};
 
+/*
+    edges[][] stays the master copy of the DFA, but it's 20 KB and most of its
+    columns are copies of each other (every capital letter behaves the same, and
+    so on). At start up we squash it: characters whose columns match in every
+    state get the same class number, and the lexer looks up
+    classEdges[state][charClass[c]] instead. That comes out at 36 classes, so the
+    whole thing is under 3 KB and stays in L1 with everything else.
+
+    Nothing changes in what state you end up in, so the sheet of DFAs still
+    applies. Edit edges[][], not these.
+*/
+static unsigned char charClass[256];
+static unsigned char classEdges[79][MAX_CLASSES];
+static int numClasses = 0;
+static int classesReady = 0;    // 0 not built yet, 1 some thread is building them, 2 built
+
+#define NEXT_STATE(state, next) (classEdges[state][charClass[(unsigned char)(next)]])
+
+static void buildClasses()
+{
+    int c, d, s;
+    int rep[MAX_CLASSES];   // A character standing in for each class
+
+    for (c = 0; c < 256; c++)
+    {
+        for (d = 0; d < numClasses; d++)
+        {
+            for (s = 0; s < 79; s++)
+                if (edges[s][c] != edges[s][rep[d]])
+                    break;
+            if (s == 79)    // Same column as class d all the way down
+                break;
+        }
+        if (d == numClasses)
+        {
+            rep[d] = c;
+            for (s = 0; s < 79; s++)
+                classEdges[s][d] = edges[s][c];
+            numClasses++;
+        }
+        charClass[c] = d;
+    }
+}
+
+/*
+    Compilers on different threads all share the tables, so the first one in
+    builds them and the rest wait for it. Once they are there it's one load.
+*/
+static void needClasses()
+{
+    int expected = 0;
+
+    if (__atomic_load_n(&classesReady, __ATOMIC_ACQUIRE) == 2)
+        return;
+    if (__atomic_compare_exchange_n(&classesReady, &expected, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE))
+    {
+        buildClasses();
+        __atomic_store_n(&classesReady, 2, __ATOMIC_RELEASE);
+    }
+    else
+        while (__atomic_load_n(&classesReady, __ATOMIC_ACQUIRE) != 2)
+            ;                       // A few microseconds at most
+}
+
 /*  int nextState(int state, char next)
 
     This function takes in one state and the next character. It returns the next
@@ -169,6 +238,7 @@ const int symbols[79]={0, 1, 2, 2, 2, 2, 21, 2, 2, 2, 27,  2,  2,  2, 28,  2, 26
 */
 
 int getNextToken(FILE *inFile, int *ftoken, char *value);    // Gets the next token in the file
+int getNextTokenBuf(const char **cursor, const char *end, int *ftoken, char *value, char *error);  // Gets the next token from a buffer
 int nextState(int state, char next);    // Retrieves next state for analyzeTokens
 
 
@@ -187,6 +257,8 @@ int getNextToken(FILE *inFile, int *ftoken, char *value)
 
 
 
+    needClasses();
+
     stateNow = 1;   // Initialize at the "Begin / End" state
     statePrev = 1;  // Initialize at the "Begin / End" state
     position = 0;
@@ -197,10 +269,10 @@ int getNextToken(FILE *inFile, int *ftoken, char *value)
         c = getc(inFile);    //Retrieves the first char of the next token
 
         if (c == EOF) {
-            stateNow = nextState(statePrev, ' ');   // EOF = -1 which would break my function. Instead I pass it white space
+            stateNow = NEXT_STATE(statePrev, ' ');   // EOF = -1 which would break my function. Instead I pass it white space
         }
         else {
-            stateNow = nextState(statePrev, c);     // Get the next state
+            stateNow = NEXT_STATE(statePrev, c);     // Get the next state
         }
 
         if (stateNow == 1)  // if we are back at 1
@@ -327,7 +399,225 @@ int getNextToken(FILE *inFile, int *ftoken, char *value)
 }
 
 
+
+/*
+    Bulk skipping helpers for getNextTokenBuf. Each returns how far it is safe
+    to jump without running the DFA. With SSE2 they look at 16 bytes at a time,
+    otherwise they just loop, which is still cheaper than a table lookup per
+    character. A 0xFF byte reads back as EOF through getc, so none of them will
+    skip over one.
+*/
+static const char *skipWhitespace(const char *p, const char *end)   // State 1: control characters, space and DEL
+{
+#if defined(__SSE2__)
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i del = _mm_set1_epi8(127);
+    while (end - p >= 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)p);
+        __m128i ws = _mm_or_si128(_mm_cmpeq_epi8(_mm_min_epu8(v, space), v), _mm_cmpeq_epi8(v, del));
+        unsigned mask = ~(unsigned)_mm_movemask_epi8(ws) & 0xFFFF;
+        if (mask)
+            return p + __builtin_ctz(mask);
+        p += 16;
+    }
+#endif
+    while (p < end && ((unsigned char)*p <= ' ' || *p == 127))
+        p++;
+    return p;
+}
+
+static const char *skipComment(const char *p, const char *end)     // State 63: anything but '*' stays in the comment
+{
+#if defined(__SSE2__)
+    const __m128i star = _mm_set1_epi8('*');
+    const __m128i eof = _mm_set1_epi8((char)0xFF);
+    while (end - p >= 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)p);
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, star), _mm_cmpeq_epi8(v, eof)));
+        if (mask)
+            return p + __builtin_ctz(mask);
+        p += 16;
+    }
+#endif
+    while (p < end && *p != '*' && *p != (char)0xFF)
+        p++;
+    return p;
+}
+
+static int runLength(const char *p, const char *end, int digitsOnly, int max) // States 57 and 59: letters/digits or just digits
+{
+    int n = 0;
+#if defined(__SSE2__)
+    if (end - p >= 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)p);
+        __m128i d = _mm_sub_epi8(v, _mm_set1_epi8('0'));
+        __m128i ok = _mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8(9)), d);
+        if (!digitsOnly)
+        {
+            __m128i a = _mm_sub_epi8(_mm_or_si128(v, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+            ok = _mm_or_si128(ok, _mm_cmpeq_epi8(_mm_min_epu8(a, _mm_set1_epi8(25)), a));
+        }
+        n = __builtin_ctz(~(unsigned)_mm_movemask_epi8(ok) | 0x10000);
+        return n < max ? n : max;
+    }
+#endif
+    while (n < max && p + n < end
+           && ((p[n] >= '0' && p[n] <= '9') || (!digitsOnly && ((p[n] >= 'a' && p[n] <= 'z') || (p[n] >= 'A' && p[n] <= 'Z')))))
+        n++;
+    return n;
+}
+
+/*  int getNextTokenBuf(const char **cursor, const char *end, int *ftoken, char *value, char *error)
+
+    Same DFA walk as getNextToken, but the program is already sitting in memory
+    (mapped or read in one go) so we just move a pointer along it instead of
+    going through getc/ungetc for every character. "Putting a character back"
+    is simply not moving the cursor past it.
+
+    The cursor is left on the first character after the token, exactly where
+    ungetc would have left the file. Tokens and error messages are the same as
+    getNextToken gives for the same bytes, except the error message is written
+    into error (LEX_ERROR_SIZE bytes) instead of being printed, so the caller
+    can decide when to show it. Nothing is closed on an error either, the
+    caller owns the buffer.
+*/
+int getNextTokenBuf(const char **cursor, const char *end, int *ftoken, char *value, char *error)
+{
+    const char *p = *cursor;   // Our place in the buffer
+    char c = ' ';
+    int num;
+
+    char tok[TOK_WIDTH];
+    int stateNow = 1;   // Initialize at the "Begin / End" state
+    int statePrev = 1;
+    int position = 0;
+
+    needClasses();
+    tok[0] = '\0';
+    while ( c != EOF )
+    {
+        if (p < end)
+            c = *p++;
+        else
+            c = EOF;    // Out of buffer, behave as getc would at the end of the file
+
+        if (c == EOF) {
+            stateNow = NEXT_STATE(statePrev, ' ');
+        }
+        else {
+            stateNow = NEXT_STATE(statePrev, c);
+        }
+
+        if (stateNow == 1)
+        {
+            if (statePrev == 1) {
+                p = skipWhitespace(p, end);     // The rest of this run of white space can't change anything
+                continue;
+            }
+            else if (statePrev == 65)   // End of a comment, the character belongs to whatever is next
+            {
+                if (c != EOF)
+                    p--;
+                position = 0;
+                tok[0] = '\0';
+            }
+            else
+            {
+                if (statePrev == 59)
+                {
+                    num = atoi(tok);
+                    if (num > 65535)
+                    {
+                        snprintf(error, LEX_ERROR_SIZE, "Error, max number size is 65535 and %d was given.", num);
+                        *cursor = p;
+                        return 1;
+                    }
+                }
+
+                if (c != EOF)
+                    p--;        // The character starts the next token
+                *ftoken = symbols[statePrev];
+                strcpy(value, tok);
+                *cursor = p;
+                return 0;
+            }
+        }
+        else if (stateNow == 0)
+        {
+            if (statePrev == 59)
+            {
+                snprintf(error, LEX_ERROR_SIZE, "Error, identifier started with number.\n");
+            } else if (statePrev == 77)
+            {
+                snprintf(error, LEX_ERROR_SIZE, "Error, expected '=' after ':' but '%c' was encountered instead.\n", c);
+            } else
+            {
+                snprintf(error, LEX_ERROR_SIZE, "Error, char is not found in pl0 lexography.\n");
+            }
+            *cursor = p;
+            return 1;
+        }
+        else
+        {
+            if (position + 1 > TOK_WIDTH - 1){
+                if (stateNow == 59)
+                    snprintf(error, LEX_ERROR_SIZE, "Error: Number too large.\n");
+                else
+                    snprintf(error, LEX_ERROR_SIZE, "Error: identifier too long.\n");
+                *cursor = p;
+                return 1;
+            }
+
+            if (stateNow < 63 || stateNow > 65)
+            {
+                tok[position] = c;
+                tok[position+1] = '\0';
+                position++;
+            }
+
+            /*
+                Long runs that can't change the outcome are taken in bulk: the
+                inside of a comment, and the rest of an identifier or number.
+                The walk picks up again at the first character that does
+                something, so the result is the same.
+            */
+            if (stateNow == 63)
+                p = skipComment(p, end);
+            else if ((stateNow == 57 || stateNow == 59) && position < TOK_WIDTH - 1)
+            {
+                num = runLength(p, end, stateNow == 59, TOK_WIDTH - 1 - position);
+                memcpy(tok + position, p, num);
+                position += num;
+                tok[position] = '\0';
+                p += num;
+            }
+        }
+        statePrev = stateNow;
+    }
+    *cursor = p;
+    if (stateNow != 1)
+    {
+        if (stateNow == 0)
+        {
+            snprintf(error, LEX_ERROR_SIZE, "Ended file on an error.\n");
+        } else if (stateNow !=63 && stateNow != 64)
+        {
+            snprintf(error, LEX_ERROR_SIZE, "Ended file unexpectedly in the middle of a token.\n");
+        } else
+        {
+            snprintf(error, LEX_ERROR_SIZE, "Ended file in the middle of a comment.\n");
+        }
+        return 1;
+    }
+    *ftoken = 1;
+    return 0;
+}
+
 int nextState(int state, char next)
 {
-    return edges[state][(int)next];
+    needClasses();
+    return NEXT_STATE(state, next);
 }
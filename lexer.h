@@ -1,7 +1,10 @@
 #ifndef LEXER_H_INCLUDED
 #define LEXER_H_INCLUDED
 
+#define LEX_ERROR_SIZE 128  // Room for any message getNextTokenBuf writes
+
 int getNextToken(FILE *inFile, int *ftoken, char *value);    // Gets the next token in the file
+int getNextTokenBuf(const char **cursor, const char *end, int *ftoken, char *value, char *error);  // Gets the next token from a buffer, moves the cursor past it
 int nextState(int state, char next);    // Retrieves next state for analyzeTokens
 
 #endif // LEXER_H_INCLUDED
@@ -0,0 +1,102 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "linemap.h"
+#include "nomem.h"
+
+void initLineMap(lineMap *map)
+{
+    memset(map, 0, sizeof(*map));
+}
+
+void freeLineMap(lineMap *map)
+{
+    free(map->ranges);
+    free(map->source);
+    memset(map, 0, sizeof(*map));
+}
+
+void markLine(lineMap *map, int pc, int line, int column)
+{
+    lineRange *last = map->count > 0 ? &map->ranges[map->count - 1] : NULL, *bigger;
+    int cap = map->capacity ? map->capacity * 2 : 256;
+
+    if (last != NULL && last->line == line && last->column == column)
+        return;
+    if (last != NULL && last->pc >= pc)     // Nothing was barked for the one before, it's replaced
+    {
+        last->line = line;
+        last->column = column;
+        if (map->count > 1 && last[-1].line == line && last[-1].column == column)
+            map->count--;
+        return;
+    }
+    if (map->count == map->capacity)
+    {
+        if ((bigger = realloc(map->ranges, cap * sizeof(lineRange))) == NULL)
+            outOfMemory("Out of memory for the line map\n");
+        map->ranges = bigger;
+        map->capacity = cap;
+    }
+    map->ranges[map->count].pc = pc;
+    map->ranges[map->count].line = line;
+    map->ranges[map->count].column = column;
+    map->count++;
+}
+
+int writeLineMap(FILE *out, const lineMap *map)
+{
+    int i;
+
+    fprintf(out, "%s %d\nsource %s\n", LINEMAP_MAGIC, LINEMAP_VERSION, map->source != NULL ? map->source : "");
+    for (i = 0; i < map->count; i++)
+        fprintf(out, "%d %d %d\n", map->ranges[i].pc, map->ranges[i].line, map->ranges[i].column);
+    return ferror(out) != 0;
+}
+
+int loadLineMap(const char *path, lineMap *map)
+{
+    FILE *file;
+    char word[16], source[4096];
+    int version, pc, line, column, n;
+
+    initLineMap(map);
+    file = fopen(path, "r");
+    if (file == NULL)
+        return 1;
+    if (fscanf(file, "%15s %d ", word, &version) != 2 || strcmp(word, LINEMAP_MAGIC) != 0 || version != LINEMAP_VERSION ||
+        fgets(source, sizeof(source), file) == NULL || strncmp(source, "source ", 7) != 0)
+    {
+        printf("Error, %s is not a line map\n", path);
+        fclose(file);
+        return 2;
+    }
+    n = strcspn(source, "\r\n");
+    source[n] = '\0';
+    if (n > 7)
+    {
+        map->source = malloc(n - 6);
+        if (map->source != NULL)
+            strcpy(map->source, source + 7);
+    }
+    while (fscanf(file, "%d %d %d", &pc, &line, &column) == 3)
+        if (map->count == 0 || pc > map->ranges[map->count - 1].pc)     // Anything out of order would break lineAt
+            markLine(map, pc, line, column);
+    fclose(file);
+    return 0;
+}
+
+int lineAt(const lineMap *map, int pc)
+{
+    int low = 0, high = map->count - 1, mid;
+
+    while (low <= high)     // Last range starting at or before pc
+    {
+        mid = (low + high) / 2;
+        if (map->ranges[mid].pc <= pc)
+            low = mid + 1;
+        else
+            high = mid - 1;
+    }
+    return high;
+}
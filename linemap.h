@@ -0,0 +1,43 @@
+#ifndef LINEMAP_H_INCLUDED
+#define LINEMAP_H_INCLUDED
+
+#include <stdio.h>
+
+#define LINEMAP_MAGIC "pm0map"  // First word of a map file
+#define LINEMAP_VERSION 1
+
+// Code from pc on, up to the next range, came from the statement at line and column
+typedef struct lineRange
+{
+    int pc;
+    int line;           // Both count from 1
+    int column;
+} lineRange;
+
+/**
+ *  Which part of the source every instruction came from, one range per run of
+ *  instructions barked for the same statement, sorted by pc. It's built while the
+ *  code is barked (see codebuf.h), so only the compiler's -g pays for it.
+ *
+ *  It's kept next to the program as <program>.map, a text file:
+ *      pm0map 1
+ *      source <path of the .pl0, the rest of the line>
+ *      <pc> <line> <column>, one range to a line
+ *  Text or binary code alike, the pcs are the same.
+ */
+typedef struct lineMap
+{
+    int count;
+    int capacity;
+    lineRange *ranges;
+    char *source;       // Path of the source as the compiler got it, NULL if not known
+} lineMap;
+
+void initLineMap(lineMap *map);
+void freeLineMap(lineMap *map);
+void markLine(lineMap *map, int pc, int line, int column);     // Code from pc on comes from line and column, nothing if it already does
+int writeLineMap(FILE *out, const lineMap *map);                // Returns 1 if it couldn't all be written
+int loadLineMap(const char *path, lineMap *map);                // Returns 1 if there's no map there, 2 and says why if it isn't one
+int lineAt(const lineMap *map, int pc);                         // Index of the range pc is in, -1 if it's before all of them
+
+#endif // LINEMAP_H_INCLUDED
@@ -1,650 +1,237 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include "lexer.h"
+#include "compiler.h"
+#include "cache.h"
+#include "source.h"
+#include "pm0.h"
+#include "peephole.h"
+#include "perf.h"
+#include "linemap.h"
 
-/**
- *  MSTS is Max Symbol Table Size
- *  MPS is Max Program Size
- */
-
-#define MSTS 100
-#define MPS 500
-
-typedef struct symbol
-{
-    int kind;       // const = 1, var = 2, proc = 3
-    char name[13];  // name up to 12 chars
-    int val;        // number
-    int level;      // L level
-    int addr;       // M address
-} symbol;
-
-typedef struct token
-{
-    int idNum;
-    char ident[13];
-    int value;
-} token;
-
-typedef struct command
-{
-    int op;
-    int lex;
-    int mod;
-} command;
-
-enum Token_Name
+static void reportStats(const compileStats *stats, int mode)
 {
-    nulsym = 1,
-    identsym = 2,
-    numbersym = 3,
-    plussym = 4,
-    minussym = 5,
-    multsym = 6,
-    slashsym = 7,
-    oddsym = 8,
-    eqlsym = 9,
-    neqsym = 10,
-    lessym = 11,
-    leqsym = 12,
-    gtrsym = 13,
-    geqsym = 14,
-    lparentsym = 15,
-    rparentsym = 16,
-    commasym = 17,
-    semicolonsym = 18,
-    periodsym = 19,
-    becomessym = 20,
-    beginsym = 21,
-    endsym = 22,
-    ifsym = 23,
-    thensym = 24,
-    whilesym = 25,
-    dosym = 26,
-    callsym = 27,
-    constsym = 28,
-    varsym = 29,
-    procsym = 30,
-    writesym = 31,
-    readsym = 32,
-    elsesym = 33
-};
-const char symbolName[34][13] = {"", "nulsym", "identsym", "numbersym", "plussym", "minussym", "multsym", "slashsym", "oddsym", "eqlsym", "neqsym", "lessym", "leqsym", "gtrsym", "geqsym", "lparentsym",
-                                 "rparentsym", "commasym", "semicolonsym", "periodsym", "becomessym", "beginsym", "endsym", "ifsym", "thensym", "whilesym", "dosym", "callsym", "constsym", "varsym",
-                                 "procsym", "writesym", "readsym", "elsesym"};
-
-/**
- *  Used by the three Ident functions to keep track of what ident is where
- *
- */
-symbol symbolTable[MSTS];
-
-/**
- *  Used by the command barker to store the finished program before output
- *
- */
-command outputProgram[MPS];
-
-/**
- *  pos is the current position for the end of the symbol table
- *  frameSize determines where new variables will be stored in the stack as well as the size of the stack
- *  commandPos is the current position for the end of the program code
- *  tokenNum is the token number of the current token. Used to tell the user where there is a problem
- *  tok is the current token being parsed
- *  InFile and OutFile are the input and output files
- *      They are only opened in Main. They can be closed anywhere when we detect an error.
- */
-int pos = 0, frameSize = 4, commandPos = 0, tokenNum = 0;
-token tok;
-FILE *inFile, *outFile;
-
-/**
- *  Non-Terminal Symbols
- *  Used in Tiny PL0 Grammar
- */
-void program();
-void block();
-void constDec();
-void varDec();
-void statement();
-void condition();
-void expression();
-void term();
-void factor();
+    if (mode == PERF_OFF)
+        return;
+    fflush(stdout);     //After the compiler's own messages, like --perf
+    printStats(stats, stderr, mode == PERF_JSON);
+}
 
 /**
- *  These provide functionality to our compiler
+ *  The command line compiler, the compiling itself is in compiler.c
  *
+ *  The code is streamed into partPath while we parse, and only renamed to outPath once the whole program compiled.
+ *  binaryOut is set by --binary, the program is then written as a binary object file (see pm0.h)
+ *  optimize holds the PEEP_ flags from -O. The code is then kept in memory until the peephole pass has run
+ *  buildIR holds the IR_ flags from --ir. Each block's statement is then built as IR and optimized before it's barked
+ *  cacheDir is from --cache, or PL0_CACHE if that's set. A program compiled before is then copied out of it (see cache.h)
+ *  perfOut is from --perf, or PL0_PERF. Each phase is then counted and the counts printed to stderr at the end (see perf.h)
+ *  mapLines is set by -g. Where every instruction came from in the source is then written to outPath.map (see linemap.h).
+ *  The cache doesn't keep maps, so with -g it isn't used
+ *  statsOut is from --stats, the same text or json as --perf. Where the compile spent its time and memory is then printed to stderr (see stats.h)
  */
-void consume(int last);             //Consumes the old token, and gets a new one. Will complain if it gets heartburn (unexpected token)
-void bark(int op, int l, int m);    //Barks out command
-void rebark(int addr, int m);       //Updates command with new modifier
-void emitBark();                    //Outputs program to the file
-void ident(int kind);               //Adds ident to symbol table
-void getIdent(char * name);         //Finds memory address in symbol table and pushes value to top of stack
-void storeIdent(char * name);       //Finds memory address in symbol table and stores top of stack there
-
-
 int main(int argc, char **argv)
 {
-    if (argc < 2)
-    {
-        printf("Error: Not enough arguments.\n\"Compile <inputFile> <outputFile>\" is minimum required command line.\n Cannot continue.\n");
-        return 0;
-    }
-    inFile = fopen(argv[1], "r");
-    if (inFile == NULL)
-    {
-        printf("Error, File not found!\n");
-        return 0;
-    }
-    tok.idNum = 1;
-    consume(nulsym);
-
-    program();
-
-    if (inFile!=NULL)
-        fclose(inFile);
-    printf("No Errors, program syntactically correct.\n");
-
-    outFile = fopen(argv[2], "w");
-    emitBark();
-    fclose(outFile);
-
-    return 0;
-}
-
-void program()
-{
-    block();
-    consume(periodsym);
-    bark(9, 0, 2);
-}
-
-void block()
-{
-    constDec();
-    varDec();
-    statement();
-}
-
-void constDec()
-{
-    if (tok.idNum == constsym)
-    {
-        consume(constsym);
-        ident(1);
-        /* consume(eqlsym); // Ident will handle this
-        number(); */
-        while (tok.idNum == commasym)
+    char *inPath = NULL, *outPath = NULL, *partPath, *cacheDir = getenv("PL0_CACHE"), *perfEnv = getenv("PL0_PERF");
+    int i, perfOut = perfEnv != NULL ? perfMode(perfEnv) : PERF_OFF, binaryOut = 0, optimize = 0, buildIR = 0, showStats = 0, useCache = 0, hit = 0, failed, internal = 0;
+    int mapLines = 0, statsOut = PERF_OFF;
+    long long cacheMax = CACHE_MAX;
+    FILE *inFile, *outFile;
+    sourceBuf source;
+    compiler comp;
+    compileCache cache;
+    cacheKey key;
+    cacheEntry entry;
+    cacheStats total;
+    lineMap lines;
+    compileStats stats;
+    static perfSet perf;                //Printed after main returns
+
+    for (i = 1; i < argc; i++)          //Options can go anywhere, the first two other arguments are the files
+    {
+        if (strcmp(argv[i], "--binary") == 0)
+            binaryOut = 1;
+        else if (strcmp(argv[i], "-g") == 0)
+            mapLines = 1;
+        else if (strncmp(argv[i], "-O", 2) == 0)
         {
-            consume(commasym);
-            ident(1);
+            optimize = peepFlags(argv[i] + 2);
+            if (optimize < 0)
+            {
+                printf("Error: -O takes a list of fold, branch, jumps and dead, like -O=fold,jumps\n");
+                return 0;
+            }
         }
-        consume(semicolonsym);
-    }
-}
-
-void varDec()
-{
-    if (tok.idNum == varsym)
-    {
-        consume(varsym);
-        ident(2);
-        while (tok.idNum == commasym)
+        else if (strncmp(argv[i], "--ir", 4) == 0)
         {
-            consume(commasym);
-            ident(2);
+            buildIR = irFlags(argv[i] + 4);
+            if (buildIR < 0)
+            {
+                printf("Error: --ir takes a list of const, cse, dse and unreachable, like --ir=const,cse\n");
+                return 0;
+            }
         }
-        consume(semicolonsym);
-    }
-    bark(6, 0, frameSize);             //Set up our stack frame with room for all of our variables
-}
-
-void statement()
-{
-    char id[13];
-    int save, save2;
-    switch (tok.idNum)
-    {
-        case identsym : strcpy(id, tok.ident);  //<ident> := <expression> ** Store the value of the ident token for later
-                        consume(identsym);
-                        consume(becomessym);
-                        expression();
-                        storeIdent(id);         //Store the value at the top of the stack into the memory address for the identifier we started with.
-                        break;
-        case beginsym : consume(beginsym);      //begin <statement> {; <statement>} end
-                        statement();
-                        while (tok.idNum == semicolonsym)
-                        {
-                            consume(semicolonsym);
-                            statement();
-                        }
-                        consume(endsym);
-                        break;
-        case ifsym    : consume(ifsym);         //if <condition> then <statement>
-                        condition();
-                        save = commandPos;      //Save the current command position so we can rebark it later
-                        bark(8, 0, 0);          //Bark out a jump if condition resolved to 0
-                        consume(thensym);
-                        statement();
-                        rebark(save, commandPos);   //Update the mod of our jump command to go to the next instruction after the body of the then.
-                        break;
-        case whilesym : consume(whilesym);      //while <condition> do <statement>
-                        save2 = commandPos;
-                        condition();
-                        save = commandPos;      //Save the current command position so we can rebark it later
-                        bark(8, 0, 0);          //Bark out a jump if condition resolved to 0
-                        consume(dosym);
-                        statement();
-                        bark(7, 0, save2);
-                        rebark(save, commandPos);   //Update the mod of our jump command to go to the next instruction after the body of the loop.
-                        break;
-        case readsym  : consume(readsym);       //read <ident>
-                        bark(9, 0, 1);          //Bark out a read from user input command
-                        storeIdent(tok.ident);  //Store the value read in to the ident token we were given.
-                        consume(identsym);
-                        break;
-        case writesym : consume(writesym);      //write <ident>
-                        getIdent(tok.ident);    //Retrieve the value of the ident token we were given
-                        bark(9, 0, 0);          //Bark the command to write out the value on the top of the stack to the screen
-                        consume(identsym);
-                        break;
-        default       : break;
-    }
-}
-
-void condition()
-{
-    if (tok.idNum == oddsym)
-    {
-        consume(oddsym);
-        expression();
-    } else
-    {
-        expression();
-        int op = tok.idNum;
-        switch(tok.idNum)
+        else if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc)
+            cacheDir = argv[++i];
+        else if (strcmp(argv[i], "--no-cache") == 0)
+            cacheDir = NULL;
+        else if (strcmp(argv[i], "--cache-max") == 0 && i + 1 < argc)
         {
-            case eqlsym : consume(eqlsym);
-                          break;
-            case neqsym : consume(neqsym);
-                          break;
-            case lessym : consume(lessym);
-                          break;
-            case leqsym : consume(leqsym);
-                          break;
-            case gtrsym : consume(gtrsym);
-                          break;
-            case geqsym : consume(geqsym);
-                          break;
-            default     : consume(neqsym);  // If it's not one of these we need an error of some kind.
+            cacheMax = parseSize(argv[++i]);
+            if (cacheMax < 0)
+            {
+                printf("Error: --cache-max takes a size in bytes, like 64M\n");
+                return 0;
+            }
         }
-        expression();
-        switch(op)
+        else if (strcmp(argv[i], "--cache-stats") == 0)
+            showStats = 1;
+        else if (strncmp(argv[i], "--perf", 6) == 0)
         {
-            case eqlsym : bark(2, 0, 8);
-                          break;
-            case neqsym : bark(2, 0, 9);
-                          break;
-            case lessym : bark(2, 0, 10);
-                          break;
-            case leqsym : bark(2, 0, 11);
-                          break;
-            case gtrsym : bark(2, 0, 12);
-                          break;
-            case geqsym : bark(2, 0, 13);
-                          break;
+            perfOut = perfMode(argv[i] + 6);
+            if (perfOut < 0)
+            {
+                printf("Error: --perf takes text or json, like --perf=json\n");
+                return 0;
+            }
         }
-    }
-}
-
-void expression()
-{
-    int isNeg=0;
-    if (tok.idNum == plussym)
-    {
-        consume(plussym);
-    }
-    else if (tok.idNum == minussym)
-    {
-        consume(minussym);
-        isNeg = 1;
-    }
-    term();
-    if (isNeg)
-        bark (2, 0, 1);
-    while (tok.idNum == plussym || tok.idNum == minussym)
-    {
-        isNeg=0;
-        if (tok.idNum == plussym)
-            consume(plussym);
-        else
+        else if (strncmp(argv[i], "--stats", 7) == 0)
         {
-            consume(minussym);
-            isNeg=1;
+            statsOut = perfMode(argv[i] + 7);
+            if (statsOut < 0)
+            {
+                printf("Error: --stats takes text or json, like --stats=json\n");
+                return 0;
+            }
         }
-        term();
-        if (isNeg)
-            bark(2, 0, 3);
-        else
-            bark(2, 0, 2);
-    }
-}
-
-void term()
-{
-    int isMult;
-    factor();
-    while (tok.idNum == multsym || tok.idNum == slashsym)
-    {
-        isMult=0;
-        if (tok.idNum == multsym)
+        else if (argv[i][0] == '-' && argv[i][1] != '\0')
         {
-            consume(multsym);
-            isMult=1;
+            printf("Error: Unknown option %s\n", argv[i]);
+            return 0;
         }
-        else
-            consume(slashsym);
-        factor();
-        if (isMult)
-            bark(2, 0, 4);
-        else
-            bark(2, 0, 5);
+        else if (inPath == NULL)
+            inPath = argv[i];
+        else if (outPath == NULL)
+            outPath = argv[i];
     }
-}
-
-void factor()
-{
-    if (tok.idNum == identsym)
-    {
-        getIdent(tok.ident);
-        consume(identsym);
-    }else if (tok.idNum == numbersym)
+    if (outPath == NULL)
     {
-        bark(1, 0, tok.value);
-        consume(numbersym);
-    } else
-    {
-        consume(lparentsym);
-        expression();
-        consume(rparentsym);
+        printf("Error: Not enough arguments.\n\"Compile <inputFile> <outputFile>\" is minimum required command line.\n Cannot continue.\n");
+        return 0;
     }
-}
-
-void consume(int last)
-{
-    int *nToken = malloc(sizeof(int));
-    char tName[13];
-    int success;
-
-    if (tok.idNum == last)
-    {
-        success = getNextToken(inFile, nToken, tName);
-        if (success)
-        {
-            fclose(inFile);
-            printf("Lexer failed to parse token #%d\n", tokenNum+1);
-            exit(0);
-        }
-        tok.idNum = *nToken;
-        if (tok.idNum == numbersym)
-            tok.value = atoi(tName);
-        strcpy(tok.ident, tName);
-    } else
+    if (perfOut < 0)
+        printf("Warning, PL0_PERF should be text or json\n");
+    else if (perfOut != PERF_OFF)
+        perfAtExit(&perf, perfOut);
+    inFile = fopen(inPath, "r");
+    if (inFile == NULL)
     {
-        printf("Wrong token at token #%d\n", tokenNum);
-        switch (last)
-        {
-        case nulsym:
-            printf("Expected nulsym, but found %s: %s instead.\n", symbolName[tok.idNum], tok.ident);
-            fclose(inFile);
-            exit(0);
-        case identsym:
-            printf("Expected identsym, but found %s: %s instead.\n", symbolName[tok.idNum], tok.ident);
-            fclose(inFile);
-            exit(0);
-        case numbersym:
-            printf("Expected numbersym, but found %s: %s instead.\n", symbolName[tok.idNum], tok.ident);
-            fclose(inFile);
-            exit(0);
-        case plussym:
-            printf("Expected plussym, but found %s: %s instead.\n", symbolName[tok.idNum], tok.ident);
-            fclose(inFile);
-            exit(0);
-        case minussym:
-            printf("Expected minussym, but found %s: %s instead.\n", symbolName[tok.idNum], tok.ident);
-            fclose(inFile);
-            exit(0);
-        case multsym:
-            printf("Expected multsym, but found %s: %s instead.\n", symbolName[tok.idNum], tok.ident);
-            fclose(inFile);
-            exit(0);
-        case slashsym:
-            printf("Expected slashsym, but found %s: %s instead.\n", symbolName[tok.idNum], tok.ident);
-            fclose(inFile);
-            exit(0);
-        case oddsym:
-            printf("Expected oddsym, but found %s: %s instead.\n", symbolName[tok.idNum], tok.ident);
-            fclose(inFile);
-            exit(0);
-        case eqlsym:
-            printf("Expected eqlsym, but found %s: %s instead.\n", symbolName[tok.idNum], tok.ident);
-            fclose(inFile);
-            exit(0);
-        case neqsym:
-            printf("Expected neqsym, but found %s: %s instead.\n", symbolName[tok.idNum], tok.ident);
-            fclose(inFile);
-            exit(0);
-        case lessym:
-            printf("Expected lessym, but found %s instead.\n", symbolName[tok.idNum]);
-            fclose(inFile);
-            exit(0);
-        case leqsym:
-            printf("Expected leqsym, but found %s instead.\n", symbolName[tok.idNum]);
-            fclose(inFile);
-            exit(0);
-        case gtrsym:
-            printf("Expected gtrsym, but found %s instead.\n", symbolName[tok.idNum]);
-            fclose(inFile);
-            exit(0);
-        case geqsym:
-            printf("Expected geqsym, but found %s instead.\n", symbolName[tok.idNum]);
-            fclose(inFile);
-            exit(0);
-        case lparentsym:
-            printf("Expected lparentsym, but found %s instead.\n", symbolName[tok.idNum]);
-            fclose(inFile);
-            exit(0);
-        case rparentsym:
-            printf("Expected rparentsym, but found %s instead.\n", symbolName[tok.idNum]);
-            fclose(inFile);
-            exit(0);
-        case commasym:
-            printf("Expected commasym, but found %s instead.\n", symbolName[tok.idNum]);
-            fclose(inFile);
-            exit(0);
-        case semicolonsym:
-            printf("Expected semicolonsym, but found %s instead.\n", symbolName[tok.idNum]);
-            fclose(inFile);
-            exit(0);
-        case periodsym:
-            printf("Expected periodsym, but found %s instead.\n", symbolName[tok.idNum]);
-            fclose(inFile);
-            exit(0);
-        case becomessym:
-            printf("Expected becomessym, but found %s: %s instead.\n", symbolName[tok.idNum], tok.ident);
-            fclose(inFile);
-            exit(0);
-        case beginsym:
-            printf("Expected beginsym, but found %s: %s instead.\n", symbolName[tok.idNum], tok.ident);
-            fclose(inFile);
-            exit(0);
-        case endsym:
-            printf("Expected endsym, but found %s: %s instead.\n", symbolName[tok.idNum], tok.ident);
-            fclose(inFile);
-            exit(0);
-        case ifsym:
-            printf("Expected ifsym, but found %s: %s instead.\n", symbolName[tok.idNum], tok.ident);
-            fclose(inFile);
-            exit(0);
-        case thensym:
-            printf("Expected thensym, but found %s: %s instead.\n", symbolName[tok.idNum], tok.ident);
-            fclose(inFile);
-            exit(0);
-        case whilesym:
-            printf("Expected whilesym, but found %s: %s instead.\n", symbolName[tok.idNum], tok.ident);
-            fclose(inFile);
-            exit(0);
-        case dosym:
-            printf("Expected dosym, but found %s: %s instead.\n", symbolName[tok.idNum], tok.ident);
-            fclose(inFile);
-            exit(0);
-        case callsym:
-            printf("Expected callsym, but found %s: %s instead.\n", symbolName[tok.idNum], tok.ident);
-            fclose(inFile);
-            exit(0);
-        case constsym:
-            printf("Expected constsym, but found %s: %s instead.\n", symbolName[tok.idNum], tok.ident);
-            fclose(inFile);
-            exit(0);
-        case varsym:
-            printf("Expected varsym, but found %s: %s instead.\n", symbolName[tok.idNum], tok.ident);
-            fclose(inFile);
-            exit(0);
-        case procsym:
-            printf("Expected procsym, but found %s: %s instead.\n", symbolName[tok.idNum], tok.ident);
-            fclose(inFile);
-            exit(0);
-        case writesym:
-            printf("Expected writesym, but found %s: %s instead.\n", symbolName[tok.idNum], tok.ident);
-            fclose(inFile);
-            exit(0);
-        case readsym:
-            printf("Expected readsym, but found %s: %s instead.\n", symbolName[tok.idNum], tok.ident);
-            fclose(inFile);
-            exit(0);
-        case elsesym:
-            printf("Expected elsesym, but found %s: %s instead.\n", symbolName[tok.idNum], tok.ident);
-            fclose(inFile);
-            exit(0);
-        default:
-            printf("WHAT? This shouldn't happen! Token expected was %s\n", symbolName[last]);
-            fclose(inFile);
-            exit(1);
-        }
+        printf("Error, File not found!\n");
+        return 0;
     }
-    free(nToken);
-    tokenNum++;
-}
+    perfStart(perfOut > 0 ? &perf : NULL, PERF_READ);
+    if (loadSource(inFile, &source) != 0)   //Not a regular file, so read the stream in
+        readStream(inFile, &source);
+    fclose(inFile);
+    perfStop(perfOut > 0 ? &perf : NULL);
 
-void bark(int op, int l, int m)
-{
-    outputProgram[commandPos].op = op;
-    outputProgram[commandPos].lex = l;
-    outputProgram[commandPos].mod = m;
-    commandPos++;
-}
-
-void rebark(int addr, int m)
-{
-    outputProgram[addr].mod = m;
-}
-
-void emitBark()
-{
-    int i;
-    for (i=0; i<commandPos; i++)
+    if (cacheDir != NULL && cacheDir[0] != '\0' && !mapLines)
     {
-        fprintf(outFile, "%d %d %d\n", outputProgram[i].op, outputProgram[i].lex, outputProgram[i].mod);
+        useCache = openCache(&cache, cacheDir, cacheMax) == 0;
+        if (!useCache)
+            printf("Warning, cannot use %s as a cache\n", cacheDir);
     }
-}
-
-void ident(int kind)
-{
-    int i;
-    for (i=0; i<pos; i++)
+    partPath = malloc(strlen(outPath) + 6);
+    sprintf(partPath, "%s.part", outPath);
+    outFile = fopen(partPath, binaryOut ? (useCache ? "wb+" : "wb") : (useCache ? "w+" : "w"));   //The cache reads it back
+    if (outFile == NULL)
     {
-        if (strcmp(tok.ident, symbolTable[i].name) == 0)    //If there's already an identifier in our list with that name
-        {
-            printf("Error, duplicate identifier\n");    //Can't have two identifiers in the list at the same level with the same name
-            exit(0);
-        }
+        printf("Error, cannot write to %s\n", outPath);
+        return 0;
     }
 
-
-    if (pos == MSTS)
-    {
-        printf("Too many symbols in the symbol table\n");
-        exit(0);
-    }else if (kind == 1)                                //If our ident is a constant
+    initLineMap(&lines);
+    initStats(&stats);
+    if (useCache)
     {
-        symbolTable[pos].kind = 1;                      //Mark the ident as a constant
-        strcpy(symbolTable[pos].name, tok.ident);       //Copy the name of the constant into the table
-        consume(identsym);                              //Next symbol
-        consume(eqlsym);                                //Next symbol
-        symbolTable[pos].val = tok.value;               //Save the value of the constant into the table
-        consume(numbersym);                             //Next symbol
-    }else if (kind == 2)                                //If our ident is a variable
+        cacheKeyFor(&cache, &key, source.data, source.size, optimize, buildIR, binaryOut);
+        hit = cacheLookup(&cache, &key, &entry);
+    }
+    if (hit)                                //Exactly what compiling it would have printed and written
     {
-        symbolTable[pos].kind = 2;                      //Mark it as a variable
-        strcpy(symbolTable[pos].name, tok.ident);       //Copy the name into the table
-        symbolTable[pos].level = 0;                     //We don't have procedures so everything's L level is 0
-        symbolTable[pos].addr = frameSize;              //Save the memory position of the variable into the table
-        frameSize++;                                    //Increase the frame size
-        consume(identsym);                              //Next symbol
+        failed = entry.diag.kind != DIAG_NONE;
+        stats.cached = 1;              //All there is to say is what it came to
+        stats.sourceBytes = (long long)source.size;
+        stats.tokens = entry.tokens;
+        stats.barked = stats.instructions = entry.instructions;
+        if (failed)
+            printf("%s", entry.diag.message);
+        else
+            fwrite(entry.code, 1, entry.codeSize, outFile);
+        freeEntry(&entry);
     }
-    pos++;                                              //Next position in the symbol table
-}
-
-void getIdent(char * name)
-{
-    int i, loc = -1;
-    for (i=0; i<pos; i++)                               //Search for the identifier in the table
+    else
     {
-        if (strcmp(name, symbolTable[i].name) == 0)
+        if (binaryOut)
+            writePm0Header(outFile, 0, 0);      //Filled in once we know how much code there is
+        initCompiler(&comp, optimize, buildIR, outFile, binaryOut);
+        comp.perf = perfOut > 0 ? &perf : NULL;
+        if (mapLines)
         {
-            loc = i;
+            lines.source = malloc(strlen(inPath) + 1);
+            if (lines.source != NULL)
+                strcpy(lines.source, inPath);
+            comp.lines = &lines;
         }
-    }
-    if (loc == -1)
-    {
-        printf("Identifier not declared in symbol table\n");
-        exit(0);
-    }
-    if (symbolTable[loc].kind == 1)                     //If it's a constant
-    {
-        bark(1, 0, symbolTable[loc].val);              //Put the value on the stack
-    }else                                               //Otherwise it's a variable
-    {
-        bark(3, symbolTable[loc].level, symbolTable[loc].addr);    //Load it's value from memory, and put it on the top of the stack
-    }
-}
-
-void storeIdent(char * name)
-{
-    int i, loc = -1;
-    for (i=0; i<pos; i++)
-    {
-        if (strcmp(name, symbolTable[i].name) == 0)
+        if (statsOut != PERF_OFF)
+            comp.stats = &stats;
+        failed = compileSource(&comp, source.data, source.size) != 0;
+        if (failed)
+            printf("%s", comp.diag.message);
+        else if (binaryOut)
         {
-            loc = i;
+            fseek(outFile, 0, SEEK_SET);
+            writePm0Header(outFile, comp.code.count, comp.maxFrame);
         }
+        if (useCache)
+            cacheStore(&cache, &key, &comp, failed ? NULL : outFile);
+        internal = comp.diag.kind == DIAG_INTERNAL;
+        freeCompiler(&comp);
+    }
+    freeSource(&source);
+    if (useCache)
+        closeCache(&cache, &total);
+    if (failed)
+    {
+        if (useCache && showStats)
+            printCacheStats(&cache, &total);
+        reportStats(&stats, statsOut);
+        fclose(outFile);                    //Don't leave half a program behind
+        remove(partPath);
+        free(partPath);
+        freeLineMap(&lines);
+        return internal;
     }
-    if (loc == -1)
-    {
-        printf("Identifier not declared in symbol table\n");
-        exit(0);
-    }
-    if (symbolTable[loc].kind == 1)                     //If it's a constant
-    {
-        printf("Cannot change the value of a constant\n");  //Can't change a constant
-        exit(0);
-    } else                                              //Otherwise it's a variable and we can store it
+    printf("No Errors, program syntactically correct.\n");
+    if (useCache && showStats)
+        printCacheStats(&cache, &total);
+    reportStats(&stats, statsOut);
+
+    fclose(outFile);
+    remove(outPath);                        //rename won't replace an existing file everywhere
+    if (rename(partPath, outPath) != 0)
+        printf("Error, could not write %s\n", outPath);
+    if (mapLines)
     {
-        bark(4, symbolTable[loc].level, symbolTable[loc].addr);
+        sprintf(partPath, "%s.map", outPath);   //Same length as .part
+        outFile = fopen(partPath, "w");
+        if (outFile == NULL || writeLineMap(outFile, &lines) != 0)
+            printf("Error, could not write %s\n", partPath);
+        if (outFile != NULL)
+            fclose(outFile);
     }
-}
-
+    freeLineMap(&lines);
+    free(partPath);
 
+    return 0;
+}
@@ -0,0 +1,20 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "nomem.h"
+
+static __thread memCatcher caught;
+static __thread void *caughtContext;
+
+void catchOutOfMemory(memCatcher catcher, void *context)
+{
+    caught = catcher;
+    caughtContext = context;
+}
+
+void outOfMemory(const char *message)
+{
+    if (caught != NULL)
+        caught(caughtContext, message);     // Jumps out, but exit anyway if it didn't
+    printf("%s", message);
+    exit(1);
+}
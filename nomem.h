@@ -0,0 +1,18 @@
+#ifndef NOMEM_H_INCLUDED
+#define NOMEM_H_INCLUDED
+
+/**
+ *  What the compiler's parts (tokens, names, symbols, code, trees, the optimizers,
+ *  the line map) do when malloc or realloc comes back NULL: outOfMemory, with a
+ *  whole line saying what the memory was for. Left alone that's printed and the
+ *  program exits. A catcher set on the thread gets it instead and never returns,
+ *  which is how the compiler turns it into a diagnostic (see compiler.h). Anything
+ *  the part was in the middle of growing is left the way it was, so it can still
+ *  be freed.
+ */
+typedef void (*memCatcher)(void *context, const char *message);
+
+void catchOutOfMemory(memCatcher catcher, void *context);   // For this thread from now on, NULL goes back to exiting
+void outOfMemory(const char *message) __attribute__((noreturn));
+
+#endif // NOMEM_H_INCLUDED
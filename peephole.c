@@ -0,0 +1,299 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "peephole.h"
+#include "nomem.h"
+
+#define MAX_HOPS 64     // Longest jump chain we follow, anything longer is probably a loop of jumps
+
+/*
+    Instructions are never moved while the patterns run, the ones that go away
+    are only marked dead. Once nothing else changes the live ones are packed
+    down and every jump target is moved along with them. A target that landed
+    on a dead instruction goes to the next live one after it, which is where
+    running through the dead ones would have ended up.
+*/
+
+typedef struct peepState
+{
+    command *prog;
+    int n;
+    char *dead;
+    int *target;    // How many jumps and calls lead here
+} peepState;
+
+static int isJump(int op)
+{
+    return op == 5 || op == 7 || op == 8;   // CAL, JMP, JPC
+}
+
+static int liveFrom(peepState *s, int i)
+{
+    while (i < s->n && s->dead[i])
+        i++;
+    return i;
+}
+
+static void markTargets(peepState *s)
+{
+    int i;
+
+    memset(s->target, 0, (s->n + 1) * sizeof(int));
+    s->target[0] = 1;
+    for (i = 0; i < s->n; i++)
+        if (!s->dead[i] && isJump(s->prog[i].op) && s->prog[i].mod >= 0 && s->prog[i].mod <= s->n)
+            s->target[s->prog[i].mod]++;
+}
+
+// A jump to a dead instruction really lands on the next live one, so those count too
+static int isTarget(peepState *s, int i)
+{
+    if (s->target[i])
+        return 1;
+    while (--i >= 0 && s->dead[i])
+        if (s->target[i])
+            return 1;
+    return 0;
+}
+
+int foldOpr(int m, int a, int b, int *result)
+{
+    switch (m)
+    {
+        case 1: *result = (int)(0u - (unsigned)a); return 1;
+        case 6: *result = a & 1; return 1;
+        case 2: *result = (int)((unsigned)a + (unsigned)b); return 1;
+        case 3: *result = (int)((unsigned)a - (unsigned)b); return 1;
+        case 4: *result = (int)((unsigned)a * (unsigned)b); return 1;
+        case 5:
+        case 7: if (b == 0 || (a == INT_MIN && b == -1))
+                    return 0;
+                *result = m == 5 ? a / b : a % b;
+                return 1;
+        case 8: *result = a == b; return 1;
+        case 9: *result = a != b; return 1;
+        case 10: *result = a < b; return 1;
+        case 11: *result = a <= b; return 1;
+        case 12: *result = a > b; return 1;
+        case 13: *result = a >= b; return 1;
+    }
+    return 0;
+}
+
+static int foldConstants(peepState *s, int i)
+{
+    command *p = s->prog;
+    int j = liveFrom(s, i + 1), k = liveFrom(s, j + 1), result;
+
+    if (p[i].op != 1 || j >= s->n || isTarget(s, j))
+        return 0;
+    if (p[j].op == 2 && (p[j].mod == 1 || p[j].mod == 6))     // LIT a; NEG or ODD
+    {
+        foldOpr(p[j].mod, p[i].mod, 0, &p[i].mod);
+        s->dead[j] = 1;
+        return 1;
+    }
+    if (p[j].op == 1 && k < s->n && !isTarget(s, k) && p[k].op == 2 && p[k].mod != 1 && p[k].mod != 6 &&
+        foldOpr(p[k].mod, p[i].mod, p[j].mod, &result))       // LIT a; LIT b; OPR
+    {
+        p[i].mod = result;
+        s->dead[j] = s->dead[k] = 1;
+        return 1;
+    }
+    return 0;
+}
+
+static int foldBranch(peepState *s, int i)
+{
+    command *p = s->prog;
+    int j = liveFrom(s, i + 1);
+
+    if (j >= s->n || isTarget(s, j))
+        return 0;
+    if (p[i].op == 1 && p[j].op == 8)   // LIT c; JPC t
+    {
+        if (p[i].mod == 0)
+        {
+            p[i].op = 7;
+            p[i].lex = 0;
+            p[i].mod = p[j].mod;
+        }
+        else
+        {
+            s->dead[i] = 1;
+            s->target[p[j].mod]--;
+        }
+        s->dead[j] = 1;
+        return 1;
+    }
+    if (p[i].op == 3 && p[j].op == 4 && p[i].lex == p[j].lex && p[i].mod == p[j].mod)   // x := x
+    {
+        s->dead[i] = s->dead[j] = 1;
+        return 1;
+    }
+    return 0;
+}
+
+static int shortenJumps(peepState *s, int i)
+{
+    command *p = s->prog;
+    int t, hops;
+
+    if (p[i].op != 7 && p[i].op != 8)
+        return 0;
+    if (p[i].mod < 0 || p[i].mod > s->n)
+        return 0;
+    t = liveFrom(s, p[i].mod);
+    for (hops = 0; t < s->n && p[t].op == 7; hops++)
+    {
+        if (hops == MAX_HOPS)
+            return 0;
+        if (p[t].mod < 0 || p[t].mod > s->n)
+            break;
+        t = liveFrom(s, p[t].mod);
+    }
+    if (p[i].op == 7 && t == liveFrom(s, i + 1))  // Jumping to where we'd go anyway
+    {
+        s->dead[i] = 1;
+        s->target[p[i].mod]--;
+        return 1;
+    }
+    if (t != p[i].mod)
+    {
+        s->target[p[i].mod]--;
+        s->target[t]++;
+        p[i].mod = t;
+        return 1;
+    }
+    return 0;
+}
+
+static int dropUnreachable(peepState *s)
+{
+    command *p = s->prog;
+    char *seen = calloc(s->n + 1, 1);
+    int *work = malloc((s->n + 1) * sizeof(int));
+    int top = 0, i, changed = 0;
+
+    if (seen == NULL || work == NULL)
+    {
+        free(seen);
+        free(work);
+        outOfMemory("Out of memory for the optimizer\n");
+    }
+    work[top++] = liveFrom(s, 0);
+    seen[work[0]] = 1;
+    while (top > 0)
+    {
+        int at = work[--top], next[2], k, count = 0;
+
+        if (at >= s->n)
+            continue;
+        if (isJump(p[at].op) && p[at].mod >= 0 && p[at].mod <= s->n)
+            next[count++] = liveFrom(s, p[at].mod);
+        if (p[at].op != 7 && !(p[at].op == 9 && p[at].mod == 2) && !(p[at].op == 2 && p[at].mod == 0))
+            next[count++] = liveFrom(s, at + 1);    // Everything but JMP, HLT and RET can go on to the next one
+        for (k = 0; k < count; k++)
+            if (!seen[next[k]])
+            {
+                seen[next[k]] = 1;
+                work[top++] = next[k];
+            }
+    }
+    for (i = 0; i < s->n; i++)
+        if (!s->dead[i] && !seen[i])
+        {
+            s->dead[i] = 1;
+            changed = 1;
+        }
+    free(seen);
+    free(work);
+    return changed;
+}
+
+int peephole(command *prog, int n, int flags, int *from)
+{
+    peepState s;
+    int *newAddr, i, kept, changed;
+
+    s.prog = prog;
+    s.n = n;
+    s.dead = calloc(n + 1, 1);
+    s.target = malloc((n + 1) * sizeof(int));
+    newAddr = malloc((n + 1) * sizeof(int));
+    if (s.dead == NULL || s.target == NULL || newAddr == NULL)
+    {
+        free(s.dead);
+        free(s.target);
+        free(newAddr);
+        outOfMemory("Out of memory for the optimizer\n");
+    }
+
+    do
+    {
+        changed = 0;
+        markTargets(&s);
+        for (i = 0; i < n; i++)
+        {
+            if (s.dead[i])
+                continue;
+            if ((flags & PEEP_FOLD) && foldConstants(&s, i))
+                changed = 1;
+            else if ((flags & PEEP_BRANCH) && foldBranch(&s, i))
+                changed = 1;
+            else if ((flags & PEEP_JUMPS) && shortenJumps(&s, i))
+                changed = 1;
+        }
+        if ((flags & PEEP_DEAD) && dropUnreachable(&s))
+            changed = 1;
+    } while (changed);
+
+    for (i = 0, kept = 0; i <= n; i++)
+    {
+        newAddr[i] = kept;
+        if (i < n && !s.dead[i])
+            kept++;
+    }
+    for (i = 0, kept = 0; i < n; i++)
+    {
+        if (s.dead[i])
+            continue;
+        prog[kept] = prog[i];
+        if (from != NULL)
+            from[kept] = i;
+        if (isJump(prog[kept].op) && prog[kept].mod >= 0 && prog[kept].mod <= n)
+            prog[kept].mod = newAddr[prog[kept].mod];
+        kept++;
+    }
+
+    free(s.dead);
+    free(s.target);
+    free(newAddr);
+    return kept;
+}
+
+int peepFlags(const char *spec)
+{
+    static const char *names[] = {"fold", "branch", "jumps", "dead"};
+    int flags = 0, i, len;
+
+    if (*spec == '\0')
+        return PEEP_ALL;
+    if (*spec++ != '=')
+        return -1;
+    while (*spec != '\0')
+    {
+        len = (int)strcspn(spec, ",");
+        for (i = 0; i < 4; i++)
+            if ((int)strlen(names[i]) == len && strncmp(spec, names[i], len) == 0)
+                break;
+        if (i == 4)
+            return -1;
+        flags |= 1 << i;
+        spec += len;
+        if (*spec == ',')
+            spec++;
+    }
+    return flags;
+}
@@ -0,0 +1,30 @@
+#ifndef PEEPHOLE_H_INCLUDED
+#define PEEPHOLE_H_INCLUDED
+
+#include "codebuf.h"
+
+/**
+ *  What the peephole pass is allowed to do, -O turns on all of them
+ */
+#define PEEP_FOLD 1     // LIT a; LIT b; OPR x into LIT (a x b), and LIT a; NEG/ODD
+#define PEEP_BRANCH 2   // LIT c; JPC t becomes JMP t or nothing, LOD x; STO x goes away
+#define PEEP_JUMPS 4    // Jumps to jumps go straight to the end of the chain, jumps to the next instruction go away
+#define PEEP_DEAD 8     // Code that can't be reached from 0 goes away
+#define PEEP_ALL 15
+
+/**
+ *  Rewrites the n commands in prog in place and returns how many are left.
+ *  Jump and call targets are remapped to where their instruction ended up, so
+ *  everything rebarked before this still points at the right place.
+ *  If from isn't NULL, from[i] gets the address command i had before.
+ */
+int peephole(command *prog, int n, int flags, int *from);
+int peepFlags(const char *spec);   // Flags for what follows -O: "" is everything, "=fold,jumps" picks some. -1 if it makes no sense
+
+/**
+ *  What OPR m does to a (and b, unless it's NEG or ODD), the way the VM would do it.
+ *  Returns 0 for the ones that can't be worked out ahead of time, like dividing by zero.
+ */
+int foldOpr(int m, int a, int b, int *result);
+
+#endif // PEEPHOLE_H_INCLUDED
@@ -0,0 +1,252 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "perf.h"
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+#ifdef __linux__
+#include <errno.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+static const char *phaseNames[PERF_PHASES] = {"read", "lex", "parse", "optimize", "write", "run"};
+static const char *eventNames[PERF_EVENTS] = {"cycles", "instructions", "branch_misses", "l1d_misses", "llc_misses", "task_clock_ns", "page_faults"};
+
+static perfSet *exitSet;        // What perfAtExit prints
+static int exitMode;
+
+static double wallMs(void)
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e3 + t.tv_nsec / 1e6;
+}
+
+static long peakRss(void)
+{
+#ifndef _WIN32
+    struct rusage usage;
+
+    if (getrusage(RUSAGE_SELF, &usage) == 0)
+#ifdef __APPLE__
+        return usage.ru_maxrss / 1024;     // Bytes there, KB everywhere else
+#else
+        return usage.ru_maxrss;
+#endif
+#endif
+    return -1;
+}
+
+int perfMode(const char *text)
+{
+    if (*text == '=')
+        text++;
+    if (*text == '\0' || strcmp(text, "text") == 0 || strcmp(text, "1") == 0)
+        return PERF_TEXT;
+    if (strcmp(text, "json") == 0)
+        return PERF_JSON;
+    if (strcmp(text, "0") == 0 || strcmp(text, "off") == 0)
+        return PERF_OFF;
+    return -1;
+}
+
+#ifdef __linux__
+static int openEvent(unsigned type, unsigned long long config)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    attr.exclude_kernel = 1;    // Allowed with perf_event_paranoid at 2, and the kernel's time isn't ours anyway
+    attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);     // This thread, any CPU
+}
+
+// value, time enabled and time running of a counter
+static void readEvent(int fd, unsigned long long *v)
+{
+    if (read(fd, v, 3 * sizeof(unsigned long long)) != 3 * sizeof(unsigned long long))
+        v[0] = v[1] = v[2] = 0;
+}
+#endif
+
+void openPerf(perfSet *p)
+{
+    int i;
+
+    memset(p, 0, sizeof(*p));
+    p->running = -1;
+    for (i = 0; i < PERF_EVENTS; i++)
+        p->fd[i] = -1;
+#ifdef __linux__
+    p->fd[PERF_CYCLES] = openEvent(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    if (p->fd[PERF_CYCLES] < 0)
+        snprintf(p->why, sizeof(p->why), "%s (%s)", errno == EACCES || errno == EPERM ? "not allowed, see /proc/sys/kernel/perf_event_paranoid" :
+                 errno == ENOSYS ? "the kernel doesn't have perf_event_open" : "the machine doesn't have them, or doesn't let us see them", strerror(errno));
+    else
+    {
+        p->fd[PERF_INSTRUCTIONS] = openEvent(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+        p->fd[PERF_BRANCH_MISSES] = openEvent(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+        p->fd[PERF_L1_MISSES] = openEvent(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D |
+                                          PERF_COUNT_HW_CACHE_OP_READ << 8 | PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        p->fd[PERF_LLC_MISSES] = openEvent(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+    }
+    p->fd[PERF_TASK_CLOCK] = openEvent(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK);
+    p->fd[PERF_PAGE_FAULTS] = openEvent(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS);
+#else
+    snprintf(p->why, sizeof(p->why), "there are no counters on this system");
+#endif
+}
+
+void perfStart(perfSet *p, int phase)
+{
+    int i;
+
+    if (p == NULL)
+        return;
+    perfStop(p);
+    p->running = phase;
+#ifdef __linux__
+    for (i = 0; i < PERF_EVENTS; i++)
+        if (p->fd[i] >= 0)
+            readEvent(p->fd[i], p->start[i]);
+#else
+    (void)i;
+#endif
+    p->startMs = wallMs();     // Last, so reading the counters isn't in it
+}
+
+void perfStop(perfSet *p)
+{
+    perfPhase *ph;
+    double ms;
+    int i;
+#ifdef __linux__
+    unsigned long long now[3], value, enabled, running;
+#endif
+
+    if (p == NULL || p->running < 0)
+        return;
+    ms = wallMs() - p->startMs;
+    ph = &p->phase[p->running];
+#ifdef __linux__
+    for (i = 0; i < PERF_EVENTS; i++)
+        if (p->fd[i] >= 0)
+        {
+            readEvent(p->fd[i], now);
+            value = now[0] - p->start[i][0];
+            enabled = now[1] - p->start[i][1];
+            running = now[2] - p->start[i][2];
+            if (running > 0 && running < enabled)   // It was only counting part of the time
+                value = (unsigned long long)((double)value * enabled / running);
+            ph->count[i] += value;
+        }
+#else
+    (void)i;
+#endif
+    ph->ms += ms;
+    ph->peakKB = peakRss();
+    ph->times++;
+    p->running = -1;
+}
+
+void printPerf(perfSet *p, FILE *out, int mode)
+{
+    perfPhase *ph;
+    int i, e;
+
+    perfStop(p);
+    if (mode == PERF_JSON)
+    {
+        fprintf(out, "{\"perf\":1,\"hardware\":%s,\"why\":\"", p->fd[PERF_CYCLES] >= 0 ? "true" : "false");
+        for (i = 0; p->why[i] != '\0'; i++)
+            if (p->why[i] != '"' && p->why[i] != '\\')
+                fputc(p->why[i], out);
+        fprintf(out, "\"}\n");
+    }
+    else
+    {
+        fprintf(out, "\nphase     times         ms   peak RSS       cycles  instructions   IPC  branch miss    L1d miss    LLC miss    CPU ms  faults\n");
+        if (p->why[0] != '\0')
+            fprintf(out, "(no hardware counters: %s)\n", p->why);
+    }
+
+    for (i = 0; i < PERF_PHASES; i++)
+    {
+        ph = &p->phase[i];
+        if (ph->times == 0)
+            continue;
+        if (mode == PERF_JSON)
+        {
+            fprintf(out, "{\"phase\":\"%s\",\"times\":%d,\"ms\":%.3f,\"peak_rss_kb\":%ld", phaseNames[i], ph->times, ph->ms, ph->peakKB);
+            for (e = 0; e < PERF_EVENTS; e++)
+                if (p->fd[e] >= 0)
+                    fprintf(out, ",\"%s\":%llu", eventNames[e], ph->count[e]);
+                else
+                    fprintf(out, ",\"%s\":null", eventNames[e]);
+            fprintf(out, "}\n");
+            continue;
+        }
+        fprintf(out, "%-9s %5d %10.3f %8ld KB", phaseNames[i], ph->times, ph->ms, ph->peakKB);
+        for (e = PERF_CYCLES; e <= PERF_INSTRUCTIONS; e++)
+            if (p->fd[e] >= 0)
+                fprintf(out, " %*llu", e == PERF_CYCLES ? 12 : 13, ph->count[e]);
+            else
+                fprintf(out, " %*s", e == PERF_CYCLES ? 12 : 13, "-");
+        if (p->fd[PERF_CYCLES] >= 0 && p->fd[PERF_INSTRUCTIONS] >= 0 && ph->count[PERF_CYCLES] > 0)
+            fprintf(out, " %5.2f", (double)ph->count[PERF_INSTRUCTIONS] / ph->count[PERF_CYCLES]);
+        else
+            fprintf(out, " %5s", "-");
+        for (e = PERF_BRANCH_MISSES; e <= PERF_LLC_MISSES; e++)
+            if (p->fd[e] >= 0)
+                fprintf(out, " %11llu", ph->count[e]);
+            else
+                fprintf(out, " %11s", "-");
+        if (p->fd[PERF_TASK_CLOCK] >= 0)
+            fprintf(out, " %9.3f", ph->count[PERF_TASK_CLOCK] / 1e6);
+        else
+            fprintf(out, " %9s", "-");
+        if (p->fd[PERF_PAGE_FAULTS] >= 0)
+            fprintf(out, " %7llu\n", ph->count[PERF_PAGE_FAULTS]);
+        else
+            fprintf(out, " %7s\n", "-");
+    }
+}
+
+void closePerf(perfSet *p)
+{
+    int i;
+
+    for (i = 0; i < PERF_EVENTS; i++)
+    {
+#ifdef __linux__
+        if (p->fd[i] >= 0)
+            close(p->fd[i]);
+#endif
+        p->fd[i] = -1;
+    }
+}
+
+static void printAtExit(void)
+{
+    fflush(stdout);     // So the report comes after everything the program printed
+    printPerf(exitSet, stderr, exitMode);
+    closePerf(exitSet);
+}
+
+void perfAtExit(perfSet *p, int mode)
+{
+    openPerf(p);
+    exitSet = p;
+    exitMode = mode;
+    atexit(printAtExit);
+}
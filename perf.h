@@ -0,0 +1,66 @@
+#ifndef PERF_H_INCLUDED
+#define PERF_H_INCLUDED
+
+#include <stdio.h>
+
+// Phases, the compiler's and then the VM's
+#define PERF_READ 0         // Getting the source, or the code for the VM, into memory
+#define PERF_LEX 1          // tokenize
+#define PERF_PARSE 2        // program(), which barks the code as it goes and writes out what's finished
+#define PERF_OPTIMIZE 3     // The peephole pass, -O
+#define PERF_WRITE 4        // Writing out the code that was still held at the end
+#define PERF_RUN 5          // The VM running the program
+#define PERF_PHASES 6
+
+// Counters
+#define PERF_CYCLES 0
+#define PERF_INSTRUCTIONS 1
+#define PERF_BRANCH_MISSES 2
+#define PERF_L1_MISSES 3        // Level 1 data cache misses on reads
+#define PERF_LLC_MISSES 4       // Last level cache misses
+#define PERF_TASK_CLOCK 5       // CPU time in ns. The last two are the kernel's own, so they're there when the rest aren't
+#define PERF_PAGE_FAULTS 6
+#define PERF_EVENTS 7
+
+// How the report is printed
+#define PERF_OFF 0
+#define PERF_TEXT 1
+#define PERF_JSON 2         // One object to a line, the first one says which counters there were
+
+typedef struct perfPhase
+{
+    unsigned long long count[PERF_EVENTS];
+    double ms;              // Wall clock, always there
+    long peakKB;            // Peak RSS of the process when the phase last ended
+    int times;              // How often it ran, 0 if it never did
+} perfPhase;
+
+/**
+ *  Hardware performance counters (perf_event_open) for each phase of a compile or a
+ *  run, for the thread that opened them. If the machine or the kernel won't give us
+ *  the counters, the ones we have are still counted, and the wall clock and RSS are
+ *  always there. The counters run all the time, a phase reads them when it starts
+ *  and stops, so there's no cost inside a phase.
+ *
+ *  If the kernel had to share the counters out between more events than it has, a
+ *  count is scaled up by how long it was really counting.
+ */
+typedef struct perfSet
+{
+    int fd[PERF_EVENTS];            // -1 for the ones we couldn't open
+    char why[128];                  // Why the hardware counters aren't there, "" if they are
+    perfPhase phase[PERF_PHASES];
+    int running;                    // Phase that was started and not stopped yet, -1 if none
+    unsigned long long start[PERF_EVENTS][3];   // Value, time enabled and time running when it was started
+    double startMs;
+} perfSet;
+
+int perfMode(const char *text);         // "" or "=text" is PERF_TEXT, "=json" PERF_JSON, "=off" PERF_OFF, -1 if it isn't one of them. The = is optional
+void openPerf(perfSet *p);
+void perfStart(perfSet *p, int phase);  // Stops the phase before it if there is one. p may be NULL, then it does nothing, and so does perfStop
+void perfStop(perfSet *p);              // Adds what was counted since perfStart to its phase. Nothing if no phase is running
+void printPerf(perfSet *p, FILE *out, int mode);    // Stops a phase that's still running first
+void closePerf(perfSet *p);
+void perfAtExit(perfSet *p, int mode);  // Opens p, and prints it to stderr and closes it when the program exits, however it does
+
+#endif // PERF_H_INCLUDED
@@ -0,0 +1,431 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ *  Writes out a random PL/0 program that compiles. The same options and seed always
+ *  give the same program, so it can be used to benchmark the compiler and checked in
+ *  as nothing more than a command line.
+ *
+ *      pl0gen [--seed <n>] [--statements <n>] [--procs <n>] [--depth <n>] [--idents <n>]
+ *             [--nesting <n>] [--expr <n>] [--reads] [-o <file.pl0>]
+ *
+ *  --statements    About how many statements there are in the whole program (default 200)
+ *  --procs         How many procedures (default 10)
+ *  --depth         How deep procedures are nested in each other, 1 is all in the program block (default 3)
+ *  --idents        Constants and variables each block declares, at most (default 8)
+ *  --nesting       How deep begin, if and while go inside each other (default 4)
+ *  --expr          How many operators an expression has, at most about (default 6)
+ *  --reads         Have read statements too, then the program needs input to run
+ *
+ *  Besides compiling, the programs always finish when they are run, unless they are
+ *  stuck on input. Every while loop has a counter of its own that nothing else stores
+ *  into, a procedure is only called once its body has been written so nothing recurses,
+ *  and nothing is divided by anything but a number other than 0. The steps a block can
+ *  take are estimated as it's written, and calls that would make it run too long aren't
+ *  made. Numbers can still overflow, same as in any PL/0 program.
+ */
+
+#define MAX_IDENT 11            // Longest identifier the lexer takes
+#define MAX_NUMBER 65535        // Biggest number it takes
+#define COST_LIMIT 1000000.0    // Steps a block may take, about, counting what it calls
+
+// What a name is
+#define GEN_CONST 1
+#define GEN_VAR 2
+#define GEN_COUNTER 3           // A loop counter, read anywhere but only stored into by its own loop
+#define GEN_PROC 4
+
+typedef struct genSymbol
+{
+    char name[MAX_IDENT + 1];
+    int kind;                   // GEN_ constant
+    int done;                   // For a procedure, its body has been written so it can be called
+    int depth;                  // For a counter, the loop depth it's used at
+    double cost;                // For a procedure, about how many steps a call takes
+} genSymbol;
+
+// A procedure and where it goes, the procedures are made into a tree before anything is written
+typedef struct genProc
+{
+    int parent;                 // Procedure it's declared in, -1 for the program block
+    int level;                  // 1 in the program block
+    int statements;             // Its share of --statements
+} genProc;
+
+unsigned long long rng;
+int statements = 200, procCount = 10, maxDepth = 3, idents = 8, nesting = 4, exprOps = 6, reads = 0;
+genProc *procs;
+genSymbol *symbols;             // Every name that can be seen from where we are, innermost last
+int symbolCount, symbolCap;
+int nameCount;                  // Names handed out so far, every name in the program is different
+int mainStatements;
+double blockCost;               // Steps the block being written takes so far, about
+FILE *out;
+
+static unsigned long long next(void)    // xorshift64*
+{
+    rng ^= rng >> 12;
+    rng ^= rng << 25;
+    rng ^= rng >> 27;
+    return rng * 0x2545F4914F6CDD1DULL;
+}
+
+static int below(int n)     // 0 up to n - 1
+{
+    return n <= 1 ? 0 : (int)((next() >> 33) % (unsigned)n);
+}
+
+static int chance(int percent)
+{
+    return below(100) < percent;
+}
+
+static void indent(int level)
+{
+    int i;
+
+    for (i = 0; i < level; i++)
+        fputs("    ", out);
+}
+
+static genSymbol *declare(char prefix, int kind)
+{
+    genSymbol *s;
+
+    if (symbolCount == symbolCap)
+    {
+        symbolCap = symbolCap ? symbolCap * 2 : 256;
+        symbols = realloc(symbols, symbolCap * sizeof(genSymbol));
+        if (symbols == NULL)
+        {
+            printf("Out of memory for the symbols\n");
+            exit(1);
+        }
+    }
+    s = &symbols[symbolCount++];
+    memset(s, 0, sizeof(*s));
+    snprintf(s->name, sizeof(s->name), "%c%d", prefix, nameCount++);
+    s->kind = kind;
+    return s;
+}
+
+// A name of one of the kinds in mask (1 << GEN_ constant) that can be seen from here, NULL if there is none
+static genSymbol *pick(int mask)
+{
+    int i, n = 0, chosen;
+
+    for (i = 0; i < symbolCount; i++)
+        if (mask & (1 << symbols[i].kind))
+            n++;
+    if (n == 0)
+        return NULL;
+    chosen = below(n);
+    for (i = 0; i < symbolCount; i++)
+        if ((mask & (1 << symbols[i].kind)) && chosen-- == 0)
+            return &symbols[i];
+    return NULL;
+}
+
+static void expression(int ops);
+
+static void factor(int ops)
+{
+    genSymbol *s;
+
+    if (ops > 0 && chance(25))
+    {
+        fputc('(', out);
+        expression(ops);
+        fputc(')', out);
+    }
+    else if (chance(60) && (s = pick(1 << GEN_CONST | 1 << GEN_VAR | 1 << GEN_COUNTER)) != NULL)
+        fputs(s->name, out);
+    else
+        fprintf(out, "%d", chance(80) ? below(100) : below(MAX_NUMBER + 1));
+}
+
+// A term with ops operators in it, or about that many, ops is used up by the factors in it
+static void term(int *ops)
+{
+    int share = *ops > 0 ? below(*ops + 1) : 0;
+
+    *ops -= share;
+    factor(share > 0 ? share - 1 : 0);
+    while (*ops > 0 && chance(40))
+    {
+        (*ops)--;
+        if (chance(25))    // Only ever by a number, so it's never by 0
+            fprintf(out, " / %d", 1 + below(chance(80) ? 9 : MAX_NUMBER));
+        else
+        {
+            fputs(" * ", out);
+            share = *ops > 0 ? below(*ops + 1) : 0;
+            *ops -= share;
+            factor(share > 0 ? share - 1 : 0);
+        }
+    }
+}
+
+static void expression(int ops)
+{
+    if (chance(10))
+        fputs(chance(50) ? "-" : "+", out);
+    term(&ops);
+    while (ops > 0)
+    {
+        ops--;
+        fputs(chance(50) ? " + " : " - ", out);
+        term(&ops);
+    }
+}
+
+static void condition(void)
+{
+    static const char *relations[] = {"=", "<>", "<", "<=", ">", ">="};
+
+    if (chance(15))
+    {
+        fputs("odd ", out);
+        expression(below(exprOps + 1));
+    }
+    else
+    {
+        expression(below(exprOps / 2 + 1));
+        fprintf(out, " %s ", relations[below(6)]);
+        expression(below(exprOps / 2 + 1));
+    }
+}
+
+static genSymbol *counter(int loops)
+{
+    int i;
+
+    for (i = symbolCount - 1; i >= 0; i--)     // The innermost is this block's
+        if (symbols[i].kind == GEN_COUNTER && symbols[i].depth == loops)
+            return &symbols[i];
+    return NULL;
+}
+
+/**
+ *  Writes one statement at nest levels of begin, if and while, inside loops while loops.
+ *  budget is how many statements it should come to, begin ... end included. weight is
+ *  how many times it runs for each time the block runs, about
+ */
+static void statement(int level, int nest, int loops, int budget, double weight)
+{
+    genSymbol *s;
+    int kind = below(100), trips, n, i;
+
+    indent(level);
+    blockCost += weight;
+    if (budget > 1 && nest < nesting && (nest == 0 || kind < 50 || (kind >= 70 && (budget < 3 || counter(loops) == NULL))))
+    {
+        fputs("begin\n", out);
+        budget--;
+        n = nest == 0 ? (budget + 7) / 8 : 1 + below(budget < 8 ? budget : 8);   // A block's own begin takes a long list
+        for (i = 0; i < n; i++)
+        {
+            statement(level + 1, nest + 1, loops, budget / n + (i < budget % n), weight);
+            fputs(i < n - 1 ? ";\n" : "\n", out);
+        }
+        indent(level);
+        fputs("end", out);
+    }
+    else if (budget > 1 && nest < nesting && kind < 70)
+    {
+        fputs("if ", out);
+        condition();
+        fputs(" then\n", out);
+        statement(level + 1, nest + 1, loops, budget - 1, weight);
+    }
+    else if (budget > 1 && nest < nesting)
+    {
+        s = counter(loops);
+        trips = 1 + below(8);   // counter := 0; while counter < trips do begin ... ; counter := counter + 1 end
+        fprintf(out, "%s := 0;\n", s->name);
+        indent(level);
+        fprintf(out, "while %s < %d do\n", s->name, trips);
+        indent(level);
+        fputs("begin\n", out);
+        statement(level + 1, nest + 1, loops + 1, budget - 2, weight * trips);
+        fputs(";\n", out);
+        indent(level + 1);
+        fprintf(out, "%s := %s + 1\n", s->name, s->name);
+        indent(level);
+        fputs("end", out);
+        blockCost += weight * trips * 4;
+    }
+    else if (kind < 30 && (s = pick(1 << GEN_PROC)) != NULL && s->done && blockCost + weight * s->cost < COST_LIMIT)
+    {
+        fprintf(out, "call %s", s->name);
+        blockCost += weight * s->cost;
+    }
+    else if (kind < 40 && (s = pick(1 << GEN_VAR | 1 << GEN_CONST | 1 << GEN_COUNTER)) != NULL)
+        fprintf(out, "write %s", s->name);
+    else if (reads && kind < 45 && (s = pick(1 << GEN_VAR)) != NULL)
+        fprintf(out, "read %s", s->name);
+    else if ((s = pick(1 << GEN_VAR)) != NULL)
+    {
+        fprintf(out, "%s := ", s->name);
+        expression(below(exprOps + 1));
+    }
+    else
+        fputs("begin end", out);  // Nothing to store into, an empty statement is still one
+}
+
+static void block(int proc, int level);
+
+static void declarations(int proc, int level)
+{
+    genSymbol *s;
+    int consts = below(idents / 2 + 1), vars = idents - consts, i, n;
+
+    if (consts > 0)
+    {
+        indent(level);
+        fputs("const ", out);
+        for (i = 0; i < consts; i++)
+        {
+            s = declare('c', GEN_CONST);
+            fprintf(out, "%s = %d%s", s->name, chance(80) ? below(100) : below(MAX_NUMBER + 1), i < consts - 1 ? ", " : ";\n");
+        }
+    }
+    n = vars > 0 ? 1 + below(vars) : 0;
+    indent(level);
+    fputs("var ", out);
+    for (i = 0; i < n; i++)
+        fprintf(out, "%s, ", declare('v', GEN_VAR)->name);
+    for (i = 0; i < nesting; i++)   // One counter for each depth of loop
+    {
+        s = declare('k', GEN_COUNTER);
+        s->depth = i;
+        fprintf(out, "%s%s", s->name, i < nesting - 1 ? ", " : ";\n");
+    }
+    if (nesting == 0)
+        fprintf(out, "%s;\n", declare('v', GEN_VAR)->name);
+
+    for (i = 0; i < procCount; i++)
+        if (procs[i].parent == proc)
+        {
+            indent(level);
+            s = declare('p', GEN_PROC);
+            fprintf(out, "procedure %s;\n", s->name);
+            n = s - symbols;
+            block(i, level + 1);
+            symbols[n].done = 1;
+            symbols[n].cost = blockCost;
+            fputs(";\n", out);
+        }
+}
+
+/**
+ *  The declarations and statement of procedure proc, or the program if it's -1. Its
+ *  variables are all set to 0 before anything else, so what the program does never
+ *  depends on what was left on the stack, and builds with and without -O or --ir
+ *  have to agree on it.
+ */
+static void block(int proc, int level)
+{
+    int first = symbolCount, budget = proc < 0 ? mainStatements : procs[proc].statements, i;
+
+    declarations(proc, level);
+    blockCost = 0;
+    indent(level);
+    fputs("begin\n", out);
+    for (i = first; i < symbolCount; i++)
+        if (symbols[i].kind == GEN_VAR || symbols[i].kind == GEN_COUNTER)
+        {
+            indent(level + 1);
+            fprintf(out, "%s := 0;\n", symbols[i].name);
+            blockCost++;
+        }
+    statement(level + 1, 0, 0, budget < 1 ? 1 : budget, 1);
+    fputs("\n", out);
+    indent(level);
+    fputs("end", out);
+    symbolCount = first;    // Its names can't be seen from outside
+}
+
+int main(int argc, char **argv)
+{
+    unsigned long long seed = 1;
+    const char *outName = NULL;
+    int i, each;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+            seed = strtoull(argv[++i], NULL, 0);
+        else if (strcmp(argv[i], "--statements") == 0 && i + 1 < argc)
+            statements = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--procs") == 0 && i + 1 < argc)
+            procCount = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--depth") == 0 && i + 1 < argc)
+            maxDepth = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--idents") == 0 && i + 1 < argc)
+            idents = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--nesting") == 0 && i + 1 < argc)
+            nesting = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--expr") == 0 && i + 1 < argc)
+            exprOps = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--reads") == 0)
+            reads = 1;
+        else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+            outName = argv[++i];
+        else
+        {
+            printf("Usage: pl0gen [--seed <n>] [--statements <n>] [--procs <n>] [--depth <n>] [--idents <n>] "
+                   "[--nesting <n>] [--expr <n>] [--reads] [-o <file.pl0>]\n");
+            return 1;
+        }
+    }
+    if (statements < 1 || procCount < 0 || maxDepth < 1 || idents < 0 || nesting < 0 || exprOps < 0)
+    {
+        printf("Error: --statements and --depth have to be at least 1, and nothing can be negative\n");
+        return 1;
+    }
+
+    rng = seed * 0x9E3779B97F4A7C15ULL + 0x632BE59BD9B4E019ULL;     // Never 0, which xorshift can't leave
+    if (rng == 0)
+        rng = 1;
+    for (i = 0; i < 4; i++)
+        next();
+
+    // Hang each procedure under the program or one made before it that isn't too deep yet
+    procs = calloc(procCount + 1, sizeof(genProc));
+    if (procs == NULL)
+    {
+        printf("Out of memory for the procedures\n");
+        return 1;
+    }
+    each = statements / (procCount + 1);
+    for (i = 0; i < procCount; i++)
+    {
+        procs[i].parent = below(i + 1) - 1;
+        while (procs[i].parent >= 0 && procs[procs[i].parent].level >= maxDepth)
+            procs[i].parent = procs[procs[i].parent].parent;
+        procs[i].level = procs[i].parent < 0 ? 1 : procs[procs[i].parent].level + 1;
+        procs[i].statements = each > 0 ? each / 2 + below(each + 1) : 1;   // Anywhere from half to one and a half shares
+        statements -= procs[i].statements;
+    }
+    mainStatements = statements;
+
+    if (outName == NULL)
+        out = stdout;
+    else if ((out = fopen(outName, "w")) == NULL)
+    {
+        printf("Error, cannot open %s\n", outName);
+        return 1;
+    }
+    block(-1, 0);
+    fputs(".\n", out);
+    if (out != stdout && fclose(out) != 0)
+    {
+        printf("Error, cannot write %s\n", outName);
+        return 1;
+    }
+    free(procs);
+    free(symbols);
+    return 0;
+}
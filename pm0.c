@@ -0,0 +1,125 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "pm0.h"
+
+void writePm0Header(FILE *out, int count, int maxFrame)
+{
+    pm0Header head;
+
+    memcpy(head.magic, PM0_MAGIC, 4);
+    head.version = PM0_VERSION;
+    head.count = count;
+    head.maxFrame = maxFrame;
+    fwrite(&head, sizeof(head), 1, out);
+}
+
+void writePm0Code(FILE *out, const pm0Instr *code, int n)
+{
+    fwrite(code, sizeof(pm0Instr), n, out);
+}
+
+/*
+    Reads one whitespace separated integer, the way fscanf's %d would.
+    Returns 0 if there isn't one before end.
+*/
+static int readInt(const char **cursor, const char *end, int *value)
+{
+    const char *p = *cursor;
+    int neg = 0;
+    long v = 0;
+
+    while (p < end && isspace((unsigned char)*p))
+        p++;
+    if (p < end && (*p == '-' || *p == '+'))
+        neg = *p++ == '-';
+    if (p == end || !isdigit((unsigned char)*p))
+        return 0;
+    while (p < end && isdigit((unsigned char)*p))
+        v = v * 10 + (*p++ - '0');
+    *value = (int)(neg ? -v : v);
+    *cursor = p;
+    return 1;
+}
+
+/*
+    Text object file, "op l m" on each line. Reads until the numbers run out,
+    growing the code as it goes so there's no limit on the program size.
+*/
+static int parseText(pm0Program *prog)
+{
+    const char *p = prog->file.data, *end = p + prog->file.size;
+    int cap = 0, op, l, m;
+    pm0Instr *bigger;
+
+    while (readInt(&p, end, &op) && readInt(&p, end, &l) && readInt(&p, end, &m))
+    {
+        if (prog->count == cap)
+        {
+            cap = cap ? cap * 2 : 1024;
+            bigger = realloc(prog->owned, cap * sizeof(pm0Instr));
+            if (bigger == NULL)
+            {
+                printf("Out of memory for the program code\n");
+                return 1;
+            }
+            prog->owned = bigger;
+        }
+        prog->owned[prog->count].op = (unsigned char)op;
+        prog->owned[prog->count].l = (unsigned char)l;
+        prog->owned[prog->count].reserved = 0;
+        prog->owned[prog->count].m = m;
+        prog->count++;
+    }
+    prog->code = prog->owned;
+    return 0;
+}
+
+int loadProgram(const char *path, pm0Program *prog)
+{
+    FILE *file;
+    pm0Header head;
+
+    memset(prog, 0, sizeof(*prog));
+    file = fopen(path, "rb");
+    if (file == NULL)
+    {
+        printf("Error opening input file %s\nExiting Program ...\n", path);
+        return 1;
+    }
+    if (loadSource(file, &prog->file) != 0 && readStream(file, &prog->file) != 0)
+    {
+        printf("Out of memory reading %s\n", path);
+        fclose(file);
+        return 1;
+    }
+    fclose(file);   // A mapping stays valid without the file open
+
+    if (prog->file.size < 4 || memcmp(prog->file.data, PM0_MAGIC, 4) != 0)
+        return parseText(prog);
+
+    if (prog->file.size < sizeof(head))
+        head.version = 0;
+    else
+        memcpy(&head, prog->file.data, sizeof(head));
+    if (head.version != PM0_VERSION || head.count < 0 ||
+        (prog->file.size - sizeof(head)) / sizeof(pm0Instr) < (size_t)head.count)
+    {
+        printf("Error, %s is not a valid PM/0 object file\n", path);
+        freeProgram(prog);
+        return 1;
+    }
+    prog->code = (const pm0Instr *)(prog->file.data + sizeof(head));
+    prog->count = head.count;
+    prog->maxFrame = head.maxFrame;
+    prog->binary = 1;
+    return 0;
+}
+
+void freeProgram(pm0Program *prog)
+{
+    free(prog->owned);
+    freeSource(&prog->file);
+    memset(prog, 0, sizeof(*prog));
+}
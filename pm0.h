@@ -0,0 +1,53 @@
+#ifndef PM0_H_INCLUDED
+#define PM0_H_INCLUDED
+
+#include <stdio.h>
+#include "source.h"
+
+#define PM0_MAGIC "PM0B"    // First four bytes of a binary object file
+#define PM0_VERSION 1
+
+/**
+ *  Binary .pm0 layout: a pm0Header followed by count pm0Instr records, nothing else.
+ *  Numbers are stored in the byte order of the machine that compiled it, so the VM can
+ *  run the records straight out of the mapped file without looking at each one.
+ *
+ *  The text format ("op l m" per line) is still accepted everywhere, a file is only
+ *  treated as binary if it starts with PM0_MAGIC.
+ */
+typedef struct pm0Header
+{
+    char magic[4];      // PM0_MAGIC, not null terminated
+    int version;        // PM0_VERSION
+    int count;          // Number of instructions after the header
+    int maxFrame;       // Largest INC the program does, 0 if unknown
+} pm0Header;
+
+typedef struct pm0Instr
+{
+    unsigned char op;
+    unsigned char l;
+    short reserved;     // Always 0, keeps m aligned
+    int m;
+} pm0Instr;
+
+/**
+ *  A loaded program. code points into the mapped file for binary input,
+ *  or into owned if it had to be parsed from text.
+ */
+typedef struct pm0Program
+{
+    const pm0Instr *code;
+    int count;
+    int maxFrame;
+    int binary;         // 1 if it came from a binary file
+    sourceBuf file;
+    pm0Instr *owned;
+} pm0Program;
+
+void writePm0Header(FILE *out, int count, int maxFrame);          // Writes a header at the current position
+void writePm0Code(FILE *out, const pm0Instr *code, int n);        // Appends n records
+int loadProgram(const char *path, pm0Program *prog);              // Loads either format. Prints why and returns 1 if it can't
+void freeProgram(pm0Program *prog);
+
+#endif // PM0_H_INCLUDED
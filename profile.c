@@ -0,0 +1,320 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "profile.h"
+#include "source.h"
+
+static const char *opNames[10] = {"", "LIT", "OPR", "LOD", "STO", "CAL", "INC", "JMP", "JPC", "SIO"};
+static const char *oprNames[14] = {"RET", "NEG", "ADD", "SUB", "MUL", "DIV", "ODD", "MOD", "EQL", "NEQ", "LSS", "LEQ", "GTR", "GEQ"};
+static const char *sioNames[3] = {"OUT", "INP", "HLT"};
+
+// A jump back, from end to head
+typedef struct profileLoop
+{
+    int head;
+    int end;
+    long long iterations;   // Times it jumped back
+    long long instrs;       // Instructions run from head to end
+} profileLoop;
+
+static const long long *sortCounts;     // What the qsort below compares by
+
+static int byCount(const void *a, const void *b)
+{
+    long long x = sortCounts[*(const int *)a], y = sortCounts[*(const int *)b];
+
+    if (x != y)
+        return x < y ? 1 : -1;
+    return *(const int *)a - *(const int *)b;
+}
+
+static int byInstrs(const void *a, const void *b)
+{
+    const profileLoop *x = a, *y = b;
+
+    if (x->instrs != y->instrs)
+        return x->instrs < y->instrs ? 1 : -1;
+    return x->head - y->head;
+}
+
+static const char *instrName(const pm0Instr *i)
+{
+    if (i->op == 2)
+        return i->m >= 0 && i->m < 14 ? oprNames[i->m] : "OPR";
+    if (i->op == 9)
+        return i->m >= 0 && i->m < 3 ? sioNames[i->m] : "SIO";
+    return i->op < 10 ? opNames[i->op] : "???";
+}
+
+// Index into the opcode table, OPR and SIO by what they do
+static int opIndex(const pm0Instr *i)
+{
+    if (i->op == 2 && i->m >= 0 && i->m < 14)
+        return 10 + i->m;
+    if (i->op == 9 && i->m >= 0 && i->m < 3)
+        return 24 + i->m;
+    return i->op < 10 ? i->op : 0;
+}
+
+static double share(long long n, long long of)
+{
+    return of > 0 ? 100.0 * n / of : 0;
+}
+
+int initProfile(vmProfile *prof, int count)
+{
+    prof->count = count;
+    prof->steps = 0;
+    prof->runs = calloc(count + 1, sizeof(long long));
+    prof->taken = calloc(count + 1, sizeof(long long));
+    if (prof->runs == NULL || prof->taken == NULL)
+    {
+        freeProfile(prof);
+        return 1;
+    }
+    return 0;
+}
+
+void finishProfile(vmProfile *prof)
+{
+    long long sum = 0;
+    int i;
+
+    for (i = 0; i <= prof->count; i++)
+    {
+        sum += prof->runs[i];
+        prof->runs[i] = sum;
+    }
+}
+
+void freeProfile(vmProfile *prof)
+{
+    free(prof->runs);
+    free(prof->taken);
+    prof->runs = prof->taken = NULL;
+}
+
+void annotateProfile(const vmProfile *prof, const pm0Instr *code, int pc, FILE *out)
+{
+    long long n = prof->runs[pc];
+
+    if (n == 0)
+    {
+        fprintf(out, "%14s", "-");
+        return;
+    }
+    fprintf(out, "%14lld %6.2f%%", n, share(n, prof->steps));
+    if (code[pc].op == 8)
+        fprintf(out, "  jumped %lld, fell through %lld", prof->taken[pc], n - prof->taken[pc]);
+    else if (code[pc].op == 7 && code[pc].m <= pc)
+        fprintf(out, "  loop back to %d", code[pc].m);
+}
+
+void printProfile(const vmProfile *prof, const pm0Instr *code, FILE *out)
+{
+    long long ops[27] = {0}, back, *before;
+    int order[27], *top, loopCount = 0, i, j, n;
+    profileLoop *loops;
+
+    fprintf(out, "\n%lld instructions run\n", prof->steps);
+
+    for (i = 0; i < prof->count; i++)
+        ops[opIndex(&code[i])] += prof->runs[i];
+    for (i = 0; i < 27; i++)
+        order[i] = i;
+    sortCounts = ops;
+    qsort(order, 27, sizeof(int), byCount);
+    fprintf(out, "\nopcode          instrs   share\n");
+    for (i = 0; i < 27 && ops[order[i]] > 0; i++)
+    {
+        j = order[i];
+        fprintf(out, "%-6s %14lld %6.2f%%\n", j >= 24 ? sioNames[j - 24] : j >= 10 ? oprNames[j - 10] : opNames[j],
+                ops[j], share(ops[j], prof->steps));
+    }
+
+    top = malloc((prof->count + 1) * sizeof(int));
+    loops = malloc((prof->count + 1) * sizeof(profileLoop));
+    before = malloc((prof->count + 1) * sizeof(long long));
+    if (top == NULL || loops == NULL || before == NULL)
+    {
+        fprintf(out, "Out of memory for the profile\n");
+        free(top);
+        free(loops);
+        free(before);
+        return;
+    }
+    for (i = 0; i < prof->count; i++)
+        top[i] = i;
+    sortCounts = prof->runs;
+    qsort(top, prof->count, sizeof(int), byCount);
+    n = prof->count < PROFILE_TOP ? prof->count : PROFILE_TOP;
+    fprintf(out, "\nhot spots          instrs   share  running\n");
+    for (i = 0, back = 0; i < n && prof->runs[top[i]] > 0; i++)
+    {
+        j = top[i];
+        back += prof->runs[j];
+        fprintf(out, "%5d %-6s%3d%6d %12lld %6.2f%% %7.2f%%\n", j, instrName(&code[j]), code[j].l, code[j].m,
+                prof->runs[j], share(prof->runs[j], prof->steps), share(back, prof->steps));
+    }
+
+    before[0] = 0;         // Instructions run ahead of each one, so a loop's are one subtraction
+    for (i = 0; i < prof->count; i++)
+        before[i + 1] = before[i] + prof->runs[i];
+    for (i = 0; i < prof->count; i++)
+        if ((code[i].op == 7 || code[i].op == 8) && code[i].m <= i && code[i].m >= 0)
+        {
+            back = code[i].op == 7 ? prof->runs[i] : prof->taken[i];
+            loops[loopCount].head = code[i].m;
+            loops[loopCount].end = i;
+            loops[loopCount].iterations = back;
+            loops[loopCount].instrs = before[i + 1] - before[code[i].m];
+            loopCount++;
+        }
+    qsort(loops, loopCount, sizeof(profileLoop), byInstrs);
+    if (loopCount > 0)
+        fprintf(out, "\nloop             entered   iterations         instrs   share\n");
+    for (i = 0; i < loopCount && i < PROFILE_TOP && loops[i].instrs > 0; i++)
+    {
+        // Getting to the head other than by jumping back is going in
+        fprintf(out, "%5d-%-5d %12lld %12lld %14lld %6.2f%%\n", loops[i].head, loops[i].end,
+                prof->runs[loops[i].head] - loops[i].iterations, loops[i].iterations,
+                loops[i].instrs, share(loops[i].instrs, prof->steps));
+    }
+    free(top);
+    free(loops);
+    free(before);
+}
+
+/*
+    The source the map was made from: where it says, that taken from the map's
+    directory, or just its name in the map's directory. 1 if it's none of them
+*/
+static int openMapSource(const lineMap *map, const char *mapPath, sourceBuf *src)
+{
+    const char *slash = strrchr(mapPath, '/'), *name = strrchr(map->source, '/');
+    char *near;
+    FILE *file = fopen(map->source, "rb");
+    int failed;
+
+    if (file == NULL && map->source[0] != '/' && slash != NULL)
+    {
+        near = malloc(slash - mapPath + strlen(map->source) + 2);
+        if (near == NULL)
+            return 1;
+        sprintf(near, "%.*s/%s", (int)(slash - mapPath), mapPath, map->source);
+        file = fopen(near, "rb");
+        if (file == NULL && name != NULL)
+        {
+            sprintf(near, "%.*s%s", (int)(slash - mapPath), mapPath, name);
+            file = fopen(near, "rb");
+        }
+        free(near);
+    }
+    if (file == NULL)
+        return 1;
+    failed = loadSource(file, src) != 0 && readStream(file, src) != 0;
+    fclose(file);
+    return failed;
+}
+
+void printLineProfile(const vmProfile *prof, const lineMap *map, const char *mapPath, FILE *out)
+{
+    sourceBuf src;
+    const char **text = NULL, *p, *end;
+    int *top, lines = 0, hasSource, at, i, j, n;
+    long long *instrs, *times, back;
+
+    if (map->count > 0 && map->ranges[map->count - 1].pc >= prof->count)
+    {
+        fprintf(out, "\n%s doesn't fit this program, it's from a different compile\n", mapPath);
+        return;
+    }
+    hasSource = map->source != NULL && openMapSource(map, mapPath, &src) == 0;
+    if (hasSource)
+    {
+        for (p = src.data, end = p + src.size; p < end; p++)
+            lines += *p == '\n';
+        lines += src.size > 0 && end[-1] != '\n';  // A last line without a newline
+    }
+    for (i = 0; i < map->count; i++)
+        if (map->ranges[i].line > lines)
+            lines = map->ranges[i].line;
+
+    instrs = calloc(lines + 1, sizeof(long long));
+    times = calloc(lines + 1, sizeof(long long));
+    top = malloc((lines + 1) * sizeof(int));
+    text = calloc(lines + 2, sizeof(char *));
+    if (instrs == NULL || times == NULL || top == NULL || text == NULL)
+    {
+        fprintf(out, "Out of memory for the profile\n");
+        lines = -1;
+    }
+    for (j = 1; j <= lines; j++)
+        times[j] = -1;      // No code at all, as opposed to code that never ran
+    for (i = 0; i < map->count && lines > 0; i++)
+        times[map->ranges[i].line] = 0;
+    for (i = 0; i < prof->count && lines > 0; i++)
+    {
+        at = lineAt(map, i);
+        if (at < 0)
+            continue;
+        j = map->ranges[at].line;
+        instrs[j] += prof->runs[i];
+        if (prof->runs[i] > times[j])
+            times[j] = prof->runs[i];
+    }
+    if (hasSource && lines > 0)     // Where each line starts, the one after the last is the end
+    {
+        text[1] = src.data;
+        for (p = src.data, end = p + src.size, j = 2; p < end; p++)
+            if (*p == '\n')
+                text[j++] = p + 1;
+        for (; j <= lines + 1; j++)
+            text[j] = end;
+    }
+
+    if (lines > 0)
+    {
+        for (i = 0; i < lines; i++)
+            top[i] = i + 1;
+        sortCounts = instrs;
+        qsort(top, lines, sizeof(int), byCount);
+        fprintf(out, "\nhot lines          times         instrs   share  running\n");
+        for (i = 0, back = 0; i < lines && i < PROFILE_TOP && instrs[top[i]] > 0; i++)
+        {
+            j = top[i];
+            back += instrs[j];
+            fprintf(out, "%5d %14lld %14lld %6.2f%% %7.2f%%", j, times[j], instrs[j], share(instrs[j], prof->steps), share(back, prof->steps));
+            if (hasSource)      // Enough of it to know which line it is
+            {
+                for (p = text[j]; p < text[j + 1] && (*p == ' ' || *p == '\t'); p++)
+                    ;
+                for (n = 0; p + n < text[j + 1] && p[n] != '\r' && p[n] != '\n' && n < 40; n++)
+                    ;
+                fprintf(out, "   %.*s", n, p);
+            }
+            fprintf(out, "\n");
+        }
+    }
+    if (!hasSource)
+        fprintf(out, "\n(no listing, can't read the source %s)\n", map->source != NULL ? map->source : "the map doesn't name");
+    else if (lines > 0)
+    {
+        fprintf(out, "\n%s:\n\n        times         instrs   share  line\n", map->source);
+        for (j = 1; j <= lines; j++)
+        {
+            for (n = 0; text[j] + n < text[j + 1] && text[j][n] != '\r' && text[j][n] != '\n'; n++)
+                ;
+            if (times[j] >= 0)
+                fprintf(out, "%13lld %14lld %6.2f%% %5d  %.*s\n", times[j], instrs[j], share(instrs[j], prof->steps), j, n, text[j]);
+            else
+                fprintf(out, "%13s %14s %7s %5d  %.*s\n", "", "", "", j, n, text[j]);
+        }
+    }
+    if (hasSource)
+        freeSource(&src);
+    free(instrs);
+    free(times);
+    free(top);
+    free(text);
+}
@@ -0,0 +1,48 @@
+#ifndef PROFILE_H_INCLUDED
+#define PROFILE_H_INCLUDED
+
+#include <stdio.h>
+#include "pm0.h"
+#include "linemap.h"
+
+#define PROFILE_TOP 20      // Lines in the hot spot and loop tables
+
+/**
+ *  How often every instruction of one run ran, counted by the fast engine (see
+ *  runProfiled in fastvm.h). Nothing is sampled, every count is exact.
+ *
+ *  While the program runs, runs only gets a +1 where a straight run of
+ *  instructions started and a -1 just after it ended, at the jumps, calls and
+ *  returns. finishProfile adds those up into a count for every instruction.
+ *
+ *  A loop is a jump back to an earlier instruction, the loop being everything
+ *  from there to the jump. The instrs of a loop are the instructions that ran
+ *  inside it, nested loops included, the procedures it called not.
+ */
+typedef struct vmProfile
+{
+    int count;              // Instructions in the program
+    long long *runs;        // Times each instruction ran, count + 1 of them
+    long long *taken;       // Times each JPC jumped
+    long long steps;        // Instructions run in all
+} vmProfile;
+
+int initProfile(vmProfile *prof, int count);    // Returns 1 if there's no memory for it
+void finishProfile(vmProfile *prof);            // Once, after the run
+void freeProfile(vmProfile *prof);
+
+// The counts for one line of a listing: times, share of the run, and what a jump did
+void annotateProfile(const vmProfile *prof, const pm0Instr *code, int pc, FILE *out);
+
+// Instructions run by opcode, then the top instructions and loops, hottest first
+void printProfile(const vmProfile *prof, const pm0Instr *code, FILE *out);
+
+/**
+ *  The same counts by source line, from the compiler's line map (see linemap.h): the
+ *  hottest lines, then the whole source with what each line cost. The times of a line
+ *  are those of its instruction that ran the most, its instrs all of theirs added up.
+ *  The source is looked for where the map says, and failing that next to mapPath.
+ */
+void printLineProfile(const vmProfile *prof, const lineMap *map, const char *mapPath, FILE *out);
+
+#endif // PROFILE_H_INCLUDED
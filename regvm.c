@@ -0,0 +1,594 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "regvm.h"
+#include "fastvm.h"
+
+/*
+    Kinds of register instruction. The binary operators come in four forms each,
+    depending on which operands are constants: form = 2 * (a is constant) + (b is constant).
+*/
+#define RK_BIN 0            // fp[dst] = a op b, + 4 * OPR modifier + form
+#define RK_BIN_STO 56       // the same, and fp[to] too
+#define RK_BRANCH 112       // the same, and jump to to if it came out 0
+#define RK_MOV 168          // fp[dst] = a, + 1 if a is a constant
+#define RK_NEG 170          // fp[dst] = -a
+#define RK_ODD 172          // fp[dst] = a & 1
+#define RK_JPC 174          // jump to to if a is 0
+#define RK_OUT 176          // write a
+#define RK_STO_UP 178       // a into address b, to levels down
+#define RK_INP 180          // read into fp[dst]
+#define RK_LOD_UP 181       // fp[dst] = address b, a levels down
+#define RK_JMP 182
+#define RK_INC 183          // a more slots on top of the dst the stack is at
+#define RK_CAL 184          // a levels down, to to, from the stack height in dst
+#define RK_RET 185
+#define RK_HLT 186
+#define RK_COUNT 187
+
+typedef struct regInstr
+{
+    const void *run;    // Handler, filled in from kind just before running
+    int kind;
+    int a;              // Operands, a frame slot or a constant depending on kind
+    int b;
+    int dst;            // Frame slot the result goes to
+    int keep;           // Frame slot where the stack machine would have left b (or a, for the unary ones)
+    int to;             // Jump target (register code), second destination, or a level
+    int pc;             // PM/0 instruction it came from
+} regInstr;
+
+// A value on the operand stack while translating: what's in a frame slot right now, or a constant
+typedef struct operand
+{
+    int isConst;
+    int v;
+} operand;
+
+typedef struct regCode
+{
+    regInstr *code;
+    int count;
+    int capacity;
+    int *entry;         // Register instruction each PM/0 instruction starts at, -1 if it isn't the start of a block
+    int *depth;         // sp - bp before each PM/0 instruction, DEPTH_UNSEEN if it can't be reached
+    int deepest;        // The most sp - bp gets to anywhere
+    operand *val;       // Operand stack while translating a block, by depth + 1
+    int low;            // Lowest depth pushed since the block started, below that every slot holds itself
+    int top;            // Current depth
+    int last;           // Instruction a STO or JPC may still merge into, -1 if none
+} regCode;
+
+static int emit(regCode *rc, int kind, int a, int b, int dst, int keep, int to, int pc)
+{
+    regInstr *in;
+
+    if (rc->count == rc->capacity)
+    {
+        rc->capacity = rc->capacity ? rc->capacity * 2 : 256;
+        rc->code = realloc(rc->code, rc->capacity * sizeof(regInstr));
+        if (rc->code == NULL)
+        {
+            printf("Out of memory for the program code\n");
+            exit(1);
+        }
+    }
+    in = &rc->code[rc->count];
+    in->run = NULL;
+    in->kind = kind;
+    in->a = a;
+    in->b = b;
+    in->dst = dst;
+    in->keep = keep;
+    in->to = to;
+    in->pc = pc;
+    rc->last = -1;
+    return rc->count++;
+}
+
+static int isSlot(operand o, int slot)
+{
+    return !o.isConst && o.v == slot;
+}
+
+static void writeSlot(regCode *rc, int slot, int pc);
+
+// Puts the value at depth q into its own slot
+static void materialize(regCode *rc, int q, int pc)
+{
+    operand o = rc->val[q + 1];
+
+    if (isSlot(o, q))
+        return;
+    writeSlot(rc, q, pc);
+    emit(rc, RK_MOV + o.isConst, o.v, 0, q, q, 0, pc);
+    rc->val[q + 1].isConst = 0;
+    rc->val[q + 1].v = q;
+}
+
+// slot is about to change, so anything on the stack still reading it gets its own copy first
+static void writeSlot(regCode *rc, int slot, int pc)
+{
+    int q;
+
+    for (q = rc->low; q <= rc->top; q++)
+        if (q != slot && isSlot(rc->val[q + 1], slot))
+            materialize(rc, q, pc);
+}
+
+// The next block reads the stack from memory
+static void flush(regCode *rc, int pc)
+{
+    int q;
+
+    for (q = rc->low; q <= rc->top; q++)
+        materialize(rc, q, pc);
+}
+
+static void push(regCode *rc, int isConst, int v)
+{
+    rc->top++;
+    if (rc->top < rc->low)
+        rc->low = rc->top;
+    rc->val[rc->top + 1].isConst = isConst;
+    rc->val[rc->top + 1].v = v;
+}
+
+// After something wrote slot, a stack entry at that depth is back to being the slot itself
+static void wrote(regCode *rc, int slot)
+{
+    if (slot >= rc->low && slot <= rc->top)
+    {
+        rc->val[slot + 1].isConst = 0;
+        rc->val[slot + 1].v = slot;
+    }
+}
+
+// Whether writing slot would need copies made first
+static int inUse(regCode *rc, int slot, int except)
+{
+    int q;
+
+    for (q = rc->low; q <= rc->top; q++)
+        if (q != slot && q != except && isSlot(rc->val[q + 1], slot))
+            return 1;
+    return 0;
+}
+
+static void translateAt(regCode *rc, const pm0Instr *code, int count, int i)
+{
+    int op = code[i].op, l = code[i].l, m = code[i].m, d = rc->top, last = rc->last, form;
+    operand x, y;
+
+    switch (op)
+    {
+        case 1:
+            push(rc, 1, m);
+            break;
+        case 3:
+            if (l == 0)
+            {
+                if (m >= rc->low && m <= d)
+                    x = rc->val[m + 1];
+                else
+                {
+                    x.isConst = 0;
+                    x.v = m;
+                }
+                push(rc, x.isConst, x.v);
+                break;
+            }
+            flush(rc, i);
+            writeSlot(rc, d + 1, i);
+            emit(rc, RK_LOD_UP, l, m, d + 1, 0, 0, i);
+            push(rc, 0, d + 1);
+            break;
+        case 4:
+            x = rc->val[d + 1];
+            rc->top--;
+            if (l != 0)
+            {
+                flush(rc, i);
+                emit(rc, RK_STO_UP + x.isConst, x.v, m, 0, d, l, i);
+                break;
+            }
+            if (last >= 0 && rc->code[last].dst == d && isSlot(x, d) && !inUse(rc, m, d))
+            {
+                rc->code[last].kind += RK_BIN_STO - RK_BIN;     // OPR; STO into one
+                rc->code[last].to = m;
+                wrote(rc, m);
+                break;
+            }
+            writeSlot(rc, m, i);
+            writeSlot(rc, d, i);
+            emit(rc, RK_MOV + x.isConst, x.v, 0, m, d, 0, i);
+            wrote(rc, m);
+            break;
+        case 2:
+            if (m == 0)
+            {
+                flush(rc, i);
+                emit(rc, RK_RET, 0, 0, 0, 0, 0, i);
+                break;
+            }
+            if (m == 1 || m == 6)
+            {
+                x = rc->val[d + 1];
+                writeSlot(rc, d, i);
+                emit(rc, (m == 1 ? RK_NEG : RK_ODD) + x.isConst, x.v, 0, d, d, 0, i);
+                wrote(rc, d);
+                break;
+            }
+            if (m < 2 || m > 13)
+                break;      // Does nothing, same as on the stack machine
+            x = rc->val[d];
+            y = rc->val[d + 1];
+            rc->top--;
+            writeSlot(rc, d - 1, i);
+            writeSlot(rc, d, i);
+            form = 2 * x.isConst + y.isConst;
+            emit(rc, RK_BIN + 4 * m + form, x.v, y.v, d - 1, d, 0, i);
+            wrote(rc, d - 1);
+            rc->last = rc->count - 1;
+            break;
+        case 5:
+            flush(rc, i);
+            emit(rc, RK_CAL, l, 0, d, 0, m, i);
+            break;
+        case 6:
+            emit(rc, RK_INC, m, 0, d, 0, 0, i);
+            rc->top += m;
+            if (d + 1 < rc->low)
+                rc->low = d + 1;
+            for (form = d + 1; form <= rc->top; form++)
+                wrote(rc, form);    // Whatever is in memory there, not something pushed earlier
+            break;
+        case 7:
+            flush(rc, i);
+            emit(rc, RK_JMP, 0, 0, 0, 0, m, i);
+            break;
+        case 8:
+            x = rc->val[d + 1];
+            rc->top--;
+            flush(rc, i);
+            if (last >= 0 && rc->last == last && rc->code[last].dst == d && isSlot(x, d) &&
+                rc->code[last].kind >= RK_BIN + 4 * 8 && rc->code[last].kind < RK_BIN_STO)
+            {
+                rc->code[last].kind += RK_BRANCH - RK_BIN;      // Compare; JPC into one
+                rc->code[last].to = m;
+                rc->last = -1;
+                break;
+            }
+            writeSlot(rc, d, i);
+            emit(rc, RK_JPC + x.isConst, x.v, 0, 0, d, m, i);
+            break;
+        case 9:
+            if (m == 0)
+            {
+                x = rc->val[d + 1];
+                rc->top--;
+                writeSlot(rc, d, i);
+                emit(rc, RK_OUT + x.isConst, x.v, 0, 0, d, 0, i);
+            }
+            else if (m == 1)
+            {
+                writeSlot(rc, d + 1, i);
+                emit(rc, RK_INP, 0, 0, d + 1, 0, 0, i);
+                push(rc, 0, d + 1);
+            }
+            else if (m == 2)
+                emit(rc, RK_HLT, 0, 0, 0, 0, 0, i);
+            break;
+    }
+}
+
+/*
+    Translates code into rc. Blocks start at 0, at every jump and call target, and
+    right after every jump, call and RET. Returns 0 if it can't be done.
+*/
+static int translate(const pm0Instr *code, int count, int height, regCode *rc)
+{
+    char *leader;
+    int i, t, maxDepth = 0, blockEnd = 1, op, m;
+
+    memset(rc, 0, sizeof(*rc));
+    rc->entry = malloc((count + 1) * sizeof(int));
+    rc->depth = malloc((count + 1) * sizeof(int));
+    leader = calloc(count + 1, 1);
+    if (rc->entry == NULL || rc->depth == NULL || leader == NULL)
+    {
+        printf("Out of memory for the program code\n");
+        exit(1);
+    }
+    if (!stackDepths(code, count, height, rc->depth))
+    {
+        free(leader);
+        return 0;
+    }
+    for (i = 0; i < count; i++)
+    {
+        op = code[i].op;
+        m = code[i].m;
+        if (rc->depth[i] == DEPTH_UNSEEN)
+            continue;
+        t = rc->depth[i] + (op == 6 && m > 0 ? m : 1);     // Deepest it gets after this one
+        if (t > maxDepth)
+            maxDepth = t;
+        if ((op == 5 || op == 7 || op == 8) && m >= 0 && m < count)
+            leader[m] = 1;
+        if (op == 5 || op == 7 || op == 8 || (op == 2 && m == 0))
+            leader[i + 1] = 1;
+    }
+    leader[0] = 1;
+    rc->deepest = maxDepth;
+    rc->val = malloc((maxDepth + 2) * sizeof(operand));
+    if (rc->val == NULL)
+    {
+        printf("Out of memory for the program code\n");
+        exit(1);
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        rc->entry[i] = -1;
+        if (rc->depth[i] == DEPTH_UNSEEN)
+        {
+            blockEnd = 1;
+            continue;
+        }
+        if (leader[i] || blockEnd)
+        {
+            if (!blockEnd)
+                flush(rc, i);
+            rc->entry[i] = rc->count;
+            rc->top = rc->depth[i];
+            rc->low = rc->top + 1;
+            rc->last = -1;
+        }
+        translateAt(rc, code, count, i);
+        op = code[i].op;
+        m = code[i].m;
+        blockEnd = op == 7 || (op == 2 && m == 0) || (op == 9 && m == 2);
+    }
+    if (!blockEnd)
+        flush(rc, count);
+    rc->entry[count] = emit(rc, RK_HLT, 0, 0, 0, 0, 0, count);     // Running off the end halts, like the tracing VM
+
+    for (i = 0; i < rc->count; i++)
+    {
+        t = rc->code[i].kind;
+        if (t == RK_JMP || t == RK_CAL || t == RK_JPC || t == RK_JPC + 1 || (t >= RK_BRANCH && t < RK_MOV))
+        {
+            m = rc->code[i].to;
+            rc->code[i].to = m >= 0 && m < count ? rc->entry[m] : rc->entry[count];
+        }
+    }
+    free(leader);
+    return 1;
+}
+
+static void freeRegCode(regCode *rc)
+{
+    free(rc->code);
+    free(rc->entry);
+    free(rc->depth);
+    free(rc->val);
+}
+
+int registerSize(const pm0Instr *code, int count, int height)
+{
+    regCode rc;
+    int n;
+
+    n = translate(code, count, height, &rc) ? rc.count : -1;
+    freeRegCode(&rc);
+    return n;
+}
+
+#define NEXT do { ir = ip++; goto *ir->run; } while (0)
+
+int runRegister(const pm0Instr *code, int count, int *stack, int height)
+{
+#define FORMS(name) {&&name##_ss, &&name##_sc, &&name##_cs, &&name##_cc}
+#define NONE {NULL, NULL, NULL, NULL}
+    static const void *bins[14][4] = {NONE, NONE, FORMS(add), FORMS(sub), FORMS(mul), FORMS(dvd), NONE, FORMS(mod),
+                                      FORMS(eql), FORMS(neq), FORMS(lss), FORMS(leq), FORMS(gtr), FORMS(geq)};
+    static const void *binStos[14][4] = {NONE, NONE, FORMS(add_st), FORMS(sub_st), FORMS(mul_st), FORMS(dvd_st), NONE,
+                                         FORMS(mod_st), FORMS(eql_st), FORMS(neq_st), FORMS(lss_st), FORMS(leq_st),
+                                         FORMS(gtr_st), FORMS(geq_st)};
+    static const void *branches[14][4] = {NONE, NONE, NONE, NONE, NONE, NONE, NONE, NONE,
+                                          FORMS(eql_br), FORMS(neq_br), FORMS(lss_br), FORMS(leq_br), FORMS(gtr_br), FORMS(geq_br)};
+    static const void *others[RK_COUNT - RK_MOV] = {&&mov_s, &&mov_c, &&neg_s, &&neg_c, &&odd_s, &&odd_c, &&jpc_s, &&jpc_c,
+                                                    &&out_s, &&out_c, &&stoup_s, &&stoup_c, &&inp, &&lodup, &&jmp, &&inc,
+                                                    &&cal, &&ret, &&hlt};
+#undef FORMS
+#undef NONE
+    regCode rc;
+    regInstr *prog, *ip, *ir;
+    int *fp, bp = 1, sp, b, l, i, k, x, y, top;
+    sioReader *in = sioStdin();     // The same ones resumeFast goes on with
+    sioWriter *out = sioStdout();
+
+    /*
+        Nothing is written more than deepest + 4 above a frame's bp, so a CAL with sp
+        up to top has room for everything the callee does, and nothing is compared
+        with height on the way. One that doesn't carries on on the stack machine,
+        which stops at the exact instruction that goes over.
+    */
+    top = translate(code, count, height, &rc) ? height - rc.deepest - 5 : -1;
+    if (top < 0)
+    {
+        freeRegCode(&rc);
+        return runFast(code, count, stack, height, FAST_ALL);
+    }
+    prog = rc.code;
+    for (i = 0; i < rc.count; i++)
+    {
+        k = prog[i].kind;
+        if (k < RK_BIN_STO)
+            prog[i].run = bins[k / 4][k % 4];
+        else if (k < RK_BRANCH)
+            prog[i].run = binStos[(k - RK_BIN_STO) / 4][k % 4];
+        else if (k < RK_MOV)
+            prog[i].run = branches[(k - RK_BRANCH) / 4][k % 4];
+        else
+            prog[i].run = others[k - RK_MOV];
+    }
+
+    stack[1] = stack[2] = stack[3] = 0;
+    fp = stack + bp;
+    ip = prog;
+    NEXT;
+
+// x and y are the operands, the stack machine leaves y where it was pushed
+#define BIN(label, X, Y, expr) \
+label: \
+    x = X; \
+    y = Y; \
+    fp[ir->keep] = y; \
+    fp[ir->dst] = expr; \
+    NEXT;
+#define BIN_STO(label, X, Y, expr) \
+label: \
+    x = X; \
+    y = Y; \
+    fp[ir->keep] = y; \
+    fp[ir->dst] = expr; \
+    fp[ir->to] = fp[ir->dst]; \
+    NEXT;
+#define BRANCH(label, X, Y, expr) \
+label: \
+    x = X; \
+    y = Y; \
+    fp[ir->keep] = y; \
+    if ((fp[ir->dst] = expr) == 0) \
+        ip = prog + ir->to; \
+    NEXT;
+#define ALL_FORMS(how, name, expr) \
+    how(name##_ss, fp[ir->a], fp[ir->b], expr) \
+    how(name##_sc, fp[ir->a], ir->b, expr) \
+    how(name##_cs, ir->a, fp[ir->b], expr) \
+    how(name##_cc, ir->a, ir->b, expr)
+#define OPERATOR(name, expr) \
+    ALL_FORMS(BIN, name, expr) \
+    ALL_FORMS(BIN_STO, name##_st, expr)
+#define COMPARISON(name, expr) \
+    OPERATOR(name, expr) \
+    ALL_FORMS(BRANCH, name##_br, expr)
+
+    OPERATOR(add, x + y)
+    OPERATOR(sub, x - y)
+    OPERATOR(mul, x * y)
+    OPERATOR(dvd, x / y)
+    OPERATOR(mod, x % y)
+    COMPARISON(eql, x == y)
+    COMPARISON(neq, x != y)
+    COMPARISON(lss, x < y)
+    COMPARISON(leq, x <= y)
+    COMPARISON(gtr, x > y)
+    COMPARISON(geq, x >= y)
+#undef BIN
+#undef BIN_STO
+#undef BRANCH
+#undef ALL_FORMS
+#undef OPERATOR
+#undef COMPARISON
+
+mov_s:
+    x = fp[ir->a];
+    fp[ir->keep] = x;
+    fp[ir->dst] = x;
+    NEXT;
+mov_c:
+    fp[ir->keep] = ir->a;
+    fp[ir->dst] = ir->a;
+    NEXT;
+neg_s:
+    fp[ir->dst] = -fp[ir->a];
+    NEXT;
+neg_c:
+    fp[ir->dst] = -ir->a;
+    NEXT;
+odd_s:
+    fp[ir->dst] = fp[ir->a] & 1;
+    NEXT;
+odd_c:
+    fp[ir->dst] = ir->a & 1;
+    NEXT;
+jpc_s:
+    x = fp[ir->a];
+    fp[ir->keep] = x;
+    if (x == 0)
+        ip = prog + ir->to;
+    NEXT;
+jpc_c:
+    fp[ir->keep] = ir->a;
+    if (ir->a == 0)
+        ip = prog + ir->to;
+    NEXT;
+out_s:
+    x = fp[ir->a];
+    fp[ir->keep] = x;
+    writeNumber(out, x);
+    NEXT;
+out_c:
+    fp[ir->keep] = ir->a;
+    writeNumber(out, ir->a);
+    NEXT;
+stoup_s:
+stoup_c:
+    x = ir->kind == RK_STO_UP ? fp[ir->a] : ir->a;
+    fp[ir->keep] = x;
+    for (b = bp, l = ir->to; l > 0; l--)
+        b = stack[b + 1];
+    stack[b + ir->b] = x;
+    NEXT;
+inp:
+    readNumber(in, &fp[ir->dst]);
+    NEXT;
+lodup:
+    for (b = bp, l = ir->a; l > 0; l--)
+        b = stack[b + 1];
+    fp[ir->dst] = stack[b + ir->b];
+    NEXT;
+jmp:
+    ip = prog + ir->to;
+    NEXT;
+inc:
+    NEXT;
+cal:
+    sp = bp + ir->dst;
+    if (sp > top)                       // The callee might not fit, let the stack machine have it
+    {
+        freeRegCode(&rc);
+        return resumeFast(code, count, stack, height, FAST_FUSE, ir->pc, bp, sp);
+    }
+    for (b = bp, l = ir->a; l > 0; l--)
+        b = stack[b + 1];
+    stack[sp + 1] = 0;                  // return value
+    stack[sp + 2] = b;                  // static link
+    stack[sp + 3] = bp;                 // dynamic link
+    stack[sp + 4] = ir->pc + 1;         // return address, the PM/0 one so the stack looks the same
+    bp = sp + 1;
+    fp = stack + bp;
+    ip = prog + ir->to;
+    NEXT;
+ret:
+    sp = bp - 1;
+    i = stack[sp + 4];
+    bp = stack[sp + 3];
+    fp = stack + bp;
+    if (i < 0 || i >= count)
+        goto hlt;
+    if (rc.entry[i] < 0 || rc.depth[i] != sp - bp)      // Not somewhere a CAL returns to, let the stack machine have it
+    {
+        freeRegCode(&rc);
+        return resumeFast(code, count, stack, height, FAST_FUSE, i, bp, sp);
+    }
+    ip = prog + rc.entry[i];
+    NEXT;
+hlt:
+    flushWriter(out);
+    freeRegCode(&rc);
+    return 0;
+}
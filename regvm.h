@@ -0,0 +1,30 @@
+#ifndef REGVM_H_INCLUDED
+#define REGVM_H_INCLUDED
+
+#include "pm0.h"
+
+/**
+ *  Runs a program on a register machine instead of a stack machine.
+ *
+ *  The PM/0 code is translated once up front. Because the compiler always leaves
+ *  the stack the same height at the same instruction, every value on the operand
+ *  stack has a fixed slot in the frame, so LIT and LOD don't need an instruction
+ *  of their own any more: they become the operands (a frame slot or a constant) of
+ *  whatever uses them. ADD, STO, JPC, OUT and the rest turn into three address
+ *  instructions on frame slots, like fp[6] = fp[4] + 1, and sp isn't kept at all.
+ *
+ *  Every instruction still leaves the stack memory exactly as the PM/0 code would,
+ *  values popped off the top included, so a program that reads a variable it never
+ *  set sees the same leftovers on either machine. Code the translation can't give
+ *  fixed slots to (jumps that arrive with a different stack height, a RET to
+ *  somewhere no CAL returns to) runs on runFast instead, or carries on there from
+ *  the RET. So does a CAL whose callee might not fit on the stack any more.
+ *
+ *  Arguments and the return value are the same as runFast's.
+ */
+int runRegister(const pm0Instr *code, int count, int *stack, int height);
+
+// How many register instructions code translates to, -1 if it can't be translated
+int registerSize(const pm0Instr *code, int count, int height);
+
+#endif // REGVM_H_INCLUDED
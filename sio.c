@@ -0,0 +1,223 @@
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <limits.h>
+#include "sio.h"
+
+#ifndef _WIN32
+#include <errno.h>
+#include <unistd.h>
+#endif
+
+static sioReader standardIn;
+static sioWriter standardOut;
+static int standard;        // 1 once the two above are open
+
+void openWriter(sioWriter *w, FILE *file, int binary)
+{
+    w->file = file;
+    w->binary = binary;
+    w->at = w->buf;
+#ifndef _WIN32
+    w->eager = fileno(file) >= 0 && isatty(fileno(file));
+#else
+    w->eager = 0;
+#endif
+}
+
+void openReader(sioReader *r, FILE *file, int binary, sioWriter *tied)
+{
+    r->file = file;
+    r->fd = -1;
+#ifndef _WIN32
+    r->fd = fileno(file);
+#endif
+    r->binary = binary;
+    r->done = 0;
+    r->tied = tied;
+    r->at = r->end = r->buf;
+}
+
+void memoryReader(sioReader *r, const char *data, size_t size, int binary)
+{
+    r->file = NULL;
+    r->fd = -1;
+    r->binary = binary;
+    r->done = 1;
+    r->tied = NULL;
+    r->at = data;
+    r->end = data + size;
+}
+
+void dropInput(sioReader *r)
+{
+    if (r->file == NULL)
+        return;
+    r->done = 0;
+    r->at = r->end = r->buf;
+}
+
+// The next buffer's worth. Returns 0 at the end of the input
+static int fill(sioReader *r)
+{
+    long n;
+
+    if (r->done)
+        return 0;
+    if (r->tied != NULL)
+        flushWriter(r->tied);
+#ifndef _WIN32
+    if (r->fd >= 0)
+        do
+            n = (long)read(r->fd, r->buf, SIO_BUFFER);
+        while (n < 0 && errno == EINTR);
+    else
+#endif
+        n = (long)fread(r->buf, 1, SIO_BUFFER, r->file);
+    if (n <= 0)
+    {
+        r->done = 1;
+        return 0;
+    }
+    r->at = r->buf;
+    r->end = r->buf + n;
+    return 1;
+}
+
+static int readBinary(sioReader *r, int *value)
+{
+    unsigned char bytes[4];
+    int i;
+
+    if (r->end - r->at >= 4)
+        memcpy(bytes, r->at, 4), r->at += 4;
+    else
+        for (i = 0; i < 4; i++)     // Across the end of the buffer. A number cut short at the end of the input isn't one
+        {
+            if (r->at == r->end && !fill(r))
+                return 0;
+            bytes[i] = (unsigned char)*r->at++;
+        }
+    *value = (int)((unsigned int)bytes[0] | (unsigned int)bytes[1] << 8 | (unsigned int)bytes[2] << 16 | (unsigned int)bytes[3] << 24);
+    return 1;
+}
+
+int readNumber(sioReader *r, int *value)
+{
+    unsigned long n = 0, limit = LONG_MAX;
+    int negative = 0, digits = 0, c = 0;
+
+    if (r->binary)
+        return readBinary(r, value);
+    for (;;)
+    {
+        if (r->at == r->end && !fill(r))
+            return 0;
+        c = (unsigned char)*r->at;
+        if (!isspace(c))
+            break;
+        r->at++;
+    }
+    if (c == '-' || c == '+')
+    {
+        negative = c == '-';
+        limit += negative;
+        r->at++;
+    }
+    for (;;)
+    {
+        if (r->at == r->end && !fill(r))
+            break;
+        c = (unsigned char)*r->at - '0';
+        if (c < 0 || c > 9)
+            break;
+        n = n > (limit - c) / 10 ? limit : n * 10 + c;     // strtol's clamp
+        digits++;
+        r->at++;
+    }
+    if (digits == 0)
+        return 0;
+    *value = negative ? (n == (unsigned long)LONG_MAX + 1 ? (int)LONG_MIN : (int)-(long)n) : (int)(long)n;
+    return 1;
+}
+
+// Hands the buffer to the file, without flushing the file
+static void pass(sioWriter *w)
+{
+    if (w->at > w->buf)
+        fwrite(w->buf, 1, w->at - w->buf, w->file);
+    w->at = w->buf;
+}
+
+void flushWriter(sioWriter *w)
+{
+    pass(w);
+    fflush(w->file);
+}
+
+void writeNumber(sioWriter *w, int value)
+{
+    char digits[12], *d = digits + sizeof(digits);
+    unsigned int u = (unsigned int)value;
+
+    if (w->buf + SIO_BUFFER - w->at < 12)
+        pass(w);
+    if (w->binary)
+    {
+        w->at[0] = (char)u;
+        w->at[1] = (char)(u >> 8);
+        w->at[2] = (char)(u >> 16);
+        w->at[3] = (char)(u >> 24);
+        w->at += 4;
+    }
+    else
+    {
+        if (value < 0)
+        {
+            *w->at++ = '-';
+            u = 0u - u;
+        }
+        do
+            *--d = (char)('0' + u % 10);
+        while ((u /= 10) != 0);
+        memcpy(w->at, d, digits + sizeof(digits) - d);
+        w->at += digits + sizeof(digits) - d;
+        *w->at++ = '\n';
+    }
+    if (w->eager)
+        flushWriter(w);
+}
+
+void sioStandard(int binaryIn, int binaryOut)
+{
+    openWriter(&standardOut, stdout, binaryOut);
+    openReader(&standardIn, stdin, binaryIn, &standardOut);
+    standard = 1;
+}
+
+sioReader *sioStdin(void)
+{
+    if (!standard)
+        sioStandard(SIO_TEXT, SIO_TEXT);
+    return &standardIn;
+}
+
+sioWriter *sioStdout(void)
+{
+    if (!standard)
+        sioStandard(SIO_TEXT, SIO_TEXT);
+    return &standardOut;
+}
+
+int sioMode(const char *text, int *binaryIn, int *binaryOut)
+{
+    if (*text == '\0')
+        *binaryIn = *binaryOut = SIO_BINARY;
+    else if (strcmp(text, "=in") == 0)
+        *binaryIn = SIO_BINARY;
+    else if (strcmp(text, "=out") == 0)
+        *binaryOut = SIO_BINARY;
+    else
+        return -1;
+    return 0;
+}
@@ -0,0 +1,72 @@
+#ifndef SIO_H_INCLUDED
+#define SIO_H_INCLUDED
+
+#include <stdio.h>
+#include <stddef.h>
+
+#define SIO_BUFFER (64 * 1024)  // Bytes read or written at a time
+
+#define SIO_TEXT 0              // Numbers as text, exactly what scanf("%d") takes and printf("%d\n") writes
+#define SIO_BINARY 1            // Every number is 4 bytes, a little endian int32, nothing between them
+
+/**
+ *  What SIO writes, a buffer's worth at a time. Numbers are formatted by hand
+ *  into the buffer, which goes to file once it's full, when the run stops, or
+ *  after every number if it's eager (file is a terminal, where the output has
+ *  to show up as it's written).
+ */
+typedef struct sioWriter
+{
+    FILE *file;
+    int binary;
+    int eager;
+    char *at;               // Where the next number goes
+    char buf[SIO_BUFFER];
+} sioWriter;
+
+/**
+ *  What SIO reads, a buffer's worth at a time, straight from the file's
+ *  descriptor so a terminal or a pipe gives us what it has without waiting
+ *  for more. Before it waits for more input, whatever the tied writer holds is
+ *  written out, so a program's prompt shows up before it reads the answer.
+ *
+ *  A reader over memory (vmbatch's inputs) reads it where it is.
+ */
+typedef struct sioReader
+{
+    FILE *file;             // NULL when it reads memory
+    int fd;                 // -1 if the file has no descriptor, then it's fread
+    int binary;
+    int done;               // Nothing more to come
+    sioWriter *tied;
+    const char *at, *end;   // What's left of the buffer
+    char buf[SIO_BUFFER];
+} sioReader;
+
+void openWriter(sioWriter *w, FILE *file, int binary);
+void openReader(sioReader *r, FILE *file, int binary, sioWriter *tied);
+void memoryReader(sioReader *r, const char *data, size_t size, int binary);
+
+/**
+ *  Reads a number into value, returns 0 and leaves value alone if there isn't
+ *  one. In text it's scanf's %d to the letter: whitespace skipped, a sign, the
+ *  digits (clamped to a long and then cut down to an int), and anything else is
+ *  left where it is, so every read after it fails too.
+ */
+int readNumber(sioReader *r, int *value);
+void writeNumber(sioWriter *w, int value);
+void flushWriter(sioWriter *w);         // Out to the file and the file flushed, before anything else writes to it
+void dropInput(sioReader *r);           // Forgets what's buffered, for a file that was rewound under it
+
+/**
+ *  SIO for the engines that run on stdin and stdout (runFast, runRegister,
+ *  runJit, the tracing VM), one reader and writer shared by all of them, so a
+ *  run that moves from one engine to another keeps what was read ahead.
+ *  sioStandard picks text or binary for each, text if it's never called.
+ */
+void sioStandard(int binaryIn, int binaryOut);
+sioReader *sioStdin(void);
+sioWriter *sioStdout(void);
+int sioMode(const char *text, int *binaryIn, int *binaryOut);  // --binary[=in|=out] after the name. Returns -1 if it isn't one
+
+#endif // SIO_H_INCLUDED
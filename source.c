@@ -0,0 +1,116 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "source.h"
+
+#ifndef _WIN32
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#endif
+
+/*
+    Gets the whole program into memory so the lexer can walk it with a pointer
+    instead of calling getc for every character.
+
+    Regular files are mmapped. If that isn't possible (no mmap, or it failed)
+    the file is read in with one fread. Anything that isn't a regular file
+    (pipes, terminals) can't be sized up front, so we return 1 and the caller
+    reads it in with readStream instead.
+*/
+int loadSource(FILE *file, sourceBuf *src)
+{
+    long size;
+    char *buf;
+
+    src->data = NULL;
+    src->size = 0;
+    src->mapped = 0;
+
+#ifndef _WIN32
+    struct stat st;
+    if (fstat(fileno(file), &st) != 0 || !S_ISREG(st.st_mode))
+        return 1;
+    if (st.st_size == 0)
+    {
+        src->data = "";
+        return 0;
+    }
+    buf = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fileno(file), 0);
+    if (buf != MAP_FAILED)
+    {
+#ifdef MADV_SEQUENTIAL
+        madvise(buf, (size_t)st.st_size, MADV_SEQUENTIAL);  // We only ever walk forward
+#endif
+        src->data = buf;
+        src->size = (size_t)st.st_size;
+        src->mapped = 1;
+        return 0;
+    }
+#endif
+
+    // No mapping, read it all in at once
+    if (fseek(file, 0, SEEK_END) != 0 || (size = ftell(file)) < 0 || fseek(file, 0, SEEK_SET) != 0)
+        return 1;
+    buf = malloc(size > 0 ? (size_t)size : 1);
+    if (buf == NULL)
+        return 1;
+    size = (long)fread(buf, 1, (size_t)size, file);
+    if (size == 0)
+    {
+        free(buf);
+        src->data = "";
+        return 0;
+    }
+    src->data = buf;
+    src->size = (size_t)size;
+    return 0;
+}
+
+int readStream(FILE *file, sourceBuf *src)
+{
+    size_t cap = 65536, got;
+    char *buf = malloc(cap), *bigger;
+
+    src->mapped = 0;
+    src->size = 0;
+    while (buf != NULL && (got = fread(buf + src->size, 1, cap - src->size, file)) > 0)
+    {
+        src->size += got;
+        if (src->size == cap)
+        {
+            bigger = realloc(buf, cap * 2);
+            if (bigger == NULL)
+                free(buf);
+            buf = bigger;
+            cap *= 2;
+        }
+    }
+    if (buf == NULL)
+    {
+        src->data = NULL;
+        src->size = 0;
+        return 1;
+    }
+    if (src->size == 0)
+    {
+        free(buf);
+        src->data = "";
+        return 0;
+    }
+    src->data = buf;
+    return 0;
+}
+
+void freeSource(sourceBuf *src)
+{
+#ifndef _WIN32
+    if (src->mapped)
+        munmap((void *)src->data, src->size);
+    else
+#endif
+    if (src->size > 0)
+        free((void *)src->data);
+    src->data = NULL;
+    src->size = 0;
+    src->mapped = 0;
+}
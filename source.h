@@ -0,0 +1,17 @@
+#ifndef SOURCE_H_INCLUDED
+#define SOURCE_H_INCLUDED
+
+#include <stddef.h>
+
+typedef struct sourceBuf
+{
+    const char *data;   // First byte of the program text
+    size_t size;        // Number of bytes in the program
+    int mapped;         // 1 if data is mmapped, 0 if it was read into the heap
+} sourceBuf;
+
+int loadSource(FILE *file, sourceBuf *src);    // Maps (or reads in one go) a regular file. Returns 1 if it has to be streamed instead
+int readStream(FILE *file, sourceBuf *src);    // Reads a stream (pipe, terminal) to the end. Returns 1 if we ran out of memory
+void freeSource(sourceBuf *src);               // Releases whatever loadSource got
+
+#endif // SOURCE_H_INCLUDED
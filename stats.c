@@ -0,0 +1,88 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "stats.h"
+
+static const char *bucketNames[STAT_BUCKETS] = {"lex", "parse", "symbols", "emit", "optimize", "write"};
+static const char *memNames[MEM_KINDS] = {"tokens", "names", "symbols", "nodes", "ir", "code"};
+
+static double nowMs(void)
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e3 + t.tv_nsec / 1e6;
+}
+
+void initStats(compileStats *s)
+{
+    memset(s, 0, sizeof(*s));
+    s->bucket = -1;
+}
+
+int switchStat(compileStats *s, int bucket)
+{
+    int was = s->bucket;
+    double now;
+
+    if (bucket == was)
+        return was;
+    now = nowMs();
+    if (was >= 0)
+        s->ms[was] += now - s->since;
+    if (bucket >= 0)
+        s->entered[bucket]++;
+    s->bucket = bucket;
+    s->since = now;
+    return was;
+}
+
+void printStats(const compileStats *s, FILE *out, int json)
+{
+    double total = 0;
+    long long memory = 0;
+    int i;
+
+    for (i = 0; i < STAT_BUCKETS; i++)
+        total += s->ms[i];
+    for (i = 0; i < MEM_KINDS; i++)
+        memory += s->bytes[i];
+    if (json)
+    {
+        fprintf(out, "{\"stats\":1,\"cached\":%s,\"source_bytes\":%lld,\"tokens\":%d,\"symbols\":%d,\"lookups\":%lld,"
+                "\"barked\":%d,\"instructions\":%d,\"backpatches\":%d,\"ir_instructions\":%d,\"ms\":%.3f,\"memory\":%lld}\n",
+                s->cached ? "true" : "false", s->sourceBytes, s->tokens, s->symbols, s->lookups,
+                s->barked, s->instructions, s->backpatches, s->irInstructions, total, memory);
+        for (i = 0; i < STAT_BUCKETS; i++)
+            if (s->entered[i] > 0)
+                fprintf(out, "{\"phase\":\"%s\",\"ms\":%.3f,\"entered\":%lld}\n", bucketNames[i], s->ms[i], s->entered[i]);
+        for (i = 0; i < MEM_KINDS; i++)
+            if (s->bytes[i] > 0)
+                fprintf(out, "{\"memory\":\"%s\",\"bytes\":%lld}\n", memNames[i], s->bytes[i]);
+        return;
+    }
+
+    if (s->cached)
+    {
+        fprintf(out, "\n(from the cache, nothing was compiled)\n");
+        return;
+    }
+    fprintf(out, "\nphase            ms   share       entered\n");
+    for (i = 0; i < STAT_BUCKETS; i++)
+        if (s->entered[i] > 0)
+            fprintf(out, "%-9s %10.3f %6.2f%% %13lld\n", bucketNames[i], s->ms[i], total > 0 ? 100 * s->ms[i] / total : 0, s->entered[i]);
+    fprintf(out, "%-9s %10.3f\n", "total", total);
+
+    fprintf(out, "\n%12lld source bytes\n%12d tokens\n%12d symbols declared\n%12lld names looked up\n", s->sourceBytes, s->tokens, s->symbols, s->lookups);
+    if (s->irInstructions > 0)
+        fprintf(out, "%12d IR instructions\n", s->irInstructions);
+    fprintf(out, "%12d instructions barked\n", s->barked);
+    if (s->instructions != s->barked)
+        fprintf(out, "%12d after -O\n", s->instructions);
+    fprintf(out, "%12d backpatches\n", s->backpatches);
+
+    fprintf(out, "\nmemory            bytes   share\n");
+    for (i = 0; i < MEM_KINDS; i++)
+        fprintf(out, "%-9s %14lld %6.2f%%\n", memNames[i], s->bytes[i], memory > 0 ? 100.0 * s->bytes[i] / memory : 0);
+    fprintf(out, "%-9s %14lld\n", "total", memory);
+}
@@ -0,0 +1,53 @@
+#ifndef STATS_H_INCLUDED
+#define STATS_H_INCLUDED
+
+#include <stdio.h>
+
+// Where the compiler's time goes, every moment of a compile is in exactly one of these
+#define STAT_LEX 0          // tokenize
+#define STAT_PARSE 1        // The grammar itself, less the two below
+#define STAT_SYMBOLS 2      // Declaring and looking up identifiers, opening and closing scopes
+#define STAT_EMIT 3         // Barking, expressions and lowered IR included, and rebarking
+#define STAT_OPTIMIZE 4     // The IR passes (--ir) and the peephole pass (-O)
+#define STAT_WRITE 5        // Writing out the code that was still held at the end
+#define STAT_BUCKETS 6
+
+// What the structures of a compile took up at their largest, in bytes
+#define MEM_TOKENS 0        // The token stream, and the line table if -g asked for it
+#define MEM_NAMES 1         // Intern table
+#define MEM_SYMBOLS 2       // Symbol table, bindings and scopes
+#define MEM_NODES 3         // Expression trees, the arena's blocks
+#define MEM_IR 4            // The IR of the biggest block
+#define MEM_CODE 5          // Code chunks in memory at once, and the addresses held for rebarking
+#define MEM_KINDS 6
+
+/**
+ *  What --stats reports about one compile (see compiler.h). The time is taken with
+ *  the monotonic clock each time the compiler moves from one bucket to another, so
+ *  every bucket is exclusive: looking up a name inside an expression counts towards
+ *  STAT_SYMBOLS and not STAT_PARSE. A compiler without stats never reads the clock.
+ */
+typedef struct compileStats
+{
+    double ms[STAT_BUCKETS];
+    long long entered[STAT_BUCKETS];    // Times the compiler went into each
+    int bucket;                         // Where the time is going now, -1 if nowhere
+    double since;                       // When it went there
+    long long bytes[MEM_KINDS];
+
+    long long sourceBytes;
+    int tokens;
+    int symbols;                // Declared
+    long long lookups;          // Names looked up
+    int barked;                 // Instructions emitted, before -O
+    int instructions;           // and what was left of them after it
+    int backpatches;            // Jumps rebarked once their target was known
+    int irInstructions;         // Added to the IR over all blocks
+    int cached;                 // Nothing was compiled, it came from the cache
+} compileStats;
+
+void initStats(compileStats *s);
+int switchStat(compileStats *s, int bucket);    // Charges the time since the last switch, returns the bucket it was in
+void printStats(const compileStats *s, FILE *out, int json);   // One object to a line with json, like --perf
+
+#endif // STATS_H_INCLUDED
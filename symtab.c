@@ -0,0 +1,91 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "symtab.h"
+#include "nomem.h"
+
+static void *growArray(void *array, int count, size_t size)
+{
+    void *bigger = realloc(array, count * size);
+    if (bigger == NULL)
+        outOfMemory("Out of memory for the symbol table\n");
+    return bigger;
+}
+
+void initSymbols(symbolTable *table)
+{
+    memset(table, 0, sizeof(*table));
+    pushScope(table);
+}
+
+void freeSymbols(symbolTable *table)
+{
+    free(table->symbols);
+    free(table->binding);
+    free(table->scopeStart);
+    memset(table, 0, sizeof(*table));
+}
+
+void pushScope(symbolTable *table)
+{
+    if (table->depth == table->scopeCap)
+    {
+        table->scopeCap = table->scopeCap ? table->scopeCap * 2 : 8;
+        table->scopeStart = growArray(table->scopeStart, table->scopeCap, sizeof(int));
+    }
+    table->scopeStart[table->depth++] = table->count;
+}
+
+void popScope(symbolTable *table)
+{
+    int start = table->scopeStart[--table->depth];
+
+    while (table->count > start)    // Newest first, so each name gets back what it was hiding
+    {
+        table->count--;
+        table->binding[table->symbols[table->count].name] = table->symbols[table->count].shadow;
+    }
+}
+
+int addSymbol(symbolTable *table, int name, int kind)
+{
+    int old, newCap, i;
+    symbol *sym;
+
+    if (name >= table->bindingCap)  // Ids come from the intern table, so they only ever count up
+    {
+        newCap = table->bindingCap ? table->bindingCap : 256;
+        while (newCap <= name)
+            newCap *= 2;
+        table->binding = growArray(table->binding, newCap, sizeof(int));
+        for (i = table->bindingCap; i < newCap; i++)
+            table->binding[i] = -1;
+        table->bindingCap = newCap;
+    }
+
+    old = table->binding[name];
+    if (old >= table->scopeStart[table->depth - 1])     // Already declared in this scope
+        return -1;
+
+    if (table->count == table->capacity)
+    {
+        table->capacity = table->capacity ? table->capacity * 2 : 256;
+        table->symbols = growArray(table->symbols, table->capacity, sizeof(symbol));
+    }
+    sym = &table->symbols[table->count];
+    sym->kind = kind;
+    sym->name = name;
+    sym->val = 0;
+    sym->level = table->depth - 1;
+    sym->addr = 0;
+    sym->shadow = old;
+    table->binding[name] = table->count;
+    return table->count++;
+}
+
+int findSymbol(const symbolTable *table, int name)
+{
+    if (name < 0 || name >= table->bindingCap)
+        return -1;
+    return table->binding[name];
+}
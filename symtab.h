@@ -0,0 +1,39 @@
+#ifndef SYMTAB_H_INCLUDED
+#define SYMTAB_H_INCLUDED
+
+typedef struct symbol
+{
+    int kind;       // const = 1, var = 2, proc = 3
+    int name;       // Interned id of the name, see intern.h
+    int val;        // number
+    int level;      // L level
+    int addr;       // M address
+    int shadow;     // Symbol this one hides in an outer scope, -1 if none
+} symbol;
+
+/**
+ *  Symbols live in one growing array in the order they were declared. Names are interned,
+ *  so instead of searching, binding[name id] says which symbol that name currently means.
+ *  Opening a scope remembers how many symbols there were, closing it drops everything
+ *  declared since and puts back whatever they were hiding.
+ */
+typedef struct symbolTable
+{
+    symbol *symbols;
+    int count;
+    int capacity;
+    int *binding;       // Innermost symbol for each name id, -1 if the name isn't declared
+    int bindingCap;
+    int *scopeStart;    // count when each open scope began
+    int depth;          // Number of open scopes, the current lexical level is depth - 1
+    int scopeCap;
+} symbolTable;
+
+void initSymbols(symbolTable *table);   // Starts with the outermost scope already open
+void freeSymbols(symbolTable *table);
+void pushScope(symbolTable *table);
+void popScope(symbolTable *table);
+int addSymbol(symbolTable *table, int name, int kind);    // Returns the new symbol's index, or -1 if name is already in this scope
+int findSymbol(const symbolTable *table, int name);       // Returns the index of the innermost symbol called name, or -1
+
+#endif // SYMTAB_H_INCLUDED
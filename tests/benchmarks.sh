@@ -0,0 +1,50 @@
+#!/bin/sh
+#
+# Makes the inputs the compiler's performance numbers were measured on and runs
+# compbench over them, so the numbers can be had again on any machine.
+#
+#     tests/benchmarks.sh [<compbench option>...]
+#
+# Options go to every compbench run, like --json <file> or --compare <file>.
+# RUNS is how many times each phase runs (7 unless it's set), SCALE multiplies
+# the size of everything (1 unless it's set).
+#
+#     dense.pl0       pl0gen --seed 1 with no indentation, 15 MB that's nearly
+#                     all tokens, for the lexer's MB/s on real code
+#     commented.pl0   pl0gen --seed 2 indented twice as deep with a comment
+#                     after every line, 27 MB of mostly whitespace and comments,
+#                     for the bulk skips in the lexer
+#     vars<N>.pl0     N variables in one block and 2N statements v<a> := v<b> + v<c>,
+#                     for N of 1000, 10000 and 100000, for the symbol table.
+#                     Look at compile and parse.
+
+. "$(dirname "$0")/build.sh"
+
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+build PL0Gen "$work"
+build CompBench "$work"
+scale=${SCALE:-1}
+runs=${RUNS:-7}
+
+"$work/PL0Gen" --seed 1 --statements $((1000000 * scale)) | sed 's/^ *//' > "$work/dense.pl0"
+"$work/PL0Gen" --seed 2 --statements $((200000 * scale)) |
+    sed 's/^\( *\)\(.*\)$/\1\1        \2    \/* what this line does, more or less *\//' > "$work/commented.pl0"
+for n in 1000 10000 100000; do
+    awk -v n=$((n * scale)) 'BEGIN {
+        printf "var v0"
+        for (i = 1; i < n; i++)
+            printf ", v%d", i
+        print ";"
+        print "begin"
+        for (i = 0; i < 2 * n; i++)
+            printf "    v%d := v%d + v%d;\n", i % n, (i * 7 + 1) % n, (i * 13 + 2) % n
+        print "    v0 := 0"
+        print "end."
+    }' > "$work/vars$n.pl0"
+done
+
+for f in dense commented vars1000 vars10000 vars100000; do
+    echo "== $f.pl0"
+    "$work/CompBench" --runs "$runs" --label "$f" "$@" "$work/$f.pl0" || exit 1
+done
@@ -0,0 +1,14 @@
+# Sourced by the other scripts in tests.
+#
+# build <project> <dir> [<tree>] compiles the .c files <project>.cbp lists, from
+# <tree> (the checkout these scripts are in if it isn't given), into <dir>/<project>
+# the way the Release target would. CC is the compiler, cc if it isn't set.
+
+root=$(cd "$(dirname "$0")/.." && pwd)
+
+build()
+{
+    tree=${3:-$root}
+    units=$(sed -n 's/.*<Unit filename="\([^"]*\.c\)".*/\1/p' "$tree/$1.cbp")
+    (cd "$tree" && ${CC:-cc} -O2 -pthread -o "$2/$1" $units) || { echo "Could not build $1"; exit 2; }
+}
@@ -0,0 +1,90 @@
+#!/bin/sh
+#
+# Compiles the same programs with the compile cache and without it, and says
+# where the cache changed anything.
+#
+#     tests/cachecompare.sh [<file.pl0>...]
+#
+# The programs are every .pl0 in the tree, errors included, and GENERATED (50
+# unless it's set) programs from pl0gen. Each is compiled plain, with --ir,
+# --ir -O, -O and --binary, through an empty cache and then again through the one
+# that left behind, so both a miss and a hit are checked against --no-cache. What
+# the compiler printed, its exit status and the code it wrote have to match byte
+# for byte. Then batch compiles them all again, and BIG (8 unless it's set) long
+# pl0gen programs, at every one of those levels with -j 8 --write, and each .pm0
+# it leaves has to match what Parser --no-cache writes on its own, so threads
+# compiling side by side can't get in each other's way. Exits with 1 if anything
+# differed.
+
+. "$(dirname "$0")/build.sh"
+
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+build Parser "$work"
+build PL0Gen "$work"
+build Batch "$work"
+
+if [ $# -eq 0 ]; then
+    set -- "$root"/*.pl0
+    i=1
+    while [ $i -le "${GENERATED:-50}" ]; do
+        "$work/PL0Gen" --seed $i -o "$work/gen$i.pl0"
+        set -- "$@" "$work/gen$i.pl0"
+        i=$((i + 1))
+    done
+fi
+
+runs=0
+bad=0
+for pass in miss hit; do
+    for f in "$@"; do
+        for level in "" "--ir" "--ir -O" "-O" "--binary"; do
+            rm -f "$work/plain.pm0" "$work/cached.pm0"
+            "$work/Parser" "$f" "$work/plain.pm0" $level --no-cache > "$work/plain.out" 2>&1
+            echo "exit $?" >> "$work/plain.out"
+            "$work/Parser" "$f" "$work/cached.pm0" $level --cache "$work/cache" > "$work/cached.out" 2>&1
+            echo "exit $?" >> "$work/cached.out"
+            runs=$((runs + 1))
+            if ! cmp -s "$work/plain.out" "$work/cached.out"; then
+                bad=$((bad + 1))
+                echo "DIFFERENT: $(basename "$f") ${level:-plain} $pass, what it printed"
+            elif [ -f "$work/plain.pm0" ] || [ -f "$work/cached.pm0" ]; then
+                if ! cmp -s "$work/plain.pm0" "$work/cached.pm0"; then
+                    bad=$((bad + 1))
+                    echo "DIFFERENT: $(basename "$f") ${level:-plain} $pass, the code"
+                fi
+            fi
+        done
+    done
+done
+
+mkdir "$work/batch"
+n=0
+for f in "$@"; do
+    n=$((n + 1))
+    cp "$f" "$work/batch/$n.pl0"
+done
+i=1
+while [ $i -le "${BIG:-8}" ]; do
+    n=$((n + 1))
+    "$work/PL0Gen" --seed $i --statements 20000 -o "$work/batch/$n.pl0"
+    i=$((i + 1))
+done
+for level in "" "--ir" "--ir -O" "-O" "--binary"; do
+    rm -f "$work"/batch/*.pm0
+    PL0_CACHE= "$work/Batch" -j 8 --write --quiet $level "$work"/batch/*.pl0 > /dev/null 2>&1
+    for f in "$work"/batch/*.pl0; do
+        rm -f "$work/plain.pm0"
+        "$work/Parser" "$f" "$work/plain.pm0" $level --no-cache > /dev/null 2>&1
+        runs=$((runs + 1))
+        if [ -f "$work/plain.pm0" ] || [ -f "${f%.pl0}.pm0" ]; then
+            if ! cmp -s "$work/plain.pm0" "${f%.pl0}.pm0"; then
+                bad=$((bad + 1))
+                echo "DIFFERENT: $(basename "$f") ${level:-plain} batch -j 8, the code"
+            fi
+        fi
+    done
+done
+
+echo "$runs compiles, $bad different"
+[ $bad -eq 0 ]
@@ -0,0 +1,106 @@
+#!/bin/sh
+#
+# Runs the sample programs on every engine vm has and on the AOT compiler, and
+# diffs what each one writes against tests/refvm, the plain switch interpreter.
+#
+#     tests/engines.sh [<file.pl0>...]
+#
+# Without arguments it's every correct*.pl0 and test*.pl0, nested.pl0, recurse.pl0
+# and gcd.pl0, and GENERATED (20 unless it's set) programs from pl0gen --reads
+# --procs 3, since most of the samples never write anything. Each is compiled as
+# it is, with -O and with --ir -O, and runs twice: on ten numbers, and on two, so
+# reads run out of input and have to leave whatever was in the slot the way refvm
+# does. With only three procedures the calls reuse each other's frames, and a
+# read often lands on one that isn't 0. The engines are the tracing VM (its OUT
+# lines), --fast, --fast --no-fuse, --fast --no-display, --reg, --jit and aot,
+# and vm --bench must not find an output that came out DIFFERENT either. A program that doesn't compile is skipped, one that runs for
+# more than 20 s counts as different. Exits with 1 if anything differed.
+
+. "$(dirname "$0")/build.sh"
+
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+for p in Parser VM AOT PL0Gen; do
+    build $p "$work"
+done
+${CC:-cc} -O2 -o "$work/refvm" "$root/tests/refvm.c" || exit 2
+
+if [ $# -eq 0 ]; then
+    set -- "$root"/correct*.pl0 "$root"/test*.pl0 "$root/nested.pl0" "$root/recurse.pl0" "$root/gcd.pl0"
+    i=1
+    while [ $i -le "${GENERATED:-20}" ]; do
+        "$work/PL0Gen" --seed $i --reads --statements 150 --procs 3 -o "$work/gen$i.pl0"
+        set -- "$@" "$work/gen$i.pl0"
+        i=$((i + 1))
+    done
+fi
+limit=
+if command -v timeout > /dev/null; then
+    limit="timeout 20"
+fi
+printf '12\n18\n7\n5\n3\n9\n4\n2\n6\n8\n' > "$work/long"
+printf '12\n18\n' > "$work/short"
+
+runs=0
+bad=0
+skipped=0
+differs()
+{
+    bad=$((bad + 1))
+    echo "DIFFERENT: $1"
+    diff "$work/expected" "$work/got" | head -5
+}
+
+for f in "$@"; do
+    for level in "" "-O" "--ir -O"; do
+        rm -f "$work/p.pm0"
+        "$work/Parser" "$f" "$work/p.pm0" $level --no-cache > /dev/null
+        if [ ! -f "$work/p.pm0" ]; then
+            skipped=$((skipped + 1))
+            continue
+        fi
+        aot=1
+        if ! "$work/AOT" "$work/p.pm0" "$work/aot" > "$work/aotlog" 2>&1; then
+            aot=0
+            bad=$((bad + 1))
+            echo "DIFFERENT: $(basename "$f") ${level:-plain} aot didn't compile"
+            head -5 "$work/aotlog"
+        fi
+        for input in long short; do
+            name="$(basename "$f") ${level:-plain} $input"
+            $limit "$work/refvm" "$work/p.pm0" < "$work/$input" > "$work/expected"
+            status=$?
+
+            $limit "$work/VM" "$work/p.pm0" < "$work/$input" > "$work/trace"
+            s=$?
+            grep -o -E 'popped stack val: -?[0-9]+|Stack overflow at [0-9]+' "$work/trace" | sed 's/popped stack val: //' > "$work/got"
+            runs=$((runs + 1))
+            cmp -s "$work/expected" "$work/got" && [ $s -eq $status ] || differs "$name tracing"
+
+            for engine in "--fast" "--fast --no-fuse" "--fast --no-display" "--reg" "--jit"; do
+                $limit "$work/VM" $engine "$work/p.pm0" < "$work/$input" > "$work/got"
+                s=$?
+                runs=$((runs + 1))
+                cmp -s "$work/expected" "$work/got" && [ $s -eq $status ] || differs "$name $engine"
+            done
+
+            if [ $aot -eq 1 ]; then
+                $limit "$work/aot" < "$work/$input" > "$work/got"
+                s=$?
+                runs=$((runs + 1))
+                cmp -s "$work/expected" "$work/got" && [ $s -eq $status ] || differs "$name aot"
+            fi
+
+            $limit "$work/VM" --bench "$work/p.pm0" < "$work/$input" > "$work/bench" 2>&1
+            runs=$((runs + 1))
+            if grep -q DIFFERENT "$work/bench"; then
+                bad=$((bad + 1))
+                echo "DIFFERENT: $name --bench"
+                grep DIFFERENT "$work/bench" | head -5
+            fi
+        done
+    done
+done
+
+echo "$runs runs, $bad different, $skipped programs that didn't compile"
+[ $bad -eq 0 ]
@@ -0,0 +1,163 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+/**
+ *  The PM/0 machine tests/engines.sh holds every engine in vm to: one switch
+ *  over the instruction set the way the assignment gives it, nothing decoded,
+ *  fused, cached or checked ahead of time. It runs the text .pm0 the compiler
+ *  writes, reads with scanf and writes every OUT on a line of its own, like
+ *  vm --fast.
+ *
+ *      refvm <code.pm0>
+ *
+ *  Writing past stack[MAX_STACK_HEIGHT] stops it with "Stack overflow at <pc>" and
+ *  exit status 1, as the engines do. INC counts as writing its new top, CAL as
+ *  writing all four words of the frame it sets up.
+ */
+
+#define MAX_STACK_HEIGHT 2000   // Same as vm.c
+
+typedef struct instr
+{
+    int op;
+    int l;
+    int m;
+} instr;
+
+int stack[MAX_STACK_HEIGHT + 1];
+
+int base(int l, int bp)
+{
+    while (l-- > 0)
+        bp = stack[bp + 1];
+    return bp;
+}
+
+int overflow(int pc)
+{
+    printf("Stack overflow at %d\n", pc);
+    return 1;
+}
+
+int main(int argc, char *argv[])
+{
+    FILE *in;
+    instr *code = NULL, ir;
+    int count = 0, capacity = 0, op, l, m, pc = 0, bp = 1, sp = 0;
+
+    if (argc != 2 || (in = fopen(argv[1], "r")) == NULL)
+    {
+        printf("Usage: refvm <code.pm0>\n");
+        return 2;
+    }
+    while (fscanf(in, "%d %d %d", &op, &l, &m) == 3)
+    {
+        if (count == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 256;
+            code = realloc(code, capacity * sizeof(instr));
+            if (code == NULL)
+            {
+                printf("Out of memory for the program code\n");
+                return 2;
+            }
+        }
+        code[count].op = op;
+        code[count].l = l;
+        code[count].m = m;
+        count++;
+    }
+    fclose(in);
+
+    while (pc >= 0 && pc < count)
+    {
+        ir = code[pc++];
+        switch (ir.op)
+        {
+            case 1:     // LIT
+                if (sp + 1 > MAX_STACK_HEIGHT)
+                    return overflow(pc - 1);
+                stack[++sp] = ir.m;
+                break;
+            case 2:     // OPR
+                if (ir.m == 0)
+                {
+                    sp = bp - 1;
+                    pc = stack[sp + 4];
+                    bp = stack[sp + 3];
+                    break;
+                }
+                if (ir.m == 1)
+                {
+                    stack[sp] = -stack[sp];
+                    break;
+                }
+                if (ir.m == 6)
+                {
+                    stack[sp] = stack[sp] & 1;
+                    break;
+                }
+                sp--;
+                switch (ir.m)
+                {
+                    case 2: stack[sp] = stack[sp] + stack[sp + 1]; break;
+                    case 3: stack[sp] = stack[sp] - stack[sp + 1]; break;
+                    case 4: stack[sp] = stack[sp] * stack[sp + 1]; break;
+                    case 5: stack[sp] = stack[sp] / stack[sp + 1]; break;
+                    case 7: stack[sp] = stack[sp] % stack[sp + 1]; break;
+                    case 8: stack[sp] = stack[sp] == stack[sp + 1]; break;
+                    case 9: stack[sp] = stack[sp] != stack[sp + 1]; break;
+                    case 10: stack[sp] = stack[sp] < stack[sp + 1]; break;
+                    case 11: stack[sp] = stack[sp] <= stack[sp + 1]; break;
+                    case 12: stack[sp] = stack[sp] > stack[sp + 1]; break;
+                    case 13: stack[sp] = stack[sp] >= stack[sp + 1]; break;
+                }
+                break;
+            case 3:     // LOD
+                if (sp + 1 > MAX_STACK_HEIGHT)
+                    return overflow(pc - 1);
+                sp++;
+                stack[sp] = stack[base(ir.l, bp) + ir.m];
+                break;
+            case 4:     // STO
+                stack[base(ir.l, bp) + ir.m] = stack[sp--];
+                break;
+            case 5:     // CAL
+                if (sp + 4 > MAX_STACK_HEIGHT)
+                    return overflow(pc - 1);
+                stack[sp + 1] = 0;
+                stack[sp + 2] = base(ir.l, bp);
+                stack[sp + 3] = bp;
+                stack[sp + 4] = pc;
+                bp = sp + 1;
+                pc = ir.m;
+                break;
+            case 6:     // INC
+                if (sp + ir.m > MAX_STACK_HEIGHT)
+                    return overflow(pc - 1);
+                sp += ir.m;
+                break;
+            case 7:     // JMP
+                pc = ir.m;
+                break;
+            case 8:     // JPC
+                if (stack[sp--] == 0)
+                    pc = ir.m;
+                break;
+            case 9:     // SIO
+                if (ir.m == 0)
+                    printf("%d\n", stack[sp--]);
+                else if (ir.m == 1)
+                {
+                    if (sp + 1 > MAX_STACK_HEIGHT)
+                        return overflow(pc - 1);
+                    if (scanf("%d", &stack[++sp]) != 1)
+                        ;   // Nothing to read, whatever was there stays
+                }
+                else if (ir.m == 2)
+                    return 0;
+                break;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,79 @@
+#!/bin/sh
+#
+# Runs the same programs on the vm in this tree and on the vm from another commit,
+# and says where they don't do exactly the same thing.
+#
+#     tests/vmcompare.sh [--against <rev>] [<file.pl0>...]
+#
+# <rev> is HEAD unless it's given, so by default it checks what the uncommitted
+# changes did. The programs are the samples and GENERATED (50 unless it's set)
+# programs from pl0gen --reads, compiled once by this tree's compiler. Every mode
+# is compared: the tracing VM, --fast with and without fusion and the display,
+# --reg, --jit, --bench (with the times taken out), --profile and the trace file
+# --record writes. The output, the exit status and the trace have to match byte
+# for byte. Exits with 1 if anything differed.
+
+. "$(dirname "$0")/build.sh"
+
+rev=HEAD
+if [ "$1" = "--against" ]; then
+    rev=$2
+    shift 2
+fi
+
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+mkdir "$work/old" "$work/new" "$work/tree"
+(cd "$root" && git archive "$rev") | tar -x -C "$work/tree" || exit 2
+build VM "$work/old" "$work/tree"
+build VM "$work/new"
+build Parser "$work/new"
+build PL0Gen "$work/new"
+
+if [ $# -eq 0 ]; then
+    set -- "$root"/*.pl0
+    i=1
+    while [ $i -le "${GENERATED:-50}" ]; do
+        "$work/new/PL0Gen" --seed $i --reads -o "$work/gen$i.pl0"
+        set -- "$@" "$work/gen$i.pl0"
+        i=$((i + 1))
+    done
+fi
+seq 1 200 > "$work/input"
+limit=
+if command -v timeout > /dev/null; then
+    limit="timeout 20"
+fi
+
+runs=0
+bad=0
+for f in "$@"; do
+    rm -f "$work/p.pm0"
+    "$work/new/Parser" "$f" "$work/p.pm0" --no-cache > /dev/null
+    [ -f "$work/p.pm0" ] || continue
+    for mode in "" "--fast" "--fast --no-fuse" "--fast --no-display" "--reg" "--jit" "--bench" "--profile"; do
+        for side in old new; do
+            $limit "$work/$side/VM" $mode "$work/p.pm0" < "$work/input" > "$work/$side.out" 2>&1
+            echo "exit $?" >> "$work/$side.out"
+            if [ "$mode" = "--bench" ]; then
+                sed 's/[0-9.]* ms/X ms/' "$work/$side.out" > "$work/$side.tmp" && mv "$work/$side.tmp" "$work/$side.out"
+            fi
+        done
+        runs=$((runs + 1))
+        if ! cmp -s "$work/old.out" "$work/new.out"; then
+            bad=$((bad + 1))
+            echo "DIFFERENT: $(basename "$f") ${mode:-tracing}"
+        fi
+    done
+    for side in old new; do
+        $limit "$work/$side/VM" --record "$work/$side.trace" "$work/p.pm0" < "$work/input" > /dev/null 2>&1
+    done
+    runs=$((runs + 1))
+    if ! cmp -s "$work/old.trace" "$work/new.trace"; then
+        bad=$((bad + 1))
+        echo "DIFFERENT: $(basename "$f") --record"
+    fi
+done
+
+echo "$runs runs against $rev, $bad different"
+[ $bad -eq 0 ]
@@ -0,0 +1,132 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tokens.h"
+#include "nomem.h"
+
+#define NUMBERSYM 3
+#define IDENTSYM 2
+
+/*
+    What every token other than identifiers and numbers looks like in the
+    source. They can only be spelled one way, so there's no need to store them.
+*/
+static const char *fixedText[34] = {"", "", "", "", "+", "-", "*", "/", "odd", "=", "<>", "<", "<=", ">", ">=", "(",
+                                    ")", ",", ";", ".", ":=", "begin", "end", "if", "then", "while", "do", "call", "const", "var",
+                                    "procedure", "write", "read", "else"};
+
+static void *growArray(void *array, int count, size_t size)
+{
+    void *bigger = realloc(array, count * size);
+    if (bigger == NULL)
+        outOfMemory("Out of memory for the token stream\n");
+    return bigger;
+}
+
+static void growTokens(tokenStream *tokens)
+{
+    int cap = tokens->capacity ? tokens->capacity * 2 : 4096;
+
+    tokens->kind = growArray(tokens->kind, cap, 1);
+    tokens->offset = growArray(tokens->offset, cap, sizeof(int));
+    tokens->length = growArray(tokens->length, cap, 1);
+    tokens->name = growArray(tokens->name, cap, sizeof(int));
+    tokens->value = growArray(tokens->value, cap, sizeof(int));
+    tokens->capacity = cap;
+}
+
+int tokenize(const char *src, size_t size, tokenStream *tokens, internTable *names)
+{
+    const char *cursor = src, *end = src + size;
+    char value[13];
+    int type, len, n, i;
+
+    memset(tokens, 0, sizeof(*tokens));
+    tokens->src = src;
+    tokens->size = (int)size;
+    do
+    {
+        if (tokens->count == tokens->capacity)
+            growTokens(tokens);
+        n = tokens->count++;
+
+        value[0] = '\0';  // The end of file doesn't fill it in
+        if (getNextTokenBuf(&cursor, end, &type, value, tokens->error))
+        {
+            tokens->kind[n] = 0;
+            tokens->offset[n] = (int)(cursor - src);
+            tokens->length[n] = 0;
+            tokens->name[n] = -1;
+            tokens->value[n] = 0;
+            return 1;
+        }
+
+        len = (int)strlen(value);
+        tokens->kind[n] = type;
+        tokens->offset[n] = (int)(cursor - src) - len;    // Tokens never have anything inside them, so it ends at the cursor
+        tokens->length[n] = len;
+        tokens->name[n] = -1;
+        tokens->value[n] = 0;
+        if (type == IDENTSYM || type == NUMBERSYM)
+            tokens->name[n] = internName(names, value, len);
+        if (type == NUMBERSYM)
+            for (i = 0; i < len; i++)
+                tokens->value[n] = tokens->value[n] * 10 + (value[i] - '0');
+    } while (type != 1);
+
+    return 0;
+}
+
+void freeTokens(tokenStream *tokens)
+{
+    free(tokens->kind);
+    free(tokens->offset);
+    free(tokens->length);
+    free(tokens->name);
+    free(tokens->value);
+    free(tokens->lineStart);
+    memset(tokens, 0, sizeof(*tokens));
+}
+
+const char *tokenText(const tokenStream *tokens, const internTable *names, int index)
+{
+    if (tokens->name[index] >= 0)
+        return internText(names, tokens->name[index]);
+    return fixedText[tokens->kind[index]];
+}
+
+// Where every line of the source starts
+static void findLines(tokenStream *tokens)
+{
+    const char *p = tokens->src, *end = p + tokens->size, *nl;
+    int n = 1;
+
+    for (nl = p; (nl = memchr(nl, '\n', end - nl)) != NULL; nl++)
+        n++;
+    tokens->lineStart = malloc(n * sizeof(int));
+    if (tokens->lineStart == NULL)
+        outOfMemory("Out of memory for the token stream\n");
+    tokens->lineStart[0] = 0;
+    for (n = 1, nl = p; (nl = memchr(nl, '\n', end - nl)) != NULL; nl++)
+        tokens->lineStart[n++] = (int)(nl + 1 - p);
+    tokens->lines = n;
+}
+
+void tokenPlace(tokenStream *tokens, int index, int *line, int *column)
+{
+    int offset = tokens->offset[index], low = 0, high, mid;
+
+    if (tokens->lines == 0)
+        findLines(tokens);
+    high = tokens->lines - 1;
+    while (low <= high)     // Last line starting at or before the token
+    {
+        mid = (low + high) / 2;
+        if (tokens->lineStart[mid] <= offset)
+            low = mid + 1;
+        else
+            high = mid - 1;
+    }
+    *line = high + 1;
+    *column = offset - tokens->lineStart[high] + 1;
+}
@@ -0,0 +1,39 @@
+#ifndef TOKENS_H_INCLUDED
+#define TOKENS_H_INCLUDED
+
+#include "intern.h"
+#include "lexer.h"
+
+/**
+ *  The whole program lexed up front, one entry per token, kept as parallel arrays.
+ *  The parser walks it by index, so looking ahead is just looking at the next entry.
+ *
+ *  The last entry is always the end of file nulsym, unless the lexer failed. Then the
+ *  last entry has kind 0 and error holds what the lexer had to say about it.
+ *
+ *  Lines and columns aren't worked out per token, hardly anything needs them. The
+ *  first tokenPlace finds where every line starts, in one pass over the source, so
+ *  the source has to stay around as long as the stream does.
+ */
+typedef struct tokenStream
+{
+    int count;
+    int capacity;
+    unsigned char *kind;    // Token type, see Token_Name in compiler.c
+    int *offset;            // Where the token starts in the source
+    unsigned char *length;  // How many bytes it takes up there
+    int *name;              // Interned spelling of an identsym or numbersym, -1 for everything else
+    int *value;             // Value of a numbersym
+    const char *src;        // The source the offsets are into
+    int size;
+    int lines;              // Lines in the source, 0 until tokenPlace needs them
+    int *lineStart;         // Where each line starts, line 1 first
+    char error[LEX_ERROR_SIZE];
+} tokenStream;
+
+int tokenize(const char *src, size_t size, tokenStream *tokens, internTable *names);  // Returns 1 if the lexer stopped on an error
+void freeTokens(tokenStream *tokens);
+const char *tokenText(const tokenStream *tokens, const internTable *names, int index);   // Spelling of a token, for messages
+void tokenPlace(tokenStream *tokens, int index, int *line, int *column);    // Line and column a token starts at, both counting from 1
+
+#endif // TOKENS_H_INCLUDED
@@ -0,0 +1,120 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "trace.h"
+
+int openTrace(traceRecorder *rec, const char *path, const pm0Instr *code, int count)
+{
+    pm0Header head;
+
+    memset(rec, 0, sizeof(*rec));
+    rec->out = fopen(path, "wb");
+    if (rec->out == NULL)
+    {
+        printf("Error, cannot write the trace to %s\n", path);
+        return 1;
+    }
+    rec->buf = malloc(TRACE_BUFFER);
+    if (rec->buf == NULL)
+    {
+        printf("Out of memory for the trace buffer\n");
+        fclose(rec->out);
+        return 1;
+    }
+    rec->at = rec->buf;
+    rec->limit = rec->buf + TRACE_BUFFER - TRACE_SLACK;
+
+    memcpy(head.magic, TRACE_MAGIC, 4);
+    head.version = TRACE_VERSION;
+    head.count = count;
+    head.maxFrame = 0;
+    fwrite(&head, sizeof(head), 1, rec->out);
+    writePm0Code(rec->out, code, count);
+    return 0;
+}
+
+void flushTrace(traceRecorder *rec)
+{
+    fwrite(rec->buf, 1, rec->at - rec->buf, rec->out);
+    rec->at = rec->buf;
+}
+
+void closeTrace(traceRecorder *rec)
+{
+    flushTrace(rec);
+    fclose(rec->out);
+    free(rec->buf);
+    memset(rec, 0, sizeof(*rec));
+}
+
+static int readNum(const unsigned char **cursor, const unsigned char *end, unsigned *value)
+{
+    const unsigned char *p = *cursor;
+    unsigned v = 0;
+    int shift = 0;
+
+    do
+    {
+        if (p == end || shift > 28)
+            return 0;
+        v |= (unsigned)(*p & 0x7F) << shift;
+        shift += 7;
+    } while (*p++ & 0x80);
+    *value = v;
+    *cursor = p;
+    return 1;
+}
+
+static int unzigzag(unsigned v)
+{
+    return (int)(v >> 1) ^ -(int)(v & 1);
+}
+
+int readEvent(const unsigned char **cursor, const unsigned char *end, int pc, traceEvent *ev)
+{
+    const unsigned char *p = *cursor;
+    unsigned v;
+    int i;
+
+    if (p == end)
+        return 0;
+    ev->pc = pc;
+    ev->op = *p & 0x0F;
+    ev->flags = *p++ & 0xF0;
+    ev->nextPc = pc + 1;
+    ev->sp = 0;
+    ev->writes = 0;
+    if (ev->flags & TRACE_JUMP)
+    {
+        if (!readNum(&p, end, &v))
+            return 0;
+        ev->nextPc = (int)v;
+    }
+    if (ev->flags & TRACE_SP)
+    {
+        if (!readNum(&p, end, &v))
+            return 0;
+        ev->sp = unzigzag(v);
+    }
+    if (ev->flags & TRACE_BP)
+    {
+        if (!readNum(&p, end, &v))
+            return 0;
+        ev->bp = (int)v;
+    }
+    if (ev->flags & TRACE_WRITE)
+    {
+        ev->writes = ev->op == 5 ? 4 : 1;
+        for (i = 0; i < ev->writes; i++)
+        {
+            if (!readNum(&p, end, &v))
+                return 0;
+            ev->slot[i] = (int)v;
+            if (!readNum(&p, end, &v))
+                return 0;
+            ev->value[i] = unzigzag(v);
+        }
+    }
+    *cursor = p;
+    return 1;
+}
@@ -0,0 +1,66 @@
+#ifndef TRACE_H_INCLUDED
+#define TRACE_H_INCLUDED
+
+#include <stdio.h>
+#include "pm0.h"
+
+#define TRACE_MAGIC "PM0T"  // First four bytes of a trace file
+#define TRACE_VERSION 1
+#define TRACE_BUFFER 65536  // Bytes of events collected before they are written out
+#define TRACE_SLACK 64      // Room the biggest single event could need
+
+/**
+ *  Trace file layout: a pm0Header with TRACE_MAGIC (count is the number of
+ *  instructions), a copy of the program, then one event per instruction executed.
+ *
+ *  Each event starts with a byte holding the opcode in the low 4 bits and the
+ *  flags below in the high 4. Whatever the flags say changed follows in this
+ *  order, as variable length numbers (7 bits a byte, high bit set if more follow):
+ *      TRACE_JUMP  new pc, if it isn't just the next instruction
+ *      TRACE_SP    how much sp moved, zigzag encoded so small negatives stay short
+ *      TRACE_BP    new bp
+ *      TRACE_WRITE slot and value (zigzag) of every stack slot the instruction
+ *                  stored to. That is 4 for CAL and 1 for anything else.
+ *  The run starts at pc 0, bp 1, sp 0 with a stack of zeros.
+ */
+#define TRACE_JUMP 0x10
+#define TRACE_SP 0x20
+#define TRACE_BP 0x40
+#define TRACE_WRITE 0x80
+
+typedef struct traceRecorder
+{
+    unsigned char *buf;
+    unsigned char *at;      // Where the next event goes
+    unsigned char *limit;   // Flush before starting an event past this
+    FILE *out;
+} traceRecorder;
+
+typedef struct traceEvent
+{
+    int pc;                 // Instruction that ran
+    int op;
+    int flags;
+    int nextPc;
+    int sp;                 // Change in sp
+    int bp;                 // New bp, if TRACE_BP
+    int writes;
+    int slot[4];
+    int value[4];
+} traceEvent;
+
+int openTrace(traceRecorder *rec, const char *path, const pm0Instr *code, int count);  // Prints why and returns 1 if it can't
+void flushTrace(traceRecorder *rec);
+void closeTrace(traceRecorder *rec);
+
+// Decodes the event at *cursor for the instruction at pc. Returns 0 at the end of the trace
+int readEvent(const unsigned char **cursor, const unsigned char *end, int pc, traceEvent *ev);
+
+/**
+ *  Appending to an event, used by the recording engine. p is a local copy of rec->at
+ *  so it can stay in a register.
+ */
+#define TRACE_NUM(p, v) do { unsigned u_ = (unsigned)(v); while (u_ >= 0x80) { *p++ = (unsigned char)(u_ | 0x80); u_ >>= 7; } *p++ = (unsigned char)u_; } while (0)
+#define TRACE_ZIGZAG(v) (((unsigned)(v) << 1) ^ (unsigned)((v) >> 31))
+
+#endif // TRACE_H_INCLUDED
@@ -0,0 +1,213 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pm0.h"
+#include "trace.h"
+
+/**
+ *  Turns a trace recorded with "vm --record" back into the listing the tracing VM
+ *  prints (see stacktrace*.txt), by replaying the events over its own copy of the stack.
+ *
+ *      traceview <trace>                   everything, code listing included
+ *      traceview <trace> <first> [<last>]  only the execution lines for those steps,
+ *                                          counting the first instruction as step 1
+ */
+
+const char *opcodes[] = {"", "LIT", "OPR", "LOD", "STO", "CAL", "INC", "JMP", "JPC", "SIO"};
+const char *opcodesSIO[] = {"OUT", "INP", "HLT"};
+const char *opcodesOPR[] = {"RET", "NEG", "ADD", "SUB", "MUL", "DIV", "ODD", "MOD", "EQL", "NEQ", "LSS", "LEQ", "GTR", "GEQ"};
+
+int *stack, stackCap;
+int pc = 0, bp = 1, sp = 0;
+
+const char *oprName(int m)
+{
+    return m >= 0 && m < 14 ? opcodesOPR[m] : "???";
+}
+
+const char *sioName(int m)
+{
+    return m >= 0 && m < 3 ? opcodesSIO[m] : "???";
+}
+
+// Makes sure stack[top] exists, anything new is 0 like the VM's stack starts out
+void reach(int top)
+{
+    int old = stackCap;
+
+    if (top < stackCap)
+        return;
+    while (stackCap <= top)
+        stackCap = stackCap ? stackCap * 2 : 2048;
+    stack = realloc(stack, stackCap * sizeof(int));
+    if (stack == NULL)
+    {
+        printf("Out of memory for the stack\n");
+        exit(1);
+    }
+    memset(stack + old, 0, (stackCap - old) * sizeof(int));
+}
+
+// Same layout as printCode in vm.c
+void printCode(const pm0Instr *code, int count)
+{
+    int i;
+
+    for (i = 0; i < count; i++)
+    {
+        switch (code[i].op)
+        {
+            case 1: case 6: case 7: case 8:
+                printf("%3d  %s %9d\n", i, opcodes[code[i].op], code[i].m);
+                break;
+            case 2:
+                if (code[i].m == 0)
+                    printf("%3d  %s\n", i, oprName(code[i].m));
+                else
+                    printf("%3d  %s%5d%5d\n", i, oprName(code[i].m), code[i].l, code[i].m);
+                break;
+            case 3: case 4: case 5:
+                printf("%3d  %s%5d%5d\n", i, opcodes[code[i].op], code[i].l, code[i].m);
+                break;
+            case 9:
+                if (code[i].m == 2)
+                    printf("%3d  %s\n", i, sioName(code[i].m));
+                else
+                    printf("%3d  %s %9d\n", i, sioName(code[i].m), code[i].m);
+                break;
+        }
+    }
+    printf("\n");
+}
+
+// What executeCycle in vm.c prints for an instruction, before it runs
+void printInstr(const pm0Instr *ir, int at)
+{
+    switch (ir->op)
+    {
+        case 1: case 6: case 7: case 8:
+            printf("%3d  %s %9d", at, opcodes[ir->op], ir->m);
+            break;
+        case 2:
+            printf("%3d  %s  \t  ", at, oprName(ir->m));
+            if (ir->m < 0 || ir->m > 13)
+                printf("error executing OPR\n");
+            break;
+        case 3: case 4: case 5:
+            printf("%3d  %s%5d%5d", at, opcodes[ir->op], ir->l, ir->m);
+            break;
+        case 9:
+            if (ir->m == 0)
+                printf("%3d  %s %9d" "popped stack val: %d\n", at, sioName(ir->m), ir->m, stack[sp]);
+            else if (ir->m == 1)
+                printf("%3d  %s %9d", at, sioName(ir->m), ir->m);
+            else if (ir->m == 2)
+                printf("%3d  %s \t  ", at, sioName(ir->m));
+            else
+                printf("SIO error\n");
+            break;
+    }
+}
+
+// printStateE and printStack in vm.c
+void printState()
+{
+    int i;
+
+    printf("%6d%5d%5d", pc, bp, sp);
+    printf("   ");
+    if (bp == 1 && sp != 0)
+    {
+        for (i = 1; i <= sp; i++)
+            printf("%d ", stack[i]);
+    }
+    else if (bp > 1)
+    {
+        for (i = 1; i < bp; i++)
+            printf("%d ", stack[i]);
+        if (bp < sp)
+            printf("| ");
+        for (i = bp; i <= sp; i++)
+            printf("%d ", stack[i]);
+    }
+    printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+    sourceBuf file;
+    FILE *in;
+    pm0Header head;
+    const pm0Instr *code;
+    const unsigned char *cursor, *end;
+    traceEvent ev;
+    long long step = 0, first = 1, last = -1;
+    int i, all;
+
+    if (argc < 2)
+    {
+        printf("Usage: traceview <trace> [<first step> [<last step>]]\n");
+        return 1;
+    }
+    all = argc < 3;
+    if (argc > 2)
+        first = atoll(argv[2]);
+    if (argc > 3)
+        last = atoll(argv[3]);
+
+    in = fopen(argv[1], "rb");
+    if (in == NULL)
+    {
+        printf("Error opening trace file %s\n", argv[1]);
+        return 1;
+    }
+    if (loadSource(in, &file) != 0 && readStream(in, &file) != 0)
+    {
+        printf("Out of memory reading %s\n", argv[1]);
+        return 1;
+    }
+    fclose(in);
+    if (file.size >= sizeof(head))
+        memcpy(&head, file.data, sizeof(head));
+    if (file.size < sizeof(head) || memcmp(head.magic, TRACE_MAGIC, 4) != 0 || head.version != TRACE_VERSION ||
+        head.count < 0 || (file.size - sizeof(head)) / sizeof(pm0Instr) < (size_t)head.count)
+    {
+        printf("Error, %s is not a trace file\n", argv[1]);
+        return 1;
+    }
+    code = (const pm0Instr *)(file.data + sizeof(head));
+    cursor = (const unsigned char *)(code + head.count);
+    end = (const unsigned char *)file.data + file.size;
+    reach(3);
+
+    if (all)
+    {
+        printf("PL/0 code:\n\n");
+        printCode(code, head.count);
+        printf("Execution:\n");
+        printf("                      pc   bp   sp   stack\n");
+        printf("%24d%5d%5d  \n", pc, bp, sp);
+    }
+    while ((last < 0 || step < last) && readEvent(&cursor, end, pc, &ev))
+    {
+        step++;
+        if (step >= first && ev.pc >= 0 && ev.pc < head.count)
+            printInstr(&code[ev.pc], ev.pc);
+        for (i = 0; i < ev.writes; i++)
+        {
+            reach(ev.slot[i]);
+            stack[ev.slot[i]] = ev.value[i];
+        }
+        sp += ev.sp;
+        if (ev.flags & TRACE_BP)
+            bp = ev.bp;
+        pc = ev.nextPc;
+        reach(sp);
+        if (step >= first)
+            printState();
+    }
+
+    free(stack);
+    freeSource(&file);
+    return 0;
+}
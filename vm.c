@@ -1 +1,627 @@
-// Team name:  Compiler Builder 11//// Emily ["Mel"] Pelchat// Hunter Pierce// Jacob Hazelbaker// Jessica ["Kika"] Wingert#include <stdio.h>#include <stdlib.h>#define MAX_STACK_HEIGHT 2000#define MAX_CODE_LENGTH 500#define MAX_LEXI_LEVELS 3typedef struct{ int op; int l; int m;}instr;/// global variables ftwchar *opcodes[] = {"", "LIT", "OPR", "LOD", "STO", "CAL", "INC", "JMP", "JPC", "SIO"}; //stolen from Hunterchar *opcodesSIO[] = {"OUT", "INP", "HLT"};char *opcodesOPR[] = {"RET", "NEG", "ADD", "SUB", "MUL", "DIV", "ODD", "MOD", "EQL", "NEQ", "LSS", "LEQ", "GTR", "GEQ"};int bp = 1;int sp = 0;int pc = 0;instr ir;int stack[MAX_STACK_HEIGHT+1];instr code[MAX_CODE_LENGTH];int codeSize=-1;FILE *fp;///FILE *ofp;///void write_Stack(int bp, int sp);void printCode();void fetchCycle();void executeCycle();void printHeading();///void printStateF();void printStateE();void printStack();///void printStackAR();int halt();int base(int level, int b);int main(int argc, char * argv[]){ stack[1] = 0; stack[2] = 0; stack[3] = 0;  /*** ///open files fp = fopen("test.txt", "r"); ///ofp = fopen("testout.txt", "w"); if(fp==NULL) //|| ofp==NULL)      printf("error opening file\n");      ***/     fp = fopen(argv[1], "r");       // open the input file    ///ofp = fopen("trace.txt", "w");  // open the output file if(fp==NULL) {        printf("Error opening input file %s\nExiting Program ...\n", argv[1]);        return -1;    }    ///if (ofp == NULL) {       /// printf("Error opening output file\nExiting Program ...\n");        ///return -1;   ///read fp into code[]   int lines;      //num lines in fp while(!feof(fp)){      for(lines=0; lines<MAX_CODE_LENGTH; lines++){         fscanf(fp, "%d %d %d", &code[lines].op, &code[lines].l, &code[lines].m);         if(feof(fp)){            codeSize = lines+1;   /// lines is now also equal to instruction number            break;         }      }      ///print pl/0 code      printf("PL/0 code:\n\n");  printCode(); }   ///print execution   printHeading();   do{    fetchCycle();    //printStateF();    executeCycle();    printStateE();    //write_Stack(bp, sp);    printStack();   } while(!halt()); fclose(fp); ///fclose(ofp); return 0;}void write_Stack(int bp, int sp){    // TO DO - Write the contents of the stack to output_file    int i;    if (bp > 1) {        write_Stack(stack[bp+2], bp-1);        if (bp<sp)            printf("| ");        for (i = bp; i <= sp; i++) {            printf("%d ", stack[i]);        }        printf("\n");    }    else {        for (i=bp; i<=sp; i++)        {            printf("%d ", stack[i]);        }    }    printf("\n");}void printCode(){  int i;   for(i=0; i<codeSize-1; i++){   switch(code[i].op){    /// LIT __  M    case 1:     printf("%3d  %s %9d\n", i, opcodes[code[i].op], code[i].m);     break;    /// OPR    case 2:       if(code[i].m == 0)                  printf("%3d  %s\n", i, opcodesOPR[code[i].m]);     else                  printf("%3d  %s%5d%5d\n", i, opcodesOPR[code[i].m], code[i].l, code[i].m);     break;     //switch(ir.m){      /// RET __ __      //case 0:       //printf("%3d  %s\n", i, opcodesOPR[code[i].m]);      ///     //}    /// LOD L M    case 3:     printf("%3d  %s%5d%5d\n", i, opcodes[code[i].op], code[i].l, code[i].m);     break;    /// STO L M    case 4:     printf("%3d  %s%5d%5d\n", i, opcodes[code[i].op], code[i].l, code[i].m);     break;    /// CAL L M    case 5:     printf("%3d  %s%5d%5d\n", i, opcodes[code[i].op], code[i].l, code[i].m);     break;    /// INC __ M    case 6:     printf("%3d  %s %9d\n", i, opcodes[code[i].op], code[i].m);     break;    /// JMP __ M    case 7:     printf("%3d  %s %9d\n", i, opcodes[code[i].op], code[i].m);     break;    ///??????????? JPC __ M ?????????    case 8:     printf("%3d  %s %9d\n", i, opcodes[code[i].op], code[i].m);     break;    /// SIO    case 9:     if(code[i].m == 2)      printf("%3d  %s\n", i, opcodesSIO[code[i].m]);     else                  printf("%3d  %s %9d\n", i, opcodesSIO[code[i].m], code[i].m);     break;    default:     ;   }  }  printf("\n");   /*     if (code[i].op == 2)       printf("%3d  %s%5d%5d\n", i, opcodesOPR[code[i].m], code[i].l, code[i].m);       if (code[i].op == 9)       printf("%3d  %s\n", i, opcodesSIO[code[i].m]);       else         printf("%3d  %s%5d%5d\n", i, opcodes[code[i].op], code[i].l, code[i].m);   }   printf("\n");*/}void printHeading(){ printf("Execution:\n"); printf("                      pc   bp   sp   stack\n"); printf("%24d%5d%5d  \n", pc, bp, sp);}///print state of machine after fetch cyclevoid printStateF(){   switch(ir.op){      case 2:         printf("%3d  %s%5d%5d\n", pc-1, opcodesOPR[ir.m], ir.l, ir.m);      case 9:         switch(ir.m){            case 2:               printf("%3d  %s\n", pc-1, opcodesSIO[ir.m]);            default:               printf("%3d  %s%5d%5d\n", pc-1, opcodesSIO[ir.m], ir.l, ir.m);         }      default:         ; //printf("%3d  %s%5d%5d", pc-1, opcodes[ir.op], ir.l, ir.m);   }}/// print state of machine after execute cyclevoid printStateE(){   if(sp==0 || bp==1)      printf("%6d%5d%5d", pc, bp, sp);   else      printf("%6d%5d%5d", pc, bp, sp);}void printStack(){ int i, bp_copy=bp; printf("   ");   /*if(sp==0){   } else if(bp_copy==1){      for (i=1; i<=sp; i++)         printf("%d ", stack[i]); } for (i=1; i<=bp_copy; i++)      printf("%d ", stack[i]); if(bp_copy>1){      if(bp_copy<sp){         printf(" | ");      for (i=bp_copy; i<=sp; i++)         printf("%d ", stack[i]);      } }//      if(bp==1)//         break;*/    if(bp_copy==1 && sp!=0){      for(i=1; i<=sp; i++)        printf("%d ", stack[i]);    }   else if(bp_copy>1){      for(i=1; i<bp_copy; i++)        printf("%d ", stack[i]);      if(bp_copy<sp)         printf("| ");      for(i=bp_copy; i<=sp; i++)         printf("%d ", stack[i]); } printf("\n");}void printStackAR(){ int i = 1; printf("  "); for (i=2; i<=sp; i++)  printf("%2d", stack[i]); printf(" |");}void fetchCycle(){   ir = code[pc];   pc++;   //printf("%d fetched\n", ir.op);}void executeCycle(){ switch(ir.op){  // 01 LIT 0 M  push m onto stack  case 1:      //printf("executing LIT\n");            printf("%3d  %s %9d", pc-1, opcodes[ir.op], ir.m);            sp = sp + 1;   stack[sp] = ir.m;   break;  // 02 OPR 0 M  case 2:            //printf("executing OPR\n");            //printf("%3d  %s%5d%5d\n", pc-1, opcodesOPR[ir.m], ir.l, ir.m);            printf("%3d  %s  \t  ", pc-1, opcodesOPR[ir.m]);            switch(ir.m){      /// RET            case 0:               sp = bp-1;               pc = stack[sp+4]; //4               bp = stack[sp+3]; //3               break;            /// NEG            case 1:               stack[sp] = -stack[sp];               break;            ///ADD            case 2:               sp = sp-1;               stack[sp] = stack[sp] + stack[sp+1];               break;            /// SUB            case 3:               sp = sp-1;               stack[sp] = stack[sp] - stack[sp+1];               break;            /// MUL            case 4:               sp = sp-1;               stack[sp] = stack[sp] * stack[sp+1];               break;            /// DIV            case 5:               sp = sp-1;               stack[sp] = stack[sp] / stack[sp+1];               break;            /// ODD            case 6:               stack[sp] = stack[sp] & 1;               break;            /// MOD            case 7:               sp = sp-1;               stack[sp] = stack[sp] % stack[sp+1];               break;            /// EQL            case 8:               sp = sp-1;               stack[sp] = stack[sp] == stack[sp+1];               break;            /// NEQ            case 9:               sp = sp-1;               stack[sp] = stack[sp] != stack[sp+1];               break;            /// LSS            case 10:               sp = sp-1;               stack[sp] = stack[sp] < stack[sp+1];               break;            /// LEQ            case 11:               sp = sp-1;               stack[sp] = stack[sp] <= stack[sp+1];               break;            /// GTR            case 12:               sp = sp-1;               stack[sp] = stack[sp] > stack[sp+1];               break;            /// GEQ            case 13:               sp = sp-1;               stack[sp] = stack[sp] >= stack[sp+1];               break;            default:               printf("error executing OPR\n");     }   break;  // 03 LOD L M  push stack value of offset M in frame L levels down  case 3:            //printf("executing LOD\n");            printf("%3d  %s%5d%5d", pc-1, opcodes[ir.op], ir.l, ir.m);   sp = sp + 1;   stack[sp] = stack[base(ir.l, bp) + ir.m];   break;  // 04 STO L M  pop stack, insert val at offset M in frame L levels down  case 4:            //printf("executing STO\n");            printf("%3d  %s%5d%5d", pc-1, opcodes[ir.op], ir.l, ir.m);   stack[base(ir.l, bp) + ir.m] = stack[sp];   sp--;   //if(sp>0)    //sp--;   break;  // 05 CAL L M Call procedure at M  case 5:            //printf("executing CAL\n");            printf("%3d  %s%5d%5d", pc-1, opcodes[ir.op], ir.l, ir.m);            //printStackAR();   stack[sp+1] = 0;       // return value   stack[sp+2] = base(ir.l, bp);          //static link   stack[sp+3] = bp;       //dynamic link   stack[sp+4] = pc;       // return address   bp = sp+1;   pc = ir.m;   //printStack();   break;  // 06 INC 0 M  allocate m locals on stack  case 6:            //printf("executing INC\n");            printf("%3d  %s %9d", pc-1, opcodes[ir.op], ir.m);          /*if(sp == 0){        // What is this for?            sp = ir.m + 1;      // We add M to 0, and then add 1     sp--;               // only to subtract 1 after? This makes no sense.            }            else */            sp = sp + ir.m;     // Just add sp to M and be done with it. Both if branches ended up doing exactly the same thing.            break;  // 07 JMP 0 M  jump to M  case 7:            //printf("executing JMP\n");            //printf("%10d", ir.m);            printf("%3d  %s %9d", pc-1, opcodes[ir.op], ir.m);   pc = ir.m;      //NOOOO! Not sp+ This is not opr 6, it's 7... This is Jump. You jump to M, not to M+sp No wonder we seg faulted!   break;  // 08 JPC   pop stack, jump to m  case 8:            //printf("executing JPC\n");            printf("%3d  %s %9d", pc-1, opcodes[ir.op], ir.m);   if(stack[sp] == 0)    pc = ir.m;   sp = sp-1;   break;  // 09 SIO  case 9:            //printf("executing SIO\n");            //printf("executing SIO\n");            //printf("%3d  %s%5d%5d\n", pc-1, opcodesSIO[ir.m], ir.l, ir.m);   switch(ir.m){    // pop stack    case 0:     printf("%3d  %s %9d", pc-1, opcodesSIO[ir.m], ir.m);     printf("popped stack val: %d\n", stack[sp]);     sp = sp-1;     break;    // push user input    case 1:     printf("%3d  %s %9d", pc-1, opcodesSIO[ir.m], ir.m);     sp = sp+1;     scanf("%d", &(stack[sp]));     break;    // halt    case 2:     printf("%3d  %s \t  ", pc-1, opcodesSIO[ir.m]);                    //printf("halting...\n");                    /*printf("%3d  %s\n", pc-1, opcodesSIO[ir.m]);   */     break;    default:     printf("SIO error\n");    }  // default  default:   //printf("exec error\n");      ; }  //printState(ir);}int halt(){   if(ir.op == 9 && ir.m == 2)      return 1;  if (pc >= codeSize)    return 1;  if(pc == MAX_CODE_LENGTH)    return 1;   return 0;}int base(int level, int b){   while(level>0){      b = stack[b+1];      level--;   }   return b;}/**bp>1  write_Stack(output_file, stack[bp+2], bp-1};bp<sp  print |  printstackelsebp<spprintStack**/
+// Team name:  Compiler Builder 11
+//
+// Emily ["Mel"] Pelchat
+// Hunter Pierce
+// Jacob Hazelbaker
+// Jessica ["Kika"] Wingert
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pm0.h"
+#include "fastvm.h"
+#include "regvm.h"
+#include "bench.h"
+#include "jit.h"
+#include "perf.h"
+#include "vmstack.h"
+#include "sio.h"
+
+#define MAX_STACK_HEIGHT 2000
+#define MAX_LEXI_LEVELS 3
+
+typedef pm0Instr instr;    // op, l, m. Binary programs are run straight out of the mapped file
+
+/// global variables ftw
+char *opcodes[] = {"", "LIT", "OPR", "LOD", "STO", "CAL", "INC", "JMP", "JPC", "SIO"}; //stolen from Hunter
+char *opcodesSIO[] = {"OUT", "INP", "HLT"};
+char *opcodesOPR[] = {"RET", "NEG", "ADD", "SUB", "MUL", "DIV", "ODD", "MOD", "EQL", "NEQ", "LSS", "LEQ", "GTR", "GEQ"};
+vmStack space;              // Where the stack lives, see vmstack.h. Only ever as big as the program makes it
+int *stack;
+int height = MAX_STACK_HEIGHT;
+vmInstance vm = {NULL, MAX_STACK_HEIGHT, 0, 1, 0, NULL, NULL, 0};
+int tracing = 0;            // The tracing VM is running, not one of the fast engines
+pm0Program prog;
+const instr *code;          // The program, only ever read. Everything a run changes is in its vmInstance
+int codeSize=0;
+perfSet perf;               // --perf, see perf.h. Printed after main returns
+///FILE *ofp;
+
+///void write_Stack(int bp, int sp);
+void printCode(const vmProfile *prof);
+void fetchCycle(vmInstance *vm, instr *ir);
+void executeCycle(vmInstance *vm, instr ir);
+void printHeading(vmInstance *vm);
+///void printStateF(vmInstance *vm, instr ir);
+void printStateE(vmInstance *vm);
+void printStack(vmInstance *vm);
+///void printStackAR(vmInstance *vm);
+int halt(vmInstance *vm, instr ir);
+int base(vmInstance *vm, int level, int b);
+
+int main(int argc, char * argv[]){
+ instr ir;
+
+ /***
+ ///open files
+ fp = fopen("test.txt", "r");
+ ///ofp = fopen("testout.txt", "w");
+ if(fp==NULL) //|| ofp==NULL)
+      printf("error opening file\n");
+      ***/
+
+    int i, fast = 0, flags = FAST_ALL, reg = 0, jit = 0, bench = 0, profile = 0, found, binaryIn = SIO_TEXT, binaryOut = SIO_TEXT;
+    char *path = NULL, *tracePath = NULL, *mapPath = NULL, *perfEnv = getenv("PL0_PERF");
+    int perfOut = perfEnv != NULL ? perfMode(perfEnv) : PERF_OFF;
+    perfSet *counters = NULL;
+    traceRecorder rec;
+    vmProfile prof;
+    lineMap lines;
+    for(i=1; i<argc; i++){
+        if(strcmp(argv[i], "--fast") == 0)     // no listing, no trace, just run it
+            fast = 1;
+        else if(strcmp(argv[i], "--no-fuse") == 0)  // --fast without the superinstructions, to compare against
+            flags &= ~FAST_FUSE;
+        else if(strcmp(argv[i], "--no-display") == 0)   // --fast walking the static links every time, likewise
+            flags &= ~FAST_DISPLAY;
+        else if(strcmp(argv[i], "--reg") == 0)      // run it on the register machine, see regvm.h
+            reg = 1;
+        else if(strcmp(argv[i], "--jit") == 0)      // compile it to native code first, see jit.h
+            jit = 1;
+        else if(strcmp(argv[i], "--bench") == 0)    // time every fast engine on it, side by side
+            bench = 1;
+        else if(strcmp(argv[i], "--profile") == 0)  // run fast counting every instruction, then the listing with the counts
+            profile = 1;
+        else if(strcmp(argv[i], "--map") == 0 && i+1 < argc)   // the compiler's -g map for --profile, if it isn't <code.pm0>.map
+            mapPath = argv[++i];
+        else if(strcmp(argv[i], "--stack") == 0 && i+1 < argc){   // bytes of stack, like 512m, instead of 2000 ints
+            height = stackHeight(argv[++i]);
+            if(height < 0){
+                printf("--stack takes a size in bytes, like 64k, 512m or 2g\n");
+                return -1;
+            }
+        }
+        else if(strcmp(argv[i], "--record") == 0 && i+1 < argc)    // run fast, keep a binary trace for traceview
+            tracePath = argv[++i];
+        else if(strncmp(argv[i], "--binary", 8) == 0){   // SIO reads and writes raw little endian int32s, both ways or =in or =out
+            if(sioMode(argv[i] + 8, &binaryIn, &binaryOut) != 0){
+                printf("--binary takes in or out, like --binary=in\n");
+                return -1;
+            }
+        }
+        else if(strncmp(argv[i], "--perf", 6) == 0){    // count loading and running it, report on stderr at the end
+            perfOut = perfMode(argv[i] + 6);
+            if(perfOut < 0){
+                printf("--perf takes text or json, like --perf=json\n");
+                return -1;
+            }
+        }
+        else if(argv[i][0] == '-' && argv[i][1] != '\0'){
+            printf("Unknown option %s\n", argv[i]);
+            return -1;
+        }
+        else
+            path = argv[i];
+    }
+    if(path == NULL) {
+        printf("Usage: vm [--fast [--no-fuse] [--no-display] | --reg | --jit | --bench | --profile [--map <code.map>] | --record <trace>] [--stack <size>] [--binary[=in|=out]] [--perf[=json]] <code.pm0>\n");
+        return -1;
+    }
+    if(perfOut > 0){
+        perfAtExit(&perf, perfOut);
+        counters = &perf;
+    }
+    perfStart(counters, PERF_READ);
+    if(loadProgram(path, &prog) != 0)    // text or binary, loadProgram says what went wrong
+        return -1;
+    perfStart(counters, PERF_RUN);      // whichever way it runs, until we return
+    ///ofp = fopen("trace.txt", "w");  // open the output file
+    if(prog.maxFrame > height) {
+        printf("Program needs a frame of %d, the stack only holds %d\nExiting Program ...\n", prog.maxFrame, height);
+        return -1;
+    }
+    if(openStack(&space, height) != 0) {
+        printf("No room for a stack of %d\nExiting Program ...\n", height);
+        return -1;
+    }
+    stack = vm.stack = space.stack;
+    vm.height = height;
+    sioStandard(binaryIn, binaryOut);
+    vm.in = sioStdin();
+    vm.out = sioStdout();
+    if(enterStack(&space)) {    // back here if any engine ran off either end of the stack
+        flushWriter(vm.out);
+        if(space.pc < 0)    // the engine never said where it was
+            printf("Stack overflow, sp got to %d of %d\n", space.over, height);
+        else
+            printf("%sStack overflow at %d\n", tracing ? "\n" : "", space.pc);
+        return 1;
+    }
+    ///if (ofp == NULL) {
+       /// printf("Error opening output file\nExiting Program ...\n");
+        ///return -1;
+
+  code = prog.code;
+  codeSize = prog.count;
+  if(tracePath != NULL){
+      if(openTrace(&rec, tracePath, code, codeSize) != 0)
+          return -1;
+      i = runRecorded(code, codeSize, stack, height, &rec);
+      closeTrace(&rec);
+      freeProgram(&prog);
+      return i;
+  }
+  if(profile){
+      if(initProfile(&prof, codeSize) != 0){
+          printf("Out of memory for the profile\n");
+          return -1;
+      }
+      i = runProfiled(code, codeSize, stack, height, flags, &prof);
+      perfStop(counters);       // the report isn't part of the run
+      finishProfile(&prof);
+      printf("\nPL/0 code:\n\n");
+      printCode(&prof);
+      printProfile(&prof, code, stdout);
+      if(mapPath == NULL){      // next to the program, if it was compiled with -g
+          mapPath = malloc(strlen(path) + 5);
+          if(mapPath != NULL)
+              sprintf(mapPath, "%s.map", path);
+          if(mapPath != NULL && loadLineMap(mapPath, &lines) == 0)
+              printLineProfile(&prof, &lines, mapPath, stdout);
+          free(mapPath);
+      }
+      else if((found = loadLineMap(mapPath, &lines)) == 0)
+          printLineProfile(&prof, &lines, mapPath, stdout);
+      else if(found == 1)
+          printf("\nNo line map in %s\n", mapPath);
+      freeLineMap(&lines);
+      freeProfile(&prof);
+      freeProgram(&prog);
+      return i;
+  }
+  if(bench){
+      i = benchEngines(code, codeSize, &space);
+      freeProgram(&prog);
+      return i;
+  }
+  if(jit){
+      i = runJit(code, codeSize, stack, height);
+      if(i < 0)   // no JIT on this machine, the interpreter does the same thing
+          i = runFast(code, codeSize, stack, height, flags);
+      freeProgram(&prog);
+      return i;
+  }
+  if(reg){
+      i = runRegister(code, codeSize, stack, height);
+      freeProgram(&prog);
+      return i;
+  }
+  if(fast){
+      i = runFast(code, codeSize, stack, height, flags);
+      freeProgram(&prog);
+      return i;
+  }
+  ///print pl/0 code
+  printf("PL/0 code:\n\n");
+  printCode(NULL);
+
+  ///print execution
+  printHeading(&vm);
+  tracing = 1;
+  if(codeSize > 0)    // nothing to fetch from an empty program
+  do{
+   stackPc = vm.pc;
+   fetchCycle(&vm, &ir);
+   //printStateF(&vm, ir);
+   executeCycle(&vm, ir);
+   printStateE(&vm);
+   //write_Stack(&vm, vm.bp, vm.sp);
+   printStack(&vm);
+  } while(!halt(&vm, ir));
+ freeProgram(&prog);
+ ///fclose(ofp);
+ return 0;
+}
+
+void write_Stack(vmInstance *vm, int bp, int sp)
+{
+    int *stack = vm->stack;
+    // TO DO - Write the contents of the stack to output_file
+    int i;
+    if (bp > 1) {
+        write_Stack(vm, stack[bp+2], bp-1);
+        if (bp<sp)
+            printf("| ");
+        for (i = bp; i <= sp; i++) {
+            printf("%d ", stack[i]);
+        }
+        printf("\n");
+    }
+    else {
+        for (i=bp; i<=sp; i++)
+        {
+            printf("%d ", stack[i]);
+        }
+    }
+    printf("\n");
+}
+
+// With a profile every line also gets how often it ran, see profile.h
+void printCode(const vmProfile *prof){
+  int i, n;
+   for(i=0; i<codeSize; i++){
+   switch(code[i].op){
+    /// LIT __  M
+    case 1:
+     n = printf("%3d  %s %9d", i, opcodes[code[i].op], code[i].m);
+     break;
+    /// OPR
+    case 2:
+      if(code[i].m == 0)
+                  n = printf("%3d  %s", i, opcodesOPR[code[i].m]);
+     else
+                  n = printf("%3d  %s%5d%5d", i, opcodesOPR[code[i].m], code[i].l, code[i].m);
+     break;
+     //switch(ir.m){
+      /// RET __ __
+      //case 0:
+       //printf("%3d  %s\n", i, opcodesOPR[code[i].m]);
+      ///
+     //}
+    /// LOD L M
+    case 3:
+     n = printf("%3d  %s%5d%5d", i, opcodes[code[i].op], code[i].l, code[i].m);
+     break;
+    /// STO L M
+    case 4:
+     n = printf("%3d  %s%5d%5d", i, opcodes[code[i].op], code[i].l, code[i].m);
+     break;
+    /// CAL L M
+    case 5:
+     n = printf("%3d  %s%5d%5d", i, opcodes[code[i].op], code[i].l, code[i].m);
+     break;
+    /// INC __ M
+    case 6:
+     n = printf("%3d  %s %9d", i, opcodes[code[i].op], code[i].m);
+     break;
+    /// JMP __ M
+    case 7:
+     n = printf("%3d  %s %9d", i, opcodes[code[i].op], code[i].m);
+     break;
+    ///??????????? JPC __ M ?????????
+    case 8:
+     n = printf("%3d  %s %9d", i, opcodes[code[i].op], code[i].m);
+     break;
+    /// SIO
+    case 9:
+     if(code[i].m == 2)
+      n = printf("%3d  %s", i, opcodesSIO[code[i].m]);
+     else
+                  n = printf("%3d  %s %9d", i, opcodesSIO[code[i].m], code[i].m);
+     break;
+    default:
+     continue;
+   }
+   if(prof != NULL){
+     printf("%*s", n < 22 ? 22 - n : 0, "");
+     annotateProfile(prof, code, i, stdout);
+   }
+   printf("\n");
+  }
+  printf("\n");
+
+  /*
+     if (code[i].op == 2)
+       printf("%3d  %s%5d%5d\n", i, opcodesOPR[code[i].m], code[i].l, code[i].m);
+       if (code[i].op == 9)
+       printf("%3d  %s\n", i, opcodesSIO[code[i].m]);
+       else
+         printf("%3d  %s%5d%5d\n", i, opcodes[code[i].op], code[i].l, code[i].m);
+   }
+   printf("\n");*/
+}
+
+void printHeading(vmInstance *vm){
+ printf("Execution:\n");
+ printf("                      pc   bp   sp   stack\n");
+ printf("%24d%5d%5d  \n", vm->pc, vm->bp, vm->sp);
+}
+
+///print state of machine after fetch cycle
+void printStateF(vmInstance *vm, instr ir){
+   int pc = vm->pc;
+   switch(ir.op){
+      case 2:
+         printf("%3d  %s%5d%5d\n", pc-1, opcodesOPR[ir.m], ir.l, ir.m);
+      case 9:
+         switch(ir.m){
+            case 2:
+               printf("%3d  %s\n", pc-1, opcodesSIO[ir.m]);
+            default:
+               printf("%3d  %s%5d%5d\n", pc-1, opcodesSIO[ir.m], ir.l, ir.m);
+         }
+      default:
+         ; //printf("%3d  %s%5d%5d", pc-1, opcodes[ir.op], ir.l, ir.m);
+   }
+}
+
+/// print state of machine after execute cycle
+void printStateE(vmInstance *vm){
+   if(vm->sp==0 || vm->bp==1)
+      printf("%6d%5d%5d", vm->pc, vm->bp, vm->sp);
+   else
+      printf("%6d%5d%5d", vm->pc, vm->bp, vm->sp);
+}
+
+void printStack(vmInstance *vm){
+ int i, bp_copy=vm->bp, sp=vm->sp, *stack=vm->stack;
+ printf("   ");
+
+  /*if(sp==0){
+  }
+ else if(bp_copy==1){
+      for (i=1; i<=sp; i++)
+         printf("%d ", stack[i]);
+ }
+ for (i=1; i<=bp_copy; i++)
+      printf("%d ", stack[i]);
+ if(bp_copy>1){
+      if(bp_copy<sp){
+         printf(" | ");
+      for (i=bp_copy; i<=sp; i++)
+         printf("%d ", stack[i]);
+      }
+ }
+//      if(bp==1)
+//         break;*/
+
+    if(bp_copy==1 && sp!=0){
+      for(i=1; i<=sp; i++)
+        printf("%d ", stack[i]);
+    }
+   else if(bp_copy>1){
+      for(i=1; i<bp_copy; i++)
+        printf("%d ", stack[i]);
+      if(bp_copy<sp)
+         printf("| ");
+      for(i=bp_copy; i<=sp; i++)
+         printf("%d ", stack[i]);
+ }
+ printf("\n");
+}
+
+void printStackAR(vmInstance *vm){
+ int i = 1, sp=vm->sp, *stack=vm->stack;
+ printf("  ");
+ for (i=2; i<=sp; i++)
+  printf("%2d", stack[i]);
+ printf(" |");
+}
+
+void fetchCycle(vmInstance *vm, instr *ir){
+   *ir = code[vm->pc];
+   vm->pc++;
+   vm->steps++;
+   //printf("%d fetched\n", ir.op);
+}
+
+void executeCycle(vmInstance *vm, instr ir){
+ int *stack = vm->stack;
+ int pc = vm->pc, bp = vm->bp, sp = vm->sp;
+ switch(ir.op){
+  // 01 LIT 0 M  push m onto stack
+  case 1:
+      //printf("executing LIT\n");
+            printf("%3d  %s %9d", pc-1, opcodes[ir.op], ir.m);
+            sp = sp + 1;
+   stack[sp] = ir.m;
+   break;
+  // 02 OPR 0 M
+  case 2:
+            //printf("executing OPR\n");
+            //printf("%3d  %s%5d%5d\n", pc-1, opcodesOPR[ir.m], ir.l, ir.m);
+            printf("%3d  %s  \t  ", pc-1, opcodesOPR[ir.m]);
+            switch(ir.m){
+      /// RET
+            case 0:
+               sp = bp-1;
+               pc = stack[sp+4]; //4
+               bp = stack[sp+3]; //3
+               break;
+            /// NEG
+            case 1:
+               stack[sp] = -stack[sp];
+               break;
+            ///ADD
+            case 2:
+               sp = sp-1;
+               stack[sp] = stack[sp] + stack[sp+1];
+               break;
+            /// SUB
+            case 3:
+               sp = sp-1;
+               stack[sp] = stack[sp] - stack[sp+1];
+               break;
+            /// MUL
+            case 4:
+               sp = sp-1;
+               stack[sp] = stack[sp] * stack[sp+1];
+               break;
+            /// DIV
+            case 5:
+               sp = sp-1;
+               stack[sp] = stack[sp] / stack[sp+1];
+               break;
+            /// ODD
+            case 6:
+               stack[sp] = stack[sp] & 1;
+               break;
+            /// MOD
+            case 7:
+               sp = sp-1;
+               stack[sp] = stack[sp] % stack[sp+1];
+               break;
+            /// EQL
+            case 8:
+               sp = sp-1;
+               stack[sp] = stack[sp] == stack[sp+1];
+               break;
+            /// NEQ
+            case 9:
+               sp = sp-1;
+               stack[sp] = stack[sp] != stack[sp+1];
+               break;
+            /// LSS
+            case 10:
+               sp = sp-1;
+               stack[sp] = stack[sp] < stack[sp+1];
+               break;
+            /// LEQ
+            case 11:
+               sp = sp-1;
+               stack[sp] = stack[sp] <= stack[sp+1];
+               break;
+            /// GTR
+            case 12:
+               sp = sp-1;
+               stack[sp] = stack[sp] > stack[sp+1];
+               break;
+            /// GEQ
+            case 13:
+               sp = sp-1;
+               stack[sp] = stack[sp] >= stack[sp+1];
+               break;
+            default:
+               printf("error executing OPR\n");
+     }
+   break;
+  // 03 LOD L M  push stack value of offset M in frame L levels down
+  case 3:
+            //printf("executing LOD\n");
+            printf("%3d  %s%5d%5d", pc-1, opcodes[ir.op], ir.l, ir.m);
+   sp = sp + 1;
+   stack[sp] = stack[base(vm, ir.l, bp) + ir.m];
+   break;
+  // 04 STO L M  pop stack, insert val at offset M in frame L levels down
+  case 4:
+            //printf("executing STO\n");
+            printf("%3d  %s%5d%5d", pc-1, opcodes[ir.op], ir.l, ir.m);
+   stack[base(vm, ir.l, bp) + ir.m] = stack[sp];
+   sp--;
+   //if(sp>0)
+    //sp--;
+   break;
+  // 05 CAL L M Call procedure at M
+  case 5:
+            //printf("executing CAL\n");
+            printf("%3d  %s%5d%5d", pc-1, opcodes[ir.op], ir.l, ir.m);
+            //printStackAR();
+   stack[sp+1] = 0;       // return value
+   stack[sp+2] = base(vm, ir.l, bp);          //static link
+   stack[sp+3] = bp;       //dynamic link
+   stack[sp+4] = pc;       // return address
+   bp = sp+1;
+   pc = ir.m;
+   //printStack();
+   break;
+  // 06 INC 0 M  allocate m locals on stack
+  case 6:
+            //printf("executing INC\n");
+            printf("%3d  %s %9d", pc-1, opcodes[ir.op], ir.m);
+          /*if(sp == 0){        // What is this for?
+            sp = ir.m + 1;      // We add M to 0, and then add 1
+     sp--;               // only to subtract 1 after? This makes no sense.
+            }
+            else */
+            sp = sp + ir.m;     // Just add sp to M and be done with it. Both if branches ended up doing exactly the same thing.
+            break;
+  // 07 JMP 0 M  jump to M
+  case 7:
+            //printf("executing JMP\n");
+            //printf("%10d", ir.m);
+            printf("%3d  %s %9d", pc-1, opcodes[ir.op], ir.m);
+   pc = ir.m;      //NOOOO! Not sp+ This is not opr 6, it's 7... This is Jump. You jump to M, not to M+sp No wonder we seg faulted!
+   break;
+  // 08 JPC   pop stack, jump to m
+  case 8:
+            //printf("executing JPC\n");
+            printf("%3d  %s %9d", pc-1, opcodes[ir.op], ir.m);
+   if(stack[sp] == 0)
+    pc = ir.m;
+   sp = sp-1;
+   break;
+  // 09 SIO
+  case 9:
+            //printf("executing SIO\n");
+            //printf("executing SIO\n");
+            //printf("%3d  %s%5d%5d\n", pc-1, opcodesSIO[ir.m], ir.l, ir.m);
+   switch(ir.m){
+    // pop stack
+    case 0:
+     printf("%3d  %s %9d", pc-1, opcodesSIO[ir.m], ir.m);
+     printf("popped stack val: %d\n", stack[sp]);
+     sp = sp-1;
+     break;
+    // push user input
+    case 1:
+     printf("%3d  %s %9d", pc-1, opcodesSIO[ir.m], ir.m);
+     sp = sp+1;
+     readNumber(vm->in, &(stack[sp]));
+     break;
+    // halt
+    case 2:
+     printf("%3d  %s \t  ", pc-1, opcodesSIO[ir.m]);
+                    //printf("halting...\n");
+                    /*printf("%3d  %s\n", pc-1, opcodesSIO[ir.m]);
+   */
+     break;
+    default:
+     printf("SIO error\n");
+    }
+  // default
+  default:
+   //printf("exec error\n");
+      ;
+ }
+  //printState(ir);
+ vm->pc = pc;
+ vm->bp = bp;
+ vm->sp = sp;
+}
+
+int halt(vmInstance *vm, instr ir){
+   if(ir.op == 9 && ir.m == 2)
+      return 1;
+  if (vm->pc < 0 || vm->pc >= codeSize)
+    return 1;
+   return 0;
+}
+
+int base(vmInstance *vm, int level, int b){
+   while(level>0){
+      b = vm->stack[b+1];
+      level--;
+   }
+   return b;
+}
+
+/**
+bp>1
+  write_Stack(output_file, stack[bp+2], bp-1};
+bp<sp
+  print |
+  printstack
+else
+bp<sp
+printStack
+**/
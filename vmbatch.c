@@ -0,0 +1,484 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "pm0.h"
+#include "source.h"
+#include "fastvm.h"
+#include "vmstack.h"
+#include "sio.h"
+
+#define MAX_STACK_HEIGHT 2000
+
+/**
+ *  Runs compiled programs against lots of inputs in one process, on a pool of threads.
+ *
+ *      vmbatch [-j <threads>] [--no-fuse] [--no-display] [--stack <size>] [--binary[=in|=out]] [--output] [--quiet]
+ *              <code.pm0 | @list>... [--in <input | @list>...] [--lines <input>...]
+ *
+ *  Every program runs once with every input. An --in file is one input, what SIO
+ *  reads for the whole run. Every line of a --lines file is an input of its own,
+ *  so a file of a thousand input vectors is a thousand runs. With no input at all
+ *  each program runs once reading nothing. @list is a file with one path per line.
+ *
+ *  Each program is loaded and decoded once (see fastProgram in fastvm.h) and the
+ *  threads all run that same copy. What a thread owns is its stack (see vmstack.h,
+ *  2000 ints unless --stack says how many bytes), and for each run an SIO reader
+ *  over the input where it is in memory and a writer into memory (see sio.h).
+ *  With --binary the inputs and what's written are raw int32s, not text.
+ *
+ *  A line per run comes out in order: whether it halted or had to be stopped, the
+ *  steps it took, and the size and a hash of what it wrote, so runs that should
+ *  agree are easy to compare. --output also prints what it wrote, --quiet only
+ *  prints the runs that were stopped. Then the totals and how fast it went.
+ *
+ *  Runs are shared out between the threads the same way batch does it with files:
+ *  a contiguous share each, taken from the back, and the front of somebody else's
+ *  share once a thread's own runs out.
+ */
+
+typedef struct program
+{
+    char *path;
+    pm0Program code;
+    fastProgram fast;
+} program;
+
+typedef struct input
+{
+    char *name;
+    const char *data;   // Into the file's buffer, or into text for a line
+    size_t size;
+} input;
+
+typedef struct runResult
+{
+    int status;             // What runInstance returned
+    long long steps;
+    size_t bytes;           // Written by the program
+    int values;             // Lines of that, or int32s with --binary
+    unsigned long long hash;    // FNV-1a of it
+    char *output;           // What it wrote, only kept for --output
+} runResult;
+
+// The runs a thread has left, head up to tail - 1
+typedef struct workQueue
+{
+    pthread_mutex_t lock;
+    int head;           // Where other threads take from
+    int tail;           // The owner takes tail - 1
+} workQueue;
+
+typedef struct worker
+{
+    pthread_t thread;
+    workQueue queue;
+    int id;
+    vmStack stack;
+    vmInstance vm;      // Registers and steps start over for every run, the display is kept
+    sioReader in;
+    sioWriter out;
+    int done;           // Runs this thread did
+    int stolen;         // How many of them came from another thread's share
+} worker;
+
+program *programs;
+input *inputs;
+sourceBuf *files;       // Everything --in and --lines read, freed at the end
+int programCount, inputCount, fileCount;
+int programCap, inputCap, fileCap;
+runResult *results;
+int runCount;
+worker *workers;
+int threadCount;
+int flags = FAST_ALL, keepOutput = 0, quiet = 0, height = MAX_STACK_HEIGHT, binaryIn = SIO_TEXT, binaryOut = SIO_TEXT;
+
+// Makes room for one more in *list, which holds *count of size each
+void *grow(void *list, int *cap, int count, size_t size)
+{
+    if (count == *cap)
+    {
+        *cap = *cap ? *cap * 2 : 64;
+        list = realloc(list, *cap * size);
+        if (list == NULL)
+        {
+            printf("Out of memory for the batch\n");
+            exit(1);
+        }
+    }
+    return list;
+}
+
+char *copyName(const char *name)
+{
+    char *s = strdup(name);
+
+    if (s == NULL)
+    {
+        printf("Out of memory for the batch\n");
+        exit(1);
+    }
+    return s;
+}
+
+int addProgram(const char *path)
+{
+    program *p;
+
+    programs = grow(programs, &programCap, programCount, sizeof(program));
+    p = &programs[programCount];
+    if (loadProgram(path, &p->code) != 0)
+        return 1;
+    if (p->code.maxFrame > height)
+    {
+        printf("%s needs a frame of %d, the stack only holds %d\n", path, p->code.maxFrame, height);
+        freeProgram(&p->code);
+        return 1;
+    }
+    if (loadFast(&p->fast, p->code.code, p->code.count, height, flags) != 0)
+        return 1;
+    p->path = copyName(path);
+    programCount++;
+    return 0;
+}
+
+// The whole of path, kept until the end. NULL if it can't be read
+sourceBuf *readFile(const char *path)
+{
+    FILE *f = fopen(path, "r");
+    sourceBuf *src;
+
+    if (f == NULL)
+    {
+        printf("Error, cannot read %s\n", path);
+        return NULL;
+    }
+    files = grow(files, &fileCap, fileCount, sizeof(sourceBuf));
+    src = &files[fileCount];
+    if (loadSource(f, src) != 0 && readStream(f, src) != 0)
+    {
+        printf("Out of memory for %s\n", path);
+        fclose(f);
+        return NULL;
+    }
+    fclose(f);
+    fileCount++;
+    return src;
+}
+
+void addInput(const char *name, const char *data, size_t size)
+{
+    inputs = grow(inputs, &inputCap, inputCount, sizeof(input));
+    inputs[inputCount].name = copyName(name);
+    inputs[inputCount].data = data;
+    inputs[inputCount].size = size;
+    inputCount++;
+}
+
+// One input per line of path, named path:line
+int addLines(const char *path)
+{
+    sourceBuf *src = readFile(path);
+    const char *at, *end, *nl;
+    char name[4200];
+    int line = 1;
+
+    if (src == NULL)
+        return 1;
+    for (at = src->data, end = at + src->size; at < end; at = nl + 1, line++)
+    {
+        nl = memchr(at, '\n', end - at);
+        if (nl == NULL)
+            nl = end;
+        snprintf(name, sizeof(name), "%s:%d", path, line);
+        addInput(name, at, nl - at);
+    }
+    return 0;
+}
+
+// Calls add with every line of list as a path
+int addList(const char *list, int (*add)(const char *))
+{
+    FILE *f = fopen(list, "r");
+    char line[4096];
+    size_t n;
+
+    if (f == NULL)
+    {
+        printf("Error, cannot read the list %s\n", list);
+        return 1;
+    }
+    while (fgets(line, sizeof(line), f) != NULL)
+    {
+        n = strcspn(line, "\r\n");
+        line[n] = '\0';
+        if (n > 0 && add(line) != 0)
+        {
+            fclose(f);
+            return 1;
+        }
+    }
+    fclose(f);
+    return 0;
+}
+
+int addFile(const char *path)
+{
+    sourceBuf *src = readFile(path);
+
+    if (src == NULL)
+        return 1;
+    addInput(path, src->data, src->size);
+    return 0;
+}
+
+// Runs p on w's stack, and if it went off the end stops it there
+int runGuarded(worker *w, const fastProgram *p, vmInstance *vm)
+{
+    int status;
+
+    if (enterStack(&w->stack) == 0)
+        status = runInstance(p, vm);
+    else
+    {
+        flushWriter(vm->out);
+        if (w->stack.pc < 0)
+            fprintf(vm->out->file, "Stack overflow, sp got to %d of %d\n", w->stack.over, height);
+        else
+            fprintf(vm->out->file, "Stack overflow at %d\n", w->stack.pc);
+        status = 1;
+    }
+    leaveStack(&w->stack);
+    return status;
+}
+
+void runOne(worker *w, int run)
+{
+    program *p = &programs[run / inputCount];
+    input *in = &inputs[run % inputCount];
+    runResult *r = &results[run];
+    vmInstance *vm = &w->vm;
+    FILE *written;
+    char *out = NULL;
+    size_t size = 0, i;
+    unsigned long long h = 14695981039346656037ULL;
+
+    written = open_memstream(&out, &size);
+    if (written == NULL)
+    {
+        printf("Out of memory for the batch\n");
+        exit(1);
+    }
+    memoryReader(&w->in, in->data, in->size, binaryIn);
+    openWriter(&w->out, written, binaryOut);
+    memset(w->stack.stack, 0, stackUsed(&w->stack));  // Every run starts from the same stack, the rest is still untouched
+    vm->pc = 0;
+    vm->bp = 1;
+    vm->sp = 0;
+    vm->steps = 0;
+    r->status = runGuarded(w, &p->fast, vm);
+    fclose(written);
+
+    r->steps = vm->steps;
+    r->bytes = size;
+    for (i = 0; i < size; i++)
+    {
+        h = (h ^ (unsigned char)out[i]) * 1099511628211ULL;
+        r->values += out[i] == '\n';
+    }
+    if (binaryOut)      // Every value is 4 bytes, not a line
+        r->values = (int)(size / 4);
+    r->hash = h;
+    if (keepOutput)
+        r->output = out;
+    else
+        free(out);
+}
+
+// Next run for w, from its own share or someone else's. -1 once there are none left anywhere
+int takeRun(worker *w)
+{
+    workQueue *q = &w->queue;
+    int run = -1, k;
+
+    pthread_mutex_lock(&q->lock);
+    if (q->head < q->tail)
+        run = --q->tail;
+    pthread_mutex_unlock(&q->lock);
+    for (k = 1; run < 0 && k < threadCount; k++)
+    {
+        q = &workers[(w->id + k) % threadCount].queue;
+        pthread_mutex_lock(&q->lock);
+        if (q->head < q->tail)
+            run = q->head++;
+        pthread_mutex_unlock(&q->lock);
+        if (run >= 0)
+            w->stolen++;
+    }
+    return run;
+}
+
+void *work(void *arg)
+{
+    worker *w = arg;
+    int run;
+
+    while ((run = takeRun(w)) >= 0)
+    {
+        runOne(w, run);
+        w->done++;
+    }
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    struct timespec start, end;
+    int i, jobs = 0, halted = 0, stolen = 0, mode = 0;  // mode: what the paths are, 0 programs, 1 --in, 2 --lines
+    long long steps = 0;
+    double seconds;
+    int (*add)(const char *);
+
+    for (i = 1; i < argc; i++)          // Programs are loaded as they come, so the fast options go before them
+    {
+        if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+            jobs = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--no-fuse") == 0)
+            flags &= ~FAST_FUSE;
+        else if (strcmp(argv[i], "--no-display") == 0)
+            flags &= ~FAST_DISPLAY;
+        else if (strncmp(argv[i], "--binary", 8) == 0)
+        {
+            if (sioMode(argv[i] + 8, &binaryIn, &binaryOut) != 0)
+            {
+                printf("Error: --binary takes in or out, like --binary=in\n");
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--stack") == 0 && i + 1 < argc)
+        {
+            height = stackHeight(argv[++i]);
+            if (height < 0)
+            {
+                printf("Error: --stack takes a size in bytes, like 64k, 512m or 2g\n");
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--output") == 0)
+            keepOutput = 1;
+        else if (strcmp(argv[i], "--quiet") == 0)
+            quiet = 1;
+        else if (strcmp(argv[i], "--in") == 0)
+            mode = 1;
+        else if (strcmp(argv[i], "--lines") == 0)
+            mode = 2;
+        else if (argv[i][0] == '-' && argv[i][1] != '\0')
+        {
+            printf("Error: Unknown option %s\n", argv[i]);
+            return 1;
+        }
+        else
+        {
+            add = mode == 0 ? addProgram : mode == 1 ? addFile : addLines;
+            if (argv[i][0] == '@' ? addList(argv[i] + 1, add) != 0 : add(argv[i]) != 0)
+                return 1;
+        }
+    }
+    if (programCount == 0)
+    {
+        printf("Usage: vmbatch [-j <threads>] [--no-fuse] [--no-display] [--stack <size>] [--binary[=in|=out]] [--output] [--quiet] <code.pm0 | @list>... "
+               "[--in <input | @list>...] [--lines <input>...]\n");
+        return 1;
+    }
+    if (inputCount == 0)
+        addInput("nothing", "", 0);
+    runCount = programCount * inputCount;
+    if (jobs <= 0)
+        jobs = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    threadCount = jobs < 1 ? 1 : jobs > runCount ? runCount : jobs;
+
+    results = calloc(runCount, sizeof(runResult));
+    workers = calloc(threadCount, sizeof(worker));
+    if (results == NULL || workers == NULL)
+    {
+        printf("Out of memory for the batch\n");
+        return 1;
+    }
+    for (i = 0; i < threadCount; i++)
+    {
+        workers[i].id = i;
+        workers[i].queue.head = (int)((long long)runCount * i / threadCount);
+        workers[i].queue.tail = (int)((long long)runCount * (i + 1) / threadCount);
+        pthread_mutex_init(&workers[i].queue.lock, NULL);
+        if (openStack(&workers[i].stack, height) != 0)
+        {
+            printf("No room for a stack of %d on every thread\n", height);
+            return 1;
+        }
+        workers[i].vm.stack = workers[i].stack.stack;
+        workers[i].vm.height = height;
+        workers[i].vm.in = &workers[i].in;
+        workers[i].vm.out = &workers[i].out;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 1; i < threadCount; i++)
+        if (pthread_create(&workers[i].thread, NULL, work, &workers[i]) != 0)
+        {
+            printf("Error, cannot start thread %d\n", i);
+            return 1;
+        }
+    work(&workers[0]);                  // This thread is one of the workers too
+    for (i = 1; i < threadCount; i++)
+        pthread_join(workers[i].thread, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    for (i = 0; i < runCount; i++)
+    {
+        runResult *r = &results[i];
+
+        steps += r->steps;
+        halted += r->status == 0;
+        if (!quiet || r->status != 0)
+        {
+            printf("%-7s %s < %s: %lld steps, %d values, %lu bytes, %016llx\n", r->status == 0 ? "halted" : "stopped",
+                   programs[i / inputCount].path, inputs[i % inputCount].name, r->steps, r->values,
+                   (unsigned long)r->bytes, r->hash);
+            if (keepOutput)
+                fwrite(r->output, 1, r->bytes, stdout);
+        }
+        free(r->output);
+    }
+    for (i = 0; i < threadCount; i++)
+        stolen += workers[i].stolen;
+
+    printf("%d runs (%d programs, %d inputs), %d halted, %d stopped, %lld steps\n",
+           runCount, programCount, inputCount, halted, runCount - halted, steps);
+    printf("%.1f ms on %d threads (%d runs moved between them): %.0f runs/s, %.1f million steps/s\n",
+           seconds * 1000, threadCount, stolen, runCount / seconds, steps / seconds / 1e6);
+
+    for (i = 0; i < programCount; i++)
+    {
+        freeFast(&programs[i].fast);
+        freeProgram(&programs[i].code);
+        free(programs[i].path);
+    }
+    for (i = 0; i < inputCount; i++)
+        free(inputs[i].name);
+    for (i = 0; i < fileCount; i++)
+        freeSource(&files[i]);
+    for (i = 0; i < threadCount; i++)
+    {
+        closeStack(&workers[i].stack);
+        freeInstance(&workers[i].vm);
+    }
+    free(programs);
+    free(inputs);
+    free(files);
+    free(results);
+    free(workers);
+    return halted == runCount ? 0 : 1;
+}
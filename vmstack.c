@@ -0,0 +1,182 @@
+#if defined(__x86_64__) && defined(__linux__)
+#define _GNU_SOURCE         // For REG_RIP
+#include <ucontext.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include "vmstack.h"
+
+__thread volatile int stackPc = -1;
+__thread int (*stackLocate)(const void *where);
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <sys/mman.h>
+
+static __thread vmStack *watched;      // The one the handler looks after on this thread
+static volatile sig_atomic_t handling;     // The handler is installed
+
+static void onFault(int sig, siginfo_t *info, void *context)
+{
+    vmStack *s = watched;
+    char *at = info->si_addr, *top, *ready;
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+
+    if (s == NULL || at < s->map || at >= s->map + s->size)
+    {
+        signal(sig, SIG_DFL);       // Not ours, it goes down the way it would have
+        return;
+    }
+    top = (char *)(s->stack + s->height + 1);
+    if (at >= s->ready && at < top)
+    {
+        // Twice what's there, or up to where it was touched if that's further
+        ready = s->ready + (s->ready - (s->map + page));
+        if (ready <= at)
+            ready = at + 1;
+        ready = (char *)(((size_t)ready + page - 1) & ~(page - 1));
+        if (ready > top)
+            ready = top;
+        if (mprotect(s->ready, ready - s->ready, PROT_READ | PROT_WRITE) == 0)
+        {
+            s->ready = ready;
+            return;                 // and the instruction runs again
+        }
+    }
+    s->over = (int)((at - (char *)s->stack) / (long)sizeof(int));
+    s->pc = -1;
+#if defined(__x86_64__) && defined(__linux__)
+    if (stackLocate != NULL)
+        s->pc = stackLocate((void *)((ucontext_t *)context)->uc_mcontext.gregs[REG_RIP]);
+#else
+    (void)context;
+#endif
+    if (s->pc < 0)
+        s->pc = stackPc;
+    watched = NULL;
+    siglongjmp(s->escape, 1);
+}
+
+int openStack(vmStack *s, int height)
+{
+    size_t page = (size_t)sysconf(_SC_PAGESIZE), bytes, chunk;
+    struct sigaction act;
+    char *bottom;
+
+    memset(s, 0, sizeof(*s));
+    bytes = ((size_t)height + 1) * sizeof(int);
+    bytes = (bytes + page - 1) & ~(page - 1);
+    s->size = page + bytes + STACK_GUARD;
+    s->map = mmap(NULL, s->size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (s->map == MAP_FAILED)
+    {
+        s->map = NULL;
+        return 1;
+    }
+    bottom = s->map + page;
+    s->stack = (int *)(bottom + bytes) - (height + 1);
+    s->height = height;
+    chunk = bytes < STACK_CHUNK ? bytes : STACK_CHUNK;
+    if (mprotect(bottom, chunk, PROT_READ | PROT_WRITE) != 0)
+    {
+        closeStack(s);
+        return 1;
+    }
+    s->ready = bottom + chunk;
+
+    if (!handling)
+    {
+        memset(&act, 0, sizeof(act));
+        act.sa_sigaction = onFault;
+        act.sa_flags = SA_SIGINFO;
+        sigemptyset(&act.sa_mask);
+        sigaction(SIGSEGV, &act, NULL);
+        sigaction(SIGBUS, &act, NULL);      // What some systems raise for PROT_NONE
+        handling = 1;
+    }
+    return 0;
+}
+
+void closeStack(vmStack *s)
+{
+    leaveStack(s);
+    if (s->map != NULL)
+        munmap(s->map, s->size);
+    memset(s, 0, sizeof(*s));
+}
+
+void watchStack(vmStack *s)
+{
+    s->over = 0;
+    s->pc = -1;
+    stackPc = -1;
+    stackLocate = NULL;
+    watched = s;
+}
+
+void leaveStack(vmStack *s)
+{
+    if (watched == s)
+        watched = NULL;
+}
+
+size_t stackUsed(const vmStack *s)
+{
+    return s->map != NULL ? (size_t)(s->ready - (char *)s->stack) : 0;
+}
+
+#else
+
+int openStack(vmStack *s, int height)
+{
+    memset(s, 0, sizeof(*s));
+    s->stack = calloc((size_t)height + 1, sizeof(int));
+    s->height = height;
+    return s->stack == NULL;
+}
+
+void closeStack(vmStack *s)
+{
+    free(s->stack);
+    memset(s, 0, sizeof(*s));
+}
+
+void watchStack(vmStack *s)
+{
+    s->over = 0;
+    s->pc = -1;
+    stackPc = -1;
+    stackLocate = NULL;
+}
+
+void leaveStack(vmStack *s)
+{
+    (void)s;
+}
+
+size_t stackUsed(const vmStack *s)
+{
+    return ((size_t)s->height + 1) * sizeof(int);
+}
+
+#endif
+
+int stackHeight(const char *size)
+{
+    char *end;
+    double bytes = strtod(size, &end);
+
+    if (end == size || bytes <= 0)
+        return -1;
+    if (*end == 'k' || *end == 'K')
+        bytes *= 1024, end++;
+    else if (*end == 'm' || *end == 'M')
+        bytes *= 1024 * 1024, end++;
+    else if (*end == 'g' || *end == 'G')
+        bytes *= 1024.0 * 1024 * 1024, end++;
+    if (*end != '\0' || bytes / sizeof(int) < 5 || bytes / sizeof(int) > 0x7fffff00)
+        return -1;
+    return (int)(bytes / sizeof(int)) - 1;
+}
@@ -0,0 +1,71 @@
+#ifndef VMSTACK_H_INCLUDED
+#define VMSTACK_H_INCLUDED
+
+#include <stddef.h>
+#include <setjmp.h>
+
+#define STACK_CHUNK (64 * 1024)         // Bytes of stack there to begin with, it doubles from there as it's touched
+#define STACK_GUARD (1024 * 1024)       // Bytes of nothing above the top, a run of pushes past it lands in there
+#ifdef _WIN32
+#define STACK_REACH 0                   // Nothing past the top is caught there
+#else
+#define STACK_REACH (STACK_GUARD / (int)sizeof(int))     // Ints past stack[height] a write is still caught in
+#endif
+
+/**
+ *  A VM stack that only costs what the program uses of it, and that a program
+ *  can't run off the end of without being stopped.
+ *
+ *  The whole height is reserved up front with mmap but nothing is there to use
+ *  except the first STACK_CHUNK. The rest, a page below stack[0] and STACK_GUARD
+ *  above stack[height] are PROT_NONE. stack[height] is the last int before the
+ *  guard, so the first push past the top faults right away. The engines never
+ *  compare sp with anything on a push: the first touch past what's there lands in
+ *  the SIGSEGV handler, which gives the stack more pages and lets the instruction
+ *  run again, or if it's past the top or below the bottom, jumps back out to
+ *  where enterStack was called with over saying which int it was, and pc which
+ *  instruction: what stackLocate makes of where the fault was, if the engine set
+ *  it (native code, where that's all it takes), or else whatever the engine last
+ *  put in stackPc before anything that can push. A CAL writes at most 4 past sp,
+ *  so it needs no check either, and neither does an INC of up to STACK_REACH as
+ *  long as the engine touches the new top, since sp never gets further than that
+ *  above what was last written.
+ *
+ *  Only the stack that was entered last on a thread is watched, so each thread
+ *  running a VM needs its own. On Windows it's just malloc'd and nothing is watched,
+ *  and escape is a plain jmp_buf (there's no sigsetjmp there).
+ */
+typedef struct vmStack
+{
+    int *stack;             // stack[0] to stack[height]
+    int height;
+    int over;               // Index of the int that went past the end, once enterStack returned 1
+    int pc;                 // The instruction that did it, -1 if the engine never said
+    char *map;              // The reservation, guards included
+    size_t size;
+    char *ready;            // Everything below this is there to use
+#ifdef _WIN32
+    jmp_buf escape;
+#else
+    sigjmp_buf escape;
+#endif
+} vmStack;
+
+int openStack(vmStack *s, int height);     // Returns 1 if there's no room for it
+void closeStack(vmStack *s);
+void leaveStack(vmStack *s);            // Stops watching s
+size_t stackUsed(const vmStack *s);     // Bytes from stack[0] up that are there to use, a chunk or two past where it was touched
+int stackHeight(const char *size);      // Height for a stack of size bytes (k, m or g after it), -1 if it isn't one
+
+extern __thread volatile int stackPc;   // PM/0 instruction the engine on this thread is running
+extern __thread int (*stackLocate)(const void *where);  // Or what turns the machine's pc at the fault into one, -1 if it can't
+
+// 0 when entered, then 1 again from there if the program went past either end of s
+#ifdef _WIN32
+#define enterStack(s) (watchStack(s), setjmp((s)->escape))
+#else
+#define enterStack(s) (watchStack(s), sigsetjmp((s)->escape, 1))
+#endif
+void watchStack(vmStack *s);
+
+#endif // VMSTACK_H_INCLUDED